@@ -0,0 +1,55 @@
+#pragma once
+
+#ifdef CHAD_HAVE_LIBAV
+
+#include <cstdint>
+#include <functional>
+#include <string>
+
+namespace chad {
+
+/**
+ * @class AvTranscoder
+ * @brief Probes and transcodes video files in-process with libav*
+ *
+ * A transcode demuxes, decodes, scales, encodes and muxes on the calling
+ * thread, without a process spawn or a shell. Each thread keeps the decoder,
+ * scaler and encoder of its last transcode and reuses them for the next one
+ * with the same parameters, as short chunks of one stream all have. Audio is
+ * copied as it is when the output container can hold it.
+ */
+class AvTranscoder {
+public:
+    struct MediaInfo {
+        int width = 0;
+        int height = 0;
+        double duration = 0.0;   // seconds
+        std::string codec;
+    };
+
+    struct Options {
+        int width = 0;             // 0: the input's size
+        int height = 0;
+        int64_t bitRate = 0;       // bits per second; 0: the encoder's default
+        std::string codec = "libx264";
+    };
+
+    struct Progress {
+        int64_t frame = 0;         // frames encoded so far
+        double fps = 0.0;          // encoding speed
+        double outTime = 0.0;      // seconds of output written
+    };
+
+    // Called every half second and once at the end; returning false cancels the transcode
+    using ProgressCallback = std::function<bool(const Progress&)>;
+
+    // Both throw std::runtime_error, transcode() also when it is cancelled
+    static MediaInfo probe(const std::string& path);
+
+    static void transcode(const std::string& inputPath, const std::string& outputPath, const Options& options,
+                          const ProgressCallback& onProgress);
+};
+
+} // namespace chad
+
+#endif // CHAD_HAVE_LIBAV
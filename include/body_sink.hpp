@@ -0,0 +1,89 @@
+#pragma once
+
+#include <string>
+#include <cstddef>
+#include <memory>
+#include <sys/types.h>
+#include "uring_file.hpp"
+
+namespace chad {
+
+/**
+ * @class BodySink
+ * @brief Destination for a request body that is consumed while it arrives
+ *
+ * Routes that register a sink never see the body in HttpRequest::body; the
+ * connection feeds it to the sink in bounded pieces instead.
+ */
+class BodySink {
+public:
+    virtual ~BodySink() = default;
+
+    /**
+     * @brief Consume the next piece of the body
+     * @return false to abort the request
+     */
+    virtual bool write(const char* data, size_t size) = 0;
+
+    /**
+     * @brief Called once the whole body has been received
+     * @return false if the body could not be committed
+     */
+    virtual bool finish() { return true; }
+
+    /**
+     * @brief Move up to maxBytes from a readable socket without copying them
+     *        through user space
+     * @return Bytes moved, 0 on end of stream, -1 with errno set otherwise;
+     *         EAGAIN means the socket is not readable yet and ENOTSUP that
+     *         the sink only supports write()
+     */
+    virtual ssize_t spliceFrom(int socketFd, size_t maxBytes);
+};
+
+/**
+ * @class FileBodySink
+ * @brief Writes the body straight to a file descriptor
+ *
+ * The file is removed on destruction unless keep() was called, so aborted
+ * uploads do not leave partial files behind. Built with CHAD_HAVE_IO_URING,
+ * writes are batched through io_uring and the file is synced before finish()
+ * reports success; splicing is then not used.
+ */
+class FileBodySink : public BodySink {
+public:
+    explicit FileBodySink(const std::string& path);
+
+    ~FileBodySink() override;
+
+    FileBodySink(const FileBodySink&) = delete;
+    FileBodySink& operator=(const FileBodySink&) = delete;
+
+    bool isOpen() const { return fd_ >= 0; }
+
+    const std::string& path() const { return path_; }
+
+    size_t bytesWritten() const { return bytesWritten_; }
+
+    // Keep the file after the sink is destroyed
+    void keep() { keep_ = true; }
+
+    bool write(const char* data, size_t size) override;
+
+    bool finish() override;
+
+    ssize_t spliceFrom(int socketFd, size_t maxBytes) override;
+
+private:
+    std::string path_;
+    int fd_ = -1;
+    int pipe_[2] = {-1, -1};
+    size_t bytesWritten_ = 0;
+    bool spliceSupported_ = true;
+    bool keep_ = false;
+#ifdef CHAD_HAVE_IO_URING
+    std::unique_ptr<UringFile> uring_;
+#endif
+};
+
+} // namespace chad
@@ -32,6 +32,9 @@ private:
     Config(const Config&) = delete;
     Config& operator=(const Config&) = delete;
     
+    // Resolve a flat or dotted ("section.key") key; caller holds configMutex_
+    const nlohmann::json* lookup(const std::string& key) const;
+    
     nlohmann::json config_;
     mutable std::mutex configMutex_;
 };
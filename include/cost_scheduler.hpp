@@ -0,0 +1,116 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include "inline_task.hpp"
+#include "thread_pool.hpp"
+
+namespace chad {
+
+/**
+ * @class CostScheduler
+ * @brief Feeds expensive jobs to a pool shortest-expected-first, with aging
+ *
+ * Every job comes with an estimate of the seconds it occupies a worker. Only
+ * as many jobs are handed to the pool as it can run, plus one waiting there;
+ * the rest wait here, so the pool's own fair queues never see a backlog and
+ * all jobs reach it as a single flow.
+ *
+ * Each tenant therefore has its own queue here, and tenants take turns by
+ * deficit round robin: a turn credits a tenant with quantum × weight seconds
+ * of estimate, and its jobs go while the credit covers them. Within a
+ * tenant, the next to go is the job with the lowest estimate minus
+ * agingRate × seconds waited, so short jobs overtake long ones, but a long
+ * job's standing improves until nothing can overtake it any more.
+ *
+ * Estimates are scaled by how long finished jobs actually took compared to
+ * theirs, so a cost model that is off by a constant factor corrects itself,
+ * and backlogSeconds() is an estimate of real time.
+ */
+class CostScheduler {
+public:
+    // quantum: seconds of estimated cost a tenant is credited per turn, about one typical job
+    explicit CostScheduler(ThreadPool& pool, double agingRate = 1.0, double quantum = 5.0);
+
+    CostScheduler(const CostScheduler&) = delete;
+    CostScheduler& operator=(const CostScheduler&) = delete;
+
+    // Queues job for the pool; an exception it throws is logged. Dropped once closed.
+    void submit(double cost, const TaskClass& taskClass, InlineTask job);
+
+    // Seconds of estimated cost forgiven per second a job waits; applies to jobs submitted later
+    void setAgingRate(double agingRate);
+
+    // Gives a tenant weight times the share of a tenant with the default weight of 1
+    void setTenantWeight(const std::string& tenant, uint32_t weight);
+
+    // Estimated seconds until the pool finishes the jobs queued and running here
+    double backlogSeconds() const;
+
+    // Drops the queued jobs and any submitted later; call before the pool stops
+    void close();
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    struct Job {
+        double cost;
+        TaskClass taskClass;
+        InlineTask work;
+    };
+
+    struct Tenant {
+        std::string name;
+        // Keyed by cost + agingRate × (time queued - epoch_), which orders jobs
+        // like cost - agingRate × time waited would, without ever changing
+        std::multimap<double, Job> jobs;
+        double deficit = 0;
+        bool inTurn = false;
+    };
+
+    struct Running {
+        double cost;
+        Clock::time_point started;   // when the pool started it; zero while queued there
+    };
+
+    // Hands queued jobs to the pool while it has room for them
+    void dispatch();
+
+    // The tenant whose job goes next, at the front of ring_; ring_ must not be empty
+    Tenant& nextTenant();
+
+    double weightOf(const std::string& tenant) const;
+
+    void start(uint64_t ticket);
+
+    void finish(uint64_t ticket);
+
+    // Jobs the pool runs at once; it is handed one more than this
+    size_t parallelism() const;
+
+private:
+    ThreadPool& pool_;
+    const Clock::time_point epoch_;
+    const double quantum_;
+
+    mutable std::mutex mutex_;
+    double agingRate_;
+
+    std::unordered_map<std::string, Tenant> tenants_;   // nodes are stable, ring_ points into them
+    std::deque<Tenant*> ring_;
+    std::unordered_map<std::string, uint32_t> weights_;
+    double queuedCost_;
+
+    std::unordered_map<uint64_t, Running> running_;
+    uint64_t nextTicket_;
+
+    double correction_;   // actual / estimated time of finished jobs, smoothed
+    bool closed_;
+};
+
+} // namespace chad
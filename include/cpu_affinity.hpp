@@ -0,0 +1,66 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <pthread.h>
+
+namespace chad {
+
+// CPU numbers as the kernel counts them, in ascending order
+using CpuSet = std::vector<int>;
+
+/**
+ * @class CpuTopology
+ * @brief CPUs, physical cores and NUMA nodes available to this process
+ *
+ * Read once from sysfs and limited to the CPUs the process may run on, so a
+ * taskset or cgroup restriction is honoured.
+ */
+class CpuTopology {
+public:
+    struct Node {
+        int id;
+        CpuSet cpus;
+    };
+
+    static const CpuTopology& getInstance();
+
+    const CpuSet& cpus() const;
+
+    // The first hardware thread of every physical core
+    const CpuSet& physicalCores() const;
+
+    // Nodes with at least one usable CPU; empty if the host exposes no NUMA information
+    const std::vector<Node>& nodes() const;
+
+private:
+    CpuTopology();
+
+    CpuSet cpus_;
+    CpuSet physicalCores_;
+    std::vector<Node> nodes_;
+};
+
+// Parses a kernel CPU list such as "0-3,8,10-11"; throws std::invalid_argument
+CpuSet parseCpuList(const std::string& list);
+
+std::string formatCpuList(const CpuSet& cpus);
+
+/**
+ * @brief One CPU set per thread from a placement setting
+ *
+ * "" leaves threads unpinned (no sets), "cores" pins each thread to its own
+ * physical core, "nodes" to all CPUs of a NUMA node, and a CPU list pins
+ * each thread to one CPU of the list. Thread i uses set i modulo the count.
+ * Throws std::invalid_argument for a malformed setting.
+ */
+std::vector<CpuSet> cpuSetsFor(const std::string& placement);
+
+// Best effort: logs and returns false if the kernel refused
+bool pinThread(pthread_t thread, const CpuSet& cpus);
+
+// Makes node the preferred source of the calling thread's new pages; processes
+// it starts inherit the policy. Best effort, like pinThread().
+bool preferMemoryNode(int node);
+
+} // namespace chad
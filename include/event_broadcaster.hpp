@@ -0,0 +1,81 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <boost/asio.hpp>
+#include "http_server.hpp"
+
+namespace chad {
+
+/**
+ * @class EventBroadcaster
+ * @brief Fans published events out to every subscribed HTTP stream
+ *
+ * Publishers push onto a lock-free multi-producer queue and at most post one
+ * task to the IO threads, which then copy each event reference into every
+ * subscriber's stream. Publishers therefore never wait on subscribers or on
+ * each other; a subscriber that cannot keep up is dropped by its stream.
+ */
+class EventBroadcaster : public std::enable_shared_from_this<EventBroadcaster> {
+public:
+    EventBroadcaster(boost::asio::any_io_executor executor, std::chrono::seconds heartbeat);
+
+    ~EventBroadcaster();
+
+    EventBroadcaster(const EventBroadcaster&) = delete;
+    EventBroadcaster& operator=(const EventBroadcaster&) = delete;
+
+    // Starts the heartbeat that keeps idle streams (and proxies) from timing out
+    void start();
+
+    // Queue a preformatted event for all subscribers; lock-free, callable from any thread
+    void publish(std::string event);
+
+    // The stream receives every event published after this call
+    void subscribe(std::shared_ptr<HttpStream> stream);
+
+    size_t subscriberCount() const;
+
+    // Ends every subscriber's stream, and those of later subscribers at once,
+    // so their connections can finish; events published afterwards go nowhere
+    void close();
+
+private:
+    struct Node {
+        std::atomic<Node*> next{nullptr};
+        std::shared_ptr<const std::string> event;
+    };
+
+    void push(Node* node);
+
+    // Single consumer; sets stalled if a producer is halfway through a push
+    Node* pop(bool& stalled);
+
+    void schedulePump();
+
+    void pump();
+
+    void armHeartbeat();
+
+private:
+    boost::asio::any_io_executor executor_;
+    const std::chrono::seconds heartbeat_;
+
+    // Intrusive MPSC queue (Vyukov): producers exchange head_, the pump owns tail_
+    std::atomic<Node*> head_;
+    Node* tail_;
+    Node stub_;
+    std::atomic<bool> pumpScheduled_;
+
+    // Taken on IO threads, and by close()
+    std::mutex pumpMutex_;
+    std::vector<std::shared_ptr<HttpStream>> subscribers_;
+    bool closed_;
+    std::atomic<size_t> subscriberCount_;
+};
+
+} // namespace chad
@@ -0,0 +1,128 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+namespace chad {
+
+/**
+ * @class FairQueue
+ * @brief Deficit round robin over per-flow FIFO queues
+ *
+ * Each flow (tenant) with queued items takes a turn in a ring. A turn credits
+ * the flow with quantum × weight, and the flow is served while its credit
+ * covers the cost of its next item. A flow that queues thousands of items
+ * therefore gets the same share as one that queues a single item, in proportion
+ * to its weight. The quantum should be about the cost of a typical item.
+ */
+template <typename T>
+class FairQueue {
+public:
+    explicit FairQueue(uint64_t quantum = 1) : quantum_(quantum ? quantum : 1), size_(0) {}
+
+    FairQueue(const FairQueue&) = delete;
+    FairQueue& operator=(const FairQueue&) = delete;
+
+    void push(const std::string& flowKey, T item, uint64_t cost) {
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        Flow& flow = flows_[flowKey];
+        flow.items.push_back({item, cost});
+        if (!flow.active) {
+            flow.active = true;
+            flow.key = flowKey;
+            ring_.push_back(&flow);
+        }
+        size_.fetch_add(1, std::memory_order_release);
+    }
+
+    // false if empty
+    bool pop(T& item) {
+        if (empty()) {
+            return false;
+        }
+
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        while (!ring_.empty()) {
+            Flow* flow = ring_.front();
+            if (!flow->inTurn) {
+                flow->deficit += quantum_ * weightOf(flow->key);
+                flow->inTurn = true;
+            }
+
+            const Entry& next = flow->items.front();
+            if (flow->deficit >= next.cost) {
+                item = next.item;
+                flow->deficit -= next.cost;
+                flow->items.pop_front();
+                size_.fetch_sub(1, std::memory_order_relaxed);
+
+                if (flow->items.empty()) {
+                    // Idle flows keep no credit and no table entry
+                    ring_.pop_front();
+                    std::string key = std::move(flow->key);
+                    flows_.erase(key);
+                }
+                return true;
+            }
+
+            flow->inTurn = false;
+            ring_.pop_front();
+            ring_.push_back(flow);
+        }
+        return false;
+    }
+
+    // Relative share of a flow; flows without one weigh 1
+    void setWeight(const std::string& flowKey, uint32_t weight) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (weight <= 1) {
+            weights_.erase(flowKey);
+        } else {
+            weights_[flowKey] = weight;
+        }
+    }
+
+    bool empty() const {
+        return size_.load(std::memory_order_acquire) == 0;
+    }
+
+    size_t size() const {
+        return size_.load(std::memory_order_relaxed);
+    }
+
+private:
+    struct Entry {
+        T item;
+        uint64_t cost;
+    };
+
+    struct Flow {
+        std::string key;
+        std::deque<Entry> items;
+        uint64_t deficit = 0;
+        bool active = false;
+        bool inTurn = false;
+    };
+
+    uint64_t weightOf(const std::string& flowKey) const {
+        auto it = weights_.find(flowKey);
+        return it == weights_.end() ? 1 : it->second;
+    }
+
+private:
+    const uint64_t quantum_;
+    std::atomic<size_t> size_;
+
+    std::mutex mutex_;
+    std::unordered_map<std::string, Flow> flows_;   // nodes are stable, ring_ points into them
+    std::deque<Flow*> ring_;
+    std::unordered_map<std::string, uint32_t> weights_;
+};
+
+} // namespace chad
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <chrono>
+#include <string>
+#include <vector>
+#include <sys/types.h>
+
+namespace chad {
+
+/**
+ * @class HotRestart
+ * @brief Hands the listening sockets of a running server to a new process
+ *
+ * The running process execs a successor with one end of a Unix socket pair
+ * and sends it the listening descriptors with SCM_RIGHTS. The successor
+ * adopts them instead of binding, starts serving and reports back; only then
+ * does the old process stop accepting and drain. The listeners are never
+ * closed in between, so connections queued in the kernel are not lost and
+ * the port is never without a listener.
+ */
+class HotRestart {
+public:
+    HotRestart();
+
+    ~HotRestart();
+
+    HotRestart(const HotRestart&) = delete;
+    HotRestart& operator=(const HotRestart&) = delete;
+
+    /**
+     * @brief In a successor: receive the listeners of the process that started it
+     * @return The descriptors, or none if this process was not started by a hot restart
+     */
+    std::vector<int> inheritListeners();
+
+    // In a successor: tell the old process that the listeners are served now
+    void notifyReady();
+
+    /**
+     * @brief In the running process: exec a successor and hand it the listeners
+     * @param executable Binary to run; normally the path this process was started from
+     * @param args Arguments for the successor, args[0] included
+     * @param listeners Listening descriptors, in shard order
+     * @param readyTimeout How long the successor may take to start serving
+     * @return true once the successor is serving; on failure it is killed and
+     *         this process keeps serving
+     */
+    bool spawnSuccessor(const std::string& executable, const std::vector<std::string>& args,
+                        const std::vector<int>& listeners, std::chrono::milliseconds readyTimeout);
+
+private:
+    bool sendListeners(int channel, const std::vector<int>& listeners);
+
+    bool awaitReady(int channel, std::chrono::milliseconds timeout);
+
+private:
+    int channel_;   // to the old process, while this one is a successor starting up
+};
+
+} // namespace chad
@@ -0,0 +1,198 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <memory>
+#include <memory_resource>
+#include <string>
+#include <vector>
+#include <boost/asio.hpp>
+#include "http_server.hpp"
+#include "http_parser.hpp"
+
+namespace chad {
+
+/**
+ * @class HttpConnection
+ * @brief Per-socket state machine driven by asynchronous reads and writes
+ *
+ * Every operation on a connection is posted through its socket's strand, so
+ * a connection never occupies a thread while it waits for the network.
+ * Persistent connections loop back to READING_HEADERS after each response;
+ * pipelined requests already sitting in the buffer are served in order.
+ */
+class HttpConnection : public std::enable_shared_from_this<HttpConnection> {
+public:
+    enum class State {
+        READING_HEADERS,
+        READING_BODY,
+        WRITING,
+        CLOSED
+    };
+
+    // What the single pending deadline guards
+    enum class Deadline {
+        NONE,
+        IDLE,       // between keep-alive requests
+        HEADERS,    // absolute, from the first byte of a request
+        BODY,       // re-armed on every bit of body progress
+        WRITE       // re-armed on every bit of response progress
+    };
+
+    HttpConnection(boost::asio::ip::tcp::socket socket, HttpServer& server, TimerWheel& timerWheel);
+
+    ~HttpConnection();
+
+    void start();
+
+private:
+    friend class HttpResponder;
+    friend class HttpStream;
+
+    void readHeaders();
+
+    void readMore();
+
+    void onRead(const boost::system::error_code& error, size_t bytesTransferred);
+
+    // Returns false while more bytes are needed for the request head
+    bool parseHeaders();
+
+    void armDeadline(Deadline kind, std::chrono::milliseconds delay);
+
+    void cancelDeadline();
+
+    void onDeadline(uint64_t generation);
+
+    bool shouldKeepAlive() const;
+
+    // Applies size, memory and Expect checks; returns false if the request was answered
+    bool admitBody();
+
+    // Hands buffered body bytes to the request or sink and reads the rest
+    void beginBody();
+
+    // Chunked bodies are decoded in place, then fed to the sink or the request
+    void beginChunkedBody();
+
+    void readChunkedBody();
+
+    void onChunkedBody(const boost::system::error_code& error, size_t bytesTransferred);
+
+    enum class ChunkedResult { MORE, DONE, FAILED };
+
+    ChunkedResult consumeChunked(char* data, size_t size, size_t& consumed);
+
+    void readBody();
+
+    void onBody(const boost::system::error_code& error, size_t bytesTransferred);
+
+    // Streaming bodies: splice into the sink when it can, else copy through bodyChunk_
+    void streamBody();
+
+    void onBodyReadable(const boost::system::error_code& error);
+
+    void readBodyChunk();
+
+    void onBodyChunk(const boost::system::error_code& error, size_t bytesTransferred);
+
+    void finishBody();
+
+    void handleRequest();
+
+    void sendError(int statusCode, const std::string& statusText);
+
+    // 503 for requests that would exceed the body memory budget
+    void sendBusy();
+
+    // Returns false if the client is over its rate and has been answered
+    bool checkRateLimit();
+
+    void writeResponse(HttpResponse& response);
+
+    void onHeadWritten(const boost::system::error_code& error);
+
+    // Writer bodies: pull the next part from HttpResponse::writer and send it
+    void writeNextPart();
+
+    // Sends file-backed bodies with sendfile(2), waiting for writability on EAGAIN
+    void writeFileBody();
+
+    // Streamed bodies: write whatever the HttpStream has queued, then wait for more
+    void drainStream();
+
+    void onStreamWritten(const boost::system::error_code& error);
+
+    void finishStream();
+
+    // Notices a client hanging up while the stream is idle
+    void watchStream();
+
+    void onStreamReadable(const boost::system::error_code& error);
+
+    void onWrite(const boost::system::error_code& error);
+
+    void releaseBody();
+
+    // Drops everything the previous request allocated from the arena at once
+    void resetArena();
+
+    void close();
+
+private:
+    // Enough for a typical request and response; larger ones spill to the heap
+    static constexpr size_t ARENA_INLINE_SIZE = 4096;
+
+    boost::asio::ip::tcp::socket socket_;
+    HttpServer& server_;
+    TimerWheel& timerWheel_;        // the wheel of the shard that accepted the socket
+    TimerWheel::Entry deadline_;
+    Deadline deadlineKind_ = Deadline::NONE;
+    uint64_t deadlineGeneration_ = 0;
+
+    // Receive buffer; [readPos_, readEnd_) holds bytes not yet consumed
+    std::vector<char> readBuffer_;
+    size_t readPos_ = 0;
+    size_t readEnd_ = 0;
+    HttpParser parser_;
+
+    // Per-request allocations (header tables, response headers) come from here;
+    // declared before the request and response that point into it
+    std::array<std::byte, ARENA_INLINE_SIZE> arenaBuffer_;
+    std::pmr::monotonic_buffer_resource arena_;
+
+    State state_ = State::READING_HEADERS;
+    HttpRequest request_;
+    Router::Match routeMatch_;
+    size_t contentLength_ = 0;
+    std::unique_ptr<BodySink> bodySink_;
+    std::vector<char> bodyChunk_;
+    size_t bodyRemaining_ = 0;
+    size_t bodyReserved_ = 0;       // bytes claimed from the server's body memory budget
+    bool chunkedBody_ = false;
+    ChunkedDecoder chunkedDecoder_;
+    size_t bodyReceived_ = 0;
+    std::vector<char> carryOver_;   // bytes read past a chunked body, for the next request
+    size_t requestsServed_ = 0;
+    uint64_t clientKey_ = 0;
+    bool keepAlive_ = false;
+    HttpResponse response_;
+    std::string responseHead_;
+
+    std::shared_ptr<FileBody> file_;
+    size_t fileSegment_ = 0;
+    bool filePrefixSent_ = false;
+    bool fileTrailerSent_ = false;
+    off_t fileOffset_ = 0;
+    uint64_t fileRemaining_ = 0;
+
+    std::shared_ptr<HttpStream> stream_;
+    bool streamChunked_ = false;
+    std::vector<std::shared_ptr<const std::string>> streamChunks_;
+    std::string streamFraming_;                 // chunk-size lines for streamChunks_
+    std::vector<size_t> streamFrameEnds_;
+    std::vector<boost::asio::const_buffer> streamBuffers_;
+    std::string partBuffer_;
+};
+
+} // namespace chad
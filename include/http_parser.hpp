@@ -0,0 +1,125 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include "http_server.hpp"
+
+namespace chad {
+
+/**
+ * @class HttpParser
+ * @brief Incremental HTTP/1.x request-head parser
+ *
+ * The parser works directly over the connection's receive buffer. It only
+ * records offsets while the head is incomplete, so the caller may grow or
+ * move the buffer between calls; once the blank line is seen the request's
+ * method, path and headers are exposed as string views into that buffer.
+ */
+class HttpParser {
+public:
+    enum class Status {
+        INCOMPLETE,
+        COMPLETE,
+        BAD_REQUEST,
+        HEADERS_TOO_LARGE
+    };
+
+    static constexpr size_t MAX_HEADERS = 64;
+
+    explicit HttpParser(size_t maxHeaderBytes = 64 * 1024);
+
+    /**
+     * @brief Resume parsing a request head
+     * @param data Start of the request (may differ between calls if the buffer moved)
+     * @param size Number of bytes currently available at data
+     * @param request Filled with views into data when COMPLETE is returned
+     * @return Parse status
+     */
+    Status parse(const char* data, size_t size, HttpRequest& request);
+
+    /**
+     * @brief Bytes taken by the request line and headers, valid after COMPLETE
+     */
+    size_t headerSize() const { return headerSize_; }
+
+    size_t maxHeaderBytes() const { return maxHeaderBytes_; }
+
+    void reset();
+
+private:
+    struct Span {
+        uint32_t offset = 0;
+        uint32_t length = 0;
+    };
+
+    bool parseRequestLine(const char* data, size_t begin, size_t end);
+
+    bool parseHeaderLine(const char* data, size_t begin, size_t end);
+
+    static std::string_view view(const char* data, const Span& span) {
+        return std::string_view(data + span.offset, span.length);
+    }
+
+private:
+    size_t maxHeaderBytes_;
+    size_t scanned_ = 0;
+    size_t headerSize_ = 0;
+    bool haveRequestLine_ = false;
+
+    Span method_;
+    Span target_;
+    Span version_;
+
+    std::array<std::pair<Span, Span>, MAX_HEADERS> headers_;
+    size_t headerCount_ = 0;
+};
+
+/**
+ * @class ChunkedDecoder
+ * @brief Incremental decoder for "Transfer-Encoding: chunked" bodies
+ *
+ * Decodes in place: the payload is compacted to the front of the buffer
+ * it was read into, so no second buffer is needed. Chunk extensions and
+ * trailer fields are skipped. Decoding stops at the end of the body, which
+ * leaves any pipelined request after it untouched.
+ */
+class ChunkedDecoder {
+public:
+    enum class Status {
+        INCOMPLETE,
+        COMPLETE,
+        BAD_REQUEST
+    };
+
+    /**
+     * @brief Decode the next piece of the body
+     * @param data Bytes received; overwritten with the decoded payload
+     * @param size Number of bytes at data
+     * @param consumed Receives how many input bytes belonged to the body
+     * @param payload Receives how many payload bytes now start at data
+     */
+    Status decode(char* data, size_t size, size_t& consumed, size_t& payload);
+
+    void reset();
+
+private:
+    enum class State {
+        SIZE,           // hex digits of the chunk size
+        EXTENSION,      // ";name=value" up to the end of the size line
+        SIZE_LF,
+        DATA,
+        DATA_CR,
+        DATA_LF,
+        TRAILER,        // start of a trailer line, or the final CRLF
+        TRAILER_LINE,
+        FINAL_LF,
+        DONE
+    };
+
+    State state_ = State::SIZE;
+    uint64_t remaining_ = 0;
+    bool sawDigit_ = false;
+};
+
+} // namespace chad
@@ -1,47 +1,309 @@
 #pragma once
 
 #include <string>
+#include <string_view>
+#include <optional>
 #include <memory>
+#include <memory_resource>
 #include <functional>
 #include <unordered_map>
+#include <vector>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <strings.h>
 #include <boost/asio.hpp>
 #include <nlohmann/json.hpp>
 #include "video_processor.hpp"
+#include "body_sink.hpp"
+#include "router.hpp"
+#include "timer_wheel.hpp"
+#include "rate_limiter.hpp"
 
 namespace chad {
 
+struct HttpHeader {
+    std::string_view name;
+    std::string_view value;
+};
+
+// Views point into the connection's receive buffer and are valid until the
+// response has been produced; copy anything that must outlive the handler.
+// The header and parameter tables live in the connection's per-request arena.
 struct HttpRequest {
-    std::string method;
-    std::string path;
-    std::string version;
-    std::unordered_map<std::string, std::string> headers;
+    using allocator_type = std::pmr::polymorphic_allocator<std::byte>;
+
+    HttpRequest() = default;
+
+    explicit HttpRequest(const allocator_type& alloc) : headers(alloc), pathParams(alloc) {}
+
+    std::string_view method;
+    std::string_view target;
+    std::string_view path;
+    std::string_view query;
+    std::string_view version;
+    std::pmr::vector<HttpHeader> headers;
+    std::pmr::vector<PathParam> pathParams;
     std::string body;
 
-    std::unordered_map<std::string, std::string> queryParams;
+    // Set instead of body when the route streams its body to a sink
+    BodySink* bodySink = nullptr;
+
+    // The client's address, as keyed by RateLimiter::clientKey
+    uint64_t clientKey = 0;
+
+    // Header names are case-insensitive (RFC 7230 3.2)
+    std::optional<std::string_view> findHeader(std::string_view name) const {
+        for (const auto& header : headers) {
+            if (header.name.size() == name.size() &&
+                strncasecmp(header.name.data(), name.data(), name.size()) == 0) {
+                return header.value;
+            }
+        }
+        return std::nullopt;
+    }
+
+    // Value captured by a "{name}" or "*name" route segment
+    std::optional<std::string_view> pathParam(std::string_view name) const {
+        for (const auto& param : pathParams) {
+            if (param.name == name) {
+                return param.value;
+            }
+        }
+        return std::nullopt;
+    }
+
+    // Decodes the named query parameter on demand
+    std::optional<std::string> queryParam(std::string_view name) const;
+
+    void clear() {
+        method = target = path = query = version = std::string_view();
+        headers.clear();
+        pathParams.clear();
+        body.clear();
+        bodySink = nullptr;
+    }
 };
 
+// File-backed response body, sent with sendfile(2) so the payload never
+// passes through user space. Each segment writes its prefix (e.g. a
+// multipart/byteranges part header) followed by a range of the file.
+struct FileBody {
+    struct Segment {
+        std::string prefix;
+        uint64_t offset = 0;
+        uint64_t length = 0;
+    };
+
+    int fd = -1;
+    std::vector<Segment> segments;
+    std::string trailer;
+
+    FileBody() = default;
+    ~FileBody();
+
+    FileBody(const FileBody&) = delete;
+    FileBody& operator=(const FileBody&) = delete;
+
+    uint64_t size() const;
+};
+
+class HttpStream;
+
+// Responses built by the connection allocate their status text and headers
+// from its per-request arena; those built elsewhere use the default resource.
 struct HttpResponse {
+    using allocator_type = std::pmr::polymorphic_allocator<std::byte>;
+
+    HttpResponse() = default;
+
+    explicit HttpResponse(const allocator_type& alloc) : statusText("OK", alloc), headers(alloc) {}
+
     int statusCode = 200;
-    std::string statusText = "OK";
-    std::unordered_map<std::string, std::string> headers;
+    std::pmr::string statusText = "OK";
+    std::pmr::unordered_map<std::pmr::string, std::pmr::string> headers;
+
+    // Bodies are handed over without copying, so they keep their own allocations
     std::string body;
 
+    // Alternatives to body: an immutable buffer shared with other responses,
+    // or a file sent with sendfile(2). At most one of the three is used.
+    std::shared_ptr<const std::string> sharedBody;
+    std::shared_ptr<FileBody> file;
+
+    // Set by HttpResponder::stream(): the body follows the head as it is written
+    std::shared_ptr<HttpStream> stream;
+
+    // Produces the body on demand: appends the next part to out and returns
+    // false once that part was the last. Called on the IO thread after the
+    // head has been sent, as the client takes the data.
+    using BodyWriter = std::function<bool(std::string& out)>;
+    BodyWriter writer;
+
     void setJson(const nlohmann::json& jsonObj) {
-        body = jsonObj.dump();
-        headers["Content-Type"] = "application/json";
+        setBody(jsonObj.dump(), "application/json");
     }
 
     void setText(const std::string& text) {
-        body = text;
-        headers["Content-Type"] = "text/plain";
+        setBody(std::string(text), "text/plain");
+    }
+
+    // Takes ownership of content without copying it
+    void setBody(std::string&& content, const std::string& contentType);
+
+    // Sends content by reference; the buffer must not be modified afterwards
+    void setSharedBody(std::shared_ptr<const std::string> content, const std::string& contentType);
+
+    // Sends the body with chunked encoding as writer produces it
+    void setWriter(BodyWriter bodyWriter, const std::string& contentType);
+
+    // Streamed bodies have no Content-Length
+    bool isStreamed() const {
+        return stream || writer;
     }
+
+    std::string_view bodyView() const {
+        return sharedBody ? std::string_view(*sharedBody) : std::string_view(body);
+    }
+
+    uint64_t contentLength() const {
+        return file ? file->size() : bodyView().size();
+    }
+
+    /**
+     * @brief Serve a file, honouring a Range request header
+     * @param path File to send
+     * @param contentType Media type of the file
+     * @param range Value of the request's Range header, if any
+     * @return false if the file cannot be opened
+     */
+    bool setFile(const std::string& path, const std::string& contentType,
+                 std::optional<std::string_view> range = std::nullopt);
+};
+
+class HttpConnection;
+
+/**
+ * @class HttpResponder
+ * @brief Completes a request whose handler answers later
+ *
+ * Copies share one response slot: the first send() wins and later calls are
+ * ignored, so a result and a timeout may race to answer. If every copy is
+ * destroyed without sending, the client gets a 500. The request passed to
+ * the handler stays valid until then.
+ */
+class HttpResponder {
+public:
+    explicit HttpResponder(std::shared_ptr<HttpConnection> connection);
+
+    // Safe to call from any thread; returns false if a response was already sent
+    bool send(HttpResponse&& response) const;
+
+    /**
+     * @brief Send the head now and the body as it is produced
+     * @param head Status and headers; any body in it is ignored
+     * @param maxBacklog Bytes that may be queued before a slow client is dropped
+     * @return The stream to write the body to, or nullptr if a response was already sent
+     */
+    std::shared_ptr<HttpStream> stream(HttpResponse&& head, size_t maxBacklog = 1024 * 1024) const;
+
+    // Executor of the connection, for timers that should run alongside it
+    boost::asio::any_io_executor executor() const;
+
+private:
+    struct State;
+    std::shared_ptr<State> state_;
+};
+
+/**
+ * @class HttpStream
+ * @brief Response body written piece by piece after the head has been sent
+ *
+ * Sent with chunked transfer encoding, or unframed and followed by a close
+ * for HTTP/1.0 clients. write() only queues, so producers on other threads
+ * are never held up by the network; a client that falls more than the
+ * backlog behind is disconnected instead. The stream does not keep its
+ * connection alive: once the client goes away, writes return false.
+ */
+class HttpStream {
+public:
+    HttpStream(std::weak_ptr<HttpConnection> connection, size_t maxBacklog);
+
+    // Queue data for the client; safe from any thread. False once the stream has ended
+    bool write(std::shared_ptr<const std::string> data);
+
+    bool write(std::string data);
+
+    // End the body once everything queued has been sent
+    void close();
+
+    bool isOpen() const;
+
+private:
+    friend class HttpConnection;
+
+    enum class Take {
+        DATA,       // queued data was moved out
+        IDLE,       // nothing queued; the next write() wakes the connection
+        FINISHED,   // closed and fully drained
+        FAILED      // overflowed or the connection is gone
+    };
+
+    // Called on the connection's strand once the head has been sent
+    void attach();
+
+    Take take(std::vector<std::shared_ptr<const std::string>>& out);
+
+    // Keeps the connection alive while it is not waiting on the socket
+    void pin(std::shared_ptr<HttpConnection> connection);
+
+    void detach();
+
+    // Wakes the connection to drain; called without the lock held
+    void notify();
+
+private:
+    mutable std::mutex mutex_;
+    std::weak_ptr<HttpConnection> connection_;
+    std::shared_ptr<HttpConnection> pinned_;
+    std::vector<std::shared_ptr<const std::string>> pending_;
+    size_t pendingBytes_ = 0;
+    const size_t maxBacklog_;
+    bool attached_ = false;
+    bool draining_ = false;
+    bool closed_ = false;
+    bool failed_ = false;
 };
 
 class HttpServer {
 public:
     using RequestHandler = std::function<void(const HttpRequest&, HttpResponse&)>;
 
-    explicit HttpServer(unsigned short port);
+    // The handler keeps the responder and answers through it when ready,
+    // without holding an IO thread in the meantime
+    using AsyncRequestHandler = std::function<void(const HttpRequest&, HttpResponder)>;
+
+    // Called once the request head is parsed; returning nullptr with a non-2xx
+    // status on the response rejects the request before any body is read
+    using BodySinkFactory = std::function<std::unique_ptr<BodySink>(const HttpRequest&, HttpResponse&)>;
+
+    struct Limits {
+        // Connections beyond this are answered with 503 and closed
+        size_t maxConnections = 1000;
+
+        // Deadline for a complete request head, and for each stall while a
+        // body is read or a response is written
+        std::chrono::milliseconds requestTimeout{30000};
+
+        // Larger Content-Length values are refused with 413 before any body is read
+        size_t maxRequestSize = 100 * 1024 * 1024;
+
+        // Budget shared by all bodies buffered in memory (not those streamed to a sink)
+        size_t maxBodyMemory = 256 * 1024 * 1024;
+    };
+
+    explicit HttpServer(unsigned short port, size_t numThreads = 0);
 
     ~HttpServer();
 
@@ -53,31 +315,128 @@ public:
 
     void addRoute(const std::string& method, const std::string& path, RequestHandler handler);
 
+    void addAsyncRoute(const std::string& method, const std::string& path, AsyncRequestHandler handler);
+
+    void addBodySink(const std::string& method, const std::string& path, BodySinkFactory factory);
+
+    void setKeepAlive(std::chrono::milliseconds idleTimeout, size_t maxRequestsPerConnection);
+
+    void setLimits(const Limits& limits);
+
+    /**
+     * @brief Shard accepting across cores; must be called before start()
+     *
+     * With shards > 0 the server opens that many SO_REUSEPORT listeners on the
+     * port, each with its own io_context, timer wheel and a single thread
+     * pinned to a core. The kernel spreads new connections over the listeners
+     * and a connection stays on its shard for its lifetime. 0 keeps the one
+     * acceptor shared by the whole IO thread pool.
+     */
+    void setAcceptShards(size_t shards);
+
+    // IO thread i runs on cpuSets[i % cpuSets.size()]; must be called before
+    // start(). Empty pins shard threads one per CPU and leaves a shared pool free.
+    void setCpuAffinity(std::vector<CpuSet> cpuSets);
+
+    // Serve these already listening descriptors (one per shard, in order)
+    // instead of binding the port; must be called before start()
+    void adoptListeners(std::vector<int> fds);
+
+    // Listening descriptors of the running server, in shard order
+    std::vector<int> listenerFds() const;
+
+    /**
+     * @brief Stop accepting and let existing connections finish
+     *
+     * The listening sockets are closed here only; a process they were handed
+     * to keeps accepting on them. Connections close after their current
+     * response instead of being kept alive.
+     */
+    void stopAccepting();
+
+    // Requests beyond the rate are answered with 429 before routing
+    void setRateLimit(const RateLimiter::Settings& settings);
+
     bool isRunning() const;
 
+    size_t getConnectionCount() const;
+
+    // Executor of the IO threads (the first shard's when sharded), for work
+    // that should run alongside connections
+    boost::asio::any_io_executor getExecutor() const;
+
 private:
-    void acceptConnection();
+    friend class HttpConnection;
+
+    // An acceptor with the io_context, timer wheel and threads that serve its connections
+    struct Shard {
+        explicit Shard(size_t threads);
+
+        // Declared before the io_context: connections destroyed with it cancel their entries
+        TimerWheel timerWheel;
+        std::unique_ptr<boost::asio::io_context> ioContext;
+        std::unique_ptr<boost::asio::ip::tcp::acceptor> acceptor;
+        boost::asio::steady_timer acceptRetry;   // backs off after a failed accept
+        const size_t threads;
+    };
+
+    // Binds a new listener, or takes over adoptedFd if it is not -1
+    void openAcceptor(Shard& shard, int adoptedFd);
+
+    void acceptConnection(Shard& shard);
+
+    // Answers 503 without creating a connection; never blocks
+    static void rejectConnection(boost::asio::ip::tcp::socket& socket);
 
-    void handleClient(boost::asio::ip::tcp::socket socket);
+    // Claims bytes from the in-memory body budget; false if it is exhausted
+    bool reserveBodyMemory(size_t bytes);
 
-    HttpRequest parseRequest(const std::string& requestStr);
+    void releaseBodyMemory(size_t bytes);
 
-    void sendResponse(boost::asio::ip::tcp::socket& socket, const HttpResponse& response);
+    struct Route {
+        RequestHandler handler;
+        AsyncRequestHandler asyncHandler;
+        BodySinkFactory bodySink;
+    };
 
-    RequestHandler findHandler(const std::string& method, const std::string& path);
+    // Route slot for (method, pattern), created on first use
+    Route& routeFor(const std::string& method, const std::string& pattern);
+
+    // Resolves the route and fills request.pathParams; route is NO_ROUTE if none
+    Router::Match matchRoute(HttpRequest& request) const;
+
+    const Route* findRoute(const Router::Match& match) const;
+
+    // Returns false if an async handler took the request; it answers through the responder
+    bool dispatch(const Router::Match& match, const HttpRequest& request, HttpResponse& response,
+                  const std::shared_ptr<HttpConnection>& connection);
+
+    // Appends the status line and headers to out, reusing its capacity
+    static void serializeHead(const HttpResponse& response, std::string& out);
 
-    std::unordered_map<std::string, std::string> parseQueryParams(const std::string& queryString);
 
 private:
     unsigned short port_;
-    std::unique_ptr<boost::asio::io_service> ioService_;
-    std::unique_ptr<boost::asio::ip::tcp::acceptor> acceptor_;
+    size_t numThreads_;
+    size_t acceptShards_;
+    std::vector<CpuSet> cpuSets_;
+    std::vector<std::unique_ptr<Shard>> shards_;
+    std::vector<int> adoptedListeners_;
     std::shared_ptr<VideoProcessor> videoProcessor_;
 
-    std::unordered_map<std::string, std::unordered_map<std::string, RequestHandler>> routes_;
+    Router router_;
+    std::vector<Route> routeTable_;
+
+    std::chrono::milliseconds keepAliveTimeout_;
+    size_t maxRequestsPerConnection_;
+    Limits limits_;
+    std::atomic<size_t> bodyMemoryInUse_;
+    std::unique_ptr<RateLimiter> rateLimiter_;
 
-    bool running_ = false;
-    std::unique_ptr<std::thread> serverThread_;
+    std::atomic<bool> running_;
+    std::atomic<bool> draining_;
+    std::atomic<size_t> connectionCount_;
+    std::vector<std::thread> ioThreads_;
 };
 
 } // namespace chad
\ No newline at end of file
@@ -0,0 +1,129 @@
+#pragma once
+
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+namespace chad {
+
+/**
+ * @class InlineTask
+ * @brief Move-only void() callable that keeps small callables inside itself
+ *
+ * Unlike std::function it does not need a copyable target, so a lambda can
+ * own a std::promise or other move-only state, and targets up to INLINE_SIZE
+ * bytes are stored in place instead of on the heap. Larger targets fall back
+ * to a heap allocation.
+ */
+class InlineTask {
+public:
+    // Room for a promise plus a handful of captured strings
+    static constexpr size_t INLINE_SIZE = 128;
+
+    InlineTask() noexcept : ops_(nullptr) {}
+
+    template <typename F, typename = std::enable_if_t<!std::is_same<std::decay_t<F>, InlineTask>::value>>
+    InlineTask(F&& function) : ops_(&OpsFor<std::decay_t<F>>::ops) {
+        using Target = std::decay_t<F>;
+        if constexpr (fitsInline<Target>()) {
+            new (&storage_) Target(std::forward<F>(function));
+        } else {
+            *reinterpret_cast<void**>(&storage_) = new Target(std::forward<F>(function));
+        }
+    }
+
+    InlineTask(InlineTask&& other) noexcept : ops_(other.ops_) {
+        if (ops_) {
+            ops_->move(&other.storage_, &storage_);
+            other.ops_ = nullptr;
+        }
+    }
+
+    InlineTask& operator=(InlineTask&& other) noexcept {
+        if (this != &other) {
+            reset();
+            ops_ = other.ops_;
+            if (ops_) {
+                ops_->move(&other.storage_, &storage_);
+                other.ops_ = nullptr;
+            }
+        }
+        return *this;
+    }
+
+    InlineTask(const InlineTask&) = delete;
+    InlineTask& operator=(const InlineTask&) = delete;
+
+    ~InlineTask() {
+        reset();
+    }
+
+    void operator()() {
+        ops_->invoke(&storage_);
+    }
+
+    explicit operator bool() const noexcept {
+        return ops_ != nullptr;
+    }
+
+private:
+    struct Ops {
+        void (*invoke)(void* storage);
+        void (*move)(void* from, void* to) noexcept;
+        void (*destroy)(void* storage) noexcept;
+    };
+
+    template <typename Target>
+    static constexpr bool fitsInline() {
+        return sizeof(Target) <= INLINE_SIZE && alignof(Target) <= alignof(std::max_align_t) &&
+               std::is_nothrow_move_constructible<Target>::value;
+    }
+
+    template <typename Target>
+    struct OpsFor {
+        static Target* get(void* storage) {
+            if constexpr (fitsInline<Target>()) {
+                return std::launder(static_cast<Target*>(storage));
+            }
+            return static_cast<Target*>(*static_cast<void**>(storage));
+        }
+
+        static void invoke(void* storage) {
+            (*get(storage))();
+        }
+
+        static void move(void* from, void* to) noexcept {
+            if constexpr (fitsInline<Target>()) {
+                Target* source = get(from);
+                new (to) Target(std::move(*source));
+                source->~Target();
+            } else {
+                *static_cast<void**>(to) = *static_cast<void**>(from);
+            }
+        }
+
+        static void destroy(void* storage) noexcept {
+            if constexpr (fitsInline<Target>()) {
+                get(storage)->~Target();
+            } else {
+                delete get(storage);
+            }
+        }
+
+        static constexpr Ops ops{&invoke, &move, &destroy};
+    };
+
+    void reset() noexcept {
+        if (ops_) {
+            ops_->destroy(&storage_);
+            ops_ = nullptr;
+        }
+    }
+
+private:
+    const Ops* ops_;
+    std::aligned_storage_t<INLINE_SIZE, alignof(std::max_align_t)> storage_;
+};
+
+} // namespace chad
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <boost/asio/ip/address.hpp>
+
+namespace chad {
+
+/**
+ * @class RateLimiter
+ * @brief Per-client token buckets in a fixed, lock-free hash table
+ *
+ * Each client owns one slot holding its bucket packed into a single atomic
+ * word, so a check is a hash, a short probe and one compare-and-swap; no
+ * lock is shared between clients. Buckets refill lazily when they are next
+ * touched. Slots of clients that have been quiet long enough for their
+ * bucket to refill are reused in place, which is all the eviction needed.
+ * Clients that keep getting limited are banned for a while.
+ */
+class RateLimiter {
+public:
+    struct Settings {
+        size_t requestsPerMinute = 60;   // refill rate, and the burst a fresh client gets
+        size_t banThreshold = 100;       // limited requests before a ban
+        std::chrono::minutes banTime{30};
+    };
+
+    enum class Decision {
+        ALLOW,
+        LIMITED,
+        BANNED
+    };
+
+    explicit RateLimiter(const Settings& settings, size_t capacity = 1 << 16);
+
+    ~RateLimiter();
+
+    RateLimiter(const RateLimiter&) = delete;
+    RateLimiter& operator=(const RateLimiter&) = delete;
+
+    // IPv4 clients are keyed by address, IPv6 clients by their /64 prefix
+    static uint64_t clientKey(const boost::asio::ip::address& address);
+
+    /**
+     * @brief Take one token for a client
+     * @param retryAfter Set to when the client may try again unless ALLOW
+     */
+    Decision acquire(uint64_t client, std::chrono::seconds& retryAfter);
+
+private:
+    struct alignas(32) Slot {
+        std::atomic<uint64_t> key{0};
+        std::atomic<uint64_t> bucket{0};        // last refill time (ms) << TOKEN_BITS | tokens
+        std::atomic<int64_t> bannedUntil{0};    // ms, 0 if not banned
+        std::atomic<uint32_t> violations{0};
+    };
+
+    static constexpr unsigned TOKEN_BITS = 24;
+
+    int64_t nowMs() const;
+
+    // Slot for the client, claiming a free or stale one; nullptr if the table is full
+    Slot* findSlot(uint64_t client, int64_t now);
+
+    bool isStale(const Slot& slot, int64_t now) const;
+
+private:
+    const Settings settings_;
+    const uint64_t capacityUnits_;
+    const std::chrono::steady_clock::time_point epoch_;
+
+    const size_t mask_;
+    std::unique_ptr<Slot[]> slots_;
+};
+
+} // namespace chad
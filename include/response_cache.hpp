@@ -0,0 +1,55 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include "http_server.hpp"
+
+namespace chad {
+
+/**
+ * @class ResponseCache
+ * @brief Serialized body of a read-only endpoint, reused until its data changes
+ *
+ * The caller passes a version that changes whenever the underlying data does.
+ * While it matches the cached entry, serving is an atomic pointer load and a
+ * reference-counted copy of the body; otherwise the body is rebuilt once and
+ * published for later requests. Each entry carries a strong ETag derived from
+ * its bytes, so clients that already have it get 304 Not Modified.
+ */
+class ResponseCache {
+public:
+    using Builder = std::function<std::string()>;
+
+    explicit ResponseCache(std::string contentType);
+
+    ResponseCache(const ResponseCache&) = delete;
+    ResponseCache& operator=(const ResponseCache&) = delete;
+
+    /**
+     * @brief Answer a request from the cache, rebuilding the body if it is stale
+     * @param version Current version of the data behind the body
+     * @param build Produces the body; only called on a miss
+     */
+    void serve(const HttpRequest& request, HttpResponse& response, uint64_t version, const Builder& build);
+
+private:
+    struct Entry {
+        uint64_t version;
+        std::shared_ptr<const std::string> body;
+        std::string etag;
+    };
+
+    std::shared_ptr<const Entry> current(uint64_t version, const Builder& build);
+
+    static bool matches(std::string_view ifNoneMatch, std::string_view etag);
+
+private:
+    const std::string contentType_;
+
+    // Accessed only through std::atomic_load/atomic_store
+    std::shared_ptr<const Entry> entry_;
+};
+
+} // namespace chad
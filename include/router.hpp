@@ -0,0 +1,88 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <memory_resource>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace chad {
+
+struct PathParam {
+    std::string_view name;
+    std::string_view value;
+};
+
+/**
+ * @class Router
+ * @brief Radix tree mapping (method, path) to a route index
+ *
+ * Patterns are literal paths with optional "{name}" segments, which match a
+ * single path segment, and a trailing "*name" wildcard, which matches the
+ * rest of the path. Static edges take precedence over parameters and
+ * parameters over wildcards. Lookup walks the path once and does not
+ * allocate; captured values are views into the path being matched and names
+ * are views into the router.
+ */
+class Router {
+public:
+    static constexpr size_t NO_ROUTE = SIZE_MAX;
+
+    struct Match {
+        size_t route = NO_ROUTE;
+        bool pathMatched = false;   // path is routed, possibly only for other methods
+    };
+
+    Router();
+    ~Router();
+
+    Router(const Router&) = delete;
+    Router& operator=(const Router&) = delete;
+
+    /**
+     * @brief Register a pattern for a method
+     * @param route Index to store if the pattern is new for this method
+     * @return The index stored for (method, pattern), which is the existing
+     *         one if the pattern was already registered
+     * @throws std::invalid_argument on a malformed pattern, an unsupported
+     *         method or a parameter name that conflicts with an existing one
+     */
+    size_t insert(std::string_view method, std::string_view pattern, size_t route);
+
+    /**
+     * @brief Find the route for a request
+     * @param params Receives captured parameters (cleared first)
+     */
+    Match find(std::string_view method, std::string_view path, std::pmr::vector<PathParam>& params) const;
+
+private:
+    static constexpr size_t METHOD_COUNT = 7;
+
+    struct Node {
+        std::string prefix;
+        std::string indices;                          // first byte of each static child
+        std::vector<std::unique_ptr<Node>> children;
+        std::unique_ptr<Node> paramChild;
+        std::unique_ptr<Node> wildcardChild;
+        std::string paramName;                        // set on param/wildcard nodes
+        std::array<size_t, METHOD_COUNT> routes;
+
+        Node();
+        bool hasRoute() const;
+    };
+
+    static int methodIndex(std::string_view method);
+
+    static Node* insertStatic(Node* node, std::string_view text);
+
+    bool match(const Node* node, std::string_view rest, int method,
+               std::pmr::vector<PathParam>& params, Match& result) const;
+
+private:
+    std::unique_ptr<Node> root_;
+};
+
+} // namespace chad
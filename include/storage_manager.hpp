@@ -9,7 +9,7 @@
 namespace chad {
 
 struct StorageMetadata {
-    std::string id;\
+    std::string id;
     std::string filename;
     std::string contentType;
     size_t size;
@@ -18,7 +18,7 @@ struct StorageMetadata {
 };
 
 class StorageManager {
-public:\
+public:
     static StorageManager& getInstance();
 
     bool initialize(const std::string& basePath);
@@ -47,7 +47,7 @@ private:
     ~StorageManager() = default;
 
     StorageManager(const StorageManager&) = delete;
-    StorageManager& operator=(const StorageManager&) = delete;\
+    StorageManager& operator=(const StorageManager&) = delete;
 
     std::string generateUniqueId() const;
 
@@ -0,0 +1,479 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include <variant>
+#include <vector>
+#include "inline_task.hpp"
+#include "thread_pool.hpp"
+
+namespace chad {
+
+template <typename T>
+class Future;
+
+template <typename T>
+class Promise;
+
+namespace detail {
+
+template <typename T>
+struct FutureState {
+    using Value = std::conditional_t<std::is_void<T>::value, std::monostate, T>;
+
+    explicit FutureState(ThreadPool* pool) : pool(pool) {}
+
+    // Runs callback on the completing thread, or at once if already complete
+    void onComplete(InlineTask callback) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (!done) {
+                callbacks.push_back(std::move(callback));
+                return;
+            }
+        }
+        callback();
+    }
+
+    void complete() {
+        std::vector<InlineTask> pending;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            done = true;
+            pending.swap(callbacks);
+        }
+        finished.notify_all();
+
+        for (auto& callback : pending) {
+            callback();
+        }
+    }
+
+    ThreadPool* const pool;   // where continuations run; inline if nullptr
+
+    std::mutex mutex;
+    std::condition_variable finished;
+    bool done = false;
+    std::vector<InlineTask> callbacks;
+
+    // Written once, before done is set
+    std::optional<Value> value;
+    std::exception_ptr error;
+};
+
+template <typename F, typename T>
+struct ContinuationResult {
+    using type = typename std::invoke_result<F, T>::type;
+};
+
+template <typename F>
+struct ContinuationResult<F, void> {
+    using type = typename std::invoke_result<F>::type;
+};
+
+// A continuation that returns Future<U> yields Future<U>, not Future<Future<U>>
+template <typename R>
+struct Unwrapped {
+    using type = R;
+};
+
+template <typename U>
+struct Unwrapped<Future<U>> {
+    using type = U;
+};
+
+template <typename R>
+struct IsFuture : std::false_type {};
+
+template <typename U>
+struct IsFuture<Future<U>> : std::true_type {};
+
+// Settles promise with whatever state ends up holding, once it does
+template <typename T>
+void forward(const std::shared_ptr<FutureState<T>>& state, Promise<T> promise) {
+    state->onComplete([state, promise = std::move(promise)]() mutable {
+        if (state->error) {
+            promise.setException(state->error);
+        } else if constexpr (std::is_void<T>::value) {
+            promise.setValue();
+        } else {
+            promise.setValue(std::move(*state->value));
+        }
+    });
+}
+
+// Runs function and settles promise with its result or exception; a future
+// result settles promise later, with that future's outcome
+template <typename R, typename F, typename... Args>
+void fulfil(Promise<R>& promise, F& function, Args&&... args) {
+    using Result = typename std::invoke_result<F&, Args...>::type;
+
+    try {
+        if constexpr (IsFuture<Result>::value) {
+            Result inner = function(std::forward<Args>(args)...);
+            forward(inner.state_, std::move(promise));
+        } else if constexpr (std::is_void<R>::value) {
+            function(std::forward<Args>(args)...);
+            promise.setValue();
+        } else {
+            promise.setValue(function(std::forward<Args>(args)...));
+        }
+    } catch (...) {
+        promise.setException(std::current_exception());
+    }
+}
+
+// Posts work to pool, or runs it here without one. A stopped pool drops the
+// work, which breaks the promise inside it instead of losing the chain.
+template <typename F>
+void dispatch(ThreadPool* pool, const std::optional<TaskClass>& taskClass, F&& work) {
+    if (!pool) {
+        work();
+        return;
+    }
+    try {
+        if (taskClass) {
+            pool->post(*taskClass, std::forward<F>(work));
+        } else {
+            pool->post(std::forward<F>(work));
+        }
+    } catch (const std::runtime_error&) {
+    }
+}
+
+} // namespace detail
+
+/**
+ * @class Promise
+ * @brief Write end of a Future; a promise destroyed unsettled fails its future
+ */
+template <typename T>
+class Promise {
+public:
+    explicit Promise(ThreadPool* pool = nullptr) : state_(std::make_shared<detail::FutureState<T>>(pool)) {}
+
+    Promise(Promise&&) noexcept = default;
+    Promise& operator=(Promise&& other) noexcept {
+        abandon();
+        state_ = std::move(other.state_);
+        return *this;
+    }
+
+    Promise(const Promise&) = delete;
+    Promise& operator=(const Promise&) = delete;
+
+    ~Promise() {
+        abandon();
+    }
+
+    Future<T> getFuture() const {
+        return Future<T>(state_);
+    }
+
+    template <typename U = T, typename = std::enable_if_t<std::is_void<U>::value>>
+    void setValue() {
+        settle([](auto& state) { state.value.emplace(); });
+    }
+
+    template <typename U, typename = std::enable_if_t<!std::is_void<T>::value && std::is_convertible<U, T>::value>>
+    void setValue(U&& value) {
+        settle([&value](auto& state) { state.value.emplace(std::forward<U>(value)); });
+    }
+
+    void setException(std::exception_ptr error) {
+        settle([&error](auto& state) { state.error = std::move(error); });
+    }
+
+private:
+    template <typename Write>
+    void settle(Write&& write) {
+        auto state = std::move(state_);
+        if (!state) {
+            throw std::logic_error("Promise already settled");
+        }
+        write(*state);
+        state->complete();
+    }
+
+    void abandon() {
+        if (state_) {
+            setException(std::make_exception_ptr(std::runtime_error("Promise abandoned before it was settled")));
+        }
+    }
+
+    std::shared_ptr<detail::FutureState<T>> state_;
+};
+
+/**
+ * @class Future
+ * @brief Result of pool work that continues with more work instead of blocking
+ *
+ * then() schedules a function on the pool the moment the value is there, and
+ * returns the future of its result, unwrapped if the function itself returns
+ * a future. An exception skips the continuations and reaches the first
+ * recover() down the chain. Each future has one consumer:
+ * get(), then() or recover(), called once. Observing it with whenAll(),
+ * whenAny() or isReady() does not consume it.
+ */
+template <typename T>
+class Future {
+public:
+    Future() = default;
+
+    bool valid() const {
+        return state_ != nullptr;
+    }
+
+    bool isReady() const {
+        std::lock_guard<std::mutex> lock(state_->mutex);
+        return state_->done;
+    }
+
+    // Blocks; meant for the edges of the program, not for pool workers
+    void wait() const {
+        std::unique_lock<std::mutex> lock(state_->mutex);
+        state_->finished.wait(lock, [this] { return state_->done; });
+    }
+
+    T get() {
+        wait();
+        auto state = std::move(state_);
+        if (state->error) {
+            std::rethrow_exception(state->error);
+        }
+        if constexpr (std::is_void<T>::value) {
+            return;
+        } else {
+            return std::move(*state->value);
+        }
+    }
+
+    // Runs function(value) at NORMAL priority once this future has a value
+    template <typename F>
+    auto then(F&& function) {
+        return chain(std::nullopt, std::forward<F>(function));
+    }
+
+    template <typename F>
+    auto then(const TaskClass& taskClass, F&& function) {
+        return chain(taskClass, std::forward<F>(function));
+    }
+
+    // Passes a value through; on an exception, function(error) provides the value instead
+    template <typename F>
+    Future<T> recover(F&& function) {
+        auto state = std::move(state_);
+        Promise<T> next(state->pool);
+        Future<T> result = next.getFuture();
+
+        auto callback = [state, next = std::move(next), function = std::forward<F>(function)]() mutable {
+            if (!state->error) {
+                if constexpr (std::is_void<T>::value) {
+                    next.setValue();
+                } else {
+                    next.setValue(std::move(*state->value));
+                }
+                return;
+            }
+            detail::dispatch(state->pool, std::nullopt,
+                             [error = state->error, next = std::move(next), function = std::move(function)]() mutable {
+                detail::fulfil(next, function, error);
+            });
+        };
+        state->onComplete(std::move(callback));
+        return result;
+    }
+
+private:
+    template <typename>
+    friend class Promise;
+
+    template <typename U>
+    friend Future<void> whenAll(const std::vector<Future<U>>& futures);
+
+    template <typename U>
+    friend Future<size_t> whenAny(const std::vector<Future<U>>& futures);
+
+    template <typename R, typename F, typename... Args>
+    friend void detail::fulfil(Promise<R>& promise, F& function, Args&&... args);
+
+    explicit Future(std::shared_ptr<detail::FutureState<T>> state) : state_(std::move(state)) {}
+
+    template <typename F>
+    auto chain(std::optional<TaskClass> taskClass, F&& function) {
+        using R = typename detail::Unwrapped<typename detail::ContinuationResult<std::decay_t<F>, T>::type>::type;
+
+        auto state = std::move(state_);
+        Promise<R> next(state->pool);
+        Future<R> result = next.getFuture();
+
+        auto callback = [state, taskClass = std::move(taskClass), next = std::move(next),
+                         function = std::forward<F>(function)]() mutable {
+            if (state->error) {
+                next.setException(state->error);
+                return;
+            }
+            detail::dispatch(state->pool, taskClass,
+                             [state, next = std::move(next), function = std::move(function)]() mutable {
+                if constexpr (std::is_void<T>::value) {
+                    detail::fulfil(next, function);
+                } else {
+                    detail::fulfil(next, function, std::move(*state->value));
+                }
+            });
+        };
+        state->onComplete(std::move(callback));
+        return result;
+    }
+
+    std::shared_ptr<detail::FutureState<T>> state_;
+};
+
+// Runs function on pool and returns the future of its result
+template <typename F>
+auto schedule(ThreadPool& pool, F&& function) -> Future<typename std::invoke_result<F>::type> {
+    using R = typename std::invoke_result<F>::type;
+
+    Promise<R> promise(&pool);
+    Future<R> result = promise.getFuture();
+    pool.post([promise = std::move(promise), function = std::forward<F>(function)]() mutable {
+        detail::fulfil(promise, function);
+    });
+    return result;
+}
+
+template <typename F>
+auto schedule(ThreadPool& pool, const TaskClass& taskClass, F&& function) -> Future<typename std::invoke_result<F>::type> {
+    using R = typename std::invoke_result<F>::type;
+
+    Promise<R> promise(&pool);
+    Future<R> result = promise.getFuture();
+    pool.post(taskClass, [promise = std::move(promise), function = std::forward<F>(function)]() mutable {
+        detail::fulfil(promise, function);
+    });
+    return result;
+}
+
+/**
+ * @brief Future that completes once every one of futures has
+ *
+ * Fails with the first exception among them. The inputs are not consumed:
+ * their values are collected with get() afterwards, without blocking.
+ */
+template <typename T>
+Future<void> whenAll(const std::vector<Future<T>>& futures) {
+    Promise<void> promise(futures.empty() ? nullptr : futures.front().state_->pool);
+    Future<void> result = promise.getFuture();
+    if (futures.empty()) {
+        promise.setValue();
+        return result;
+    }
+
+    struct Join {
+        explicit Join(size_t count, Promise<void> promise) : remaining(count), promise(std::move(promise)) {}
+
+        std::atomic<size_t> remaining;
+        std::mutex mutex;
+        std::exception_ptr error;
+        Promise<void> promise;
+    };
+    auto join = std::make_shared<Join>(futures.size(), std::move(promise));
+
+    for (const auto& future : futures) {
+        auto state = future.state_;
+        state->onComplete([join, state]() {
+            if (state->error) {
+                std::lock_guard<std::mutex> lock(join->mutex);
+                if (!join->error) {
+                    join->error = state->error;
+                }
+            }
+            if (join->remaining.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+                if (join->error) {
+                    join->promise.setException(join->error);
+                } else {
+                    join->promise.setValue();
+                }
+            }
+        });
+    }
+    return result;
+}
+
+/**
+ * @brief Future of the index of whichever of futures completes first
+ *
+ * The index is delivered whether that future holds a value or an exception;
+ * it is collected with get() on the input. futures must not be empty.
+ */
+template <typename T>
+Future<size_t> whenAny(const std::vector<Future<T>>& futures) {
+    if (futures.empty()) {
+        throw std::invalid_argument("whenAny needs at least one future");
+    }
+
+    struct Race {
+        explicit Race(Promise<size_t> promise) : promise(std::move(promise)) {}
+
+        std::atomic<bool> decided{false};
+        Promise<size_t> promise;
+    };
+    Promise<size_t> promise(futures.front().state_->pool);
+    Future<size_t> result = promise.getFuture();
+    auto race = std::make_shared<Race>(std::move(promise));
+
+    for (size_t i = 0; i < futures.size(); ++i) {
+        futures[i].state_->onComplete([race, i]() {
+            if (!race->decided.exchange(true, std::memory_order_acq_rel)) {
+                race->promise.setValue(i);
+            }
+        });
+    }
+    return result;
+}
+
+/**
+ * @class TaskGraph
+ * @brief Set of tasks with dependencies, run on a pool without blocking
+ *
+ * A node may only depend on nodes added before it, so every graph is acyclic.
+ * run() starts the nodes without dependencies; each further node is posted
+ * the moment its last dependency finishes. After a failure, nodes that have
+ * not started are skipped and the graph's future carries the first exception.
+ */
+class TaskGraph {
+public:
+    using NodeId = size_t;
+
+    NodeId add(InlineTask work, const std::vector<NodeId>& dependencies = {});
+
+    NodeId add(const TaskClass& taskClass, InlineTask work, const std::vector<NodeId>& dependencies = {});
+
+    // Consumes the graph; the future completes once every node has run or been skipped
+    Future<void> run(ThreadPool& pool);
+
+private:
+    struct Node {
+        InlineTask work;
+        std::optional<TaskClass> taskClass;
+        std::vector<NodeId> dependents;
+        size_t dependencies = 0;
+    };
+
+    struct Execution;
+
+    static void post(const std::shared_ptr<Execution>& execution, NodeId id);
+
+    static void runNode(const std::shared_ptr<Execution>& execution, NodeId id);
+
+    std::vector<Node> nodes_;
+};
+
+} // namespace chad
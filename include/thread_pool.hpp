@@ -1,63 +1,303 @@
 #pragma once
 
+#include <array>
+#include <chrono>
 #include <vector>
-#include <queue>
 #include <memory>
 #include <thread>
 #include <mutex>
 #include <condition_variable>
 #include <future>
 #include <functional>
+#include <memory_resource>
+#include <string>
+#include <tuple>
 #include <type_traits>
 #include <atomic>
+#include "cpu_affinity.hpp"
+#include "fair_queue.hpp"
+#include "inline_task.hpp"
+#include "work_stealing_deque.hpp"
 
 namespace chad {
 
+/**
+ * @enum TaskPriority
+ * @brief Scheduling class of a task; a class runs only when every higher one is empty
+ */
+enum class TaskPriority {
+    HIGH,     // short, latency-sensitive work
+    NORMAL,   // what plain submit() and post() run at
+    LOW       // bulk work such as transcodes; never holds every worker
+};
+
+/**
+ * @struct TaskClass
+ * @brief Where a task is queued: its priority and the tenant it is charged to
+ */
+struct TaskClass {
+    TaskPriority priority = TaskPriority::NORMAL;
+    std::string tenant;
+    uint64_t cost = 1;   // relative to other tasks of the same priority
+};
+
+/**
+ * @class ThreadPool
+ * @brief Work-stealing pool: every worker owns a deque, idle workers steal
+ *
+ * Tasks submitted from a worker go onto that worker's own deque; tasks from
+ * other threads are handed round-robin to the workers' inboxes. A worker
+ * runs its own newest task first, then its inbox, then steals the oldest
+ * task of a random victim, so no lock is shared between submitters and
+ * workers. Idle workers spin briefly before they park; submitters only touch
+ * the parking lot when somebody sleeps in it.
+ *
+ * Tasks submitted with a TaskClass wait in one FairQueue per priority
+ * instead: tenants of a class are served by deficit round robin, classes by
+ * strict priority. Plain tasks run at NORMAL and share that class about
+ * evenly with its tenants. LOW tasks may occupy all workers but one, so
+ * bulk work alone never shuts out HIGH and NORMAL tasks. There is no
+ * preemption: a HIGH task that arrives while every worker is busy waits
+ * for the first running task to finish, however long that takes.
+ *
+ * The pool can be resized both ways at any time: surplus workers retire
+ * once their current task is done, and whatever they still had queued is
+ * stolen by the others. An optional autoscaler does the resizing from
+ * queue depth, queue wait and host CPU load.
+ *
+ * Workers can be pinned to CPUs and can prefer the memory of one NUMA node;
+ * processes a task starts inherit both from the worker that runs it.
+ *
+ * Task nodes and the shared state behind submit()'s futures come from a
+ * pooled memory resource and callables are stored inline, so in steady
+ * state the submit() and post() overloads without a TaskClass never reach
+ * malloc. Those with one can: the tenant name is a std::string, and a
+ * tenant's first task allocates its flow in the FairQueue.
+ */
 class ThreadPool {
 public:
+    struct AutoscaleSettings {
+        size_t minThreads = 1;
+        size_t maxThreads = 0;                     // 0: one per CPU the workers may use
+        std::chrono::milliseconds interval{500};   // between decisions
+
+        // Grow while tasks wait longer than this on average, or while more
+        // tasks are queued than there are workers
+        std::chrono::milliseconds maxQueueWait{100};
+
+        // Shrink only after the pool has had idle workers for this long
+        std::chrono::seconds shrinkAfter{30};
+
+        // Do not grow while the host's CPUs are busier than this (percent)
+        unsigned maxHostLoad = 90;
+    };
+
+    // Worker i runs on cpuSets[i % cpuSets.size()]
+    struct Placement {
+        std::vector<CpuSet> cpuSets;   // empty: workers are not pinned
+        int memoryNode = -1;           // -1: the kernel's default memory policy
+    };
+
     explicit ThreadPool(size_t numThreads);
 
+    ThreadPool(size_t numThreads, Placement placement);
+
+    // Runs every task already submitted, then joins the workers
     ~ThreadPool();
 
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
     template<class F, class... Args>
     auto submit(F&& f, Args&&... args) -> std::future<typename std::invoke_result<F, Args...>::type> {
         using return_type = typename std::invoke_result<F, Args...>::type;
 
-        auto task = std::make_shared<std::packaged_task<return_type()>>(
-            std::bind(std::forward<F>(f), std::forward<Args>(args)...)
-        );
+        std::future<return_type> result;
+        enqueue(makePromiseTask<return_type>(result, std::forward<F>(f), std::forward<Args>(args)...));
+        return result;
+    }
 
-        std::future<return_type> result = task->get_future();
-        {
-            std::lock_guard<std::mutex> lock(queueMutex_);
+    template<class F, class... Args>
+    auto submit(const TaskClass& taskClass, F&& f, Args&&... args)
+        -> std::future<typename std::invoke_result<F, Args...>::type> {
+        using return_type = typename std::invoke_result<F, Args...>::type;
 
-            if (stop_) {
-                throw std::runtime_error("Cannot enqueue on a stopped ThreadPool");
-            }
+        std::future<return_type> result;
+        enqueue(taskClass, makePromiseTask<return_type>(result, std::forward<F>(f), std::forward<Args>(args)...));
+        return result;
+    }
 
-            tasks_.emplace([task]() { (*task)(); });
-        }
+    // Fire and forget: no future is created; an exception thrown by the task is logged
+    template<class F, class... Args>
+    auto post(F&& f, Args&&... args) -> std::enable_if_t<std::is_invocable<F, Args...>::value> {
+        enqueue(bindArguments(std::forward<F>(f), std::forward<Args>(args)...));
+    }
 
-        condition_.notify_one();
-        return result;
+    template<class F, class... Args>
+    void post(const TaskClass& taskClass, F&& f, Args&&... args) {
+        enqueue(taskClass, bindArguments(std::forward<F>(f), std::forward<Args>(args)...));
     }
 
+    // Gives a tenant weight times the share of a tenant with the default weight of 1
+    void setTenantWeight(const std::string& tenant, uint32_t weight);
+
+    // Workers currently running a task
     size_t getActiveThreadCount() const;
 
+    // Tasks submitted but not started yet
     size_t getQueueSize() const;
 
+    // Workers the pool is sized to; retiring ones may still be finishing a task
+    size_t getThreadCount() const;
+
+    // Sizes the pool to numThreads (1 to MAX_WORKERS). Surplus workers retire
+    // after their current task; nothing queued is dropped.
     void resize(size_t numThreads);
 
+    // Starts resizing the pool on its own within the given bounds
+    void enableAutoscaling(const AutoscaleSettings& settings);
+
+    static constexpr size_t MAX_WORKERS = 256;
+
 private:
-    std::vector<std::thread> workers_;
+    struct Task {
+        std::atomic<Task*> next{nullptr};
+        InlineTask function;
+        TaskPriority priority = TaskPriority::NORMAL;
+        std::chrono::steady_clock::time_point queuedAt;
+    };
+
+    // Intrusive MPSC queue (Vyukov) of tasks submitted from outside the pool;
+    // the consumer side is claimed with a try-lock so idle workers can drain
+    // the inbox of a busy one
+    class Inbox {
+    public:
+        Inbox();
+
+        void push(Task* task);
+
+        // nullptr if empty, or if another thread is consuming right now
+        Task* tryPop();
+
+    private:
+        Task* pop();
+
+        std::atomic<Task*> head_;
+        Task* tail_;
+        Task stub_;
+        std::atomic<bool> consuming_;
+    };
+
+    struct Worker {
+        WorkStealingDeque<Task*> deque;
+        Inbox inbox;
+        std::thread thread;
+        bool retired = false;   // thread has exited; guarded by resizeMutex_
+    };
+
+    // A plain callable is stored as it is, so it keeps all of the inline space
+    template<class F, class... Args>
+    static auto bindArguments(F&& f, Args&&... args) {
+        if constexpr (sizeof...(Args) == 0) {
+            return std::decay_t<F>(std::forward<F>(f));
+        } else {
+            return [function = std::forward<F>(f), arguments = std::make_tuple(std::forward<Args>(args)...)]() mutable {
+                return std::apply(function, std::move(arguments));
+            };
+        }
+    }
+
+    template<class R, class F, class... Args>
+    static InlineTask makePromiseTask(std::future<R>& future, F&& f, Args&&... args) {
+        std::promise<R> promise(std::allocator_arg, std::pmr::polymorphic_allocator<char>(memory()));
+        future = promise.get_future();
+
+        return [promise = std::move(promise), function = bindArguments(std::forward<F>(f), std::forward<Args>(args)...)]() mutable {
+            try {
+                if constexpr (std::is_void<R>::value) {
+                    function();
+                    promise.set_value();
+                } else {
+                    promise.set_value(function());
+                }
+            } catch (...) {
+                promise.set_exception(std::current_exception());
+            }
+        };
+    }
+
+    // Shared by every pool and never destroyed: futures may outlive their pool
+    static std::pmr::memory_resource* memory();
+
+    // Both throw std::runtime_error once the pool is stopping
+    void enqueue(InlineTask function);
+
+    void enqueue(const TaskClass& taskClass, InlineTask function);
+
+    Task* newTask(InlineTask function, TaskPriority priority);
+
+    void deleteTask(Task* task);
+
+    void workerLoop(size_t index);
+
+    // Pins the calling worker and sets its memory policy
+    void applyPlacement(size_t index) const;
+
+    // Ends a worker whose slot is beyond the target size; false if it was resized back
+    bool retire(size_t index);
+
+    void autoscaleLoop(AutoscaleSettings settings);
+
+    Task* findTask(size_t index);
+
+    // Own deque and inbox, then the other workers'
+    Task* findLocalTask(size_t index);
+
+    // Claims a LOW slot; false if LOW tasks already hold all workers but one
+    bool acquireBulkSlot();
+
+    // Whether this worker could run something right now
+    bool hasRunnableWork() const;
+
+    void run(Task* task);
+
+    // Sleeps until work may have arrived; returns at once if it already has
+    void park();
+
+    void wakeOne();
+
+private:
+    const Placement placement_;
+
+    std::array<std::atomic<Worker*>, MAX_WORKERS> workers_;
+    std::atomic<size_t> workerCount_;    // slots ever started; thieves visit them all
+    std::atomic<size_t> targetCount_;    // slots below this one run a worker
+    std::vector<std::unique_ptr<Worker>> ownedWorkers_;
+    std::mutex resizeMutex_;
+
+    std::atomic<size_t> nextInbox_;
+    std::atomic<size_t> queued_;
+    std::atomic<size_t> active_;
+
+    std::array<FairQueue<Task*>, 3> fairQueues_;   // indexed by TaskPriority
+    std::atomic<size_t> bulkRunning_;
+
+    // Parking lot: epoch_ changes on every submission, so a worker that read
+    // it before its last look for work cannot miss a wakeup
+    std::mutex parkMutex_;
+    std::condition_variable parkCondition_;
+    std::atomic<uint64_t> epoch_;
+    std::atomic<size_t> sleepers_;
 
-    std::queue<std::function<void()>> tasks_;
+    // Queue wait of the tasks started since the autoscaler last looked
+    std::atomic<uint64_t> waitedNanos_;
+    std::atomic<uint64_t> started_;
 
-    mutable std::mutex queueMutex_;
-    std::condition_variable condition_;
+    std::thread autoscaler_;
+    std::mutex autoscaleMutex_;
+    std::condition_variable autoscaleCondition_;
 
     std::atomic<bool> stop_;
-    std::atomic<size_t> activeThreads_;
 };
 
-} // namespace chad
\ No newline at end of file
+} // namespace chad
@@ -0,0 +1,89 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include <boost/asio.hpp>
+
+namespace chad {
+
+/**
+ * @class TimerWheel
+ * @brief Hashed timing wheel shared by every connection of a server
+ *
+ * A single steady_timer advances the wheel one slot per tick, so thousands of
+ * header, body and idle deadlines cost one kernel timer instead of one each.
+ * Entries are intrusive and owned by the caller: arming and cancelling are
+ * O(1) and never allocate. Deadlines are rounded up to the next tick.
+ */
+class TimerWheel {
+public:
+    // Receives the generation returned by the schedule() call that expired
+    using Callback = std::function<void(uint64_t generation)>;
+
+    class Entry {
+    public:
+        Entry() = default;
+        ~Entry();
+
+        Entry(const Entry&) = delete;
+        Entry& operator=(const Entry&) = delete;
+
+        // Must be set before the entry is first scheduled
+        void setCallback(Callback callback) { callback_ = std::move(callback); }
+
+    private:
+        friend class TimerWheel;
+
+        TimerWheel* wheel_ = nullptr;   // wheel the entry was last scheduled on
+        bool linked_ = false;
+        Entry* prev_ = nullptr;
+        Entry* next_ = nullptr;
+        size_t slot_ = 0;
+        size_t rounds_ = 0;
+        uint64_t generation_ = 0;
+        Callback callback_;
+    };
+
+    TimerWheel(std::chrono::milliseconds tick, size_t slots);
+
+    ~TimerWheel();
+
+    TimerWheel(const TimerWheel&) = delete;
+    TimerWheel& operator=(const TimerWheel&) = delete;
+
+    void start(boost::asio::io_context& ioContext);
+
+    // Must be called once no thread runs the io_context
+    void stop();
+
+    /**
+     * @brief Arm an entry, replacing any deadline it already had
+     * @return Generation passed to the callback if this deadline expires
+     */
+    uint64_t schedule(Entry& entry, std::chrono::milliseconds delay);
+
+    void cancel(Entry& entry);
+
+private:
+    void unlink(Entry& entry);
+
+    void armTick();
+
+    void onTick();
+
+private:
+    const std::chrono::milliseconds tick_;
+    std::vector<Entry*> slots_;
+    size_t cursor_ = 0;
+    std::unique_ptr<boost::asio::steady_timer> timer_;
+
+    std::mutex mutex_;
+    std::vector<std::pair<Callback, uint64_t>> expired_;
+};
+
+} // namespace chad
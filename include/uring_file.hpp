@@ -0,0 +1,71 @@
+#pragma once
+
+#ifdef CHAD_HAVE_IO_URING
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include <liburing.h>
+
+namespace chad {
+
+/**
+ * @class UringFile
+ * @brief Sequential file writer that batches writes through io_uring
+ *
+ * Data is copied into a few buffers registered with the ring; each full buffer
+ * is written with one fixed-buffer request while the next one fills, so the
+ * caller only waits when every buffer is still in flight. finish() submits the
+ * tail and a linked fdatasync together and reaps them with a single syscall.
+ */
+class UringFile {
+public:
+    // nullptr if the kernel (or a seccomp policy) does not allow io_uring
+    static std::unique_ptr<UringFile> create(int fd);
+
+    // Waits for writes still in flight; the descriptor is not closed
+    ~UringFile();
+
+    UringFile(const UringFile&) = delete;
+    UringFile& operator=(const UringFile&) = delete;
+
+    bool write(const char* data, size_t size);
+
+    // Writes out what is buffered, syncs the data and waits for both
+    bool finish();
+
+private:
+    struct Buffer {
+        char* data = nullptr;
+        size_t length = 0;     // bytes filled
+        size_t written = 0;    // bytes the kernel has confirmed
+        uint64_t offset = 0;   // file offset of data[0]
+        bool busy = false;
+    };
+
+    explicit UringFile(int fd);
+
+    bool initialize();
+
+    // Queues the unwritten part of a buffer; the caller submits. nullptr if the queue is full
+    io_uring_sqe* queueWrite(Buffer& buffer);
+
+    // Handles one completion; blocks for it if wait is set
+    bool reap(bool wait);
+
+private:
+    io_uring ring_;
+    bool ringReady_ = false;
+    int fd_;
+    std::unique_ptr<char[]> memory_;
+    std::vector<Buffer> buffers_;
+    size_t current_ = 0;
+    uint64_t offset_ = 0;
+    size_t inFlight_ = 0;
+    bool failed_ = false;
+};
+
+} // namespace chad
+
+#endif // CHAD_HAVE_IO_URING
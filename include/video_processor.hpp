@@ -1,11 +1,19 @@
 #pragma once
 
 #include <string>
+#include <chrono>
 #include <vector>
 #include <memory>
 #include <future>
 #include <functional>
 #include <atomic>
+#include <mutex>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <nlohmann/json.hpp>
+#include "cost_scheduler.hpp"
+#include "task_graph.hpp"
 #include "thread_pool.hpp"
 
 namespace chad {
@@ -39,12 +47,44 @@ struct ChunkInfo {
     std::string codec;
 };
 
+/**
+ * @struct ChunkEvent
+ * @brief Status change or transcoding progress report for a chunk
+ */
+struct ChunkEvent {
+    enum class Type {
+        STATUS,
+        PROGRESS
+    };
+
+    Type type = Type::STATUS;
+    std::shared_ptr<ChunkInfo> chunk;   // the record as published
+
+    // Progress as reported by the transcoding engine
+    int64_t frame = 0;
+    double fps = 0.0;
+    std::string outTime;
+};
+
 /**
  * @class VideoProcessor
  * @brief Processes video chunks with various operations
+ *
+ * Chunks are registered as PENDING as soon as they are submitted. Records
+ * are immutable once published: each status change replaces the record, so
+ * a ChunkInfo obtained from the processor can be read without locking.
  */
 class VideoProcessor {
 public:
+    // Receives the finished chunk record
+    using ChunkCallback = std::function<void(std::shared_ptr<ChunkInfo>)>;
+
+    // Called on processing threads; must return quickly and must not block
+    using ChunkEventListener = std::function<void(const ChunkEvent&)>;
+
+    // Identifies a callback registered by waitForChunk(); 0 is never used
+    using WaiterId = uint64_t;
+
     /**
      * @brief Default constructor
      */
@@ -55,11 +95,53 @@ public:
      * @param threadPoolSize Number of threads for processing
      */
     explicit VideoProcessor(size_t threadPoolSize);
+
+    /**
+     * @brief Where the processing workers run
+     *
+     * With numaLocal on a host with several NUMA nodes, the workers are split
+     * into one pool per node. Each pool runs on its node's CPUs, prefers its
+     * node's memory, and keeps every stage of a chunk, including the FFmpeg
+     * process, on that node. cpuSets then only applies to the sets that lie
+     * within a single node.
+     */
+    struct Placement {
+        std::vector<CpuSet> cpuSets;   // worker i uses set i modulo the count; empty: unpinned
+        bool numaLocal = false;
+    };
+
+    /**
+     * @brief Constructor with thread pool size and worker placement
+     * @param threadPoolSize Number of threads for processing, over all pools
+     * @param placement CPUs and NUMA nodes the threads run on
+     */
+    VideoProcessor(size_t threadPoolSize, const Placement& placement);
     
     /**
      * @brief Destructor
      */
     ~VideoProcessor();
+
+    /**
+     * @enum Engine
+     * @brief What probes and transcodes chunks
+     *
+     * FFMPEG runs the ffprobe and ffmpeg binaries for every chunk. LIBAV does
+     * the same work in-process, without spawning anything, and keeps codec
+     * contexts across chunks with the same parameters; it is only available
+     * when built with CHAD_ENABLE_LIBAV.
+     */
+    enum class Engine {
+        FFMPEG,
+        LIBAV
+    };
+
+    /**
+     * @brief Choose the transcoding engine
+     * @param engine Must be set before initialize()
+     * @return false if the engine is not built in, in which case nothing changes
+     */
+    bool setEngine(Engine engine);
     
     /**
      * @brief Initialize the processor
@@ -76,6 +158,34 @@ public:
      * @return ChunkInfo with processing details
      */
     std::future<ChunkInfo> processChunk(const std::string& inputPath, const std::string& options);
+
+    /**
+     * @brief Queue a video chunk for processing without waiting for it
+     * @param inputPath Path to the input chunk
+     * @param options Processing options as JSON string
+     * @param tenant Who the work is charged to; tenants share the workers fairly
+     * @return ID of the chunk, already listed as PENDING
+     */
+    std::string submitChunk(const std::string& inputPath, const std::string& options,
+                            const std::string& tenant = std::string());
+
+    /**
+     * @brief Get notified once a chunk is COMPLETED or FAILED
+     * @param chunkId ID of the chunk
+     * @param callback Called at once if the chunk has already finished,
+     *        otherwise from the processing thread
+     * @return ID to pass to cancelWait(); 0 if callback was not kept, because
+     *         it has already been called or the chunk is unknown
+     */
+    WaiterId waitForChunk(const std::string& chunkId, ChunkCallback callback);
+
+    /**
+     * @brief Drop a callback that waitForChunk() kept and has not called yet
+     * @param chunkId ID of the chunk it waits for
+     * @param waiterId What waitForChunk() returned
+     * @return false if the callback has already been called or dropped
+     */
+    bool cancelWait(const std::string& chunkId, WaiterId waiterId);
     
     /**
      * @brief Get information about a processed chunk
@@ -89,29 +199,145 @@ public:
      * @return Vector of chunk information
      */
     std::vector<std::shared_ptr<ChunkInfo>> listChunks() const;
+
+    /**
+     * @brief Counter bumped whenever a chunk is added, updated or removed
+     * @return Version; a listing taken after reading it is at least that new
+     */
+    uint64_t getVersion() const;
+
+    /**
+     * @brief Number of chunks still PENDING or PROCESSING
+     * @return Count; 0 once all submitted work has finished
+     */
+    size_t getUnfinishedCount() const;
     
     /**
      * @brief Delete a processed chunk
      * @param chunkId ID of the chunk to delete
-     * @return true if deleted successfully
+     * @return true if deleted successfully; chunks still being processed
+     *         cannot be deleted
      */
     bool deleteChunk(const std::string& chunkId);
     
+    /**
+     * @brief Cancel a chunk that has not finished yet
+     * @param chunkId ID of the chunk
+     * @return false if the chunk is unknown or already finished
+     *
+     * The chunk FAILED once its pipeline notices: when it reaches a worker,
+     * or while it transcodes, at the engine's next progress report, which
+     * both engines make every half second. A cancelled FFmpeg process is
+     * terminated.
+     */
+    bool cancelChunk(const std::string& chunkId);
+
     /**
      * @brief Set the maximum number of chunks to keep
      * @param maxChunks Maximum number (0 = unlimited)
      */
     void setMaxChunks(size_t maxChunks);
+
+    /**
+     * @brief Let the processing pool resize itself with the load
+     * @param settings Bounds and thresholds for the pool's autoscaler
+     */
+    void enableAutoscaling(const ThreadPool::AutoscaleSettings& settings);
+
+    /**
+     * @brief Order and admission of transcodes
+     *
+     * Transcodes start shortest-expected-first, by an estimate from the
+     * input's duration and resolution and the target codec. Aging keeps long
+     * ones from starving: each second a transcode waits counts as agingRate
+     * seconds less work.
+     */
+    struct Scheduling {
+        std::chrono::seconds maxBacklog{0};   // uploads are refused beyond this; 0: never
+        double agingRate = 1.0;
+    };
+
+    /**
+     * @brief Set how transcodes are ordered and admitted
+     * @param scheduling Must be set before chunks are submitted
+     */
+    void setScheduling(const Scheduling& scheduling);
+
+    /**
+     * @brief How long a client should wait before uploading another chunk
+     * @return Zero while the estimated backlog is within budget
+     */
+    std::chrono::seconds getAdmissionDelay() const;
+
+    /**
+     * @brief Receive every status change and progress update
+     * @param listener Must be set before chunks are submitted
+     */
+    void setEventListener(ChunkEventListener listener);
     
     /**
      * @brief Get the current processing load (0.0-1.0)
-     * @return Load factor
+     * @return Share of the backlog budget in use, or without a budget, of the workers
      */
     double getLoadFactor() const;
 
 private:
     // Extract metadata from video file
     ChunkInfo extractMetadata(const std::string& filePath);
+
+    // Publish a PENDING record for a new chunk
+    std::string registerChunk(const std::string& inputPath);
+
+    // Chains the stages below for a registered chunk; the future holds the published outcome
+    Future<ChunkInfo> startPipeline(const std::string& chunkId, const std::string& inputPath,
+                                    const std::string& optionsStr, const std::string& tenant);
+
+    // Reads the input's metadata and publishes the chunk as PROCESSING
+    ChunkInfo probeChunk(const std::string& chunkId, const std::string& inputPath);
+
+    // Runs the engine, reporting progress; info.filePath becomes the output path
+    ChunkInfo transcodeChunk(ChunkInfo info, const std::string& inputPath, const std::string& optionsStr);
+
+    void runFfmpeg(const ChunkInfo& info, const std::string& inputPath, const std::string& outputPath,
+                   const nlohmann::json& options);
+
+    void runLibav(const ChunkInfo& info, const std::string& inputPath, const std::string& outputPath,
+                  const nlohmann::json& options);
+
+    // Throws if the chunk has been cancelled
+    void checkCancelled(const std::string& chunkId) const;
+
+    // Checks the output and marks the chunk COMPLETED
+    ChunkInfo verifyChunk(ChunkInfo info);
+
+    // The FAILED record for a chunk whose pipeline threw error
+    ChunkInfo failChunk(const std::string& chunkId, const std::string& inputPath, std::exception_ptr error);
+
+    // Deletes a processed upload from the temp directory
+    void removeUpload(const std::string& inputPath);
+
+    // Replace the published record of a chunk and wake its waiters once it has finished
+    void publishChunk(const ChunkInfo& info);
+
+    void emitEvent(const ChunkEvent& event) const;
+
+    // A pool with the scheduler that feeds it transcodes
+    struct Lane {
+        std::unique_ptr<CostScheduler> scheduler;   // outlives the pool, whose last tasks report to it
+        std::unique_ptr<ThreadPool> pool;
+    };
+
+    void addLane(size_t threads, ThreadPool::Placement placement);
+
+    // The lane with the least backlog; a chunk's stages all run on the lane it started on
+    const Lane& pickLane() const;
+
+    // Queues the transcode of a probed chunk on lane's scheduler
+    Future<ChunkInfo> queueTranscode(const Lane& lane, ChunkInfo info, const std::string& inputPath,
+                                     const std::string& optionsStr, const std::string& tenant);
+
+    // Seconds of one worker's time the transcode should take, before the scheduler's correction
+    static double estimateCost(const ChunkInfo& info, const std::string& optionsStr);
     
     // Generate a unique chunk ID
     std::string generateChunkId();
@@ -119,8 +345,13 @@ private:
     // Clean old chunks if max limit reached
     void cleanupOldChunks();
 
+    // Called with chunksMutex_ held after every change to chunks_
+    void bumpVersion();
+
 private:
-    std::unique_ptr<ThreadPool> threadPool_;
+    std::vector<Lane> lanes_;   // one per NUMA node, or just one
+    Engine engine_ = Engine::FFMPEG;
+    std::chrono::seconds maxBacklog_{0};
     std::string storagePath_;
     std::string tempPath_;
     size_t maxChunks_;
@@ -128,6 +359,11 @@ private:
     // Keep track of all chunks
     mutable std::mutex chunksMutex_;
     std::vector<std::shared_ptr<ChunkInfo>> chunks_;
+    std::unordered_map<std::string, std::vector<std::pair<WaiterId, ChunkCallback>>> waiters_;
+    WaiterId nextWaiterId_ = 1;
+    std::unordered_set<std::string> cancelled_;   // unfinished chunks only
+    ChunkEventListener eventListener_;
+    std::atomic<uint64_t> version_{0};
     
     // Statistics
     std::atomic<size_t> processedChunks_;
@@ -0,0 +1,139 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace chad {
+
+/**
+ * @class WorkStealingDeque
+ * @brief Chase-Lev deque of pointers: one owner, any number of thieves
+ *
+ * The owning thread pushes and pops at the bottom without contention; other
+ * threads steal from the top with a single compare-and-swap, which only races
+ * with the owner for the very last element. The ring grows as needed; rings
+ * that were outgrown are kept until the deque is destroyed because a thief
+ * may still be reading from one. Memory orders follow Lê et al., "Correct
+ * and Efficient Work-Stealing for Weak Memory Models" (PPoPP 2013).
+ */
+template <typename T>
+class WorkStealingDeque {
+    static_assert(std::is_pointer<T>::value, "WorkStealingDeque holds pointers");
+
+public:
+    explicit WorkStealingDeque(size_t capacity = 256)
+        : top_(0), bottom_(0), ring_(new Ring(roundUp(capacity))) {
+        rings_.emplace_back(ring_.load(std::memory_order_relaxed));
+    }
+
+    WorkStealingDeque(const WorkStealingDeque&) = delete;
+    WorkStealingDeque& operator=(const WorkStealingDeque&) = delete;
+
+    // Owner only
+    void push(T item) {
+        int64_t bottom = bottom_.load(std::memory_order_relaxed);
+        int64_t top = top_.load(std::memory_order_acquire);
+        Ring* ring = ring_.load(std::memory_order_relaxed);
+
+        if (bottom - top > ring->mask) {
+            ring = grow(ring, top, bottom);
+        }
+
+        ring->put(bottom, item);
+        std::atomic_thread_fence(std::memory_order_release);
+        bottom_.store(bottom + 1, std::memory_order_relaxed);
+    }
+
+    // Owner only; newest item first, nullptr if empty
+    T pop() {
+        int64_t bottom = bottom_.load(std::memory_order_relaxed) - 1;
+        Ring* ring = ring_.load(std::memory_order_relaxed);
+        bottom_.store(bottom, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        int64_t top = top_.load(std::memory_order_relaxed);
+
+        if (top > bottom) {
+            bottom_.store(bottom + 1, std::memory_order_relaxed);
+            return nullptr;
+        }
+
+        T item = ring->get(bottom);
+        if (top == bottom) {
+            // Last item: whoever advances top first gets it
+            if (!top_.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) {
+                item = nullptr;
+            }
+            bottom_.store(bottom + 1, std::memory_order_relaxed);
+        }
+        return item;
+    }
+
+    // Any thread; oldest item first, nullptr if empty or lost to another thread
+    T steal() {
+        int64_t top = top_.load(std::memory_order_acquire);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        int64_t bottom = bottom_.load(std::memory_order_acquire);
+
+        if (top >= bottom) {
+            return nullptr;
+        }
+
+        Ring* ring = ring_.load(std::memory_order_acquire);
+        T item = ring->get(top);
+        if (!top_.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) {
+            return nullptr;
+        }
+        return item;
+    }
+
+    // Approximate when other threads are pushing or stealing
+    size_t size() const {
+        int64_t bottom = bottom_.load(std::memory_order_relaxed);
+        int64_t top = top_.load(std::memory_order_relaxed);
+        return bottom > top ? static_cast<size_t>(bottom - top) : 0;
+    }
+
+private:
+    struct Ring {
+        explicit Ring(int64_t capacity) : mask(capacity - 1), slots(new std::atomic<T>[capacity]) {}
+
+        T get(int64_t index) const {
+            return slots[index & mask].load(std::memory_order_relaxed);
+        }
+
+        void put(int64_t index, T item) {
+            slots[index & mask].store(item, std::memory_order_relaxed);
+        }
+
+        const int64_t mask;
+        std::unique_ptr<std::atomic<T>[]> slots;
+    };
+
+    static int64_t roundUp(size_t capacity) {
+        int64_t result = 2;
+        while (result < static_cast<int64_t>(capacity)) {
+            result <<= 1;
+        }
+        return result;
+    }
+
+    Ring* grow(Ring* ring, int64_t top, int64_t bottom) {
+        Ring* bigger = new Ring((ring->mask + 1) * 2);
+        for (int64_t i = top; i < bottom; ++i) {
+            bigger->put(i, ring->get(i));
+        }
+        rings_.emplace_back(bigger);
+        ring_.store(bigger, std::memory_order_release);
+        return bigger;
+    }
+
+private:
+    alignas(64) std::atomic<int64_t> top_;
+    alignas(64) std::atomic<int64_t> bottom_;
+    std::atomic<Ring*> ring_;
+    std::vector<std::unique_ptr<Ring>> rings_;   // owner only
+};
+
+} // namespace chad
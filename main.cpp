@@ -2,11 +2,17 @@
 #include <memory>
 #include <string>
 #include <csignal>
+#include <atomic>
+#include <vector>
+#include <algorithm>
 #include "include/logger.hpp"
 #include "include/config.hpp"
 #include "include/http_server.hpp"
 #include "include/video_processor.hpp"
 #include "include/storage_manager.hpp"
+#include "include/event_broadcaster.hpp"
+#include "include/response_cache.hpp"
+#include "include/hot_restart.hpp"
 #include <boost/asio.hpp>
 #include <nlohmann/json.hpp>
 #include <filesystem>
@@ -17,6 +23,9 @@ using json = nlohmann::json;
 std::unique_ptr<chad::HttpServer> g_server;
 std::shared_ptr<chad::VideoProcessor> g_videoProcessor;
 
+// Set from the SIGUSR2 handler, acted on by the main loop
+std::atomic<bool> g_restartRequested(false);
+
 void signalHandler(int signum) {
     LOG_INFO("Signal received: " + std::to_string(signum));
 
@@ -28,48 +37,255 @@ void signalHandler(int signum) {
     std::exit(0);
 }
 
-void setupRoutes(chad::HttpServer& server, std::shared_ptr<chad::VideoProcessor> processor) {
-    server.addRoute("GET", "/api/status", [&](const chad::HttpRequest& req, chad::HttpResponse& res) {
-        json response = {
-            {"status", "running"},
-            {"version", "1.0.0"},
-            {"processor_load", processor->getLoadFactor()},
-            {"thread_pool_size", chad::Config::getInstance().getInt("video_processing.thread_pool_size", 4)}
+void restartSignalHandler(int) {
+    g_restartRequested = true;
+}
+
+// Hands the listeners to a fresh instance of the binary, then drains this one.
+// Returns false if the successor failed to start and this process keeps serving.
+bool hotRestart(const std::string& executable, const std::vector<std::string>& args,
+                chad::EventBroadcaster& events) {
+    LOG_INFO("Hot restart requested");
+
+    auto readyTimeout = std::chrono::milliseconds(chad::Config::getInstance().getInt("server.restart_ready_timeout_ms", 10000));
+    chad::HotRestart restart;
+    if (!restart.spawnSuccessor(executable, args, g_server->listenerFds(), readyTimeout)) {
+        return false;
+    }
+
+    g_server->stopAccepting();
+
+    // Event streams never end on their own; ended, their clients reconnect to the successor
+    events.close();
+
+    // In-flight requests and transcodes get until the deadline; the successor serves everything new
+    auto drainTimeout = std::chrono::milliseconds(chad::Config::getInstance().getInt("server.drain_timeout_ms", 30000));
+    auto deadline = std::chrono::steady_clock::now() + drainTimeout;
+    while (g_server->getConnectionCount() > 0 || g_videoProcessor->getUnfinishedCount() > 0) {
+        if (std::chrono::steady_clock::now() >= deadline) {
+            LOG_WARNING("Drain deadline reached with " + std::to_string(g_server->getConnectionCount()) +
+                        " connections and " + std::to_string(g_videoProcessor->getUnfinishedCount()) +
+                        " chunks unfinished");
+            break;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    }
+
+    g_server->stop();
+    return true;
+}
+
+bool hasVideoContentType(const chad::HttpRequest& req) {
+    auto contentType = req.findHeader("Content-Type");
+    return contentType && contentType->find("video/") == 0;
+}
+
+// Chunk routes accept the id as a path segment or, for older clients, as ?id=
+std::optional<std::string> requestedChunkId(const chad::HttpRequest& req) {
+    if (auto id = req.pathParam("id")) {
+        return std::string(*id);
+    }
+    return req.queryParam("id");
+}
+
+chad::HttpResponse errorResponse(int statusCode, const std::string& statusText, const std::string& message) {
+    chad::HttpResponse res;
+    res.statusCode = statusCode;
+    res.statusText = statusText;
+    res.setJson({{"error", message}});
+    return res;
+}
+
+json chunkJson(const chad::ChunkInfo& chunkInfo) {
+    json response = {
+        {"id", chunkInfo.chunkId},
+        {"status", static_cast<int>(chunkInfo.status)},
+        {"size", chunkInfo.size},
+        {"width", chunkInfo.width},
+        {"height", chunkInfo.height},
+        {"duration", chunkInfo.duration},
+        {"codec", chunkInfo.codec}
+    };
+
+    if (!chunkInfo.errorMessage.empty()) {
+        response["error"] = chunkInfo.errorMessage;
+    }
+
+    return response;
+}
+
+chad::HttpResponse chunkResponse(const chad::ChunkInfo& chunkInfo) {
+    chad::HttpResponse res;
+    res.setJson(chunkJson(chunkInfo));
+    return res;
+}
+
+// Server-Sent Events frame for /api/chunks/events
+std::string formatChunkEvent(const chad::ChunkEvent& event) {
+    json data;
+    std::string type;
+
+    if (event.type == chad::ChunkEvent::Type::STATUS) {
+        type = "status";
+        data = chunkJson(*event.chunk);
+    } else {
+        type = "progress";
+        data = {
+            {"id", event.chunk->chunkId},
+            {"frame", event.frame},
+            {"fps", event.fps},
+            {"out_time", event.outTime}
         };
-        res.setJson(response);
+    }
+
+    return "event: " + type + "\ndata: " + data.dump() + "\n\n";
+}
+
+// ?wait=<seconds> turns a chunk lookup into a long-poll, capped at a minute
+std::chrono::seconds longPollTimeout(const chad::HttpRequest& req) {
+    auto wait = req.queryParam("wait");
+    if (!wait) {
+        return std::chrono::seconds(0);
+    }
+
+    try {
+        return std::chrono::seconds(std::clamp(std::stoi(*wait), 0, 60));
+    } catch (...) {
+        return std::chrono::seconds(0);
+    }
+}
+
+// CPU sets from a placement setting ("", "cores", "nodes" or a CPU list); unpinned if it is malformed
+std::vector<chad::CpuSet> cpuSetsFromConfig(const std::string& key) {
+    std::string placement = chad::Config::getInstance().getString(key, "");
+    try {
+        return chad::cpuSetsFor(placement);
+    } catch (const std::invalid_argument& e) {
+        LOG_WARNING("Ignoring " + key + ": " + e.what());
+        return {};
+    }
+}
+
+std::string makeUploadPath() {
+    std::string tempPath = fs::path(chad::Config::getInstance().getString("video_processing.temp_path", "storage/temp")).string();
+
+    if (!fs::exists(tempPath)) {
+        fs::create_directories(tempPath);
+    }
+
+    return tempPath + "/upload_" + std::to_string(std::chrono::system_clock::now().time_since_epoch().count()) + ".mp4";
+}
+
+void setupRoutes(chad::HttpServer& server, std::shared_ptr<chad::VideoProcessor> processor,
+                 std::shared_ptr<chad::EventBroadcaster> events) {
+    // Dashboards poll these constantly; bodies are rebuilt only when chunks change
+    auto statusCache = std::make_shared<chad::ResponseCache>("application/json");
+    server.addRoute("GET", "/api/status", [processor, statusCache](const chad::HttpRequest& req, chad::HttpResponse& res) {
+        // The load is reported in thousandths so that it can be part of the cache key
+        auto load = static_cast<uint64_t>(processor->getLoadFactor() * 1000 + 0.5);
+        uint64_t version = processor->getVersion() << 11 | load;
+
+        statusCache->serve(req, res, version, [load]() {
+            json response = {
+                {"status", "running"},
+                {"version", "1.0.0"},
+                {"processor_load", static_cast<double>(load) / 1000},
+                {"thread_pool_size", chad::Config::getInstance().getInt("video_processing.thread_pool_size", 4)}
+            };
+            return response.dump();
+        });
     });
 
-    server.addRoute("GET", "/api/chunks", [processor](const chad::HttpRequest& req, chad::HttpResponse& res) {
-        auto chunks = processor->listChunks();
-
-        json response = json::array();
-        for (const auto& chunk : chunks) {
-            response.push_back({
-                {"id", chunk->chunkId},
-                {"status", static_cast<int>(chunk->status)},
-                {"size", chunk->size},
-                {"width", chunk->width},
-                {"height", chunk->height},
-                {"duration", chunk->duration},
-                {"codec", chunk->codec}
-            });
+    auto chunksCache = std::make_shared<chad::ResponseCache>("application/json");
+    server.addRoute("GET", "/api/chunks", [processor, chunksCache](const chad::HttpRequest& req, chad::HttpResponse& res) {
+        // Read before the listing, so the body is never older than the version it is cached under
+        uint64_t version = processor->getVersion();
+
+        chunksCache->serve(req, res, version, [&processor]() {
+            std::string body = "[";
+            for (const auto& chunk : processor->listChunks()) {
+                if (body.size() > 1) {
+                    body += ',';
+                }
+                body += json{
+                    {"id", chunk->chunkId},
+                    {"status", static_cast<int>(chunk->status)},
+                    {"size", chunk->size},
+                    {"width", chunk->width},
+                    {"height", chunk->height},
+                    {"duration", chunk->duration},
+                    {"codec", chunk->codec}
+                }.dump();
+            }
+            body += ']';
+            return body;
+        });
+    });
+
+    auto chunkInfoHandler = [processor](const chad::HttpRequest& req, chad::HttpResponder responder) {
+        auto chunkId = requestedChunkId(req);
+        if (!chunkId) {
+            responder.send(errorResponse(400, "Bad Request", "Missing chunk id"));
+            return;
+        }
+
+        auto chunkInfo = processor->getChunkInfo(*chunkId);
+
+        if (!chunkInfo) {
+            responder.send(errorResponse(404, "Not Found", "Chunk not found"));
+            return;
         }
 
-        res.setJson(response);
+        auto wait = longPollTimeout(req);
+        if (wait.count() == 0 || chunkInfo->status == chad::ProcessingStatus::COMPLETED ||
+            chunkInfo->status == chad::ProcessingStatus::FAILED) {
+            responder.send(chunkResponse(*chunkInfo));
+            return;
+        }
+
+        // Long-poll: answer when the chunk finishes or with its current state at the timeout
+        auto timer = std::make_shared<boost::asio::steady_timer>(responder.executor(), wait);
+        auto waiterId = processor->waitForChunk(*chunkId, [responder, timer](std::shared_ptr<chad::ChunkInfo> finished) {
+            responder.send(chunkResponse(*finished));
+            // Expired rather than cancelled, in case the wait below is not armed yet
+            boost::asio::post(responder.executor(), [timer]() {
+                timer->expires_at(boost::asio::steady_timer::time_point::min());
+            });
+        });
+
+        // A poll that times out takes its callback, and the responder in it, back out
+        timer->async_wait([processor, responder, timer, waiterId, id = *chunkId](const boost::system::error_code&) {
+            processor->cancelWait(id, waiterId);
+            auto current = processor->getChunkInfo(id);
+            responder.send(current ? chunkResponse(*current) : errorResponse(404, "Not Found", "Chunk not found"));
+        });
+    };
+    // Long-lived stream of status changes and FFmpeg progress, instead of polling
+    server.addAsyncRoute("GET", "/api/chunks/events", [events](const chad::HttpRequest& /*req*/, chad::HttpResponder responder) {
+        chad::HttpResponse head;
+        head.headers["Content-Type"] = "text/event-stream";
+        head.headers["Cache-Control"] = "no-cache";
+
+        auto stream = responder.stream(std::move(head));
+        if (stream) {
+            stream->write(std::string("retry: 3000\n\n"));
+            events->subscribe(stream);
+        }
     });
 
-    server.addRoute("GET", "/api/chunks/info", [processor](const chad::HttpRequest& req, chad::HttpResponse& res) {
-        auto params = req.queryParams;
-        if (params.find("id") == params.end()) {
+    server.addAsyncRoute("GET", "/api/chunks/info", chunkInfoHandler);
+    server.addAsyncRoute("GET", "/api/chunks/{id}", chunkInfoHandler);
+
+    auto downloadHandler = [processor](const chad::HttpRequest& req, chad::HttpResponse& res) {
+        auto chunkId = requestedChunkId(req);
+        if (!chunkId) {
             res.statusCode = 400;
             res.statusText = "Bad Request";
             res.setJson({{"error", "Missing chunk id"}});
             return;
         }
 
-        std::string chunkId = params["id"];
-        auto chunkInfo = processor->getChunkInfo(chunkId);
-
+        auto chunkInfo = processor->getChunkInfo(*chunkId);
         if (!chunkInfo) {
             res.statusCode = 404;
             res.statusText = "Not Found";
@@ -77,81 +293,105 @@ void setupRoutes(chad::HttpServer& server, std::shared_ptr<chad::VideoProcessor>
             return;
         }
 
-        json response = {
-            {"id", chunkInfo->chunkId},
-            {"status", static_cast<int>(chunkInfo->status)},
-            {"size", chunkInfo->size},
-            {"width", chunkInfo->width},
-            {"height", chunkInfo->height},
-            {"duration", chunkInfo->duration},
-            {"codec", chunkInfo->codec}
-        };
-
-        if (!chunkInfo->errorMessage.empty()) {
-            response["error"] = chunkInfo->errorMessage;
+        if (chunkInfo->status != chad::ProcessingStatus::COMPLETED) {
+            res.statusCode = 409;
+            res.statusText = "Conflict";
+            res.setJson({{"error", "Chunk has not finished processing"}});
+            return;
         }
 
-        res.setJson(response);
-    });
+        if (!res.setFile(chunkInfo->filePath, "video/mp4", req.findHeader("Range"))) {
+            res.statusCode = 404;
+            res.statusText = "Not Found";
+            res.setJson({{"error", "Chunk file not found"}});
+        }
+    };
+    server.addRoute("GET", "/api/chunks/download", downloadHandler);
+    server.addRoute("GET", "/api/chunks/{id}/download", downloadHandler);
 
-    server.addRoute("POST", "/api/upload", [processor](const chad::HttpRequest& req, chad::HttpResponse& res) {
-        auto contentType = req.headers.find("Content-Type");
-        if (contentType == req.headers.end() || contentType->second.find("video/") != 0) {
+    // Upload bodies are streamed straight into a temp file as they arrive
+    server.addBodySink("POST", "/api/upload", [processor](const chad::HttpRequest& req, chad::HttpResponse& res) -> std::unique_ptr<chad::BodySink> {
+        if (!hasVideoContentType(req)) {
             res.statusCode = 400;
             res.statusText = "Bad Request";
             res.setJson({{"error", "Content-Type must be a video format"}});
-            return;
+            return nullptr;
         }
 
-        std::string tempPath = fs::path(chad::Config::getInstance().getString("video_processing.temp_path", "storage/temp")).string();
-
-        if (!fs::exists(tempPath)) {
-            fs::create_directories(tempPath);
+        // Refused before the body is read: the transcode would not start within budget
+        auto delay = processor->getAdmissionDelay();
+        if (delay.count() > 0) {
+            res.statusCode = 503;
+            res.statusText = "Service Unavailable";
+            res.headers["Retry-After"] = std::to_string(delay.count());
+            res.setJson({{"error", "Transcode backlog is full"}});
+            return nullptr;
         }
 
-        std::string tempFile = tempPath + "/upload_" + std::to_string(std::chrono::system_clock::now().time_since_epoch().count()) + ".mp4";
-
-        std::ofstream outFile(tempFile, std::ios::binary);
-        if (!outFile) {
+        auto sink = std::make_unique<chad::FileBodySink>(makeUploadPath());
+        if (!sink->isOpen()) {
             res.statusCode = 500;
             res.statusText = "Internal Server Error";
             res.setJson({{"error", "Failed to create temporary file"}});
+            return nullptr;
+        }
+
+        return sink;
+    });
+
+    server.addRoute("POST", "/api/upload", [processor](const chad::HttpRequest& req, chad::HttpResponse& res) {
+        if (!hasVideoContentType(req)) {
+            res.statusCode = 400;
+            res.statusText = "Bad Request";
+            res.setJson({{"error", "Content-Type must be a video format"}});
             return;
         }
 
-        outFile.write(req.body.data(), req.body.size());
-        outFile.close();
+        auto upload = dynamic_cast<chad::FileBodySink*>(req.bodySink);
+        if (!upload) {
+            res.statusCode = 400;
+            res.statusText = "Bad Request";
+            res.setJson({{"error", "Missing request body"}});
+            return;
+        }
+
+        // Hand the file over to the processor instead of deleting it with the sink
+        upload->keep();
+        std::string tempFile = upload->path();
 
         json options = json::object();
-        auto optionsParam = req.queryParams.find("options");
-        if (optionsParam != req.queryParams.end()) {
+        auto optionsParam = req.queryParam("options");
+        if (optionsParam) {
             try {
-                options = json::parse(optionsParam->second);
+                options = json::parse(*optionsParam);
             } catch (...) {
-                LOG_WARNING("Failed to parse options: " + optionsParam->second);
+                LOG_WARNING("Failed to parse options: " + *optionsParam);
             }
         }
 
-        auto future = processor->processChunk(tempFile, options.dump());
-        auto result = future.get();
+        // Transcoding runs in the background; clients poll or long-poll the chunk.
+        // Each client address is a tenant, so one client's backlog cannot starve the rest.
+        std::string chunkId = processor->submitChunk(tempFile, options.dump(), std::to_string(req.clientKey));
 
+        res.statusCode = 202;
+        res.statusText = "Accepted";
+        res.headers["Location"] = "/api/chunks/" + chunkId;
         res.setJson({
-            {"id", result.chunkId},
-            {"status", static_cast<int>(result.status)}
+            {"id", chunkId},
+            {"status", static_cast<int>(chad::ProcessingStatus::PENDING)}
         });
     });
 
-    server.addRoute("DELETE", "/api/chunks", [processor](const chad::HttpRequest& req, chad::HttpResponse& res) {
-        auto params = req.queryParams;
-        if (params.find("id") == params.end()) {
+    auto deleteChunkHandler = [processor](const chad::HttpRequest& req, chad::HttpResponse& res) {
+        auto chunkId = requestedChunkId(req);
+        if (!chunkId) {
             res.statusCode = 400;
             res.statusText = "Bad Request";
             res.setJson({{"error", "Missing chunk id"}});
             return;
         }
 
-        std::string chunkId = params["id"];
-        bool success = processor->deleteChunk(chunkId);
+        bool success = processor->deleteChunk(*chunkId);
 
         if (success) {
             res.setJson({{"success", true}});
@@ -160,13 +400,45 @@ void setupRoutes(chad::HttpServer& server, std::shared_ptr<chad::VideoProcessor>
             res.statusText = "Not Found";
             res.setJson({{"error", "Chunk not found or could not be deleted"}});
         }
+    };
+    server.addRoute("DELETE", "/api/chunks", deleteChunkHandler);
+    server.addRoute("DELETE", "/api/chunks/{id}", deleteChunkHandler);
+
+    server.addRoute("POST", "/api/chunks/{id}/cancel", [processor](const chad::HttpRequest& req, chad::HttpResponse& res) {
+        auto chunkId = requestedChunkId(req);
+        if (!chunkId) {
+            res.statusCode = 400;
+            res.statusText = "Bad Request";
+            res.setJson({{"error", "Missing chunk id"}});
+            return;
+        }
+
+        // The chunk turns FAILED once processing notices; clients follow it as usual
+        if (processor->cancelChunk(*chunkId)) {
+            res.statusCode = 202;
+            res.statusText = "Accepted";
+            res.setJson({{"success", true}});
+        } else {
+            res.statusCode = 404;
+            res.statusText = "Not Found";
+            res.setJson({{"error", "Chunk not found or already finished"}});
+        }
     });
 }
 
-int main() {
+int main(int argc, char* argv[]) {
     try {
         std::signal(SIGINT, signalHandler);
         std::signal(SIGTERM, signalHandler);
+        std::signal(SIGUSR2, restartSignalHandler);
+
+        // Resolved now: after a deploy replaces the binary, the path names the new one
+        std::error_code ec;
+        std::string executable = fs::read_symlink("/proc/self/exe", ec).string();
+        if (ec) {
+            executable = argv[0];
+        }
+        std::vector<std::string> args(argv, argv + argc);
 
         fs::create_directories("logs");
         chad::Logger::getInstance().initialize("logs/server.log", chad::LogLevel::INFO);
@@ -201,7 +473,17 @@ int main() {
         }
 
         int threadPoolSize = chad::Config::getInstance().getInt("video_processing.thread_pool_size", 2);
-        g_videoProcessor = std::make_shared<chad::VideoProcessor>(threadPoolSize);
+        chad::VideoProcessor::Placement placement;
+        placement.cpuSets = cpuSetsFromConfig("video_processing.cpu_affinity");
+        placement.numaLocal = chad::Config::getInstance().getBool("video_processing.numa_local", false);
+        g_videoProcessor = std::make_shared<chad::VideoProcessor>(threadPoolSize, placement);
+
+        std::string engine = chad::Config::getInstance().getString("video_processing.engine", "ffmpeg");
+        if (engine == "libav") {
+            g_videoProcessor->setEngine(chad::VideoProcessor::Engine::LIBAV);
+        } else if (engine != "ffmpeg") {
+            LOG_WARNING("Unknown video_processing.engine '" + engine + "', using ffmpeg");
+        }
 
         if (!g_videoProcessor->initialize(storagePath, tempPath)) {
             LOG_ERROR("Failed to initialize video processor");
@@ -210,21 +492,72 @@ int main() {
 
         g_videoProcessor->setMaxChunks(chad::Config::getInstance().getInt("video_processing.max_chunks", 100));
 
+        chad::VideoProcessor::Scheduling scheduling;
+        scheduling.maxBacklog = std::chrono::seconds(chad::Config::getInstance().getInt("video_processing.scheduler.max_backlog_s", 0));
+        scheduling.agingRate = chad::Config::getInstance().getInt("video_processing.scheduler.aging_percent", 100) / 100.0;
+        g_videoProcessor->setScheduling(scheduling);
+
+        if (chad::Config::getInstance().getBool("video_processing.autoscale.enabled", false)) {
+            chad::ThreadPool::AutoscaleSettings autoscale;
+            autoscale.minThreads = chad::Config::getInstance().getInt("video_processing.autoscale.min_threads", 1);
+            autoscale.maxThreads = chad::Config::getInstance().getInt("video_processing.autoscale.max_threads", 0);
+            autoscale.maxQueueWait = std::chrono::milliseconds(chad::Config::getInstance().getInt("video_processing.autoscale.max_queue_wait_ms", 100));
+            autoscale.shrinkAfter = std::chrono::seconds(chad::Config::getInstance().getInt("video_processing.autoscale.shrink_after_s", 30));
+            autoscale.maxHostLoad = chad::Config::getInstance().getInt("video_processing.autoscale.max_host_load_percent", 90);
+            g_videoProcessor->enableAutoscaling(autoscale);
+        }
+
         int port = chad::Config::getInstance().getInt("server.port", 8080);
-        g_server = std::make_unique<chad::HttpServer>(port);
+        int workerThreads = chad::Config::getInstance().getInt("server.worker_threads", 4);
+        g_server = std::make_unique<chad::HttpServer>(port, workerThreads);
+        g_server->setKeepAlive(
+            std::chrono::milliseconds(chad::Config::getInstance().getInt("server.keep_alive_timeout_ms", 5000)),
+            chad::Config::getInstance().getInt("server.max_requests_per_connection", 100));
+
+        chad::HttpServer::Limits limits;
+        limits.maxConnections = chad::Config::getInstance().getInt("server.max_connections", 1000);
+        limits.requestTimeout = std::chrono::milliseconds(chad::Config::getInstance().getInt("server.request_timeout_ms", 30000));
+        limits.maxRequestSize = static_cast<size_t>(chad::Config::getInstance().getInt("server.max_request_size_mb", 100)) * 1024 * 1024;
+        limits.maxBodyMemory = static_cast<size_t>(chad::Config::getInstance().getInt("server.max_body_memory_mb", 256)) * 1024 * 1024;
+        g_server->setLimits(limits);
+        g_server->setAcceptShards(chad::Config::getInstance().getInt("server.accept_shards", 0));
+        g_server->setCpuAffinity(cpuSetsFromConfig("server.cpu_affinity"));
+
+        if (chad::Config::getInstance().getBool("security.rate_limit.enabled", false)) {
+            chad::RateLimiter::Settings rateLimit;
+            rateLimit.requestsPerMinute = chad::Config::getInstance().getInt("security.rate_limit.max_requests_per_minute", 60);
+            rateLimit.banThreshold = chad::Config::getInstance().getInt("security.rate_limit.ip_ban_threshold", 100);
+            rateLimit.banTime = std::chrono::minutes(chad::Config::getInstance().getInt("security.rate_limit.ip_ban_time_minutes", 30));
+            g_server->setRateLimit(rateLimit);
+        }
         g_server->setVideoProcessor(g_videoProcessor);
 
-        setupRoutes(*g_server, g_videoProcessor);
+        auto events = std::make_shared<chad::EventBroadcaster>(g_server->getExecutor(), std::chrono::seconds(15));
+        events->start();
+        g_videoProcessor->setEventListener([events](const chad::ChunkEvent& event) {
+            events->publish(formatChunkEvent(event));
+        });
+
+        setupRoutes(*g_server, g_videoProcessor, events);
+
+        // Started by a hot restart: serve the previous process's listeners
+        chad::HotRestart handoff;
+        g_server->adoptListeners(handoff.inheritListeners());
 
         if (!g_server->start()) {
             LOG_ERROR("Failed to start server");
             return 1;
         }
+        handoff.notifyReady();
 
         LOG_INFO("Server started on port " + std::to_string(port));
 
         while (g_server->isRunning()) {
-            std::this_thread::sleep_for(std::chrono::seconds(1));
+            if (g_restartRequested.exchange(false) && hotRestart(executable, args, *events)) {
+                LOG_INFO("Handed over to the new process, exiting");
+                return 0;
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(200));
         }
 
         LOG_INFO("Server stopped normally");
@@ -0,0 +1,537 @@
+#include "../include/av_transcoder.hpp"
+
+#ifdef CHAD_HAVE_LIBAV
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <stdexcept>
+#include <vector>
+#include "../include/logger.hpp"
+
+extern "C" {
+#include <libavcodec/avcodec.h>
+#include <libavformat/avformat.h>
+#include <libavutil/avutil.h>
+#include <libswscale/swscale.h>
+}
+
+namespace chad {
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+// Same cadence as ffmpeg -progress
+constexpr std::chrono::milliseconds PROGRESS_INTERVAL(500);
+
+struct InputCloser {
+    void operator()(AVFormatContext* context) const {
+        avformat_close_input(&context);
+    }
+};
+
+struct OutputCloser {
+    void operator()(AVFormatContext* context) const {
+        if (context->pb && !(context->oformat->flags & AVFMT_NOFILE)) {
+            avio_closep(&context->pb);
+        }
+        avformat_free_context(context);
+    }
+};
+
+struct CodecCloser {
+    void operator()(AVCodecContext* context) const {
+        avcodec_free_context(&context);
+    }
+};
+
+struct FrameFreer {
+    void operator()(AVFrame* frame) const {
+        av_frame_free(&frame);
+    }
+};
+
+struct PacketFreer {
+    void operator()(AVPacket* packet) const {
+        av_packet_free(&packet);
+    }
+};
+
+struct ScalerFreer {
+    void operator()(SwsContext* scaler) const {
+        sws_freeContext(scaler);
+    }
+};
+
+using InputPtr = std::unique_ptr<AVFormatContext, InputCloser>;
+using OutputPtr = std::unique_ptr<AVFormatContext, OutputCloser>;
+using CodecPtr = std::unique_ptr<AVCodecContext, CodecCloser>;
+using FramePtr = std::unique_ptr<AVFrame, FrameFreer>;
+using PacketPtr = std::unique_ptr<AVPacket, PacketFreer>;
+using ScalerPtr = std::unique_ptr<SwsContext, ScalerFreer>;
+
+void check(int result, const std::string& what) {
+    if (result < 0) {
+        char text[AV_ERROR_MAX_STRING_SIZE] = {};
+        av_strerror(result, text, sizeof(text));
+        throw std::runtime_error(what + ": " + text);
+    }
+}
+
+FramePtr allocateFrame() {
+    FramePtr frame(av_frame_alloc());
+    if (!frame) {
+        throw std::bad_alloc();
+    }
+    return frame;
+}
+
+PacketPtr allocatePacket() {
+    PacketPtr packet(av_packet_alloc());
+    if (!packet) {
+        throw std::bad_alloc();
+    }
+    return packet;
+}
+
+InputPtr openInput(const std::string& path) {
+    // libav* would otherwise write its own diagnostics to stderr
+    static std::once_flag quiet;
+    std::call_once(quiet, [] { av_log_set_level(AV_LOG_ERROR); });
+
+    AVFormatContext* context = nullptr;
+    check(avformat_open_input(&context, path.c_str(), nullptr, nullptr), "Cannot open " + path);
+    InputPtr input(context);
+
+    check(avformat_find_stream_info(input.get(), nullptr), "Cannot read the streams of " + path);
+    return input;
+}
+
+// What a cached context was opened for; a transcode with equal parameters reuses it
+struct DecoderKey {
+    AVCodecID codec = AV_CODEC_ID_NONE;
+    int width = 0;
+    int height = 0;
+    int format = -1;
+    std::vector<uint8_t> extradata;   // e.g. the SPS and PPS of H.264 in MP4
+
+    bool operator==(const DecoderKey& other) const {
+        return codec == other.codec && width == other.width && height == other.height &&
+               format == other.format && extradata == other.extradata;
+    }
+};
+
+struct EncoderKey {
+    std::string codec;
+    int width = 0;
+    int height = 0;
+    AVPixelFormat format = AV_PIX_FMT_NONE;
+    AVRational timeBase{0, 1};
+    int64_t bitRate = 0;
+    bool globalHeader = false;
+
+    bool operator==(const EncoderKey& other) const {
+        return codec == other.codec && width == other.width && height == other.height &&
+               format == other.format && av_cmp_q(timeBase, other.timeBase) == 0 &&
+               bitRate == other.bitRate && globalHeader == other.globalHeader;
+    }
+};
+
+// Contexts of the last transcode on this thread; codec contexts are not thread-safe
+struct ContextCache {
+    CodecPtr decoder;
+    DecoderKey decoderKey;
+    CodecPtr encoder;
+    EncoderKey encoderKey;
+    ScalerPtr scaler;
+};
+
+thread_local ContextCache cache;
+
+AVCodecContext* acquireDecoder(const AVStream* stream) {
+    const AVCodecParameters* parameters = stream->codecpar;
+
+    DecoderKey key;
+    key.codec = parameters->codec_id;
+    key.width = parameters->width;
+    key.height = parameters->height;
+    key.format = parameters->format;
+    if (parameters->extradata) {
+        key.extradata.assign(parameters->extradata, parameters->extradata + parameters->extradata_size);
+    }
+
+    if (cache.decoder && cache.decoderKey == key) {
+        avcodec_flush_buffers(cache.decoder.get());
+    } else {
+        cache.decoder.reset();
+
+        const AVCodec* codec = avcodec_find_decoder(parameters->codec_id);
+        if (!codec) {
+            throw std::runtime_error("No decoder for " + std::string(avcodec_get_name(parameters->codec_id)));
+        }
+
+        CodecPtr decoder(avcodec_alloc_context3(codec));
+        if (!decoder) {
+            throw std::bad_alloc();
+        }
+        check(avcodec_parameters_to_context(decoder.get(), parameters), "Cannot set up the decoder");
+        decoder->thread_count = 0;
+        check(avcodec_open2(decoder.get(), codec, nullptr), "Cannot open the decoder");
+
+        cache.decoder = std::move(decoder);
+        cache.decoderKey = std::move(key);
+    }
+
+    cache.decoder->pkt_timebase = stream->time_base;
+    return cache.decoder.get();
+}
+
+AVCodecContext* acquireEncoder(const AVCodec* codec, EncoderKey key) {
+    // An encoder that has been drained can only be used again if it supports flushing
+    bool reusable = false;
+#ifdef AV_CODEC_CAP_ENCODER_FLUSH
+    reusable = codec->capabilities & AV_CODEC_CAP_ENCODER_FLUSH;
+#endif
+    if (reusable && cache.encoder && cache.encoderKey == key) {
+        avcodec_flush_buffers(cache.encoder.get());
+        return cache.encoder.get();
+    }
+    cache.encoder.reset();
+
+    CodecPtr encoder(avcodec_alloc_context3(codec));
+    if (!encoder) {
+        throw std::bad_alloc();
+    }
+    encoder->width = key.width;
+    encoder->height = key.height;
+    encoder->pix_fmt = key.format;
+    encoder->time_base = key.timeBase;
+    encoder->framerate = av_inv_q(key.timeBase);
+    encoder->thread_count = 0;
+    if (key.bitRate > 0) {
+        encoder->bit_rate = key.bitRate;
+    }
+    if (key.globalHeader) {
+        encoder->flags |= AV_CODEC_FLAG_GLOBAL_HEADER;
+    }
+    check(avcodec_open2(encoder.get(), codec, nullptr), "Cannot open encoder " + key.codec);
+
+    cache.encoder = std::move(encoder);
+    cache.encoderKey = std::move(key);
+    return cache.encoder.get();
+}
+
+// sws_getCachedContext() keeps the scaler when the geometry has not changed
+SwsContext* acquireScaler(const AVFrame* source, const AVCodecContext* target) {
+    SwsContext* scaler = sws_getCachedContext(cache.scaler.release(),
+                                              source->width, source->height, static_cast<AVPixelFormat>(source->format),
+                                              target->width, target->height, target->pix_fmt,
+                                              SWS_BICUBIC, nullptr, nullptr, nullptr);
+    if (!scaler) {
+        throw std::runtime_error("Cannot convert " + std::to_string(source->width) + "x" +
+                                 std::to_string(source->height) + " frames for the encoder");
+    }
+    cache.scaler.reset(scaler);
+    return scaler;
+}
+
+/**
+ * @class Transcode
+ * @brief One input file to one output file, video re-encoded and audio copied
+ */
+class Transcode {
+public:
+    Transcode(const std::string& inputPath, const std::string& outputPath, const AvTranscoder::Options& options,
+              const AvTranscoder::ProgressCallback& onProgress)
+        : inputPath_(inputPath),
+          outputPath_(outputPath),
+          options_(options),
+          onProgress_(onProgress),
+          decoded_(allocateFrame()),
+          scaled_(allocateFrame()),
+          packet_(allocatePacket()),
+          encoded_(allocatePacket()) {}
+
+    void run() {
+        started_ = Clock::now();
+        lastReport_ = started_;
+
+        openStreams();
+
+        while (true) {
+            int result = av_read_frame(input_.get(), packet_.get());
+            if (result == AVERROR_EOF) {
+                break;
+            }
+            check(result, "Cannot read " + inputPath_);
+
+            if (packet_->stream_index == videoIn_->index) {
+                decode(packet_.get());
+            } else if (audioIn_ && packet_->stream_index == audioIn_->index) {
+                copyAudio(packet_.get());
+            }
+            av_packet_unref(packet_.get());
+        }
+
+        decode(nullptr);
+        encode(nullptr);
+        check(av_write_trailer(output_.get()), "Cannot finish " + outputPath_);
+
+        report(true);
+    }
+
+private:
+    void openStreams() {
+        input_ = openInput(inputPath_);
+
+        int videoIndex = av_find_best_stream(input_.get(), AVMEDIA_TYPE_VIDEO, -1, -1, nullptr, 0);
+        check(videoIndex, "No video stream in " + inputPath_);
+        videoIn_ = input_->streams[videoIndex];
+        decoder_ = acquireDecoder(videoIn_);
+
+        // Like ffmpeg, the output starts at zero whatever the input's first timestamp
+        if (input_->start_time != AV_NOPTS_VALUE) {
+            startTime_ = input_->start_time;
+        }
+
+        AVFormatContext* output = nullptr;
+        check(avformat_alloc_output_context2(&output, nullptr, nullptr, outputPath_.c_str()),
+              "Cannot create " + outputPath_);
+        output_.reset(output);
+
+        const AVCodec* codec = avcodec_find_encoder_by_name(options_.codec.c_str());
+        if (!codec || codec->type != AVMEDIA_TYPE_VIDEO) {
+            throw std::runtime_error("Unknown video encoder " + options_.codec);
+        }
+
+        AVRational frameRate = av_guess_frame_rate(input_.get(), videoIn_, nullptr);
+        if (frameRate.num <= 0 || frameRate.den <= 0) {
+            frameRate = AVRational{25, 1};
+        }
+
+        EncoderKey key;
+        key.codec = options_.codec;
+        key.width = options_.width > 0 ? options_.width : decoder_->width;
+        key.height = options_.height > 0 ? options_.height : decoder_->height;
+        key.format = codec->pix_fmts ? avcodec_find_best_pix_fmt_of_list(codec->pix_fmts, decoder_->pix_fmt, 0, nullptr)
+                                     : decoder_->pix_fmt;
+        key.timeBase = av_inv_q(frameRate);
+        key.bitRate = options_.bitRate;
+        key.globalHeader = output_->oformat->flags & AVFMT_GLOBALHEADER;
+        encoder_ = acquireEncoder(codec, std::move(key));
+
+        videoOut_ = avformat_new_stream(output_.get(), nullptr);
+        if (!videoOut_) {
+            throw std::bad_alloc();
+        }
+        check(avcodec_parameters_from_context(videoOut_->codecpar, encoder_), "Cannot describe the video stream");
+        videoOut_->time_base = encoder_->time_base;
+        videoOut_->avg_frame_rate = frameRate;
+
+        int audioIndex = av_find_best_stream(input_.get(), AVMEDIA_TYPE_AUDIO, -1, videoIndex, nullptr, 0);
+        if (audioIndex >= 0) {
+            AVStream* audio = input_->streams[audioIndex];
+            if (avformat_query_codec(output_->oformat, audio->codecpar->codec_id, FF_COMPLIANCE_NORMAL) == 1) {
+                audioIn_ = audio;
+                audioOut_ = avformat_new_stream(output_.get(), nullptr);
+                if (!audioOut_) {
+                    throw std::bad_alloc();
+                }
+                check(avcodec_parameters_copy(audioOut_->codecpar, audio->codecpar), "Cannot describe the audio stream");
+                audioOut_->codecpar->codec_tag = 0;
+                audioOut_->time_base = audio->time_base;
+            } else {
+                LOG_WARNING("Dropping " + std::string(avcodec_get_name(audio->codecpar->codec_id)) +
+                            " audio, which " + outputPath_ + " cannot hold");
+            }
+        }
+
+        if (!(output_->oformat->flags & AVFMT_NOFILE)) {
+            check(avio_open(&output_->pb, outputPath_.c_str(), AVIO_FLAG_WRITE), "Cannot write " + outputPath_);
+        }
+        check(avformat_write_header(output_.get(), nullptr), "Cannot write the header of " + outputPath_);
+    }
+
+    // nullptr drains the decoder
+    void decode(const AVPacket* packet) {
+        check(avcodec_send_packet(decoder_, packet), "Cannot decode " + inputPath_);
+
+        while (true) {
+            int result = avcodec_receive_frame(decoder_, decoded_.get());
+            if (result == AVERROR(EAGAIN) || result == AVERROR_EOF) {
+                return;
+            }
+            check(result, "Cannot decode " + inputPath_);
+
+            AVFrame* frame = convert(decoded_.get());
+
+            // Encoders need strictly increasing timestamps in their own time base
+            int64_t pts = decoded_->best_effort_timestamp;
+            if (pts == AV_NOPTS_VALUE) {
+                pts = lastPts_ + 1;
+            } else {
+                pts = av_rescale_q(pts - av_rescale_q(startTime_, AV_TIME_BASE_Q, videoIn_->time_base),
+                                   videoIn_->time_base, encoder_->time_base);
+            }
+            pts = std::max(pts, lastPts_ + 1);
+            lastPts_ = pts;
+
+            frame->pts = pts;
+            frame->pict_type = AV_PICTURE_TYPE_NONE;
+            encode(frame);
+
+            av_frame_unref(decoded_.get());
+            report(false);
+        }
+    }
+
+    // The frame itself if the encoder takes it as it is, else a scaled copy
+    AVFrame* convert(AVFrame* frame) {
+        if (frame->width == encoder_->width && frame->height == encoder_->height && frame->format == encoder_->pix_fmt) {
+            return frame;
+        }
+
+        SwsContext* scaler = acquireScaler(frame, encoder_);
+
+        if (!scaled_->data[0]) {
+            scaled_->width = encoder_->width;
+            scaled_->height = encoder_->height;
+            scaled_->format = encoder_->pix_fmt;
+            check(av_frame_get_buffer(scaled_.get(), 0), "Cannot allocate a frame");
+        }
+
+        // The encoder may still hold the previous frame; that one gets new buffers
+        check(av_frame_make_writable(scaled_.get()), "Cannot allocate a frame");
+        sws_scale(scaler, frame->data, frame->linesize, 0, frame->height, scaled_->data, scaled_->linesize);
+        check(av_frame_copy_props(scaled_.get(), frame), "Cannot copy frame properties");
+        return scaled_.get();
+    }
+
+    // nullptr drains the encoder
+    void encode(AVFrame* frame) {
+        check(avcodec_send_frame(encoder_, frame), "Cannot encode " + outputPath_);
+
+        while (true) {
+            int result = avcodec_receive_packet(encoder_, encoded_.get());
+            if (result == AVERROR(EAGAIN) || result == AVERROR_EOF) {
+                return;
+            }
+            check(result, "Cannot encode " + outputPath_);
+
+            encoded_->stream_index = videoOut_->index;
+            av_packet_rescale_ts(encoded_.get(), encoder_->time_base, videoOut_->time_base);
+            if (encoded_->pts != AV_NOPTS_VALUE) {
+                outTime_ = std::max(outTime_, encoded_->pts * av_q2d(videoOut_->time_base));
+            }
+            ++frames_;
+
+            // Takes the packet's data and leaves it blank
+            check(av_interleaved_write_frame(output_.get(), encoded_.get()), "Cannot write " + outputPath_);
+        }
+    }
+
+    void copyAudio(AVPacket* packet) {
+        int64_t offset = av_rescale_q(startTime_, AV_TIME_BASE_Q, audioIn_->time_base);
+        if (packet->pts != AV_NOPTS_VALUE) {
+            packet->pts -= offset;
+        }
+        if (packet->dts != AV_NOPTS_VALUE) {
+            packet->dts -= offset;
+        }
+
+        av_packet_rescale_ts(packet, audioIn_->time_base, audioOut_->time_base);
+        packet->stream_index = audioOut_->index;
+        packet->pos = -1;
+        check(av_interleaved_write_frame(output_.get(), packet), "Cannot write " + outputPath_);
+    }
+
+    // Calls back at most every PROGRESS_INTERVAL, and at the end; throws if the callback cancels
+    void report(bool last) {
+        Clock::time_point now = Clock::now();
+        if (!onProgress_ || (!last && now - lastReport_ < PROGRESS_INTERVAL)) {
+            return;
+        }
+        lastReport_ = now;
+
+        AvTranscoder::Progress progress;
+        progress.frame = frames_;
+        double elapsed = std::chrono::duration<double>(now - started_).count();
+        progress.fps = elapsed > 0 ? frames_ / elapsed : 0.0;
+        progress.outTime = outTime_;
+
+        if (!onProgress_(progress) && !last) {
+            throw std::runtime_error("Transcode cancelled");
+        }
+    }
+
+private:
+    const std::string& inputPath_;
+    const std::string& outputPath_;
+    const AvTranscoder::Options& options_;
+    const AvTranscoder::ProgressCallback& onProgress_;
+
+    InputPtr input_;
+    OutputPtr output_;
+    AVStream* videoIn_ = nullptr;
+    AVStream* audioIn_ = nullptr;
+    AVStream* videoOut_ = nullptr;
+    AVStream* audioOut_ = nullptr;
+
+    // Owned by the thread's cache
+    AVCodecContext* decoder_ = nullptr;
+    AVCodecContext* encoder_ = nullptr;
+
+    FramePtr decoded_;
+    FramePtr scaled_;
+    PacketPtr packet_;
+    PacketPtr encoded_;
+
+    int64_t startTime_ = 0;   // AV_TIME_BASE units
+    int64_t lastPts_ = -1;
+    int64_t frames_ = 0;
+    double outTime_ = 0.0;
+    Clock::time_point started_;
+    Clock::time_point lastReport_;
+};
+
+} // namespace
+
+AvTranscoder::MediaInfo AvTranscoder::probe(const std::string& path) {
+    InputPtr input = openInput(path);
+
+    int index = av_find_best_stream(input.get(), AVMEDIA_TYPE_VIDEO, -1, -1, nullptr, 0);
+    check(index, "No video stream in " + path);
+    const AVStream* stream = input->streams[index];
+
+    MediaInfo info;
+    info.width = stream->codecpar->width;
+    info.height = stream->codecpar->height;
+    info.codec = avcodec_get_name(stream->codecpar->codec_id);
+    if (stream->duration != AV_NOPTS_VALUE) {
+        info.duration = stream->duration * av_q2d(stream->time_base);
+    } else if (input->duration != AV_NOPTS_VALUE) {
+        info.duration = static_cast<double>(input->duration) / AV_TIME_BASE;
+    }
+    return info;
+}
+
+void AvTranscoder::transcode(const std::string& inputPath, const std::string& outputPath, const Options& options,
+                             const ProgressCallback& onProgress) {
+    try {
+        Transcode(inputPath, outputPath, options, onProgress).run();
+    } catch (...) {
+        // Contexts abandoned halfway through a stream are not trusted with the next one
+        cache.decoder.reset();
+        cache.encoder.reset();
+        std::remove(outputPath.c_str());
+        throw;
+    }
+}
+
+} // namespace chad
+
+#endif // CHAD_HAVE_LIBAV
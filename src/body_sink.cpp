@@ -0,0 +1,180 @@
+#include "../include/body_sink.hpp"
+#include "../include/logger.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace chad {
+
+namespace {
+
+constexpr size_t SPLICE_CHUNK_SIZE = 64 * 1024;
+
+bool writeAll(int fd, const char* data, size_t size) {
+    while (size > 0) {
+        ssize_t n = ::write(fd, data, size);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        data += n;
+        size -= static_cast<size_t>(n);
+    }
+    return true;
+}
+
+} // namespace
+
+ssize_t BodySink::spliceFrom(int, size_t) {
+    errno = ENOTSUP;
+    return -1;
+}
+
+FileBodySink::FileBodySink(const std::string& path) : path_(path) {
+    fd_ = ::open(path_.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd_ < 0) {
+        LOG_ERROR("Failed to open upload file " + path_ + ": " + std::strerror(errno));
+    }
+#ifdef CHAD_HAVE_IO_URING
+    else {
+        uring_ = UringFile::create(fd_);
+    }
+#endif
+}
+
+FileBodySink::~FileBodySink() {
+#ifdef CHAD_HAVE_IO_URING
+    // Drain writes still in flight before their descriptor goes away
+    uring_.reset();
+#endif
+
+    for (int fd : pipe_) {
+        if (fd >= 0) {
+            ::close(fd);
+        }
+    }
+
+    if (fd_ >= 0) {
+        ::close(fd_);
+    }
+
+    if (!keep_ && !path_.empty()) {
+        ::unlink(path_.c_str());
+    }
+}
+
+bool FileBodySink::write(const char* data, size_t size) {
+#ifdef CHAD_HAVE_IO_URING
+    if (uring_) {
+        if (fd_ < 0 || !uring_->write(data, size)) {
+            return false;
+        }
+        bytesWritten_ += size;
+        return true;
+    }
+#endif
+
+    if (fd_ < 0 || !writeAll(fd_, data, size)) {
+        return false;
+    }
+    bytesWritten_ += size;
+    return true;
+}
+
+bool FileBodySink::finish() {
+    if (fd_ < 0) {
+        return false;
+    }
+
+    bool flushed = true;
+#ifdef CHAD_HAVE_IO_URING
+    if (uring_) {
+        flushed = uring_->finish();
+        uring_.reset();
+    }
+#endif
+
+    int result = ::close(fd_);
+    fd_ = -1;
+    return flushed && result == 0;
+}
+
+ssize_t FileBodySink::spliceFrom(int socketFd, size_t maxBytes) {
+#ifdef __linux__
+    if (fd_ < 0) {
+        errno = EBADF;
+        return -1;
+    }
+
+    if (!spliceSupported_) {
+        errno = ENOTSUP;
+        return -1;
+    }
+
+#ifdef CHAD_HAVE_IO_URING
+    // Bytes go through write() so they join the batched io_uring writes
+    if (uring_) {
+        errno = ENOTSUP;
+        return -1;
+    }
+#endif
+
+    if (pipe_[0] < 0 && ::pipe2(pipe_, O_CLOEXEC | O_NONBLOCK) != 0) {
+        return -1;
+    }
+
+    // socket -> pipe moves page references, not bytes
+    ssize_t received = ::splice(socketFd, nullptr, pipe_[1], nullptr,
+                                std::min(maxBytes, SPLICE_CHUNK_SIZE), SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+    if (received <= 0) {
+        return received;
+    }
+
+    // pipe -> file; drain completely so the pipe is empty between calls
+    size_t pending = static_cast<size_t>(received);
+    while (pending > 0) {
+        ssize_t moved = ::splice(pipe_[0], nullptr, fd_, nullptr, pending, SPLICE_F_MOVE);
+        if (moved > 0) {
+            pending -= static_cast<size_t>(moved);
+            continue;
+        }
+        if (moved < 0 && errno == EINTR) {
+            continue;
+        }
+
+        // The target filesystem cannot splice; copy what is in the pipe and
+        // make the caller fall back to write()
+        char buffer[8192];
+        while (pending > 0) {
+            ssize_t n = ::read(pipe_[0], buffer, std::min(pending, sizeof(buffer)));
+            if (n <= 0 || !writeAll(fd_, buffer, static_cast<size_t>(n))) {
+                errno = EIO;
+                return -1;
+            }
+            pending -= static_cast<size_t>(n);
+        }
+        bytesWritten_ += static_cast<size_t>(received);
+        LOG_DEBUG("splice() to " + path_ + " unsupported, falling back to write()");
+        ::close(pipe_[0]);
+        ::close(pipe_[1]);
+        pipe_[0] = pipe_[1] = -1;
+        spliceSupported_ = false;
+        return received;
+    }
+
+    bytesWritten_ += static_cast<size_t>(received);
+    return received;
+#else
+    (void)socketFd;
+    (void)maxBytes;
+    errno = ENOTSUP;
+    return -1;
+#endif
+}
+
+} // namespace chad
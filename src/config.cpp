@@ -1,4 +1,4 @@
-#include \"../include/config.hpp\"
+#include "../include/config.hpp"
 
 #include <fstream>
 #include <iostream>
@@ -13,41 +13,79 @@ namespace chad {
     bool Config::loadFromFile(const std::string& configPath) {
         std::ifstream configFile(configPath);
         if (!configFile.is_open()) {
-            std::cerr << \"[Config Error] Could not open config file: \" << configPath << std::endl;
+            std::cerr << "[Config Error] Could not open config file: " << configPath << std::endl;
             return false;
         }
 
         try {
+            std::lock_guard<std::mutex> lock(configMutex_);
             configFile >> config_;
             return true;
         } catch (const nlohmann::json::exception& e) {
-            std::cerr << \"[Config Error] Failed to parse config JSON: \" << e.what() << std::endl;
+            std::cerr << "[Config Error] Failed to parse config JSON: " << e.what() << std::endl;
             return false;
         }
     }
 
+    const nlohmann::json* Config::lookup(const std::string& key) const {
+        // Values stored with setValue() live under their literal key
+        auto flat = config_.find(key);
+        if (flat != config_.end()) {
+            return &*flat;
+        }
+
+        // Otherwise treat the key as a dotted path into nested sections,
+        // e.g. "server.worker_threads"
+        const nlohmann::json* node = &config_;
+        size_t start = 0;
+        while (start <= key.size()) {
+            size_t dot = key.find('.', start);
+            std::string part = key.substr(start, dot == std::string::npos ? std::string::npos : dot - start);
+
+            if (!node->is_object()) {
+                return nullptr;
+            }
+
+            auto it = node->find(part);
+            if (it == node->end()) {
+                return nullptr;
+            }
+
+            node = &*it;
+            if (dot == std::string::npos) {
+                return node;
+            }
+            start = dot + 1;
+        }
+
+        return nullptr;
+    }
+
     std::string Config::getString(const std::string& key, const std::string& defaultValue) const {
         std::lock_guard<std::mutex> lock(configMutex_);
-        if (config_.contains(key) && config_[key].is_string()) {
-            return config_[key].get<std::string>();
+        const nlohmann::json* value = lookup(key);
+        if (value && value->is_string()) {
+            return value->get<std::string>();
         }
         return defaultValue;
     }
 
     int Config::getInt(const std::string& key, int defaultValue) const {
         std::lock_guard<std::mutex> lock(configMutex_);
-        if (config_.contains(key) && config_[key].is_number()) {
-            return config_[key].get<int>();
+        const nlohmann::json* value = lookup(key);
+        if (value && value->is_number()) {
+            return value->get<int>();
         }
         return defaultValue;
     }
 
     bool Config::getBool(const std::string& key, bool defaultValue) const {
         std::lock_guard<std::mutex> lock(configMutex_);
-        if (config_.contains(key) && config_[key].is_boolean()) {
-            return config_[key].get<bool>();
+        const nlohmann::json* value = lookup(key);
+        if (value && value->is_boolean()) {
+            return value->get<bool>();
         }
         return defaultValue;
     }
 
-} // namespace chad
\ No newline at end of file
+} // namespace chad
@@ -0,0 +1,221 @@
+#include "../include/cost_scheduler.hpp"
+#include "../include/logger.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+#include <utility>
+
+namespace chad {
+
+namespace {
+
+// Weight of the latest finished job in the correction factor
+constexpr double CORRECTION_SMOOTHING = 0.2;
+
+// A single odd job must not swing the estimates by more than this
+constexpr double MIN_RATIO = 0.05;
+constexpr double MAX_RATIO = 20.0;
+
+} // namespace
+
+CostScheduler::CostScheduler(ThreadPool& pool, double agingRate, double quantum)
+    : pool_(pool),
+      epoch_(Clock::now()),
+      quantum_(quantum > 0 ? quantum : 1.0),
+      agingRate_(std::max(0.0, agingRate)),
+      queuedCost_(0),
+      nextTicket_(0),
+      correction_(1.0),
+      closed_(false) {}
+
+void CostScheduler::submit(double cost, const TaskClass& taskClass, InlineTask job) {
+    cost = std::max(0.0, cost);
+    bool queued = false;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!closed_) {
+            double waitedFrom = std::chrono::duration<double>(Clock::now() - epoch_).count();
+            Tenant& tenant = tenants_[taskClass.tenant];
+            if (tenant.jobs.empty()) {
+                tenant.name = taskClass.tenant;
+                ring_.push_back(&tenant);
+            }
+            tenant.jobs.emplace(cost + agingRate_ * waitedFrom, Job{cost, taskClass, std::move(job)});
+            queuedCost_ += cost;
+            queued = true;
+        }
+    }
+
+    // A dropped job is destroyed on return, out of the lock: it may settle a
+    // promise whose continuations submit again
+    if (queued) {
+        dispatch();
+    }
+}
+
+void CostScheduler::setAgingRate(double agingRate) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    agingRate_ = std::max(0.0, agingRate);
+}
+
+void CostScheduler::setTenantWeight(const std::string& tenant, uint32_t weight) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (weight <= 1) {
+        weights_.erase(tenant);
+    } else {
+        weights_[tenant] = weight;
+    }
+}
+
+double CostScheduler::backlogSeconds() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    Clock::time_point now = Clock::now();
+    double total = queuedCost_ * correction_;
+    for (const auto& entry : running_) {
+        const Running& job = entry.second;
+        double estimate = job.cost * correction_;
+        if (job.started != Clock::time_point()) {
+            estimate -= std::chrono::duration<double>(now - job.started).count();
+        }
+        total += std::max(0.0, estimate);
+    }
+    return total / parallelism();
+}
+
+void CostScheduler::close() {
+    std::unordered_map<std::string, Tenant> dropped;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        closed_ = true;
+        ring_.clear();
+        dropped.swap(tenants_);
+        queuedCost_ = 0;
+    }
+}
+
+void CostScheduler::dispatch() {
+    while (true) {
+        uint64_t ticket;
+        Job job;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+
+            // One job beyond what can run waits in the pool, so its queue
+            // wait still tells the autoscaler that more workers would help
+            if (closed_ || ring_.empty() || running_.size() > parallelism()) {
+                return;
+            }
+
+            Tenant& tenant = nextTenant();
+            job = std::move(tenant.jobs.begin()->second);
+            tenant.jobs.erase(tenant.jobs.begin());
+            tenant.deficit -= job.cost;
+            if (tenant.jobs.empty()) {
+                // Idle tenants keep no credit and no table entry
+                ring_.pop_front();
+                std::string name = std::move(tenant.name);
+                tenants_.erase(name);
+            }
+            queuedCost_ = ring_.empty() ? 0 : queuedCost_ - job.cost;
+
+            ticket = nextTicket_++;
+            running_.emplace(ticket, Running{job.cost, Clock::time_point()});
+        }
+
+        // Tenants have had their turns here; as a single flow the pool runs
+        // jobs in the order they are handed over instead of taking turns again
+        job.taskClass.tenant.clear();
+
+        try {
+            pool_.post(job.taskClass, [this, ticket, work = std::move(job.work)]() mutable {
+                start(ticket);
+                try {
+                    work();
+                } catch (const std::exception& e) {
+                    LOG_ERROR("Scheduled job failed: " + std::string(e.what()));
+                } catch (...) {
+                    LOG_ERROR("Scheduled job failed");
+                }
+                finish(ticket);
+            });
+        } catch (const std::runtime_error&) {
+            // The pool is stopping; the job goes with it
+            std::lock_guard<std::mutex> lock(mutex_);
+            running_.erase(ticket);
+            return;
+        }
+    }
+}
+
+CostScheduler::Tenant& CostScheduler::nextTenant() {
+    while (true) {
+        for (size_t turns = ring_.size(); turns > 0; --turns) {
+            Tenant* tenant = ring_.front();
+            if (!tenant->inTurn) {
+                tenant->deficit += quantum_ * weightOf(tenant->name);
+                tenant->inTurn = true;
+            }
+            if (tenant->deficit >= tenant->jobs.begin()->second.cost) {
+                return *tenant;
+            }
+            tenant->inTurn = false;
+            ring_.pop_front();
+            ring_.push_back(tenant);
+        }
+
+        // Nobody could afford its next job: rather than go round once per
+        // missing quantum, credit everyone all but one of the rounds the
+        // nearest tenant still needs
+        double rounds = std::numeric_limits<double>::infinity();
+        for (const Tenant* tenant : ring_) {
+            double missing = tenant->jobs.begin()->second.cost - tenant->deficit;
+            rounds = std::min(rounds, std::ceil(missing / (quantum_ * weightOf(tenant->name))));
+        }
+        for (Tenant* tenant : ring_) {
+            tenant->deficit += std::max(0.0, rounds - 1) * quantum_ * weightOf(tenant->name);
+        }
+    }
+}
+
+double CostScheduler::weightOf(const std::string& tenant) const {
+    auto it = weights_.find(tenant);
+    return it == weights_.end() ? 1 : it->second;
+}
+
+void CostScheduler::start(uint64_t ticket) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = running_.find(ticket);
+    if (it != running_.end()) {
+        it->second.started = Clock::now();
+    }
+}
+
+void CostScheduler::finish(uint64_t ticket) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = running_.find(ticket);
+        if (it == running_.end()) {
+            return;
+        }
+
+        const Running& job = it->second;
+        if (job.cost > 0 && job.started != Clock::time_point()) {
+            double took = std::chrono::duration<double>(Clock::now() - job.started).count();
+            double ratio = std::clamp(took / job.cost, MIN_RATIO, MAX_RATIO);
+            correction_ += CORRECTION_SMOOTHING * (ratio - correction_);
+        }
+        running_.erase(it);
+    }
+    dispatch();
+}
+
+size_t CostScheduler::parallelism() const {
+    // As many as the pool lets LOW tasks occupy
+    size_t threads = pool_.getThreadCount();
+    return threads > 1 ? threads - 1 : 1;
+}
+
+} // namespace chad
@@ -0,0 +1,263 @@
+#include "../include/cpu_affinity.hpp"
+#include "../include/logger.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <cerrno>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <stdexcept>
+#include <thread>
+#include <utility>
+#include <sched.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace fs = std::filesystem;
+
+namespace chad {
+
+namespace {
+
+// From <linux/mempolicy.h>, which is not guaranteed to be installed
+constexpr int MPOL_PREFERRED_MODE = 1;
+constexpr int MAX_NODES = 1024;
+
+std::string readLine(const fs::path& path) {
+    std::ifstream file(path);
+    std::string line;
+    std::getline(file, line);
+    return line;
+}
+
+int readInt(const fs::path& path, int fallback) {
+    try {
+        return std::stoi(readLine(path));
+    } catch (const std::exception&) {
+        return fallback;
+    }
+}
+
+CpuSet usableCpus() {
+    CpuSet result;
+
+    cpu_set_t allowed;
+    CPU_ZERO(&allowed);
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) == 0) {
+        for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+            if (CPU_ISSET(cpu, &allowed)) {
+                result.push_back(cpu);
+            }
+        }
+    }
+
+    if (result.empty()) {
+        for (unsigned cpu = 0; cpu < std::max(1u, std::thread::hardware_concurrency()); ++cpu) {
+            result.push_back(static_cast<int>(cpu));
+        }
+    }
+    return result;
+}
+
+} // namespace
+
+CpuTopology::CpuTopology() : cpus_(usableCpus()) {
+    const fs::path cpuRoot("/sys/devices/system/cpu");
+
+    // Siblings share a package and core id; without topology files every CPU is a core
+    std::map<std::pair<int, int>, int> cores;
+    for (int cpu : cpus_) {
+        fs::path topology = cpuRoot / ("cpu" + std::to_string(cpu)) / "topology";
+        int package = readInt(topology / "physical_package_id", 0);
+        int core = readInt(topology / "core_id", -1 - cpu);
+        cores.emplace(std::make_pair(package, core), cpu);
+    }
+    for (const auto& entry : cores) {
+        physicalCores_.push_back(entry.second);
+    }
+    std::sort(physicalCores_.begin(), physicalCores_.end());
+
+    std::error_code ec;
+    for (const auto& entry : fs::directory_iterator("/sys/devices/system/node", ec)) {
+        std::string name = entry.path().filename().string();
+        if (name.size() <= 4 || name.compare(0, 4, "node") != 0 ||
+            !std::all_of(name.begin() + 4, name.end(), [](unsigned char c) { return std::isdigit(c); })) {
+            continue;
+        }
+
+        Node node{std::stoi(name.substr(4)), {}};
+        try {
+            for (int cpu : parseCpuList(readLine(entry.path() / "cpulist"))) {
+                if (std::binary_search(cpus_.begin(), cpus_.end(), cpu)) {
+                    node.cpus.push_back(cpu);
+                }
+            }
+        } catch (const std::invalid_argument&) {
+            continue;
+        }
+        if (!node.cpus.empty()) {
+            nodes_.push_back(std::move(node));
+        }
+    }
+    std::sort(nodes_.begin(), nodes_.end(), [](const Node& a, const Node& b) { return a.id < b.id; });
+}
+
+const CpuTopology& CpuTopology::getInstance() {
+    static const CpuTopology topology;
+    return topology;
+}
+
+const CpuSet& CpuTopology::cpus() const {
+    return cpus_;
+}
+
+const CpuSet& CpuTopology::physicalCores() const {
+    return physicalCores_;
+}
+
+const std::vector<CpuTopology::Node>& CpuTopology::nodes() const {
+    return nodes_;
+}
+
+CpuSet parseCpuList(const std::string& list) {
+    CpuSet result;
+
+    size_t start = 0;
+    while (start < list.size()) {
+        size_t end = list.find(',', start);
+        if (end == std::string::npos) {
+            end = list.size();
+        }
+        std::string range = list.substr(start, end - start);
+        start = end + 1;
+
+        range.erase(std::remove_if(range.begin(), range.end(), [](unsigned char c) { return std::isspace(c); }),
+                    range.end());
+        if (range.empty()) {
+            continue;
+        }
+
+        size_t dash = range.find('-');
+        int first;
+        int last;
+        try {
+            size_t used = 0;
+            first = std::stoi(range.substr(0, dash), &used);
+            if (used != (dash == std::string::npos ? range.size() : dash)) {
+                throw std::invalid_argument(range);
+            }
+            last = first;
+            if (dash != std::string::npos) {
+                std::string upper = range.substr(dash + 1);
+                last = std::stoi(upper, &used);
+                if (used != upper.size()) {
+                    throw std::invalid_argument(range);
+                }
+            }
+        } catch (const std::exception&) {
+            throw std::invalid_argument("Invalid CPU list: " + list);
+        }
+
+        if (first < 0 || last < first || last >= CPU_SETSIZE) {
+            throw std::invalid_argument("Invalid CPU range in list: " + list);
+        }
+        for (int cpu = first; cpu <= last; ++cpu) {
+            result.push_back(cpu);
+        }
+    }
+
+    std::sort(result.begin(), result.end());
+    result.erase(std::unique(result.begin(), result.end()), result.end());
+    return result;
+}
+
+std::string formatCpuList(const CpuSet& cpus) {
+    std::string result;
+
+    for (size_t i = 0; i < cpus.size();) {
+        size_t j = i;
+        while (j + 1 < cpus.size() && cpus[j + 1] == cpus[j] + 1) {
+            ++j;
+        }
+        if (!result.empty()) {
+            result += ',';
+        }
+        result += std::to_string(cpus[i]);
+        if (j > i) {
+            result += '-' + std::to_string(cpus[j]);
+        }
+        i = j + 1;
+    }
+    return result;
+}
+
+std::vector<CpuSet> cpuSetsFor(const std::string& placement) {
+    const CpuTopology& topology = CpuTopology::getInstance();
+    std::vector<CpuSet> sets;
+
+    if (placement.empty()) {
+        return sets;
+    }
+
+    if (placement == "cores") {
+        for (int cpu : topology.physicalCores()) {
+            sets.push_back({cpu});
+        }
+    } else if (placement == "nodes") {
+        for (const auto& node : topology.nodes()) {
+            sets.push_back(node.cpus);
+        }
+        if (sets.empty()) {
+            sets.push_back(topology.cpus());
+        }
+    } else {
+        for (int cpu : parseCpuList(placement)) {
+            sets.push_back({cpu});
+        }
+        if (sets.empty()) {
+            throw std::invalid_argument("Empty CPU list: " + placement);
+        }
+    }
+    return sets;
+}
+
+bool pinThread(pthread_t thread, const CpuSet& cpus) {
+    cpu_set_t mask;
+    CPU_ZERO(&mask);
+    for (int cpu : cpus) {
+        CPU_SET(cpu, &mask);
+    }
+
+    int result = pthread_setaffinity_np(thread, sizeof(mask), &mask);
+    if (result != 0) {
+        LOG_WARNING("Failed to pin thread to CPUs " + formatCpuList(cpus) + ": " + std::strerror(result));
+        return false;
+    }
+    return true;
+}
+
+bool preferMemoryNode(int node) {
+    constexpr int BITS = 8 * sizeof(unsigned long);
+    if (node < 0 || node >= MAX_NODES) {
+        return false;
+    }
+
+    unsigned long mask[MAX_NODES / BITS] = {};
+    mask[node / BITS] |= 1UL << (node % BITS);
+
+    // The kernel reads maxnode - 1 bits of the mask
+    if (syscall(SYS_set_mempolicy, MPOL_PREFERRED_MODE, mask, MAX_NODES + 1) != 0) {
+        // Typically a kernel without NUMA or a seccomp filter; one warning says it all
+        static std::atomic<bool> warned{false};
+        if (!warned.exchange(true)) {
+            LOG_WARNING("Failed to prefer memory of NUMA node " + std::to_string(node) + ": " + std::strerror(errno));
+        }
+        return false;
+    }
+    return true;
+}
+
+} // namespace chad
@@ -0,0 +1,156 @@
+#include "../include/event_broadcaster.hpp"
+#include "../include/logger.hpp"
+
+#include <algorithm>
+
+namespace chad {
+
+EventBroadcaster::EventBroadcaster(boost::asio::any_io_executor executor, std::chrono::seconds heartbeat)
+    : executor_(std::move(executor)),
+      heartbeat_(heartbeat),
+      head_(&stub_),
+      tail_(&stub_),
+      pumpScheduled_(false),
+      closed_(false),
+      subscriberCount_(0) {}
+
+EventBroadcaster::~EventBroadcaster() {
+    bool stalled = false;
+    while (Node* node = pop(stalled)) {
+        delete node;
+    }
+}
+
+void EventBroadcaster::start() {
+    if (heartbeat_.count() > 0) {
+        armHeartbeat();
+    }
+}
+
+void EventBroadcaster::publish(std::string event) {
+    Node* node = new Node;
+    node->event = std::make_shared<const std::string>(std::move(event));
+    push(node);
+    schedulePump();
+}
+
+void EventBroadcaster::subscribe(std::shared_ptr<HttpStream> stream) {
+    std::lock_guard<std::mutex> lock(pumpMutex_);
+    if (closed_) {
+        stream->close();
+        return;
+    }
+    subscribers_.push_back(std::move(stream));
+    subscriberCount_.store(subscribers_.size(), std::memory_order_relaxed);
+}
+
+size_t EventBroadcaster::subscriberCount() const {
+    return subscriberCount_.load(std::memory_order_relaxed);
+}
+
+void EventBroadcaster::close() {
+    std::lock_guard<std::mutex> lock(pumpMutex_);
+    closed_ = true;
+    for (const auto& stream : subscribers_) {
+        stream->close();
+    }
+    subscribers_.clear();
+    subscriberCount_.store(0, std::memory_order_relaxed);
+}
+
+void EventBroadcaster::push(Node* node) {
+    node->next.store(nullptr, std::memory_order_relaxed);
+    Node* previous = head_.exchange(node, std::memory_order_acq_rel);
+    previous->next.store(node, std::memory_order_release);
+}
+
+EventBroadcaster::Node* EventBroadcaster::pop(bool& stalled) {
+    Node* tail = tail_;
+    Node* next = tail->next.load(std::memory_order_acquire);
+
+    if (tail == &stub_) {
+        if (!next) {
+            return nullptr;
+        }
+        tail_ = next;
+        tail = next;
+        next = next->next.load(std::memory_order_acquire);
+    }
+
+    if (next) {
+        tail_ = next;
+        return tail;
+    }
+
+    if (tail != head_.load(std::memory_order_acquire)) {
+        // A producer has swapped head_ but not linked its node yet
+        stalled = true;
+        return nullptr;
+    }
+
+    // tail is the last node; park the stub behind it so it can be handed out
+    push(&stub_);
+    next = tail->next.load(std::memory_order_acquire);
+    if (next) {
+        tail_ = next;
+        return tail;
+    }
+
+    stalled = true;
+    return nullptr;
+}
+
+void EventBroadcaster::schedulePump() {
+    // One pending pump at a time, however many events are published
+    if (!pumpScheduled_.exchange(true, std::memory_order_acq_rel)) {
+        boost::asio::post(executor_, [self = shared_from_this()]() {
+            self->pump();
+        });
+    }
+}
+
+void EventBroadcaster::pump() {
+    bool stalled = false;
+
+    {
+        std::lock_guard<std::mutex> lock(pumpMutex_);
+
+        // Cleared before draining so events pushed from here on schedule another pump
+        pumpScheduled_.store(false, std::memory_order_release);
+
+        while (Node* node = pop(stalled)) {
+            auto dropped = std::remove_if(subscribers_.begin(), subscribers_.end(),
+                [&node](const std::shared_ptr<HttpStream>& stream) {
+                    return !stream->write(node->event);
+                });
+            subscribers_.erase(dropped, subscribers_.end());
+            delete node;
+        }
+
+        subscriberCount_.store(subscribers_.size(), std::memory_order_relaxed);
+    }
+
+    if (stalled) {
+        schedulePump();
+    }
+}
+
+void EventBroadcaster::armHeartbeat() {
+    auto timer = std::make_shared<boost::asio::steady_timer>(executor_, heartbeat_);
+    std::weak_ptr<EventBroadcaster> weak = shared_from_this();
+
+    timer->async_wait([weak, timer](const boost::system::error_code& error) {
+        auto self = weak.lock();
+        if (error || !self) {
+            return;
+        }
+
+        // An SSE comment line: ignored by clients, but it flushes out dead ones
+        if (self->subscriberCount() > 0) {
+            self->publish(": heartbeat\n\n");
+        }
+        self->armHeartbeat();
+    });
+}
+
+} // namespace chad
@@ -0,0 +1,234 @@
+#include "../include/hot_restart.hpp"
+#include "../include/logger.hpp"
+
+#include <cerrno>
+#include <csignal>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+extern char** environ;
+
+namespace chad {
+
+namespace {
+
+// Names the descriptor of the channel in the successor's environment
+constexpr const char* HANDOFF_ENV = "CHAD_HANDOFF_FD";
+
+// The successor always finds its end of the channel here
+constexpr int HANDOFF_FD = 3;
+
+// More than any shard count worth configuring
+constexpr size_t MAX_LISTENERS = 64;
+
+constexpr char READY = 'R';
+
+} // namespace
+
+HotRestart::HotRestart() : channel_(-1) {}
+
+HotRestart::~HotRestart() {
+    if (channel_ >= 0) {
+        ::close(channel_);
+    }
+}
+
+std::vector<int> HotRestart::inheritListeners() {
+    std::vector<int> listeners;
+
+    const char* handoff = std::getenv(HANDOFF_ENV);
+    if (!handoff) {
+        return listeners;
+    }
+    channel_ = std::atoi(handoff);
+    ::unsetenv(HANDOFF_ENV);
+    ::fcntl(channel_, F_SETFD, FD_CLOEXEC);
+
+    char count = 0;
+    iovec iov{&count, sizeof(count)};
+    alignas(cmsghdr) char control[CMSG_SPACE(sizeof(int) * MAX_LISTENERS)];
+
+    msghdr message{};
+    message.msg_iov = &iov;
+    message.msg_iovlen = 1;
+    message.msg_control = control;
+    message.msg_controllen = sizeof(control);
+
+    ssize_t received;
+    do {
+        received = ::recvmsg(channel_, &message, MSG_CMSG_CLOEXEC);
+    } while (received < 0 && errno == EINTR);
+
+    if (received <= 0) {
+        LOG_ERROR("Failed to receive listeners from the previous process: " +
+                  std::string(received < 0 ? std::strerror(errno) : "channel closed"));
+        return listeners;
+    }
+
+    for (cmsghdr* header = CMSG_FIRSTHDR(&message); header; header = CMSG_NXTHDR(&message, header)) {
+        if (header->cmsg_level != SOL_SOCKET || header->cmsg_type != SCM_RIGHTS) {
+            continue;
+        }
+        size_t fds = (header->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+        const int* data = reinterpret_cast<const int*>(CMSG_DATA(header));
+        listeners.insert(listeners.end(), data, data + fds);
+    }
+
+    LOG_INFO("Inherited " + std::to_string(listeners.size()) + " listening sockets from the previous process");
+    return listeners;
+}
+
+void HotRestart::notifyReady() {
+    if (channel_ < 0) {
+        return;
+    }
+
+    char ready = READY;
+    if (::write(channel_, &ready, 1) != 1) {
+        LOG_WARNING("Failed to notify the previous process: " + std::string(std::strerror(errno)));
+    }
+    ::close(channel_);
+    channel_ = -1;
+}
+
+bool HotRestart::spawnSuccessor(const std::string& executable, const std::vector<std::string>& args,
+                                const std::vector<int>& listeners, std::chrono::milliseconds readyTimeout) {
+    if (listeners.empty() || listeners.size() > MAX_LISTENERS) {
+        LOG_ERROR("Cannot hand off " + std::to_string(listeners.size()) + " listeners");
+        return false;
+    }
+
+    int channel[2];
+    if (::socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, channel) != 0) {
+        LOG_ERROR("socketpair failed: " + std::string(std::strerror(errno)));
+        return false;
+    }
+
+    // Everything exec needs is built before fork: the child of a threaded
+    // process may only make async-signal-safe calls
+    std::vector<char*> argv;
+    for (const auto& arg : args) {
+        argv.push_back(const_cast<char*>(arg.c_str()));
+    }
+    argv.push_back(nullptr);
+
+    std::string handoff = std::string(HANDOFF_ENV) + "=" + std::to_string(HANDOFF_FD);
+    std::vector<char*> envp;
+    for (char** var = environ; *var; ++var) {
+        if (std::strncmp(*var, HANDOFF_ENV, std::strlen(HANDOFF_ENV)) != 0) {
+            envp.push_back(*var);
+        }
+    }
+    envp.push_back(const_cast<char*>(handoff.c_str()));
+    envp.push_back(nullptr);
+
+    long maxFd = ::sysconf(_SC_OPEN_MAX);
+    if (maxFd < 0) {
+        maxFd = 1024;
+    }
+
+    pid_t pid = ::fork();
+    if (pid < 0) {
+        LOG_ERROR("fork failed: " + std::string(std::strerror(errno)));
+        ::close(channel[0]);
+        ::close(channel[1]);
+        return false;
+    }
+
+    if (pid == 0) {
+        // dup2 clears close-on-exec on the copy. Every other descriptor,
+        // client connections included, must not leak into the successor:
+        // it would keep those connections open after this process closes them.
+        if (channel[1] == HANDOFF_FD) {
+            ::fcntl(HANDOFF_FD, F_SETFD, 0);
+        } else if (::dup2(channel[1], HANDOFF_FD) < 0) {
+            ::_exit(127);
+        }
+        for (long fd = HANDOFF_FD + 1; fd < maxFd; ++fd) {
+            ::close(static_cast<int>(fd));
+        }
+        ::execve(executable.c_str(), argv.data(), envp.data());
+        ::_exit(127);
+    }
+
+    ::close(channel[1]);
+    LOG_INFO("Started successor process " + std::to_string(pid) + " from " + executable);
+
+    bool ready = sendListeners(channel[0], listeners) && awaitReady(channel[0], readyTimeout);
+    ::close(channel[0]);
+
+    if (!ready) {
+        LOG_ERROR("Successor process " + std::to_string(pid) + " did not start serving, keeping this one");
+        ::kill(pid, SIGKILL);
+        ::waitpid(pid, nullptr, 0);
+        return false;
+    }
+
+    LOG_INFO("Successor process " + std::to_string(pid) + " is serving");
+    return true;
+}
+
+bool HotRestart::sendListeners(int channel, const std::vector<int>& listeners) {
+    char count = static_cast<char>(listeners.size());
+    iovec iov{&count, sizeof(count)};
+
+    std::vector<char> control(CMSG_SPACE(sizeof(int) * listeners.size()));
+    msghdr message{};
+    message.msg_iov = &iov;
+    message.msg_iovlen = 1;
+    message.msg_control = control.data();
+    message.msg_controllen = control.size();
+
+    cmsghdr* header = CMSG_FIRSTHDR(&message);
+    header->cmsg_level = SOL_SOCKET;
+    header->cmsg_type = SCM_RIGHTS;
+    header->cmsg_len = CMSG_LEN(sizeof(int) * listeners.size());
+    std::memcpy(CMSG_DATA(header), listeners.data(), sizeof(int) * listeners.size());
+
+    ssize_t sent;
+    do {
+        sent = ::sendmsg(channel, &message, MSG_NOSIGNAL);
+    } while (sent < 0 && errno == EINTR);
+
+    if (sent != 1) {
+        LOG_ERROR("Failed to send listeners: " + std::string(std::strerror(errno)));
+        return false;
+    }
+    return true;
+}
+
+bool HotRestart::awaitReady(int channel, std::chrono::milliseconds timeout) {
+    auto deadline = std::chrono::steady_clock::now() + timeout;
+
+    for (;;) {
+        auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now());
+        if (remaining.count() <= 0) {
+            LOG_ERROR("Timed out waiting for the successor to start");
+            return false;
+        }
+
+        pollfd fd{channel, POLLIN, 0};
+        int result = ::poll(&fd, 1, static_cast<int>(remaining.count()));
+        if (result < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            LOG_ERROR("Failed to wait for the successor: " + std::string(std::strerror(errno)));
+            return false;
+        }
+        if (result == 0) {
+            continue;
+        }
+
+        // A crashed successor closes the channel without a word
+        char reply = 0;
+        return ::read(channel, &reply, 1) == 1 && reply == READY;
+    }
+}
+
+} // namespace chad
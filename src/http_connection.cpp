@@ -0,0 +1,1180 @@
+#include "../include/http_connection.hpp"
+#include "../include/logger.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <charconv>
+#include <cstring>
+#include <sys/sendfile.h>
+#include <sys/socket.h>
+
+namespace chad {
+
+using boost::asio::ip::tcp;
+
+namespace {
+
+constexpr size_t INITIAL_READ_BUFFER_SIZE = 8 * 1024;
+constexpr size_t BODY_CHUNK_SIZE = 64 * 1024;
+constexpr size_t SENDFILE_CHUNK_SIZE = 1024 * 1024;
+
+// Bytes spliced per readiness event before yielding to other connections
+constexpr size_t SPLICE_BUDGET = 1024 * 1024;
+
+constexpr std::string_view CRLF = "\r\n";
+constexpr std::string_view LAST_CHUNK = "0\r\n\r\n";
+
+bool equalsIgnoreCase(std::string_view a, std::string_view b) {
+    return a.size() == b.size() && strncasecmp(a.data(), b.data(), a.size()) == 0;
+}
+
+} // namespace
+
+HttpConnection::HttpConnection(tcp::socket socket, HttpServer& server, TimerWheel& timerWheel)
+    : socket_(std::move(socket)), server_(server), timerWheel_(timerWheel), readBuffer_(INITIAL_READ_BUFFER_SIZE),
+      arena_(arenaBuffer_.data(), arenaBuffer_.size()), request_(&arena_), response_(&arena_) {
+    server_.connectionCount_++;
+}
+
+HttpConnection::~HttpConnection() {
+    releaseBody();
+    server_.connectionCount_--;
+}
+
+void HttpConnection::start() {
+    // splice()/sendfile() are issued on the raw descriptor and must never block
+    boost::system::error_code ec;
+    socket_.native_non_blocking(true, ec);
+
+    auto remote = socket_.remote_endpoint(ec);
+    if (!ec) {
+        clientKey_ = RateLimiter::clientKey(remote.address());
+    }
+
+    // The wheel fires on its own thread; hop onto the strand without keeping the connection alive
+    std::weak_ptr<HttpConnection> weak = shared_from_this();
+    deadline_.setCallback([weak](uint64_t generation) {
+        if (auto self = weak.lock()) {
+            boost::asio::post(self->socket_.get_executor(), [self, generation]() {
+                self->onDeadline(generation);
+            });
+        }
+    });
+
+    readHeaders();
+}
+
+void HttpConnection::readHeaders() {
+    state_ = State::READING_HEADERS;
+    resetArena();
+    bodySink_.reset();
+    parser_.reset();
+
+    if (!carryOver_.empty()) {
+        // The head views into readBuffer_ are gone, so it may be compacted now
+        std::memmove(readBuffer_.data(), readBuffer_.data() + readPos_, readEnd_ - readPos_);
+        readEnd_ -= readPos_;
+        readPos_ = 0;
+
+        if (readBuffer_.size() < readEnd_ + carryOver_.size()) {
+            readBuffer_.resize(readEnd_ + carryOver_.size());
+        }
+        std::memcpy(readBuffer_.data() + readEnd_, carryOver_.data(), carryOver_.size());
+        readEnd_ += carryOver_.size();
+        carryOver_.clear();
+    }
+
+    // Pipelined requests may already be buffered in full
+    if (parseHeaders()) {
+        return;
+    }
+
+    // A new connection must send its request promptly; a reused one may idle first
+    if (requestsServed_ == 0 || readEnd_ > readPos_) {
+        armDeadline(Deadline::HEADERS, server_.limits_.requestTimeout);
+    } else {
+        armDeadline(Deadline::IDLE, server_.keepAliveTimeout_);
+    }
+    readMore();
+}
+
+void HttpConnection::readMore() {
+    // Move the partial request to the front before reading more of it
+    if (readPos_ > 0) {
+        std::memmove(readBuffer_.data(), readBuffer_.data() + readPos_, readEnd_ - readPos_);
+        readEnd_ -= readPos_;
+        readPos_ = 0;
+    }
+
+    if (readEnd_ == readBuffer_.size()) {
+        readBuffer_.resize(std::min(readBuffer_.size() * 2, parser_.maxHeaderBytes() + 1));
+    }
+
+    socket_.async_read_some(boost::asio::buffer(readBuffer_.data() + readEnd_, readBuffer_.size() - readEnd_),
+        [self = shared_from_this()](const boost::system::error_code& error, size_t bytesTransferred) {
+            self->onRead(error, bytesTransferred);
+        });
+}
+
+void HttpConnection::onRead(const boost::system::error_code& error, size_t bytesTransferred) {
+    if (error) {
+        if (error != boost::asio::error::eof && error != boost::asio::error::operation_aborted) {
+            LOG_ERROR("Error reading request: " + error.message());
+        }
+        close();
+        return;
+    }
+
+    readEnd_ += bytesTransferred;
+
+    // The head deadline starts with its first byte and is not extended by
+    // later ones, so trickling a request out byte by byte does not help
+    if (deadlineKind_ == Deadline::IDLE) {
+        armDeadline(Deadline::HEADERS, server_.limits_.requestTimeout);
+    }
+
+    if (!parseHeaders()) {
+        readMore();
+    }
+}
+
+bool HttpConnection::parseHeaders() {
+    HttpParser::Status status = parser_.parse(readBuffer_.data() + readPos_, readEnd_ - readPos_, request_);
+
+    switch (status) {
+        case HttpParser::Status::INCOMPLETE:
+            return false;
+        case HttpParser::Status::BAD_REQUEST:
+            sendError(400, "Bad Request");
+            return true;
+        case HttpParser::Status::HEADERS_TOO_LARGE:
+            sendError(431, "Request Header Fields Too Large");
+            return true;
+        case HttpParser::Status::COMPLETE:
+            break;
+    }
+
+    cancelDeadline();
+    readPos_ += parser_.headerSize();
+
+    if (!checkRateLimit()) {
+        return true;
+    }
+
+    // Any method may carry a body; it must be drained to find the next request
+    contentLength_ = 0;
+    if (auto contentLength = request_.findHeader("Content-Length")) {
+        const char* end = contentLength->data() + contentLength->size();
+        auto result = std::from_chars(contentLength->data(), end, contentLength_);
+        if (result.ec != std::errc() || result.ptr != end) {
+            sendError(400, "Bad Request");
+            return true;
+        }
+    }
+
+    chunkedBody_ = false;
+    if (auto transferEncoding = request_.findHeader("Transfer-Encoding")) {
+        if (!equalsIgnoreCase(*transferEncoding, "chunked")) {
+            sendError(501, "Not Implemented");
+            return true;
+        }
+        // Both framings at once is how requests get smuggled past proxies
+        if (request_.findHeader("Content-Length")) {
+            sendError(400, "Bad Request");
+            return true;
+        }
+        chunkedBody_ = true;
+    }
+
+    bool expectContinue = false;
+    if (auto expect = request_.findHeader("Expect")) {
+        if (!equalsIgnoreCase(*expect, "100-continue")) {
+            sendError(417, "Expectation Failed");
+            return true;
+        }
+        expectContinue = request_.version != "HTTP/1.0";
+    }
+
+    routeMatch_ = server_.matchRoute(request_);
+
+    if ((contentLength_ > 0 || chunkedBody_) && !admitBody()) {
+        return true;
+    }
+
+    if (expectContinue && (chunkedBody_ || contentLength_ > readEnd_ - readPos_)) {
+        // The client holds the body back until told to go ahead
+        static constexpr std::string_view CONTINUE = "HTTP/1.1 100 Continue\r\n\r\n";
+        armDeadline(Deadline::WRITE, server_.limits_.requestTimeout);
+        boost::asio::async_write(socket_, boost::asio::buffer(CONTINUE.data(), CONTINUE.size()),
+            [self = shared_from_this()](const boost::system::error_code& error, size_t) {
+                if (error) {
+                    LOG_ERROR("Error sending 100 Continue: " + error.message());
+                    self->close();
+                    return;
+                }
+                self->beginBody();
+            });
+        return true;
+    }
+
+    beginBody();
+    return true;
+}
+
+bool HttpConnection::admitBody() {
+    // Every rejection below leaves the body unread, so the connection cannot be reused
+    if (contentLength_ > server_.limits_.maxRequestSize) {
+        LOG_WARNING("Rejecting request body of " + std::to_string(contentLength_) + " bytes");
+        sendError(413, "Payload Too Large");
+        return false;
+    }
+
+    const HttpServer::Route* route = server_.findRoute(routeMatch_);
+    if (route && route->bodySink) {
+        HttpResponse rejection;
+        bodySink_ = route->bodySink(request_, rejection);
+        if (!bodySink_ && rejection.statusCode >= 300) {
+            keepAlive_ = false;
+            writeResponse(rejection);
+            return false;
+        }
+        if (bodySink_) {
+            return true;
+        }
+    }
+
+    // Buffered bodies are held in memory until the response is sent; chunked
+    // ones reserve their share as they grow
+    if (!chunkedBody_) {
+        if (!server_.reserveBodyMemory(contentLength_)) {
+            sendBusy();
+            return false;
+        }
+        bodyReserved_ = contentLength_;
+    }
+    return true;
+}
+
+void HttpConnection::beginBody() {
+    if (chunkedBody_) {
+        beginChunkedBody();
+        return;
+    }
+
+    // Take whatever part of the body is already buffered, read the rest directly
+    size_t buffered = std::min(contentLength_, readEnd_ - readPos_);
+
+    if (bodySink_) {
+        request_.bodySink = bodySink_.get();
+        if (!bodySink_->write(readBuffer_.data() + readPos_, buffered)) {
+            sendError(500, "Internal Server Error");
+            return;
+        }
+        readPos_ += buffered;
+        bodyRemaining_ = contentLength_ - buffered;
+        streamBody();
+        return;
+    }
+
+    request_.body.assign(readBuffer_.data() + readPos_, buffered);
+    readPos_ += buffered;
+    bodyRemaining_ = contentLength_ - buffered;
+
+    if (bodyRemaining_ > 0) {
+        request_.body.resize(contentLength_);
+        readBody();
+    } else {
+        handleRequest();
+    }
+}
+
+void HttpConnection::beginChunkedBody() {
+    state_ = State::READING_BODY;
+    chunkedDecoder_.reset();
+    bodyReceived_ = 0;
+    request_.bodySink = bodySink_.get();
+
+    // Decode whatever arrived with the head; the rest is read into bodyChunk_
+    size_t consumed = 0;
+    ChunkedResult result = consumeChunked(readBuffer_.data() + readPos_, readEnd_ - readPos_, consumed);
+    readPos_ += consumed;
+
+    if (result == ChunkedResult::MORE) {
+        readChunkedBody();
+    } else if (result == ChunkedResult::DONE) {
+        if (bodySink_) {
+            finishBody();
+        } else {
+            handleRequest();
+        }
+    }
+}
+
+void HttpConnection::readChunkedBody() {
+    if (bodyChunk_.empty()) {
+        bodyChunk_.resize(BODY_CHUNK_SIZE);
+    }
+
+    armDeadline(Deadline::BODY, server_.limits_.requestTimeout);
+    socket_.async_read_some(boost::asio::buffer(bodyChunk_.data(), bodyChunk_.size()),
+        [self = shared_from_this()](const boost::system::error_code& error, size_t bytesTransferred) {
+            self->onChunkedBody(error, bytesTransferred);
+        });
+}
+
+void HttpConnection::onChunkedBody(const boost::system::error_code& error, size_t bytesTransferred) {
+    if (error) {
+        LOG_ERROR("Error reading request body: " + error.message());
+        close();
+        return;
+    }
+
+    size_t consumed = 0;
+    ChunkedResult result = consumeChunked(bodyChunk_.data(), bytesTransferred, consumed);
+
+    if (result == ChunkedResult::MORE) {
+        readChunkedBody();
+    } else if (result == ChunkedResult::DONE) {
+        // Anything after the last chunk is the start of a pipelined request
+        carryOver_.assign(bodyChunk_.data() + consumed, bodyChunk_.data() + bytesTransferred);
+        cancelDeadline();
+
+        if (bodySink_) {
+            finishBody();
+        } else {
+            handleRequest();
+        }
+    }
+}
+
+HttpConnection::ChunkedResult HttpConnection::consumeChunked(char* data, size_t size, size_t& consumed) {
+    size_t payload = 0;
+    ChunkedDecoder::Status status = chunkedDecoder_.decode(data, size, consumed, payload);
+
+    if (status == ChunkedDecoder::Status::BAD_REQUEST) {
+        sendError(400, "Bad Request");
+        return ChunkedResult::FAILED;
+    }
+
+    // Without a Content-Length the size cap can only be checked as data arrives
+    bodyReceived_ += payload;
+    if (bodyReceived_ > server_.limits_.maxRequestSize) {
+        LOG_WARNING("Chunked request body exceeded " + std::to_string(server_.limits_.maxRequestSize) + " bytes");
+        sendError(413, "Payload Too Large");
+        return ChunkedResult::FAILED;
+    }
+
+    if (payload > 0) {
+        if (bodySink_) {
+            if (!bodySink_->write(data, payload)) {
+                sendError(500, "Internal Server Error");
+                return ChunkedResult::FAILED;
+            }
+        } else {
+            size_t needed = request_.body.size() + payload;
+            if (needed > bodyReserved_) {
+                size_t extra = std::max(needed - bodyReserved_, BODY_CHUNK_SIZE);
+                if (!server_.reserveBodyMemory(extra)) {
+                    sendBusy();
+                    return ChunkedResult::FAILED;
+                }
+                bodyReserved_ += extra;
+            }
+            request_.body.append(data, payload);
+        }
+    }
+
+    return status == ChunkedDecoder::Status::COMPLETE ? ChunkedResult::DONE : ChunkedResult::MORE;
+}
+
+void HttpConnection::armDeadline(Deadline kind, std::chrono::milliseconds delay) {
+    deadlineKind_ = kind;
+    deadlineGeneration_ = timerWheel_.schedule(deadline_, delay);
+}
+
+void HttpConnection::cancelDeadline() {
+    if (deadlineKind_ != Deadline::NONE) {
+        deadlineKind_ = Deadline::NONE;
+        timerWheel_.cancel(deadline_);
+    }
+}
+
+void HttpConnection::onDeadline(uint64_t generation) {
+    // Ignore deadlines that were re-armed or cancelled after they fired
+    if (generation != deadlineGeneration_ || deadlineKind_ == Deadline::NONE || state_ == State::CLOSED) {
+        return;
+    }
+
+    Deadline kind = deadlineKind_;
+    deadlineKind_ = Deadline::NONE;
+
+    // A connection that never started a request is simply dropped
+    if (kind == Deadline::IDLE || (kind == Deadline::HEADERS && readEnd_ == readPos_)) {
+        LOG_DEBUG("Closing idle connection");
+        close();
+        return;
+    }
+
+    if (kind == Deadline::HEADERS || kind == Deadline::BODY) {
+        // Reads are still pending, so tell the client without waiting on it
+        static constexpr std::string_view TIMEOUT =
+            "HTTP/1.1 408 Request Timeout\r\n"
+            "Connection: close\r\n"
+            "Content-Length: 0\r\n\r\n";
+        boost::system::error_code ec;
+        socket_.write_some(boost::asio::buffer(TIMEOUT.data(), TIMEOUT.size()), ec);
+        LOG_WARNING(std::string("Request timed out while reading the ") +
+                    (kind == Deadline::HEADERS ? "headers" : "body"));
+    } else {
+        LOG_WARNING("Client stopped reading the response");
+    }
+
+    close();
+}
+bool HttpConnection::shouldKeepAlive() const {
+    if (!server_.isRunning() || server_.draining_ || requestsServed_ >= server_.maxRequestsPerConnection_) {
+        return false;
+    }
+
+    auto connection = request_.findHeader("Connection");
+
+    // HTTP/1.1 is persistent unless the client opts out; HTTP/1.0 is the reverse
+    if (request_.version == "HTTP/1.0") {
+        return connection && equalsIgnoreCase(*connection, "keep-alive");
+    }
+    return !connection || !equalsIgnoreCase(*connection, "close");
+}
+
+void HttpConnection::readBody() {
+    state_ = State::READING_BODY;
+    armDeadline(Deadline::BODY, server_.limits_.requestTimeout);
+
+    // The body is read straight into the request so the receive buffer, and
+    // the header views into it, never move while a request is in flight
+    size_t offset = contentLength_ - bodyRemaining_;
+    socket_.async_read_some(boost::asio::buffer(&request_.body[offset], bodyRemaining_),
+        [self = shared_from_this()](const boost::system::error_code& error, size_t bytesTransferred) {
+            self->onBody(error, bytesTransferred);
+        });
+}
+
+void HttpConnection::onBody(const boost::system::error_code& error, size_t bytesTransferred) {
+    if (error) {
+        LOG_ERROR("Error reading request body: " + error.message());
+        close();
+        return;
+    }
+
+    bodyRemaining_ -= bytesTransferred;
+    if (bodyRemaining_ > 0) {
+        readBody();
+        return;
+    }
+
+    cancelDeadline();
+    handleRequest();
+}
+
+void HttpConnection::streamBody() {
+    state_ = State::READING_BODY;
+
+    if (bodyRemaining_ == 0) {
+        finishBody();
+        return;
+    }
+
+    armDeadline(Deadline::BODY, server_.limits_.requestTimeout);
+    socket_.async_wait(tcp::socket::wait_read,
+        [self = shared_from_this()](const boost::system::error_code& error) {
+            self->onBodyReadable(error);
+        });
+}
+
+void HttpConnection::onBodyReadable(const boost::system::error_code& error) {
+    if (error) {
+        LOG_ERROR("Error reading request body: " + error.message());
+        close();
+        return;
+    }
+
+    size_t budget = SPLICE_BUDGET;
+    while (bodyRemaining_ > 0 && budget > 0) {
+        ssize_t moved = bodySink_->spliceFrom(socket_.native_handle(), std::min(bodyRemaining_, budget));
+
+        if (moved > 0) {
+            bodyRemaining_ -= static_cast<size_t>(moved);
+            budget -= std::min(budget, static_cast<size_t>(moved));
+            continue;
+        }
+
+        if (moved == 0) {
+            LOG_ERROR("Client closed connection during request body");
+            close();
+            return;
+        }
+
+        if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) {
+            break;
+        }
+
+        if (errno == ENOTSUP) {
+            readBodyChunk();
+            return;
+        }
+
+        LOG_ERROR("Error streaming request body: " + std::string(std::strerror(errno)));
+        sendError(500, "Internal Server Error");
+        return;
+    }
+
+    if (bodyRemaining_ == 0) {
+        finishBody();
+        return;
+    }
+
+    // Let other connections on this thread run before continuing
+    boost::asio::post(socket_.get_executor(), [self = shared_from_this()]() {
+        self->streamBody();
+    });
+}
+
+void HttpConnection::readBodyChunk() {
+    if (bodyRemaining_ == 0) {
+        finishBody();
+        return;
+    }
+
+    if (bodyChunk_.empty()) {
+        bodyChunk_.resize(BODY_CHUNK_SIZE);
+    }
+
+    armDeadline(Deadline::BODY, server_.limits_.requestTimeout);
+    socket_.async_read_some(boost::asio::buffer(bodyChunk_.data(), std::min(bodyChunk_.size(), bodyRemaining_)),
+        [self = shared_from_this()](const boost::system::error_code& error, size_t bytesTransferred) {
+            self->onBodyChunk(error, bytesTransferred);
+        });
+}
+
+void HttpConnection::onBodyChunk(const boost::system::error_code& error, size_t bytesTransferred) {
+    if (error) {
+        LOG_ERROR("Error reading request body: " + error.message());
+        close();
+        return;
+    }
+
+    if (!bodySink_->write(bodyChunk_.data(), bytesTransferred)) {
+        sendError(500, "Internal Server Error");
+        return;
+    }
+
+    bodyRemaining_ -= bytesTransferred;
+    readBodyChunk();
+}
+
+void HttpConnection::finishBody() {
+    cancelDeadline();
+
+    if (!bodySink_->finish()) {
+        sendError(500, "Internal Server Error");
+        return;
+    }
+
+    handleRequest();
+}
+
+void HttpConnection::handleRequest() {
+    requestsServed_++;
+    keepAlive_ = shouldKeepAlive();
+
+    // Async handlers answer later through an HttpResponder; nothing is pending until then
+    state_ = State::WRITING;
+
+    HttpResponse response(&arena_);
+    if (server_.dispatch(routeMatch_, request_, response, shared_from_this())) {
+        writeResponse(response);
+    }
+}
+
+void HttpConnection::sendError(int statusCode, const std::string& statusText) {
+    keepAlive_ = false;
+
+    HttpResponse response(&arena_);
+    response.statusCode = statusCode;
+    response.statusText = statusText;
+    response.setText(statusText);
+    writeResponse(response);
+}
+
+bool HttpConnection::checkRateLimit() {
+    if (!server_.rateLimiter_) {
+        return true;
+    }
+
+    std::chrono::seconds retryAfter(0);
+    RateLimiter::Decision decision = server_.rateLimiter_->acquire(clientKey_, retryAfter);
+    if (decision == RateLimiter::Decision::ALLOW) {
+        return true;
+    }
+
+    // The body, if any, is left unread
+    keepAlive_ = false;
+
+    HttpResponse response(&arena_);
+    response.statusCode = 429;
+    response.statusText = "Too Many Requests";
+    response.headers["Retry-After"] = std::to_string(retryAfter.count());
+    response.setText(decision == RateLimiter::Decision::BANNED ? "Client temporarily banned" : "Rate limit exceeded");
+    writeResponse(response);
+    return false;
+}
+
+void HttpConnection::sendBusy() {
+    LOG_WARNING("Body memory budget exhausted, deferring request");
+    keepAlive_ = false;
+
+    HttpResponse busy(&arena_);
+    busy.statusCode = 503;
+    busy.statusText = "Service Unavailable";
+    busy.headers["Retry-After"] = "1";
+    busy.setText("Server busy, retry later");
+    writeResponse(busy);
+}
+
+void HttpConnection::writeResponse(HttpResponse& response) {
+    state_ = State::WRITING;
+
+    // HTTP/1.0 has no chunked encoding: the end of a stream is the end of the connection
+    if (response.isStreamed()) {
+        streamChunked_ = request_.version != "HTTP/1.0";
+        if (streamChunked_) {
+            response.headers["Transfer-Encoding"] = "chunked";
+        } else {
+            keepAlive_ = false;
+        }
+    }
+
+    if (keepAlive_) {
+        response.headers["Connection"] = "keep-alive";
+        response.headers["Keep-Alive"] = "timeout=" + std::to_string(server_.keepAliveTimeout_.count() / 1000) +
+                                         ", max=" + std::to_string(server_.maxRequestsPerConnection_ - requestsServed_);
+    } else {
+        response.headers["Connection"] = "close";
+    }
+
+    // Keep the response alive for the write; its body is never copied
+    response_ = std::move(response);
+    file_ = response_.file;
+    stream_ = response_.stream;
+
+    responseHead_.clear();
+    HttpServer::serializeHead(response_, responseHead_);
+
+    std::string_view body = response_.bodyView();
+    std::array<boost::asio::const_buffer, 2> buffers = {
+        boost::asio::buffer(responseHead_),
+        boost::asio::buffer(body.data(), body.size())
+    };
+
+    armDeadline(Deadline::WRITE, server_.limits_.requestTimeout);
+    boost::asio::async_write(socket_, buffers,
+        [self = shared_from_this()](const boost::system::error_code& error, size_t) {
+            self->onHeadWritten(error);
+        });
+}
+
+void HttpConnection::onHeadWritten(const boost::system::error_code& error) {
+    if (!error && stream_) {
+        stream_->attach();
+        watchStream();
+        drainStream();
+        return;
+    }
+
+    if (!error && response_.writer) {
+        writeNextPart();
+        return;
+    }
+
+    if (error || !file_) {
+        onWrite(error);
+        return;
+    }
+
+    fileSegment_ = 0;
+    filePrefixSent_ = false;
+    fileTrailerSent_ = false;
+    writeFileBody();
+}
+
+void HttpConnection::writeFileBody() {
+    auto continueWith = [self = shared_from_this()](const boost::system::error_code& error, size_t = 0) {
+        if (error) {
+            self->onWrite(error);
+        } else {
+            self->writeFileBody();
+        }
+    };
+
+    // Every step here follows progress, so only a stalled reader hits the deadline
+    armDeadline(Deadline::WRITE, server_.limits_.requestTimeout);
+
+    while (fileSegment_ < file_->segments.size()) {
+        const FileBody::Segment& segment = file_->segments[fileSegment_];
+
+        if (!filePrefixSent_) {
+            filePrefixSent_ = true;
+            fileOffset_ = static_cast<off_t>(segment.offset);
+            fileRemaining_ = segment.length;
+
+            if (!segment.prefix.empty()) {
+                boost::asio::async_write(socket_, boost::asio::buffer(segment.prefix), continueWith);
+                return;
+            }
+        }
+
+        while (fileRemaining_ > 0) {
+            ssize_t sent = ::sendfile(socket_.native_handle(), file_->fd, &fileOffset_,
+                                      std::min<uint64_t>(fileRemaining_, SENDFILE_CHUNK_SIZE));
+            if (sent > 0) {
+                fileRemaining_ -= static_cast<uint64_t>(sent);
+                continue;
+            }
+            if (sent < 0 && errno == EINTR) {
+                continue;
+            }
+            if (sent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+                socket_.async_wait(tcp::socket::wait_write, continueWith);
+                return;
+            }
+
+            // sendfile() returning 0 means the file shrank underneath us
+            LOG_ERROR("Error sending file body: " + std::string(sent < 0 ? std::strerror(errno) : "unexpected end of file"));
+            close();
+            return;
+        }
+
+        fileSegment_++;
+        filePrefixSent_ = false;
+    }
+
+    if (!file_->trailer.empty() && !fileTrailerSent_) {
+        fileTrailerSent_ = true;
+        boost::asio::async_write(socket_, boost::asio::buffer(file_->trailer), continueWith);
+        return;
+    }
+
+    onWrite(boost::system::error_code());
+}
+
+void HttpConnection::writeNextPart() {
+    // Gather small parts so each write carries a reasonable amount of data
+    bool more = true;
+    partBuffer_.clear();
+    try {
+        while (more && partBuffer_.size() < BODY_CHUNK_SIZE) {
+            more = response_.writer(partBuffer_);
+        }
+    } catch (const std::exception& e) {
+        // The head is out; all that is left is to cut the response short
+        LOG_ERROR("Exception in response writer: " + std::string(e.what()));
+        close();
+        return;
+    }
+
+    streamFraming_.clear();
+    streamBuffers_.clear();
+    if (!partBuffer_.empty()) {
+        if (streamChunked_) {
+            char size[24];
+            auto result = std::to_chars(size, size + sizeof(size), partBuffer_.size(), 16);
+            streamFraming_.append(size, result.ptr).append(CRLF);
+            streamBuffers_.push_back(boost::asio::buffer(streamFraming_));
+            streamBuffers_.push_back(boost::asio::buffer(partBuffer_));
+            streamBuffers_.push_back(boost::asio::buffer(CRLF.data(), CRLF.size()));
+        } else {
+            streamBuffers_.push_back(boost::asio::buffer(partBuffer_));
+        }
+    }
+    if (!more && streamChunked_) {
+        streamBuffers_.push_back(boost::asio::buffer(LAST_CHUNK.data(), LAST_CHUNK.size()));
+    }
+
+    if (streamBuffers_.empty()) {
+        onWrite(boost::system::error_code());
+        return;
+    }
+
+    armDeadline(Deadline::WRITE, server_.limits_.requestTimeout);
+    boost::asio::async_write(socket_, streamBuffers_,
+        [self = shared_from_this(), more](const boost::system::error_code& error, size_t) {
+            if (error || !more) {
+                self->onWrite(error);
+            } else {
+                self->writeNextPart();
+            }
+        });
+}
+
+void HttpConnection::drainStream() {
+    if (state_ == State::CLOSED || !stream_) {
+        return;
+    }
+
+    streamChunks_.clear();
+    switch (stream_->take(streamChunks_)) {
+        case HttpStream::Take::IDLE:
+            // Waiting on the producer, not the client
+            cancelDeadline();
+            return;
+        case HttpStream::Take::FAILED:
+            LOG_WARNING("Dropping streaming client that fell too far behind");
+            close();
+            return;
+        case HttpStream::Take::FINISHED:
+            finishStream();
+            return;
+        case HttpStream::Take::DATA:
+            break;
+    }
+
+    // Size lines go into one string first so the buffers pointing into it stay valid
+    streamFraming_.clear();
+    streamFrameEnds_.clear();
+    if (streamChunked_) {
+        char size[24];
+        for (const auto& chunk : streamChunks_) {
+            auto result = std::to_chars(size, size + sizeof(size), chunk->size(), 16);
+            streamFraming_.append(size, result.ptr).append("\r\n");
+            streamFrameEnds_.push_back(streamFraming_.size());
+        }
+    }
+
+    streamBuffers_.clear();
+    for (size_t i = 0; i < streamChunks_.size(); ++i) {
+        const std::string& chunk = *streamChunks_[i];
+        // An empty chunk would end a chunked body
+        if (chunk.empty()) {
+            continue;
+        }
+        if (streamChunked_) {
+            size_t begin = i == 0 ? 0 : streamFrameEnds_[i - 1];
+            streamBuffers_.push_back(boost::asio::buffer(streamFraming_.data() + begin, streamFrameEnds_[i] - begin));
+            streamBuffers_.push_back(boost::asio::buffer(chunk));
+            streamBuffers_.push_back(boost::asio::buffer(CRLF.data(), CRLF.size()));
+        } else {
+            streamBuffers_.push_back(boost::asio::buffer(chunk));
+        }
+    }
+
+    if (streamBuffers_.empty()) {
+        drainStream();
+        return;
+    }
+
+    armDeadline(Deadline::WRITE, server_.limits_.requestTimeout);
+    boost::asio::async_write(socket_, streamBuffers_,
+        [self = shared_from_this()](const boost::system::error_code& error, size_t) {
+            self->onStreamWritten(error);
+        });
+}
+
+void HttpConnection::onStreamWritten(const boost::system::error_code& error) {
+    if (error) {
+        if (error != boost::asio::error::operation_aborted) {
+            LOG_DEBUG("Error writing response stream: " + error.message());
+        }
+        close();
+        return;
+    }
+
+    drainStream();
+}
+
+void HttpConnection::finishStream() {
+    // Stop watching the socket so the next request can be read from it
+    boost::system::error_code ec;
+    socket_.cancel(ec);
+
+    if (!streamChunked_) {
+        onWrite(boost::system::error_code());
+        return;
+    }
+
+    armDeadline(Deadline::WRITE, server_.limits_.requestTimeout);
+    boost::asio::async_write(socket_, boost::asio::buffer(LAST_CHUNK.data(), LAST_CHUNK.size()),
+        [self = shared_from_this()](const boost::system::error_code& error, size_t) {
+            self->onWrite(error);
+        });
+}
+
+void HttpConnection::watchStream() {
+    // The pending wait is also what keeps the connection alive while the stream is idle
+    socket_.async_wait(tcp::socket::wait_read,
+        [self = shared_from_this()](const boost::system::error_code& error) {
+            self->onStreamReadable(error);
+        });
+}
+
+void HttpConnection::onStreamReadable(const boost::system::error_code& error) {
+    if (error || !stream_ || state_ == State::CLOSED) {
+        return;
+    }
+
+    char byte;
+    ssize_t peeked = ::recv(socket_.native_handle(), &byte, 1, MSG_PEEK);
+
+    if (peeked > 0) {
+        // A pipelined request; it is read once the stream ends
+        stream_->pin(shared_from_this());
+        return;
+    }
+
+    if (peeked < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)) {
+        watchStream();
+        return;
+    }
+
+    LOG_DEBUG("Streaming client disconnected");
+    close();
+}
+
+void HttpConnection::onWrite(const boost::system::error_code& error) {
+    // Release the body (and any shared buffer or file) as soon as it is sent
+    response_ = HttpResponse(&arena_);
+    file_.reset();
+    if (stream_) {
+        stream_->detach();
+        stream_.reset();
+    }
+    cancelDeadline();
+    releaseBody();
+
+    if (error) {
+        LOG_ERROR("Error sending response: " + error.message());
+        close();
+        return;
+    }
+
+    if (!keepAlive_) {
+        close();
+        return;
+    }
+
+    readHeaders();
+}
+
+void HttpConnection::releaseBody() {
+    if (bodyReserved_ > 0) {
+        // Drop the capacity too, or a reused connection would keep holding it
+        std::string().swap(request_.body);
+        server_.releaseBodyMemory(bodyReserved_);
+        bodyReserved_ = 0;
+    }
+}
+
+void HttpConnection::resetArena() {
+    // Swap in empty tables built on the arena first: moving between equal
+    // allocators hands over storage, so nothing still points into the arena
+    // when it is rewound. Objects from other allocators would be copied
+    // element-wise into the old storage instead.
+    request_ = HttpRequest(&arena_);
+    response_ = HttpResponse(&arena_);
+    arena_.release();
+
+    request_.clientKey = clientKey_;
+}
+
+void HttpConnection::close() {
+    if (state_ == State::CLOSED) {
+        return;
+    }
+
+    state_ = State::CLOSED;
+    cancelDeadline();
+    releaseBody();
+
+    if (stream_) {
+        stream_->detach();
+        stream_.reset();
+    }
+
+    boost::system::error_code ec;
+    socket_.shutdown(tcp::socket::shutdown_both, ec);
+    socket_.close(ec);
+}
+
+struct HttpResponder::State {
+    std::shared_ptr<HttpConnection> connection;
+    std::atomic<bool> sent{false};
+
+    void deliver(HttpResponse&& response) {
+        // The connection's strand serializes this with everything else it does
+        boost::asio::post(connection->socket_.get_executor(),
+            [connection = connection, response = std::move(response)]() mutable {
+                connection->writeResponse(response);
+            });
+    }
+
+    ~State() {
+        if (!sent.exchange(true)) {
+            LOG_ERROR("Async handler dropped its request without responding");
+
+            HttpResponse response;
+            response.statusCode = 500;
+            response.statusText = "Internal Server Error";
+            response.setText("Internal server error");
+            deliver(std::move(response));
+        }
+    }
+};
+
+HttpResponder::HttpResponder(std::shared_ptr<HttpConnection> connection)
+    : state_(std::make_shared<State>()) {
+    state_->connection = std::move(connection);
+}
+
+bool HttpResponder::send(HttpResponse&& response) const {
+    if (state_->sent.exchange(true)) {
+        return false;
+    }
+
+    state_->deliver(std::move(response));
+    return true;
+}
+
+std::shared_ptr<HttpStream> HttpResponder::stream(HttpResponse&& head, size_t maxBacklog) const {
+    if (state_->sent.exchange(true)) {
+        return nullptr;
+    }
+
+    head.body.clear();
+    head.sharedBody.reset();
+    head.file.reset();
+    head.stream = std::make_shared<HttpStream>(state_->connection, maxBacklog);
+
+    std::shared_ptr<HttpStream> stream = head.stream;
+    state_->deliver(std::move(head));
+    return stream;
+}
+
+boost::asio::any_io_executor HttpResponder::executor() const {
+    return state_->connection->socket_.get_executor();
+}
+
+HttpStream::HttpStream(std::weak_ptr<HttpConnection> connection, size_t maxBacklog)
+    : connection_(std::move(connection)), maxBacklog_(maxBacklog) {}
+
+bool HttpStream::write(std::shared_ptr<const std::string> data) {
+    bool wake = false;
+    bool accepted = false;
+
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (closed_ || failed_) {
+            return false;
+        }
+
+        if (pendingBytes_ + data->size() > maxBacklog_) {
+            // Let the connection drop the client rather than buffer without bound
+            failed_ = true;
+        } else {
+            pendingBytes_ += data->size();
+            pending_.push_back(std::move(data));
+            accepted = true;
+        }
+
+        wake = attached_ && !draining_;
+        draining_ = draining_ || wake;
+    }
+
+    if (wake) {
+        notify();
+    }
+    return accepted;
+}
+
+bool HttpStream::write(std::string data) {
+    return write(std::make_shared<const std::string>(std::move(data)));
+}
+
+void HttpStream::close() {
+    bool wake = false;
+
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (closed_ || failed_) {
+            return;
+        }
+
+        closed_ = true;
+        wake = attached_ && !draining_;
+        draining_ = draining_ || wake;
+    }
+
+    if (wake) {
+        notify();
+    }
+}
+
+bool HttpStream::isOpen() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return !closed_ && !failed_;
+}
+
+void HttpStream::attach() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    attached_ = true;
+    draining_ = true;
+}
+
+HttpStream::Take HttpStream::take(std::vector<std::shared_ptr<const std::string>>& out) {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    if (failed_) {
+        return Take::FAILED;
+    }
+
+    if (pending_.empty()) {
+        if (closed_) {
+            return Take::FINISHED;
+        }
+        draining_ = false;
+        return Take::IDLE;
+    }
+
+    // Swapping hands the drained vector's capacity back for the next batch
+    out.swap(pending_);
+    pendingBytes_ = 0;
+    return Take::DATA;
+}
+
+void HttpStream::pin(std::shared_ptr<HttpConnection> connection) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    pinned_ = std::move(connection);
+}
+
+void HttpStream::detach() {
+    std::shared_ptr<HttpConnection> pinned;
+
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        failed_ = true;
+        pinned = std::move(pinned_);
+    }
+}
+
+void HttpStream::notify() {
+    std::shared_ptr<HttpConnection> connection = connection_.lock();
+    if (!connection) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        failed_ = true;
+        return;
+    }
+
+    boost::asio::post(connection->socket_.get_executor(), [connection]() {
+        connection->drainStream();
+    });
+}
+
+} // namespace chad
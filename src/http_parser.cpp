@@ -0,0 +1,266 @@
+#include "../include/http_parser.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+namespace chad {
+
+namespace {
+
+bool isTokenChar(char c) {
+    // RFC 7230 tchar
+    if ((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9')) {
+        return true;
+    }
+    return std::strchr("!#$%&'*+-.^_`|~", c) != nullptr && c != '\0';
+}
+
+bool isWhitespace(char c) {
+    return c == ' ' || c == '\t';
+}
+
+} // namespace
+
+HttpParser::HttpParser(size_t maxHeaderBytes) : maxHeaderBytes_(maxHeaderBytes) {}
+
+void HttpParser::reset() {
+    scanned_ = 0;
+    headerSize_ = 0;
+    haveRequestLine_ = false;
+    headerCount_ = 0;
+}
+
+HttpParser::Status HttpParser::parse(const char* data, size_t size, HttpRequest& request) {
+    while (scanned_ < size) {
+        const void* newline = std::memchr(data + scanned_, '\n', size - scanned_);
+        if (!newline) {
+            break;
+        }
+
+        size_t lineBegin = scanned_;
+        size_t lineEnd = static_cast<const char*>(newline) - data;
+        scanned_ = lineEnd + 1;
+
+        if (scanned_ > maxHeaderBytes_) {
+            return Status::HEADERS_TOO_LARGE;
+        }
+
+        // Tolerate bare LF line endings
+        if (lineEnd > lineBegin && data[lineEnd - 1] == '\r') {
+            lineEnd--;
+        }
+
+        if (!haveRequestLine_) {
+            // Ignore empty lines preceding the request line (RFC 7230 3.5)
+            if (lineEnd == lineBegin) {
+                continue;
+            }
+            if (!parseRequestLine(data, lineBegin, lineEnd)) {
+                return Status::BAD_REQUEST;
+            }
+            haveRequestLine_ = true;
+            continue;
+        }
+
+        if (lineEnd == lineBegin) {
+            headerSize_ = scanned_;
+
+            request.method = view(data, method_);
+            request.target = view(data, target_);
+            request.version = view(data, version_);
+
+            size_t queryPos = request.target.find('?');
+            request.path = request.target.substr(0, queryPos);
+            request.query = queryPos == std::string_view::npos ? std::string_view() : request.target.substr(queryPos + 1);
+
+            request.headers.clear();
+            for (size_t i = 0; i < headerCount_; ++i) {
+                request.headers.push_back({view(data, headers_[i].first), view(data, headers_[i].second)});
+            }
+
+            return Status::COMPLETE;
+        }
+
+        if (headerCount_ == MAX_HEADERS) {
+            return Status::HEADERS_TOO_LARGE;
+        }
+
+        if (!parseHeaderLine(data, lineBegin, lineEnd)) {
+            return Status::BAD_REQUEST;
+        }
+    }
+
+    if (size > maxHeaderBytes_) {
+        return Status::HEADERS_TOO_LARGE;
+    }
+
+    return Status::INCOMPLETE;
+}
+
+bool HttpParser::parseRequestLine(const char* data, size_t begin, size_t end) {
+    // method SP request-target SP HTTP-version
+    size_t pos = begin;
+    while (pos < end && isTokenChar(data[pos])) {
+        pos++;
+    }
+    if (pos == begin || pos >= end || data[pos] != ' ') {
+        return false;
+    }
+    method_ = {static_cast<uint32_t>(begin), static_cast<uint32_t>(pos - begin)};
+
+    size_t targetBegin = ++pos;
+    while (pos < end && data[pos] != ' ') {
+        pos++;
+    }
+    if (pos == targetBegin || pos >= end) {
+        return false;
+    }
+    target_ = {static_cast<uint32_t>(targetBegin), static_cast<uint32_t>(pos - targetBegin)};
+
+    size_t versionBegin = ++pos;
+    if (end - versionBegin != 8 || std::memcmp(data + versionBegin, "HTTP/1.", 7) != 0) {
+        return false;
+    }
+    version_ = {static_cast<uint32_t>(versionBegin), static_cast<uint32_t>(end - versionBegin)};
+
+    return true;
+}
+
+bool HttpParser::parseHeaderLine(const char* data, size_t begin, size_t end) {
+    // field-name ":" OWS field-value OWS
+    size_t pos = begin;
+    while (pos < end && isTokenChar(data[pos])) {
+        pos++;
+    }
+    if (pos == begin || pos >= end || data[pos] != ':') {
+        return false;
+    }
+    Span name{static_cast<uint32_t>(begin), static_cast<uint32_t>(pos - begin)};
+
+    size_t valueBegin = pos + 1;
+    while (valueBegin < end && isWhitespace(data[valueBegin])) {
+        valueBegin++;
+    }
+    size_t valueEnd = end;
+    while (valueEnd > valueBegin && isWhitespace(data[valueEnd - 1])) {
+        valueEnd--;
+    }
+    Span value{static_cast<uint32_t>(valueBegin), static_cast<uint32_t>(valueEnd - valueBegin)};
+
+    headers_[headerCount_++] = {name, value};
+    return true;
+}
+
+void ChunkedDecoder::reset() {
+    state_ = State::SIZE;
+    remaining_ = 0;
+    sawDigit_ = false;
+}
+
+ChunkedDecoder::Status ChunkedDecoder::decode(char* data, size_t size, size_t& consumed, size_t& payload) {
+    size_t in = 0;
+    payload = 0;
+
+    while (in < size && state_ != State::DONE) {
+        char c = data[in];
+
+        switch (state_) {
+            case State::SIZE: {
+                int digit = -1;
+                if (c >= '0' && c <= '9') digit = c - '0';
+                else if (c >= 'a' && c <= 'f') digit = c - 'a' + 10;
+                else if (c >= 'A' && c <= 'F') digit = c - 'A' + 10;
+
+                if (digit >= 0) {
+                    if (remaining_ >> 60) {
+                        return Status::BAD_REQUEST;
+                    }
+                    remaining_ = (remaining_ << 4) | static_cast<uint64_t>(digit);
+                    sawDigit_ = true;
+                } else if (!sawDigit_) {
+                    return Status::BAD_REQUEST;
+                } else if (c == ';' || c == ' ' || c == '\t') {
+                    state_ = State::EXTENSION;
+                } else if (c == '\r') {
+                    state_ = State::SIZE_LF;
+                } else {
+                    return Status::BAD_REQUEST;
+                }
+                in++;
+                break;
+            }
+
+            case State::EXTENSION:
+                if (c == '\r') {
+                    state_ = State::SIZE_LF;
+                }
+                in++;
+                break;
+
+            case State::SIZE_LF:
+                if (c != '\n') {
+                    return Status::BAD_REQUEST;
+                }
+                in++;
+                sawDigit_ = false;
+                state_ = remaining_ == 0 ? State::TRAILER : State::DATA;
+                break;
+
+            case State::DATA: {
+                size_t take = static_cast<size_t>(std::min<uint64_t>(remaining_, size - in));
+                std::memmove(data + payload, data + in, take);
+                payload += take;
+                in += take;
+                remaining_ -= take;
+                if (remaining_ == 0) {
+                    state_ = State::DATA_CR;
+                }
+                break;
+            }
+
+            case State::DATA_CR:
+                if (c != '\r') {
+                    return Status::BAD_REQUEST;
+                }
+                in++;
+                state_ = State::DATA_LF;
+                break;
+
+            case State::DATA_LF:
+                if (c != '\n') {
+                    return Status::BAD_REQUEST;
+                }
+                in++;
+                state_ = State::SIZE;
+                break;
+
+            case State::TRAILER:
+                in++;
+                state_ = c == '\r' ? State::FINAL_LF : State::TRAILER_LINE;
+                break;
+
+            case State::TRAILER_LINE:
+                if (c == '\n') {
+                    state_ = State::TRAILER;
+                }
+                in++;
+                break;
+
+            case State::FINAL_LF:
+                if (c != '\n') {
+                    return Status::BAD_REQUEST;
+                }
+                in++;
+                state_ = State::DONE;
+                break;
+
+            case State::DONE:
+                break;
+        }
+    }
+
+    consumed = in;
+    return state_ == State::DONE ? Status::COMPLETE : Status::INCOMPLETE;
+}
+
+} // namespace chad
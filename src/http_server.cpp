@@ -1,22 +1,62 @@
 #include "../include/http_server.hpp"
+#include "../include/http_connection.hpp"
+#include "../include/cpu_affinity.hpp"
 #include "../include/logger.hpp"
+#include <algorithm>
+#include <charconv>
+#include <cstring>
 #include <iostream>
+#include <random>
 #include <sstream>
 #include <thread>
-#include <regex>
 #include <boost/asio.hpp>
 #include <nlohmann/json.hpp>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 namespace chad {
 
 using boost::asio::ip::tcp;
 
-HttpServer::HttpServer(unsigned short port) : port_(port), running_(false) {
-    ioService_ = std::make_unique<boost::asio::io_service>();
+namespace {
+
+// Deadline resolution and wheel size (about 100 s per revolution)
+constexpr std::chrono::milliseconds TIMER_TICK(100);
+constexpr size_t TIMER_SLOTS = 1024;
+
+// Pause before accepting again after an error such as running out of descriptors
+constexpr std::chrono::milliseconds ACCEPT_RETRY_DELAY(100);
+
+using ReusePort = boost::asio::detail::socket_option::boolean<SOL_SOCKET, SO_REUSEPORT>;
+
+} // namespace
+
+HttpServer::Shard::Shard(size_t threads)
+    : timerWheel(TIMER_TICK, TIMER_SLOTS),
+      ioContext(std::make_unique<boost::asio::io_context>(static_cast<int>(threads))),
+      acceptRetry(*ioContext),
+      threads(threads) {}
+
+HttpServer::HttpServer(unsigned short port, size_t numThreads)
+    : port_(port),
+      numThreads_(numThreads > 0 ? numThreads : std::max(1u, std::thread::hardware_concurrency())),
+      acceptShards_(0),
+      keepAliveTimeout_(5000),
+      maxRequestsPerConnection_(100),
+      bodyMemoryInUse_(0),
+      running_(false),
+      draining_(false),
+      connectionCount_(0) {
+    shards_.push_back(std::make_unique<Shard>(numThreads_));
 }
 
 HttpServer::~HttpServer() {
     stop();
+
+    // Each shard releases its parked connections before its timer wheel goes away
+    shards_.clear();
 }
 
 bool HttpServer::start() {
@@ -26,29 +66,65 @@ bool HttpServer::start() {
     }
     
     try {
-        acceptor_ = std::make_unique<tcp::acceptor>(*ioService_, tcp::endpoint(tcp::v4(), port_));
+        for (size_t i = 0; i < shards_.size(); ++i) {
+            Shard& shard = *shards_[i];
+            if (shard.ioContext->stopped()) {
+                shard.ioContext->restart();
+            }
+            openAcceptor(shard, i < adoptedListeners_.size() ? adoptedListeners_[i] : -1);
+        }
+
+        // Listeners beyond our shard count would only queue connections nobody accepts
+        for (size_t i = shards_.size(); i < adoptedListeners_.size(); ++i) {
+            ::close(adoptedListeners_[i]);
+        }
+        adoptedListeners_.clear();
+
+        draining_ = false;
         running_ = true;
-        
-        // Start accepting connections in a separate thread
-        serverThread_ = std::make_unique<std::thread>([this]() {
-            LOG_INFO("Server started on port " + std::to_string(port_));
-            
-            try {
-                while (running_) {
-                    acceptConnection();
-                }
-            } catch (const std::exception& e) {
-                if (running_) { // Only log if not stopping deliberately
-                    LOG_ERROR("Server thread exception: " + std::string(e.what()));
+
+        // Without sharding, a fixed pool of threads drives every socket and no
+        // thread is tied to a client; with it, each shard's thread owns its
+        // connections and stays on one CPU unless told otherwise
+        std::vector<CpuSet> cpuSets = cpuSets_;
+        if (cpuSets.empty() && acceptShards_ > 0) {
+            for (int cpu : CpuTopology::getInstance().cpus()) {
+                cpuSets.push_back({cpu});
+            }
+        }
+        for (auto& shard : shards_) {
+            shard->timerWheel.start(*shard->ioContext);
+            acceptConnection(*shard);
+
+            for (size_t i = 0; i < shard->threads; ++i) {
+                ioThreads_.emplace_back([this, context = shard->ioContext.get()]() {
+                    try {
+                        context->run();
+                    } catch (const std::exception& e) {
+                        LOG_ERROR("IO thread exception: " + std::string(e.what()));
+                    }
+                });
+
+                // Best effort: an unpinned thread still works, it just may migrate
+                if (!cpuSets.empty()) {
+                    pinThread(ioThreads_.back().native_handle(), cpuSets[(ioThreads_.size() - 1) % cpuSets.size()]);
                 }
             }
-            
-            LOG_INFO("Server thread stopped");
-        });
-        
+        }
+
+        if (acceptShards_ > 0) {
+            LOG_INFO("Server started on port " + std::to_string(port_) + " with " +
+                     std::to_string(shards_.size()) + " SO_REUSEPORT accept shards");
+        } else {
+            LOG_INFO("Server started on port " + std::to_string(port_) + " with " +
+                     std::to_string(numThreads_) + " IO threads");
+        }
         return true;
     } catch (const std::exception& e) {
         LOG_ERROR("Failed to start server: " + std::string(e.what()));
+        for (auto& shard : shards_) {
+            shard->acceptor.reset();
+        }
         running_ = false;
         return false;
     }
@@ -62,20 +138,27 @@ void HttpServer::stop() {
     LOG_INFO("Stopping server");
     running_ = false;
     
-    // Close acceptor to stop accepting new connections
-    if (acceptor_ && acceptor_->is_open()) {
-        boost::system::error_code ec;
-        acceptor_->close(ec);
+    // Stop IO contexts; pending connection handlers are released with them
+    for (auto& shard : shards_) {
+        shard->ioContext->stop();
     }
     
-    // Stop IO service
-    if (ioService_) {
-        ioService_->stop();
+    // Wait for IO threads to finish
+    for (std::thread& thread : ioThreads_) {
+        if (thread.joinable()) {
+            thread.join();
+        }
     }
+    ioThreads_.clear();
     
-    // Wait for server thread to finish
-    if (serverThread_ && serverThread_->joinable()) {
-        serverThread_->join();
+    // Close acceptors once no IO thread can touch them anymore
+    for (auto& shard : shards_) {
+        shard->timerWheel.stop();
+        shard->acceptRetry.cancel();
+        if (shard->acceptor && shard->acceptor->is_open()) {
+            boost::system::error_code ec;
+            shard->acceptor->close(ec);
+        }
     }
     
     LOG_INFO("Server stopped");
@@ -86,215 +169,516 @@ void HttpServer::setVideoProcessor(std::shared_ptr<VideoProcessor> processor) {
 }
 
 void HttpServer::addRoute(const std::string& method, const std::string& path, RequestHandler handler) {
-    routes_[method][path] = handler;
+    routeFor(method, path).handler = handler;
     LOG_DEBUG("Added route: " + method + " " + path);
 }
 
+void HttpServer::addAsyncRoute(const std::string& method, const std::string& path, AsyncRequestHandler handler) {
+    routeFor(method, path).asyncHandler = handler;
+    LOG_DEBUG("Added async route: " + method + " " + path);
+}
+
+void HttpServer::setKeepAlive(std::chrono::milliseconds idleTimeout, size_t maxRequestsPerConnection) {
+    keepAliveTimeout_ = idleTimeout;
+    maxRequestsPerConnection_ = maxRequestsPerConnection;
+}
+
+void HttpServer::setLimits(const Limits& limits) {
+    limits_ = limits;
+}
+
+void HttpServer::setRateLimit(const RateLimiter::Settings& settings) {
+    rateLimiter_ = std::make_unique<RateLimiter>(settings);
+}
+
+void HttpServer::addBodySink(const std::string& method, const std::string& path, BodySinkFactory factory) {
+    routeFor(method, path).bodySink = factory;
+    LOG_DEBUG("Added body sink: " + method + " " + path);
+}
+
 bool HttpServer::isRunning() const {
     return running_;
 }
 
-void HttpServer::acceptConnection() {
-    tcp::socket socket(*ioService_);
-    acceptor_->accept(socket);
-    
-    // Handle client in a separate thread
-    std::thread([this, sock = std::move(socket)]() mutable {
-        handleClient(std::move(sock));
-    }).detach();
+size_t HttpServer::getConnectionCount() const {
+    return connectionCount_.load();
 }
 
-void HttpServer::handleClient(tcp::socket socket) {
-    try {
-        boost::asio::streambuf buffer;
-        boost::system::error_code error;
-        
-        // Read the request
-        boost::asio::read_until(socket, buffer, "\r\n\r\n", error);
-        
-        if (error) {
-            LOG_ERROR("Error reading request: " + error.message());
-            return;
+boost::asio::any_io_executor HttpServer::getExecutor() const {
+    return shards_.front()->ioContext->get_executor();
+}
+
+void HttpServer::setAcceptShards(size_t shards) {
+    if (running_) {
+        LOG_WARNING("Accept shards can only be changed while the server is stopped");
+        return;
+    }
+
+    acceptShards_ = shards;
+    shards_.clear();
+    if (shards == 0) {
+        shards_.push_back(std::make_unique<Shard>(numThreads_));
+    } else {
+        for (size_t i = 0; i < shards; ++i) {
+            shards_.push_back(std::make_unique<Shard>(1));
         }
-        
-        // Convert to string
-        std::string requestStr(
-            boost::asio::buffers_begin(buffer.data()),
-            boost::asio::buffers_begin(buffer.data()) + buffer.size()
-        );
-        
-        // Parse the request
-        HttpRequest request = parseRequest(requestStr);
-        
-        // Read any remaining body data for POST/PUT requests
-        if (request.method == "POST" || request.method == "PUT") {
-            auto contentLengthIt = request.headers.find("Content-Length");
-            if (contentLengthIt != request.headers.end()) {
-                size_t contentLength = std::stoul(contentLengthIt->second);
-                
-                // If we've already read part of the body
-                size_t headerSize = requestStr.find("\r\n\r\n") + 4;
-                size_t bodyAlreadyRead = requestStr.size() - headerSize;
-                
-                // If there's more to read
-                if (bodyAlreadyRead < contentLength) {
-                    size_t remaining = contentLength - bodyAlreadyRead;
-                    std::vector<char> bodyBuffer(remaining);
-                    
-                    size_t bytesRead = boost::asio::read(
-                        socket, 
-                        boost::asio::buffer(bodyBuffer),
-                        boost::asio::transfer_exactly(remaining),
-                        error
-                    );
-                    
-                    if (error && error != boost::asio::error::eof) {
-                        LOG_ERROR("Error reading request body: " + error.message());
-                    } else {
-                        request.body.append(requestStr.substr(headerSize));
-                        request.body.append(bodyBuffer.begin(), bodyBuffer.begin() + bytesRead);
-                    }
-                } else {
-                    request.body = requestStr.substr(headerSize);
+    }
+}
+
+void HttpServer::setCpuAffinity(std::vector<CpuSet> cpuSets) {
+    if (running_) {
+        LOG_WARNING("CPU affinity can only be changed while the server is stopped");
+        return;
+    }
+    cpuSets_ = std::move(cpuSets);
+}
+
+void HttpServer::adoptListeners(std::vector<int> fds) {
+    if (running_) {
+        LOG_WARNING("Listeners can only be adopted while the server is stopped");
+        return;
+    }
+    adoptedListeners_ = std::move(fds);
+}
+
+std::vector<int> HttpServer::listenerFds() const {
+    std::vector<int> fds;
+    for (const auto& shard : shards_) {
+        if (shard->acceptor && shard->acceptor->is_open()) {
+            fds.push_back(shard->acceptor->native_handle());
+        }
+    }
+    return fds;
+}
+
+void HttpServer::stopAccepting() {
+    draining_ = true;
+
+    // Closed on each shard's own thread, where its pending accept runs
+    for (auto& shard : shards_) {
+        boost::asio::post(*shard->ioContext, [&shard = *shard]() {
+            if (shard.acceptor && shard.acceptor->is_open()) {
+                boost::system::error_code ec;
+                shard.acceptor->close(ec);
+            }
+        });
+    }
+    LOG_INFO("Stopped accepting connections, draining");
+}
+
+void HttpServer::openAcceptor(Shard& shard, int adoptedFd) {
+    tcp::endpoint endpoint(tcp::v4(), port_);
+    shard.acceptor = std::make_unique<tcp::acceptor>(*shard.ioContext);
+
+    if (adoptedFd >= 0) {
+        // Already bound and listening, with connections possibly queued on it
+        shard.acceptor->assign(endpoint.protocol(), adoptedFd);
+        return;
+    }
+
+    shard.acceptor->open(endpoint.protocol());
+    shard.acceptor->set_option(tcp::acceptor::reuse_address(true));
+
+    // Every shard binds the same port; the kernel hashes new connections across them
+    if (acceptShards_ > 0) {
+        shard.acceptor->set_option(ReusePort(true));
+    }
+
+    shard.acceptor->bind(endpoint);
+    shard.acceptor->listen();
+}
+
+void HttpServer::acceptConnection(Shard& shard) {
+    // Each connection gets its own strand so its handlers never run concurrently
+    shard.acceptor->async_accept(boost::asio::make_strand(*shard.ioContext),
+        [this, &shard](const boost::system::error_code& error, tcp::socket socket) {
+            if (!running_) {
+                return;
+            }
+
+            if (error) {
+                if (error != boost::asio::error::operation_aborted) {
+                    // EMFILE and the like persist until connections close; accepting
+                    // again right away would fail the same way in a busy loop
+                    LOG_ERROR("Error accepting connection: " + error.message());
+                    shard.acceptRetry.expires_after(ACCEPT_RETRY_DELAY);
+                    shard.acceptRetry.async_wait([this, &shard](const boost::system::error_code& ec) {
+                        if (!ec && running_ && shard.acceptor->is_open()) {
+                            acceptConnection(shard);
+                        }
+                    });
+                    return;
                 }
+            } else if (connectionCount_.load() >= limits_.maxConnections) {
+                LOG_DEBUG("Connection limit reached, rejecting client");
+                rejectConnection(socket);
+            } else {
+                std::make_shared<HttpConnection>(std::move(socket), *this, shard.timerWheel)->start();
             }
-        }
-        
-        // Find and execute the appropriate handler
-        RequestHandler handler = findHandler(request.method, request.path);
-        
-        HttpResponse response;
-        if (handler) {
-            // Execute the handler
-            try {
-                handler(request, response);
-            } catch (const std::exception& e) {
-                LOG_ERROR("Exception in request handler: " + std::string(e.what()));
-                response.statusCode = 500;
-                response.statusText = "Internal Server Error";
-                response.setText("Internal server error: " + std::string(e.what()));
+
+            if (shard.acceptor->is_open()) {
+                acceptConnection(shard);
             }
-        } else {
-            // No handler found, return 404
-            response.statusCode = 404;
-            response.statusText = "Not Found";
-            response.setText("Resource not found: " + request.path);
+        });
+}
+
+void HttpServer::rejectConnection(tcp::socket& socket) {
+    static constexpr std::string_view response =
+        "HTTP/1.1 503 Service Unavailable\r\n"
+        "Retry-After: 1\r\n"
+        "Connection: close\r\n"
+        "Content-Length: 0\r\n\r\n";
+
+    // A single non-blocking attempt; a client that cannot take it just sees the close
+    boost::system::error_code ec;
+    socket.non_blocking(true, ec);
+    socket.write_some(boost::asio::buffer(response.data(), response.size()), ec);
+    socket.shutdown(tcp::socket::shutdown_both, ec);
+    socket.close(ec);
+}
+
+bool HttpServer::reserveBodyMemory(size_t bytes) {
+    size_t inUse = bodyMemoryInUse_.load(std::memory_order_relaxed);
+    do {
+        if (inUse > limits_.maxBodyMemory || bytes > limits_.maxBodyMemory - inUse) {
+            return false;
         }
-        
-        // Send the response
-        sendResponse(socket, response);
-    } catch (const std::exception& e) {
-        LOG_ERROR("Exception handling client: " + std::string(e.what()));
+    } while (!bodyMemoryInUse_.compare_exchange_weak(inUse, inUse + bytes, std::memory_order_relaxed));
+    return true;
+}
+
+void HttpServer::releaseBodyMemory(size_t bytes) {
+    bodyMemoryInUse_.fetch_sub(bytes, std::memory_order_relaxed);
+}
+
+HttpServer::Route& HttpServer::routeFor(const std::string& method, const std::string& pattern) {
+    size_t index = router_.insert(method, pattern, routeTable_.size());
+    if (index == routeTable_.size()) {
+        routeTable_.emplace_back();
     }
+    return routeTable_[index];
 }
 
-HttpRequest HttpServer::parseRequest(const std::string& requestStr) {
-    HttpRequest request;
-    std::istringstream requestStream(requestStr);
-    
-    // Parse the request line
-    std::string requestLine;
-    std::getline(requestStream, requestLine);
+Router::Match HttpServer::matchRoute(HttpRequest& request) const {
+    return router_.find(request.method, request.path, request.pathParams);
+}
+
+const HttpServer::Route* HttpServer::findRoute(const Router::Match& match) const {
+    return match.route == Router::NO_ROUTE ? nullptr : &routeTable_[match.route];
+}
+
+bool HttpServer::dispatch(const Router::Match& match, const HttpRequest& request, HttpResponse& response,
+                          const std::shared_ptr<HttpConnection>& connection) {
+    const Route* route = findRoute(match);
     
-    // Remove carriage return if present
-    if (!requestLine.empty() && requestLine.back() == '\r') {
-        requestLine.pop_back();
+    if (route && route->asyncHandler) {
+        try {
+            route->asyncHandler(request, HttpResponder(connection));
+            return false;
+        } catch (const std::exception& e) {
+            // Any responder the handler made has already answered with 500
+            LOG_ERROR("Exception in request handler: " + std::string(e.what()));
+            return false;
+        }
+    } else if (route && route->handler) {
+        // Execute the handler
+        try {
+            route->handler(request, response);
+        } catch (const std::exception& e) {
+            LOG_ERROR("Exception in request handler: " + std::string(e.what()));
+            response.statusCode = 500;
+            response.statusText = "Internal Server Error";
+            response.setText("Internal server error: " + std::string(e.what()));
+        }
+    } else if (match.pathMatched) {
+        response.statusCode = 405;
+        response.statusText = "Method Not Allowed";
+        response.setText("Method not allowed: " + std::string(request.method));
+    } else {
+        // No handler found, return 404
+        response.statusCode = 404;
+        response.statusText = "Not Found";
+        response.setText("Resource not found: " + std::string(request.path));
     }
-    
-    // Parse method, path (with query string), and HTTP version
-    std::istringstream lineStream(requestLine);
-    lineStream >> request.method >> request.path >> request.version;
-    
-    // Parse query parameters if present
-    size_t queryPos = request.path.find('?');
-    if (queryPos != std::string::npos) {
-        std::string queryString = request.path.substr(queryPos + 1);
-        request.path = request.path.substr(0, queryPos);
-        request.queryParams = parseQueryParams(queryString);
+
+    return true;
+}
+
+namespace {
+
+int hexValue(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+// application/x-www-form-urlencoded decoding ('+' is a space)
+std::string urlDecode(std::string_view encoded) {
+    std::string decoded;
+    decoded.reserve(encoded.size());
+
+    for (size_t i = 0; i < encoded.size(); ++i) {
+        char c = encoded[i];
+        if (c == '+') {
+            decoded += ' ';
+        } else if (c == '%' && i + 2 < encoded.size() &&
+                   hexValue(encoded[i + 1]) >= 0 && hexValue(encoded[i + 2]) >= 0) {
+            decoded += static_cast<char>(hexValue(encoded[i + 1]) * 16 + hexValue(encoded[i + 2]));
+            i += 2;
+        } else {
+            decoded += c;
+        }
     }
-    
-    // Parse headers
-    std::string headerLine;
-    while (std::getline(requestStream, headerLine) && headerLine != "\r" && headerLine != "") {
-        if (headerLine.back() == '\r') {
-            headerLine.pop_back();
+
+    return decoded;
+}
+
+enum class RangeResult {
+    NONE,
+    SATISFIABLE,
+    UNSATISFIABLE
+};
+
+// At most this many ranges are honoured; more are answered with the whole file
+constexpr size_t MAX_BYTE_RANGES = 16;
+
+bool parseNumber(std::string_view text, uint64_t& value) {
+    const char* end = text.data() + text.size();
+    auto result = std::from_chars(text.data(), end, value);
+    return !text.empty() && result.ec == std::errc() && result.ptr == end;
+}
+
+std::string_view trim(std::string_view text) {
+    while (!text.empty() && (text.front() == ' ' || text.front() == '\t')) text.remove_prefix(1);
+    while (!text.empty() && (text.back() == ' ' || text.back() == '\t')) text.remove_suffix(1);
+    return text;
+}
+
+// RFC 7233 byte-ranges-specifier; ranges are inclusive [first, last]
+RangeResult parseByteRanges(std::string_view header, uint64_t fileSize,
+                            std::vector<std::pair<uint64_t, uint64_t>>& ranges) {
+    header = trim(header);
+    if (header.substr(0, 6) != "bytes=") {
+        return RangeResult::NONE;
+    }
+    header.remove_prefix(6);
+
+    size_t specCount = 0;
+    while (!header.empty()) {
+        size_t commaPos = header.find(',');
+        std::string_view spec = trim(header.substr(0, commaPos));
+        header = commaPos == std::string_view::npos ? std::string_view() : header.substr(commaPos + 1);
+
+        if (spec.empty()) {
+            continue;
+        }
+        if (++specCount > MAX_BYTE_RANGES) {
+            return RangeResult::NONE;
         }
-        
-        size_t colonPos = headerLine.find(':');
-        if (colonPos != std::string::npos) {
-            std::string name = headerLine.substr(0, colonPos);
-            std::string value = headerLine.substr(colonPos + 1);
-            
-            // Trim leading whitespace from value
-            value.erase(value.begin(), std::find_if(value.begin(), value.end(), [](unsigned char ch) {
-                return !std::isspace(ch);
-            }));
-            
-            request.headers[name] = value;
+
+        size_t dashPos = spec.find('-');
+        if (dashPos == std::string_view::npos) {
+            return RangeResult::NONE;
         }
+
+        std::string_view firstText = spec.substr(0, dashPos);
+        std::string_view lastText = spec.substr(dashPos + 1);
+        uint64_t first = 0;
+        uint64_t last = 0;
+
+        if (firstText.empty()) {
+            // Suffix range: the final N bytes
+            uint64_t suffix = 0;
+            if (!parseNumber(lastText, suffix)) {
+                return RangeResult::NONE;
+            }
+            if (suffix == 0 || fileSize == 0) {
+                continue;
+            }
+            first = suffix < fileSize ? fileSize - suffix : 0;
+            last = fileSize - 1;
+        } else {
+            if (!parseNumber(firstText, first)) {
+                return RangeResult::NONE;
+            }
+            if (lastText.empty()) {
+                last = fileSize - 1;
+            } else if (!parseNumber(lastText, last) || last < first) {
+                return RangeResult::NONE;
+            }
+            if (first >= fileSize) {
+                continue;
+            }
+            last = std::min(last, fileSize - 1);
+        }
+
+        ranges.emplace_back(first, last);
     }
-    
-    return request;
+
+    if (specCount == 0) {
+        return RangeResult::NONE;
+    }
+
+    return ranges.empty() ? RangeResult::UNSATISFIABLE : RangeResult::SATISFIABLE;
 }
 
-std::unordered_map<std::string, std::string> HttpServer::parseQueryParams(const std::string& queryString) {
-    std::unordered_map<std::string, std::string> params;
-    std::istringstream stream(queryString);
-    std::string param;
-    
-    while (std::getline(stream, param, '&')) {
+const std::string& multipartBoundary() {
+    static const std::string boundary = [] {
+        std::random_device rd;
+        std::ostringstream ss;
+        ss << "CHADSERVR_" << std::hex << rd() << rd();
+        return ss.str();
+    }();
+    return boundary;
+}
+
+} // namespace
+
+FileBody::~FileBody() {
+    if (fd >= 0) {
+        ::close(fd);
+    }
+}
+
+uint64_t FileBody::size() const {
+    uint64_t total = trailer.size();
+    for (const auto& segment : segments) {
+        total += segment.prefix.size() + segment.length;
+    }
+    return total;
+}
+
+void HttpResponse::setBody(std::string&& content, const std::string& contentType) {
+    body = std::move(content);
+    sharedBody.reset();
+    file.reset();
+    headers["Content-Type"] = contentType;
+}
+
+void HttpResponse::setSharedBody(std::shared_ptr<const std::string> content, const std::string& contentType) {
+    body.clear();
+    sharedBody = std::move(content);
+    file.reset();
+    headers["Content-Type"] = contentType;
+}
+
+void HttpResponse::setWriter(BodyWriter bodyWriter, const std::string& contentType) {
+    body.clear();
+    sharedBody.reset();
+    file.reset();
+    writer = std::move(bodyWriter);
+    headers["Content-Type"] = contentType;
+}
+
+bool HttpResponse::setFile(const std::string& path, const std::string& contentType,
+                           std::optional<std::string_view> range) {
+    auto fileBody = std::make_shared<FileBody>();
+    fileBody->fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fileBody->fd < 0) {
+        return false;
+    }
+
+    struct stat st;
+    if (::fstat(fileBody->fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+        return false;
+    }
+    uint64_t fileSize = static_cast<uint64_t>(st.st_size);
+
+    body.clear();
+    sharedBody.reset();
+    file.reset();
+    headers["Accept-Ranges"] = "bytes";
+
+    std::vector<std::pair<uint64_t, uint64_t>> ranges;
+    RangeResult result = range ? parseByteRanges(*range, fileSize, ranges) : RangeResult::NONE;
+
+    if (result == RangeResult::UNSATISFIABLE) {
+        statusCode = 416;
+        statusText = "Range Not Satisfiable";
+        headers["Content-Range"] = "bytes */" + std::to_string(fileSize);
+        headers.erase("Content-Type");
+        return true;
+    }
+
+    if (result == RangeResult::NONE) {
+        statusCode = 200;
+        statusText = "OK";
+        headers["Content-Type"] = contentType;
+        fileBody->segments.push_back({"", 0, fileSize});
+    } else if (ranges.size() == 1) {
+        statusCode = 206;
+        statusText = "Partial Content";
+        headers["Content-Type"] = contentType;
+        headers["Content-Range"] = "bytes " + std::to_string(ranges[0].first) + "-" +
+                                   std::to_string(ranges[0].second) + "/" + std::to_string(fileSize);
+        fileBody->segments.push_back({"", ranges[0].first, ranges[0].second - ranges[0].first + 1});
+    } else {
+        const std::string& boundary = multipartBoundary();
+        statusCode = 206;
+        statusText = "Partial Content";
+        headers["Content-Type"] = "multipart/byteranges; boundary=" + boundary;
+
+        for (const auto& byteRange : ranges) {
+            std::string prefix = (fileBody->segments.empty() ? "--" : "\r\n--") + boundary + "\r\n" +
+                                 "Content-Type: " + contentType + "\r\n" +
+                                 "Content-Range: bytes " + std::to_string(byteRange.first) + "-" +
+                                 std::to_string(byteRange.second) + "/" + std::to_string(fileSize) + "\r\n\r\n";
+            fileBody->segments.push_back({std::move(prefix), byteRange.first, byteRange.second - byteRange.first + 1});
+        }
+        fileBody->trailer = "\r\n--" + boundary + "--\r\n";
+    }
+
+    file = std::move(fileBody);
+    return true;
+}
+
+std::optional<std::string> HttpRequest::queryParam(std::string_view name) const {
+    std::string_view rest = query;
+
+    while (!rest.empty()) {
+        size_t ampPos = rest.find('&');
+        std::string_view param = rest.substr(0, ampPos);
+        rest = ampPos == std::string_view::npos ? std::string_view() : rest.substr(ampPos + 1);
+
         size_t equalsPos = param.find('=');
-        if (equalsPos != std::string::npos) {
-            std::string name = param.substr(0, equalsPos);
-            std::string value = param.substr(equalsPos + 1);
-            params[name] = value;
-        } else {
-            // Parameter with no value
-            params[param] = "";
+        std::string_view paramName = param.substr(0, equalsPos);
+        if (paramName == name) {
+            // Parameter with no value yields an empty string
+            return equalsPos == std::string_view::npos ? std::string() : urlDecode(param.substr(equalsPos + 1));
         }
     }
-    
-    return params;
+
+    return std::nullopt;
 }
 
-void HttpServer::sendResponse(tcp::socket& socket, const HttpResponse& response) {
-    std::stringstream ss;
-    
+void HttpServer::serializeHead(const HttpResponse& response, std::string& out) {
+    char number[24];
+    auto appendNumber = [&out, &number](uint64_t value) {
+        auto result = std::to_chars(number, number + sizeof(number), value);
+        out.append(number, result.ptr);
+    };
+
     // Status line
-    ss << "HTTP/1.1 " << response.statusCode << " " << response.statusText << "\r\n";
+    out.append("HTTP/1.1 ");
+    appendNumber(static_cast<uint64_t>(response.statusCode));
+    out.append(" ").append(response.statusText).append("\r\n");
     
-    // Content length
-    ss << "Content-Length: " << response.body.size() << "\r\n";
+    // Content length; streamed bodies are framed by the connection instead,
+    // and a 304 describes a body it does not carry
+    if (!response.isStreamed() && response.statusCode != 304) {
+        out.append("Content-Length: ");
+        appendNumber(response.contentLength());
+        out.append("\r\n");
+    }
     
     // Headers
     for (const auto& header : response.headers) {
-        ss << header.first << ": " << header.second << "\r\n";
+        out.append(header.first).append(": ").append(header.second).append("\r\n");
     }
     
-    // End of headers
-    ss << "\r\n";
-    
-    // Body
-    ss << response.body;
-    
-    // Send the response
-    std::string responseStr = ss.str();
-    boost::asio::write(socket, boost::asio::buffer(responseStr));
-}
-
-HttpServer::RequestHandler HttpServer::findHandler(const std::string& method, const std::string& path) {
-    // Try exact match first
-    auto methodIt = routes_.find(method);
-    if (methodIt != routes_.end()) {
-        auto pathIt = methodIt->second.find(path);
-        if (pathIt != methodIt->second.end()) {
-            return pathIt->second;
-        }
-    }
-    
-    // TODO: Implement pattern matching for path parameters
-    
-    return nullptr; // No handler found
+    // End of headers; the body is sent as a separate buffer
+    out.append("\r\n");
 }
 
 } // namespace chad
\ No newline at end of file
@@ -15,24 +15,27 @@ namespace chad {
     }
 
     bool Logger::initialize(const std::string& logFilePath, LogLevel minLevel, bool consoleOutput) {
-        std::lock_guard<std::mutex> lock(logMutex_);
+        {
+            std::lock_guard<std::mutex> lock(logMutex_);
 
-        if (initialized_) {
-            if (logFile_.is_open()) {
-                logFile_.close();
+            if (initialized_) {
+                if (logFile_.is_open()) {
+                    logFile_.close();
+                }
             }
-        }
 
-        logFile_.open(logFilePath, std::ios::out | std::ios::app);
-        if (!logFile_.is_open()) {
-            std::cerr << "Logger Error: Failed to open log file: " << logFilePath << std::endl;
-            return false;
-        }
+            logFile_.open(logFilePath, std::ios::out | std::ios::app);
+            if (!logFile_.is_open()) {
+                std::cerr << "Logger Error: Failed to open log file: " << logFilePath << std::endl;
+                return false;
+            }
 
-        minLevel_ = minLevel;
-        consoleOutput_ = consoleOutput;
-        initialized_ = true;
+            minLevel_ = minLevel;
+            consoleOutput_ = consoleOutput;
+            initialized_ = true;
+        }
 
+        // log() takes logMutex_ itself
         log(LogLevel::INFO, "Logger initialized successfully.");
         return true;
     }
@@ -0,0 +1,173 @@
+#include "../include/rate_limiter.hpp"
+#include "../include/logger.hpp"
+
+#include <algorithm>
+
+namespace chad {
+
+namespace {
+
+// Fixed-point scale: one request costs this many token units
+constexpr uint64_t TOKEN_UNIT = 256;
+
+constexpr int64_t MS_PER_MINUTE = 60 * 1000;
+
+// Slots inspected per lookup before the table counts as full
+constexpr size_t MAX_PROBES = 16;
+
+uint64_t mixHash(uint64_t x) {
+    x ^= x >> 30;
+    x *= 0xbf58476d1ce4e5b9ULL;
+    x ^= x >> 27;
+    x *= 0x94d049bb133111ebULL;
+    x ^= x >> 31;
+    return x;
+}
+
+size_t roundUpToPowerOfTwo(size_t n) {
+    size_t result = 1;
+    while (result < n) {
+        result <<= 1;
+    }
+    return result;
+}
+
+} // namespace
+
+RateLimiter::RateLimiter(const Settings& settings, size_t capacity)
+    : settings_{std::clamp<size_t>(settings.requestsPerMinute, 1, ((1u << TOKEN_BITS) - 1) / TOKEN_UNIT),
+                settings.banThreshold, settings.banTime},
+      capacityUnits_(settings_.requestsPerMinute * TOKEN_UNIT),
+      // Start the clock a minute back so that an untouched bucket (time 0) reads as full
+      epoch_(std::chrono::steady_clock::now() - std::chrono::minutes(1)),
+      mask_(roundUpToPowerOfTwo(std::max(capacity, MAX_PROBES)) - 1),
+      slots_(new Slot[mask_ + 1]) {}
+
+RateLimiter::~RateLimiter() = default;
+
+uint64_t RateLimiter::clientKey(const boost::asio::ip::address& address) {
+    uint64_t key = 0;
+
+    if (address.is_v4()) {
+        key = 0xffff00000000ULL | address.to_v4().to_uint();
+    } else {
+        auto v6 = address.to_v6();
+        if (v6.is_v4_mapped()) {
+            return clientKey(boost::asio::ip::make_address_v4(boost::asio::ip::v4_mapped, v6));
+        }
+        auto bytes = v6.to_bytes();
+        for (size_t i = 0; i < 8; ++i) {
+            key = (key << 8) | bytes[i];
+        }
+    }
+
+    // 0 marks an empty slot
+    return key == 0 ? 1 : key;
+}
+
+int64_t RateLimiter::nowMs() const {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - epoch_).count();
+}
+
+bool RateLimiter::isStale(const Slot& slot, int64_t now) const {
+    // A bucket untouched for a minute is full again, so forgetting it changes nothing
+    int64_t last = static_cast<int64_t>(slot.bucket.load(std::memory_order_relaxed) >> TOKEN_BITS);
+    return now - last >= MS_PER_MINUTE && slot.bannedUntil.load(std::memory_order_relaxed) <= now;
+}
+
+RateLimiter::Slot* RateLimiter::findSlot(uint64_t client, int64_t now) {
+    size_t index = mixHash(client) & mask_;
+    Slot* stale = nullptr;
+
+    for (size_t probe = 0; probe < MAX_PROBES; ++probe) {
+        Slot& slot = slots_[(index + probe) & mask_];
+        uint64_t key = slot.key.load(std::memory_order_acquire);
+
+        if (key == client) {
+            return &slot;
+        }
+
+        if (key == 0) {
+            // Keys are never removed, so the client is not further along the probe
+            if (slot.key.compare_exchange_strong(key, client, std::memory_order_acq_rel) || key == client) {
+                return &slot;
+            }
+            continue;
+        }
+
+        if (!stale && isStale(slot, now)) {
+            stale = &slot;
+        }
+    }
+
+    if (stale) {
+        uint64_t key = stale->key.load(std::memory_order_acquire);
+        if (isStale(*stale, now) && stale->key.compare_exchange_strong(key, client, std::memory_order_acq_rel)) {
+            // The stale bucket already reads as full; only the ban history is reset
+            stale->violations.store(0, std::memory_order_relaxed);
+            return stale;
+        }
+    }
+
+    return nullptr;
+}
+
+RateLimiter::Decision RateLimiter::acquire(uint64_t client, std::chrono::seconds& retryAfter) {
+    int64_t now = nowMs();
+
+    Slot* slot = findSlot(client, now);
+    if (!slot) {
+        // Fail open rather than punish clients for a crowded table
+        return Decision::ALLOW;
+    }
+
+    int64_t bannedUntil = slot->bannedUntil.load(std::memory_order_relaxed);
+    if (bannedUntil > now) {
+        retryAfter = std::chrono::seconds((bannedUntil - now + 999) / 1000);
+        return Decision::BANNED;
+    }
+
+    const uint64_t rate = settings_.requestsPerMinute * TOKEN_UNIT;   // units per minute
+    const uint64_t tokenMask = (uint64_t(1) << TOKEN_BITS) - 1;
+
+    uint64_t state = slot->bucket.load(std::memory_order_relaxed);
+    for (;;) {
+        int64_t last = static_cast<int64_t>(state >> TOKEN_BITS);
+        uint64_t elapsed = static_cast<uint64_t>(std::clamp<int64_t>(now - last, 0, MS_PER_MINUTE));
+
+        uint64_t refill = elapsed * rate / MS_PER_MINUTE;
+        uint64_t tokens = std::min(capacityUnits_, (state & tokenMask) + refill);
+
+        if (tokens < TOKEN_UNIT) {
+            retryAfter = std::chrono::seconds(std::max<uint64_t>(1, ((TOKEN_UNIT - tokens) * 60 + rate - 1) / rate));
+            break;
+        }
+
+        // Advance the clock only by the time actually converted into tokens,
+        // so frequent callers do not lose fractional refills
+        int64_t time = tokens == capacityUnits_ ? now : last + static_cast<int64_t>(refill * MS_PER_MINUTE / rate);
+
+        uint64_t next = (static_cast<uint64_t>(time) << TOKEN_BITS) | (tokens - TOKEN_UNIT);
+        if (slot->bucket.compare_exchange_weak(state, next, std::memory_order_relaxed)) {
+            if (tokens == capacityUnits_ && slot->violations.load(std::memory_order_relaxed) != 0) {
+                // A full bucket means the client has backed off
+                slot->violations.store(0, std::memory_order_relaxed);
+            }
+            return Decision::ALLOW;
+        }
+    }
+
+    if (settings_.banThreshold > 0 &&
+        slot->violations.fetch_add(1, std::memory_order_relaxed) + 1 >= settings_.banThreshold) {
+        auto banMs = std::chrono::duration_cast<std::chrono::milliseconds>(settings_.banTime).count();
+        slot->bannedUntil.store(now + banMs, std::memory_order_relaxed);
+        slot->violations.store(0, std::memory_order_relaxed);
+        retryAfter = std::chrono::duration_cast<std::chrono::seconds>(settings_.banTime);
+        LOG_WARNING("Banning client after repeated rate limit violations");
+        return Decision::BANNED;
+    }
+
+    return Decision::LIMITED;
+}
+
+} // namespace chad
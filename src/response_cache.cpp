@@ -0,0 +1,92 @@
+#include "../include/response_cache.hpp"
+
+#include <cstdio>
+
+namespace chad {
+
+namespace {
+
+// FNV-1a; the ETag only has to change when the bytes do
+uint64_t hashBody(const std::string& body) {
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for (unsigned char c : body) {
+        hash ^= c;
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+std::string_view trim(std::string_view value) {
+    while (!value.empty() && (value.front() == ' ' || value.front() == '\t')) {
+        value.remove_prefix(1);
+    }
+    while (!value.empty() && (value.back() == ' ' || value.back() == '\t')) {
+        value.remove_suffix(1);
+    }
+    return value;
+}
+
+} // namespace
+
+ResponseCache::ResponseCache(std::string contentType) : contentType_(std::move(contentType)) {}
+
+void ResponseCache::serve(const HttpRequest& request, HttpResponse& response, uint64_t version, const Builder& build) {
+    auto entry = current(version, build);
+
+    response.headers["ETag"] = entry->etag;
+    // Clients may keep the body but must ask before reusing it
+    response.headers["Cache-Control"] = "no-cache";
+
+    auto ifNoneMatch = request.findHeader("If-None-Match");
+    if (ifNoneMatch && matches(*ifNoneMatch, entry->etag)) {
+        response.statusCode = 304;
+        response.statusText = "Not Modified";
+        return;
+    }
+
+    response.setSharedBody(entry->body, contentType_);
+}
+
+std::shared_ptr<const ResponseCache::Entry> ResponseCache::current(uint64_t version, const Builder& build) {
+    auto entry = std::atomic_load(&entry_);
+    if (entry && entry->version == version) {
+        return entry;
+    }
+
+    // Concurrent misses may each rebuild; the last one published wins, and
+    // every one of them is at least as new as the version it was asked for
+    auto body = std::make_shared<const std::string>(build());
+
+    char etag[24];
+    std::snprintf(etag, sizeof(etag), "\"%016llx\"", static_cast<unsigned long long>(hashBody(*body)));
+
+    auto fresh = std::make_shared<const Entry>(Entry{version, std::move(body), etag});
+    std::atomic_store(&entry_, fresh);
+    return fresh;
+}
+
+bool ResponseCache::matches(std::string_view ifNoneMatch, std::string_view etag) {
+    // A comma-separated list of tags; weak comparison, as RFC 9110 requires here
+    while (!ifNoneMatch.empty()) {
+        size_t comma = ifNoneMatch.find(',');
+        std::string_view candidate = trim(ifNoneMatch.substr(0, comma));
+
+        if (candidate == "*") {
+            return true;
+        }
+        if (candidate.substr(0, 2) == "W/") {
+            candidate.remove_prefix(2);
+        }
+        if (candidate == etag) {
+            return true;
+        }
+
+        if (comma == std::string_view::npos) {
+            break;
+        }
+        ifNoneMatch.remove_prefix(comma + 1);
+    }
+    return false;
+}
+
+} // namespace chad
@@ -0,0 +1,196 @@
+#include "../include/router.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+
+namespace chad {
+
+Router::Node::Node() {
+    routes.fill(NO_ROUTE);
+}
+
+bool Router::Node::hasRoute() const {
+    return std::any_of(routes.begin(), routes.end(), [](size_t route) { return route != NO_ROUTE; });
+}
+
+Router::Router() : root_(std::make_unique<Node>()) {}
+
+Router::~Router() = default;
+
+int Router::methodIndex(std::string_view method) {
+    static constexpr std::array<std::string_view, METHOD_COUNT> methods = {
+        "GET", "HEAD", "POST", "PUT", "DELETE", "PATCH", "OPTIONS"
+    };
+
+    for (size_t i = 0; i < methods.size(); ++i) {
+        if (methods[i] == method) {
+            return static_cast<int>(i);
+        }
+    }
+    return -1;
+}
+
+Router::Node* Router::insertStatic(Node* node, std::string_view text) {
+    while (!text.empty()) {
+        size_t index = node->indices.find(text.front());
+
+        if (index == std::string::npos) {
+            auto child = std::make_unique<Node>();
+            child->prefix = std::string(text);
+            node->indices.push_back(text.front());
+            node->children.push_back(std::move(child));
+            return node->children.back().get();
+        }
+
+        Node* child = node->children[index].get();
+        size_t common = 0;
+        while (common < child->prefix.size() && common < text.size() && child->prefix[common] == text[common]) {
+            common++;
+        }
+
+        // Split the edge where the new text diverges from it
+        if (common < child->prefix.size()) {
+            auto middle = std::make_unique<Node>();
+            middle->prefix = child->prefix.substr(0, common);
+
+            std::unique_ptr<Node> tail = std::move(node->children[index]);
+            tail->prefix.erase(0, common);
+            middle->indices.push_back(tail->prefix.front());
+            middle->children.push_back(std::move(tail));
+
+            node->children[index] = std::move(middle);
+            child = node->children[index].get();
+        }
+
+        node = child;
+        text.remove_prefix(common);
+    }
+
+    return node;
+}
+
+size_t Router::insert(std::string_view method, std::string_view pattern, size_t route) {
+    int methodIdx = methodIndex(method);
+    if (methodIdx < 0) {
+        throw std::invalid_argument("Unsupported method: " + std::string(method));
+    }
+    if (pattern.empty() || pattern.front() != '/') {
+        throw std::invalid_argument("Route pattern must start with '/': " + std::string(pattern));
+    }
+
+    Node* node = root_.get();
+    std::string_view rest = pattern;
+
+    while (!rest.empty()) {
+        size_t special = rest.find_first_of("{*");
+        node = insertStatic(node, rest.substr(0, special));
+        if (special == std::string_view::npos) {
+            break;
+        }
+
+        // Parameters and wildcards must start a segment
+        if (special == 0 || rest[special - 1] != '/') {
+            throw std::invalid_argument("Parameter must follow '/': " + std::string(pattern));
+        }
+        rest.remove_prefix(special);
+
+        if (rest.front() == '*') {
+            std::string name(rest.substr(1));
+            if (name.empty() || name.find('/') != std::string::npos) {
+                throw std::invalid_argument("Wildcard must be the last segment: " + std::string(pattern));
+            }
+            if (!node->wildcardChild) {
+                node->wildcardChild = std::make_unique<Node>();
+                node->wildcardChild->paramName = name;
+            } else if (node->wildcardChild->paramName != name) {
+                throw std::invalid_argument("Conflicting wildcard name in: " + std::string(pattern));
+            }
+            node = node->wildcardChild.get();
+            break;
+        }
+
+        size_t close = rest.find('}');
+        if (close == std::string_view::npos || close == 1 ||
+            (close + 1 < rest.size() && rest[close + 1] != '/')) {
+            throw std::invalid_argument("Malformed parameter in: " + std::string(pattern));
+        }
+
+        std::string name(rest.substr(1, close - 1));
+        if (!node->paramChild) {
+            node->paramChild = std::make_unique<Node>();
+            node->paramChild->paramName = name;
+        } else if (node->paramChild->paramName != name) {
+            throw std::invalid_argument("Conflicting parameter name in: " + std::string(pattern));
+        }
+        node = node->paramChild.get();
+        rest.remove_prefix(close + 1);
+    }
+
+    size_t& slot = node->routes[methodIdx];
+    if (slot == NO_ROUTE) {
+        slot = route;
+    }
+    return slot;
+}
+
+Router::Match Router::find(std::string_view method, std::string_view path, std::pmr::vector<PathParam>& params) const {
+    Match result;
+    params.clear();
+
+    int methodIdx = methodIndex(method);
+    match(root_.get(), path, methodIdx, params, result);
+    return result;
+}
+
+bool Router::match(const Node* node, std::string_view rest, int method,
+                   std::pmr::vector<PathParam>& params, Match& result) const {
+    if (rest.empty()) {
+        if (node->hasRoute()) {
+            result.pathMatched = true;
+            if (method >= 0 && node->routes[method] != NO_ROUTE) {
+                result.route = node->routes[method];
+                return true;
+            }
+        }
+    } else {
+        // Static edges first
+        size_t index = node->indices.find(rest.front());
+        if (index != std::string::npos) {
+            const Node* child = node->children[index].get();
+            if (rest.compare(0, child->prefix.size(), child->prefix) == 0 &&
+                match(child, rest.substr(child->prefix.size()), method, params, result)) {
+                return true;
+            }
+        }
+
+        // Then a parameter spanning the next segment
+        if (node->paramChild) {
+            size_t segmentEnd = rest.find('/');
+            std::string_view segment = rest.substr(0, segmentEnd);
+            if (!segment.empty()) {
+                params.push_back({node->paramChild->paramName, segment});
+                if (match(node->paramChild.get(), rest.substr(segment.size()), method, params, result)) {
+                    return true;
+                }
+                params.pop_back();
+            }
+        }
+    }
+
+    // Finally a wildcard swallowing whatever is left
+    if (node->wildcardChild) {
+        const Node* wildcard = node->wildcardChild.get();
+        if (wildcard->hasRoute()) {
+            result.pathMatched = true;
+            if (method >= 0 && wildcard->routes[method] != NO_ROUTE) {
+                params.push_back({wildcard->paramName, rest});
+                result.route = wildcard->routes[method];
+                return true;
+            }
+        }
+    }
+
+    return false;
+}
+
+} // namespace chad
@@ -1,5 +1,6 @@
 #include "../include/storage_manager.hpp"
 #include "../include/logger.hpp"
+#include "../include/body_sink.hpp"
 
 #include <fstream>
 #include <filesystem>
@@ -103,188 +104,40 @@ std::shared_ptr<StorageMetadata> StorageManager::storeFile(const std::string& so
         LOG_ERROR("An unexpected error occurred while storing file from path: " + sourceFilePath + ". Error: " + std::string(e.what()));
         return nullptr;
     }
-
-        std::vector<uint8_t> data;
-        std::ifstream file(sourceFilePath, std::ios::binary);
-        if (!file) {
-            LOG_ERROR("Failed to open source file: " + sourceFilePath);
-            return nullptr;
-        }
-
-        file.seekg(0, std::ios::end);
-        size_t size = file.tellg();
-        file.seekg(0, std::ios::beg);
-
-        data.resize(size);
-        file.read(reinterpret_cast<char*>(data.data()), size);
-
-        std::string filename = fs::path(sourceFilePath).filename().string();
-
-        return storeData(data, filename, contentType);
-    } catch (const std::exception& e) {
-        LOG_ERROR("Exception storing file: " + std::string(e.what()));
-        return nullptr;
-    }
 }
 
 std::shared_ptr<StorageMetadata> StorageManager::storeData(const std::vector<uint8_t>& data, 
                                                         const std::string& filename, 
                                                         const std::string& contentType) {
-    std::lock_guard<std::mutex> lock(storageMutex_);
+    std::string basePath;
+    {
+        std::lock_guard<std::mutex> lock(storageMutex_);
+        basePath = basePath_;
+    }
 
     try {
-        const std::string& contentType) {
-std::lock_guard<std::mutex> lock(storageMutex_);
-
-try {
-if (basePath_.empty() || !fs::exists(basePath_)) {
-LOG_ERROR("Storage base path is not set or does not exist. Initialization likely failed.");
-return nullptr;
-}
-
-std::string id = generateUniqueId();
-std::string timestamp = getCurrentTimestamp();
-
-std::string storedFilename = id + "_" + filename;
-std::string filePath = fs::path(basePath_) / storedFilename;
-
-std::ofstream outFile(filePath, std::ios::binary);
-
-if (!outFile.is_open()) {
-LOG_ERROR("Failed to create or open output file for writing: " + filePath);
-return nullptr;
-}
-
-outFile.write(reinterpret_cast<const char*>(data.data()), data.size());
-
-if (!outFile) {
-LOG_ERROR("Failed to write all data to file: " + filePath + ". Some data might be missing.");
-try {
-fs::remove(filePath);
-} catch (const fs::filesystem_error& cleanup_e) {
-LOG_ERROR("Failed to clean up partial file after write error: " + filePath + ". Error: " + std::string(cleanup_e.what()));
-}
-return nullptr;
-}
-
-outFile.close();
-
-auto metadata = std::make_shared<StorageMetadata>();
-metadata->id = id;
-metadata->filename = filename;
-metadata->contentType = contentType;
-metadata->size = data.size();
-metadata->path = filePath;
-metadata->createdAt = timestamp;
-
-files_[id] = metadata;
-
-LOG_INFO("Successfully stored file with ID: " + id + ", Original Filename: " + filename + ", Size: " + std::to_string(data.size()) + " bytes at path: " + filePath);
-return metadata;
-
-} catch (const fs::filesystem_error& e) {
-LOG_ERROR("Filesystem error while storing data to file: " + std::string(e.what()));
-return nullptr;
-} catch (const std::ios_base::failure& e) {
-LOG_ERROR("I/O error while writing data to file: " + std::string(e.what()));
-return nullptr;
-} catch (const std::exception& e) {
-LOG_ERROR("An unexpected error occurred while storing data to file: " + std::string(e.what()));
-return nullptr;
-}
-}
-
-std::shared_ptr<StorageMetadata> StorageManager::getMetadata(const std::string& id) const {
-std::lock_guard<std::mutex> lock(storageMutex_);
-
-auto it = files_.find(id);
-
-if (it != files_.end()) {
-return it->second;
-}
-
-return nullptr;
-}
-
-std::string StorageManager::getFilePath(const std::string& id) const {
-auto metadata = getMetadata(id);
-
-if (metadata) {
-return metadata->path;
-}
-
-return "";
-}
-
-bool StorageManager::readFile(const std::string& id, std::vector<uint8_t>& data) const {
-std::string filePath = getFilePath(id);
-if (filePath.empty()) {
-LOG_ERROR("Could not read file: File not found with ID: " + id);
-return false;
-}
-
-try {
-std::ifstream file(filePath, std::ios::binary);
-if (!file.is_open()) {
-LOG_ERROR("Failed to open file for reading: " + filePath);
-return false;
-}
-
-file.seekg(0, std::ios::end);
-size_t fileSize = file.tellg();
-file.seekg(0, std::ios::beg);
-
-data.resize(fileSize);
-file.read(reinterpret_cast<char*>(data.data()), fileSize);
-
-if (!file) {
-LOG_ERROR("An error occurred while reading file: " + filePath + ". Only " + std::to_string(file.gcount()) + " bytes read out of " + std::to_string(fileSize));
-return false;
-}
-
-file.close();
-
-LOG_DEBUG("Successfully read file with ID: " + id + ", path: " + filePath);
-return true;
-
-} catch (const fs::filesystem_error& e) {
-LOG_ERROR("Filesystem error while reading file: " + filePath + ". Error: " + std::string(e.what()));
-return false;
-} catch (const std::ios_base::failure& e) {
-LOG_ERROR("I/O error while reading file: " + filePath + ". Error: " + std::string(e.what()));
-return false;
-} catch (const std::exception& e) {
-LOG_ERROR("An unexpected error occurred while reading file: " + filePath + ". Error: " + std::string(e.what()));
-return false;
-}
-}
-
-bool StorageManager::deleteFile(const std::string& id) {
-    std::lock_guard<std::mutex> lock(storageMutex_);
-
-    auto it = files_.find(id);
-    if (it == files_.end()) {
-        LOG_ERROR("File not found with ID: " + id);
-        return false;
-    }
+        if (basePath.empty() || !fs::exists(basePath)) {
+            LOG_ERROR("Storage base path is not set or does not exist. Initialization likely failed.");
+            return nullptr;
+        }
 
         std::string id = generateUniqueId();
         std::string timestamp = getCurrentTimestamp();
 
         std::string storedFilename = id + "_" + filename;
-        std::string filePath = fs::path(basePath_) / storedFilename;
+        std::string filePath = fs::path(basePath) / storedFilename;
 
-        std::ofstream outFile(filePath, std::ios::binary);
-        if (!outFile) {
-            LOG_ERROR("Failed to create output file: " + filePath);
+        // Same writer as uploads: batched through io_uring and synced when built with it.
+        // The file is written without the lock and removed again if anything fails.
+        FileBodySink file(filePath);
+        if (!file.isOpen()) {
             return nullptr;
         }
-
-        outFile.write(reinterpret_cast<const char*>(data.data()), data.size());
-        if (!outFile) {
+        if (!file.write(reinterpret_cast<const char*>(data.data()), data.size()) || !file.finish()) {
             LOG_ERROR("Failed to write data to file: " + filePath);
             return nullptr;
         }
+        file.keep();
 
         auto metadata = std::make_shared<StorageMetadata>();
         metadata->id = id;
@@ -294,7 +147,10 @@ bool StorageManager::deleteFile(const std::string& id) {
         metadata->path = filePath;
         metadata->createdAt = timestamp;
 
-        files_[id] = metadata;
+        {
+            std::lock_guard<std::mutex> lock(storageMutex_);
+            files_[id] = metadata;
+        }
 
         LOG_INFO("Stored file with ID: " + id + ", Size: " + std::to_string(data.size()) + " bytes");
         return metadata;
@@ -396,7 +252,7 @@ std::vector<std::shared_ptr<StorageMetadata>> StorageManager::listFiles() const
 }
 
 size_t StorageManager::cleanupOldFiles(uint64_t maxAge) {
-    std::lock_guard<std::mutex> lock(storageMutex_);
+    std::unique_lock<std::mutex> lock(storageMutex_);
 
     size_t deletedCount = 0;
     std::vector<std::string> idsToDelete;
@@ -412,7 +268,7 @@ size_t StorageManager::cleanupOldFiles(uint64_t maxAge) {
             auto fileTime = std::chrono::system_clock::from_time_t(std::mktime(&tm));
             auto ageSeconds = std::chrono::duration_cast<std::chrono::seconds>(now - fileTime).count();
 
-            if (ageSeconds > maxAge) {
+            if (ageSeconds > 0 && static_cast<uint64_t>(ageSeconds) > maxAge) {
                 idsToDelete.push_back(pair.first);
             }
         } catch (...) {
@@ -420,6 +276,9 @@ size_t StorageManager::cleanupOldFiles(uint64_t maxAge) {
         }
     }
 
+    // deleteFile() takes the lock itself
+    lock.unlock();
+
     for (const auto& id : idsToDelete) {
         if (deleteFile(id)) {
             deletedCount++;
@@ -431,9 +290,9 @@ size_t StorageManager::cleanupOldFiles(uint64_t maxAge) {
 }
 
 std::string StorageManager::generateUniqueId() const {
-    static std::random_device rd;
-    static std::mt19937 gen(rd());
-    static std::uniform_int_distribution<> dis(0, 15);
+    // storeData() runs outside storageMutex_ on any thread, so each has its own engine
+    thread_local std::mt19937 gen(std::random_device{}());
+    thread_local std::uniform_int_distribution<> dis(0, 15);
     static const char* hex = "0123456789abcdef";
 
     std::string uuid;
@@ -458,4 +317,4 @@ std::string StorageManager::getCurrentTimestamp() const {
     return ss.str();
 }
 
-} // namespace chad
\ No newline at end of file
+} // namespace chad
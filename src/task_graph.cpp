@@ -0,0 +1,133 @@
+#include "../include/task_graph.hpp"
+
+namespace chad {
+
+struct TaskGraph::Execution {
+    Execution(ThreadPool& pool, std::vector<Node> nodes, Promise<void> promise)
+        : pool(pool), nodes(std::move(nodes)), pending(new std::atomic<size_t>[this->nodes.size()]),
+          remaining(this->nodes.size()), failed(false), promise(std::move(promise)) {
+        for (size_t i = 0; i < this->nodes.size(); ++i) {
+            pending[i].store(this->nodes[i].dependencies, std::memory_order_relaxed);
+        }
+    }
+
+    ThreadPool& pool;
+    std::vector<Node> nodes;
+    std::unique_ptr<std::atomic<size_t>[]> pending;   // unfinished dependencies per node
+    std::atomic<size_t> remaining;                     // nodes not yet run or skipped
+
+    std::atomic<bool> failed;
+    std::mutex errorMutex;
+    std::exception_ptr error;
+
+    Promise<void> promise;
+};
+
+TaskGraph::NodeId TaskGraph::add(InlineTask work, const std::vector<NodeId>& dependencies) {
+    for (NodeId dependency : dependencies) {
+        if (dependency >= nodes_.size()) {
+            throw std::invalid_argument("Task graph dependency on a node that does not exist yet");
+        }
+    }
+
+    NodeId id = nodes_.size();
+    nodes_.push_back(Node{std::move(work), std::nullopt, {}, dependencies.size()});
+    for (NodeId dependency : dependencies) {
+        nodes_[dependency].dependents.push_back(id);
+    }
+    return id;
+}
+
+TaskGraph::NodeId TaskGraph::add(const TaskClass& taskClass, InlineTask work, const std::vector<NodeId>& dependencies) {
+    NodeId id = add(std::move(work), dependencies);
+    nodes_[id].taskClass = taskClass;
+    return id;
+}
+
+Future<void> TaskGraph::run(ThreadPool& pool) {
+    Promise<void> promise(&pool);
+    Future<void> result = promise.getFuture();
+
+    if (nodes_.empty()) {
+        promise.setValue();
+        return result;
+    }
+
+    auto execution = std::make_shared<Execution>(pool, std::move(nodes_), std::move(promise));
+    nodes_.clear();
+
+    // Collected first: a root may finish and start its dependents while this loop runs
+    std::vector<NodeId> roots;
+    for (NodeId id = 0; id < execution->nodes.size(); ++id) {
+        if (execution->nodes[id].dependencies == 0) {
+            roots.push_back(id);
+        }
+    }
+    for (NodeId id : roots) {
+        post(execution, id);
+    }
+    return result;
+}
+
+void TaskGraph::post(const std::shared_ptr<Execution>& execution, NodeId id) {
+    // Skipped nodes still count down their dependents, without a trip through the pool
+    if (execution->failed.load(std::memory_order_acquire)) {
+        runNode(execution, id);
+        return;
+    }
+
+    try {
+        auto work = [execution, id]() { runNode(execution, id); };
+        const auto& taskClass = execution->nodes[id].taskClass;
+        if (taskClass) {
+            execution->pool.post(*taskClass, std::move(work));
+        } else {
+            execution->pool.post(std::move(work));
+        }
+    } catch (const std::runtime_error&) {
+        // The pool is stopping: fail the graph and skip the rest
+        {
+            std::lock_guard<std::mutex> lock(execution->errorMutex);
+            if (!execution->error) {
+                execution->error = std::current_exception();
+            }
+        }
+        execution->failed.store(true, std::memory_order_release);
+        runNode(execution, id);
+    }
+}
+
+void TaskGraph::runNode(const std::shared_ptr<Execution>& execution, NodeId id) {
+    Node& node = execution->nodes[id];
+
+    if (!execution->failed.load(std::memory_order_acquire)) {
+        try {
+            node.work();
+        } catch (...) {
+            {
+                std::lock_guard<std::mutex> lock(execution->errorMutex);
+                if (!execution->error) {
+                    execution->error = std::current_exception();
+                }
+            }
+            execution->failed.store(true, std::memory_order_release);
+        }
+    }
+    node.work = InlineTask();
+
+    for (NodeId dependent : node.dependents) {
+        if (execution->pending[dependent].fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            post(execution, dependent);
+        }
+    }
+
+    if (execution->remaining.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+        if (execution->error) {
+            execution->promise.setException(execution->error);
+        } else {
+            execution->promise.setValue();
+        }
+    }
+}
+
+} // namespace chad
@@ -1,80 +1,546 @@
 #include "../include/thread_pool.hpp"
+#include "../include/logger.hpp"
 
+#include <algorithm>
+#include <fstream>
 #include <stdexcept>
 #include <utility>
 
 
 namespace chad {
 
-ThreadPool::ThreadPool(size_t numThreads) : stop_(false), activeThreads_(0) {
-    resize(numThreads);
+namespace {
+
+// Rounds of looking for work, with a yield in between, before a worker parks
+constexpr int SPIN_ROUNDS = 64;
+
+// Lets submit() and findTask() recognise the pool's own workers
+thread_local ThreadPool* currentPool = nullptr;
+thread_local size_t currentWorker = 0;
+
+// Alternates which of plain tasks and NORMAL tenants a worker looks at first
+thread_local bool fairQueueFirst = false;
+
+// xorshift; picking victims needs neither quality nor a lock
+thread_local uint32_t victimSeed = 0;
+
+uint32_t nextRandom() {
+    uint32_t x = victimSeed;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    victimSeed = x;
+    return x;
+}
+
+// Busy and total jiffies of all CPUs since boot; false where /proc is unavailable
+bool readCpuTimes(uint64_t& busy, uint64_t& total) {
+    std::ifstream stat("/proc/stat");
+    std::string cpu;
+    uint64_t user = 0, nice = 0, system = 0, idle = 0, iowait = 0, irq = 0, softirq = 0, steal = 0;
+    if (!(stat >> cpu >> user >> nice >> system >> idle >> iowait >> irq >> softirq >> steal) || cpu != "cpu") {
+        return false;
+    }
+    busy = user + nice + system + irq + softirq + steal;
+    total = busy + idle + iowait;
+    return true;
+}
+
+} // namespace
+
+std::pmr::memory_resource* ThreadPool::memory() {
+    static auto* resource = new std::pmr::synchronized_pool_resource();
+    return resource;
+}
+
+ThreadPool::Inbox::Inbox() : head_(&stub_), tail_(&stub_), consuming_(false) {}
+
+void ThreadPool::Inbox::push(Task* task) {
+    task->next.store(nullptr, std::memory_order_relaxed);
+    Task* previous = head_.exchange(task, std::memory_order_acq_rel);
+    previous->next.store(task, std::memory_order_release);
+}
+
+ThreadPool::Task* ThreadPool::Inbox::tryPop() {
+    if (consuming_.exchange(true, std::memory_order_acquire)) {
+        return nullptr;
+    }
+    Task* task = pop();
+    consuming_.store(false, std::memory_order_release);
+    return task;
+}
+
+ThreadPool::Task* ThreadPool::Inbox::pop() {
+    Task* tail = tail_;
+    Task* next = tail->next.load(std::memory_order_acquire);
+
+    if (tail == &stub_) {
+        if (!next) {
+            return nullptr;
+        }
+        tail_ = next;
+        tail = next;
+        next = next->next.load(std::memory_order_acquire);
+    }
+
+    if (next) {
+        tail_ = next;
+        return tail;
+    }
+
+    // A push is between its exchange and its link; the task shows up shortly
+    if (tail != head_.load(std::memory_order_acquire)) {
+        return nullptr;
+    }
+
+    push(&stub_);
+    next = tail->next.load(std::memory_order_acquire);
+    if (next) {
+        tail_ = next;
+        return tail;
+    }
+    return nullptr;
+}
+
+ThreadPool::ThreadPool(size_t numThreads) : ThreadPool(numThreads, Placement()) {}
+
+ThreadPool::ThreadPool(size_t numThreads, Placement placement)
+    : placement_(std::move(placement)), workerCount_(0), targetCount_(0), nextInbox_(0), queued_(0), active_(0), bulkRunning_(0),
+      epoch_(0), sleepers_(0), waitedNanos_(0), started_(0), stop_(false) {
+    for (auto& worker : workers_) {
+        worker.store(nullptr, std::memory_order_relaxed);
+    }
+    resize(std::max<size_t>(numThreads, 1));
 }
 
 ThreadPool::~ThreadPool() {
     {
-        std::unique_lock<std::mutex> lock(queueMutex_);
+        std::lock_guard<std::mutex> lock(autoscaleMutex_);
+        std::lock_guard<std::mutex> parkLock(parkMutex_);
         stop_ = true;
     }
+    autoscaleCondition_.notify_all();
+    parkCondition_.notify_all();
+
+    if (autoscaler_.joinable()) {
+        autoscaler_.join();
+    }
 
-    condition_.notify_all();
+    // Retired workers' threads have exited but are still joinable
+    for (auto& worker : ownedWorkers_) {
+        if (worker->thread.joinable()) {
+            worker->thread.join();
+        }
+    }
 
-    for (std::thread& worker : workers_) {
-        if (worker.joinable()) {
-            worker.join();
+    // A submit racing with stop_ may have slipped in after the workers left
+    for (auto& worker : ownedWorkers_) {
+        while (Task* task = worker->deque.pop()) {
+            run(task);
+        }
+        while (Task* task = worker->inbox.tryPop()) {
+            run(task);
+        }
+    }
+    for (auto& queue : fairQueues_) {
+        Task* task;
+        while (queue.pop(task)) {
+            if (task->priority == TaskPriority::LOW) {
+                bulkRunning_.fetch_add(1, std::memory_order_relaxed);
+            }
+            run(task);
         }
     }
 }
 
 size_t ThreadPool::getActiveThreadCount() const {
-    return activeThreads_.load();
+    return active_.load(std::memory_order_relaxed);
 }
 
 size_t ThreadPool::getQueueSize() const {
-    std::lock_guard<std::mutex> lock(queueMutex_);
-    return tasks_.size();
+    return queued_.load(std::memory_order_relaxed);
+}
+
+size_t ThreadPool::getThreadCount() const {
+    return targetCount_.load(std::memory_order_relaxed);
+}
+
+void ThreadPool::setTenantWeight(const std::string& tenant, uint32_t weight) {
+    for (auto& queue : fairQueues_) {
+        queue.setWeight(tenant, weight);
+    }
 }
 
 void ThreadPool::resize(size_t numThreads) {
-    std::unique_lock<std::mutex> lock(queueMutex_);
+    std::lock_guard<std::mutex> lock(resizeMutex_);
+
+    if (stop_) {
+        return;
+    }
+
+    numThreads = std::clamp<size_t>(numThreads, 1, MAX_WORKERS);
+    size_t previous = targetCount_.load(std::memory_order_relaxed);
+
+    for (size_t i = 0; i < numThreads; ++i) {
+        if (i < ownedWorkers_.size()) {
+            // A slot still retiring sees the new target and keeps its thread
+            Worker* worker = ownedWorkers_[i].get();
+            if (worker->retired) {
+                worker->thread.join();
+                worker->retired = false;
+                worker->thread = std::thread([this, i] { workerLoop(i); });
+            }
+            continue;
+        }
+
+        ownedWorkers_.push_back(std::make_unique<Worker>());
+        Worker* worker = ownedWorkers_.back().get();
+        workers_[i].store(worker, std::memory_order_release);
+        worker->thread = std::thread([this, i] { workerLoop(i); });
+        workerCount_.store(i + 1, std::memory_order_release);
+    }
+
+    targetCount_.store(numThreads, std::memory_order_release);
+
+    // Parked workers beyond the new size have to wake up to retire
+    if (numThreads < previous) {
+        epoch_.fetch_add(1, std::memory_order_seq_cst);
+        {
+            std::lock_guard<std::mutex> parkLock(parkMutex_);
+        }
+        parkCondition_.notify_all();
+    }
+}
+
+bool ThreadPool::retire(size_t index) {
+    {
+        std::lock_guard<std::mutex> lock(resizeMutex_);
+        if (index < targetCount_.load(std::memory_order_relaxed) || stop_) {
+            return false;
+        }
+        workers_[index].load(std::memory_order_relaxed)->retired = true;
+    }
+
+    // Whatever is left in this worker's deque or inbox is stolen by the others
+    if (queued_.load(std::memory_order_acquire) > 0) {
+        wakeOne();
+    }
+    return true;
+}
+
+void ThreadPool::enableAutoscaling(const AutoscaleSettings& settings) {
+    std::lock_guard<std::mutex> lock(autoscaleMutex_);
+
+    if (stop_ || autoscaler_.joinable()) {
+        return;
+    }
+    autoscaler_ = std::thread([this, settings] { autoscaleLoop(settings); });
+}
+
+void ThreadPool::autoscaleLoop(AutoscaleSettings settings) {
+    if (settings.maxThreads == 0) {
+        settings.maxThreads = std::max(1u, std::thread::hardware_concurrency());
 
-    size_t oldSize = workers_.size();
+        if (!placement_.cpuSets.empty()) {
+            CpuSet cpus;
+            for (const auto& set : placement_.cpuSets) {
+                cpus.insert(cpus.end(), set.begin(), set.end());
+            }
+            std::sort(cpus.begin(), cpus.end());
+            cpus.erase(std::unique(cpus.begin(), cpus.end()), cpus.end());
+            settings.maxThreads = std::max<size_t>(1, cpus.size());
+        }
+    }
+    settings.maxThreads = std::min(settings.maxThreads, MAX_WORKERS);
+    settings.minThreads = std::clamp<size_t>(settings.minThreads, 1, settings.maxThreads);
+
+    LOG_INFO("Thread pool autoscaling between " + std::to_string(settings.minThreads) + " and " +
+             std::to_string(settings.maxThreads) + " workers");
+
+    uint64_t lastBusy = 0, lastTotal = 0;
+    readCpuTimes(lastBusy, lastTotal);
+    auto lastPressure = std::chrono::steady_clock::now();
+
+    std::unique_lock<std::mutex> lock(autoscaleMutex_);
+    while (!autoscaleCondition_.wait_for(lock, settings.interval, [this] { return stop_.load(); })) {
+        auto now = std::chrono::steady_clock::now();
+        size_t threads = getThreadCount();
+        size_t queued = queued_.load(std::memory_order_relaxed);
+        size_t active = active_.load(std::memory_order_relaxed);
 
+        uint64_t started = started_.exchange(0, std::memory_order_relaxed);
+        uint64_t waited = waitedNanos_.exchange(0, std::memory_order_relaxed);
+        auto meanWait = std::chrono::nanoseconds(started ? waited / started : 0);
+
+        unsigned hostLoad = 0;
+        uint64_t busy = 0, total = 0;
+        if (readCpuTimes(busy, total) && total > lastTotal) {
+            hostLoad = static_cast<unsigned>((busy - lastBusy) * 100 / (total - lastTotal));
+            lastBusy = busy;
+            lastTotal = total;
+        }
+
+        size_t target = threads;
+        bool backlog = queued > threads || (queued > 0 && meanWait > settings.maxQueueWait);
+
+        if (backlog || active + queued >= threads) {
+            lastPressure = now;
+        }
+
+        if (backlog && threads < settings.maxThreads && hostLoad < settings.maxHostLoad) {
+            // Grow quickly: by the backlog, at most doubling per step
+            target = std::min(settings.maxThreads, threads + std::clamp<size_t>(queued, 1, threads));
+        } else if (now - lastPressure >= settings.shrinkAfter && threads > settings.minThreads) {
+            // Shrink slowly: half of the idle workers per step, once idle long enough
+            size_t idle = threads - std::min(threads, active);
+            target = std::max(settings.minThreads, threads - std::max<size_t>(1, idle / 2));
+        } else if (threads < settings.minThreads) {
+            target = settings.minThreads;
+        }
+
+        if (target != threads) {
+            LOG_INFO("Thread pool resized from " + std::to_string(threads) + " to " + std::to_string(target) +
+                     " workers (queued " + std::to_string(queued) + ", mean wait " +
+                     std::to_string(std::chrono::duration_cast<std::chrono::milliseconds>(meanWait).count()) +
+                     " ms, host load " + std::to_string(hostLoad) + "%)");
+            lock.unlock();
+            resize(target);
+            lock.lock();
+        }
+    }
+}
+
+ThreadPool::Task* ThreadPool::newTask(InlineTask function, TaskPriority priority) {
     if (stop_) {
+        throw std::runtime_error("Cannot enqueue on a stopped ThreadPool");
+    }
+
+    Task* task = new (memory()->allocate(sizeof(Task), alignof(Task))) Task;
+    task->function = std::move(function);
+    task->priority = priority;
+    task->queuedAt = std::chrono::steady_clock::now();
+    return task;
+}
+
+void ThreadPool::deleteTask(Task* task) {
+    task->~Task();
+    memory()->deallocate(task, sizeof(Task), alignof(Task));
+}
+
+void ThreadPool::enqueue(InlineTask function) {
+    Task* task = newTask(std::move(function), TaskPriority::NORMAL);
+
+    // Counted before it is visible so a thief never takes it below zero
+    queued_.fetch_add(1, std::memory_order_relaxed);
+
+    if (currentPool == this) {
+        workers_[currentWorker].load(std::memory_order_relaxed)->deque.push(task);
+    } else {
+        size_t count = targetCount_.load(std::memory_order_acquire);
+        size_t index = nextInbox_.fetch_add(1, std::memory_order_relaxed) % count;
+        workers_[index].load(std::memory_order_acquire)->inbox.push(task);
+    }
+
+    wakeOne();
+}
+
+void ThreadPool::enqueue(const TaskClass& taskClass, InlineTask function) {
+    Task* task = newTask(std::move(function), taskClass.priority);
+
+    queued_.fetch_add(1, std::memory_order_relaxed);
+    fairQueues_[static_cast<size_t>(taskClass.priority)].push(taskClass.tenant, task, taskClass.cost);
+
+    wakeOne();
+}
+
+void ThreadPool::wakeOne() {
+    epoch_.fetch_add(1, std::memory_order_seq_cst);
+    if (sleepers_.load(std::memory_order_seq_cst) == 0) {
         return;
     }
+    {
+        std::lock_guard<std::mutex> lock(parkMutex_);
+    }
+    parkCondition_.notify_one();
+}
+
+void ThreadPool::applyPlacement(size_t index) const {
+    if (!placement_.cpuSets.empty()) {
+        pinThread(pthread_self(), placement_.cpuSets[index % placement_.cpuSets.size()]);
+    }
+    if (placement_.memoryNode >= 0) {
+        preferMemoryNode(placement_.memoryNode);
+    }
+}
+
+void ThreadPool::workerLoop(size_t index) {
+    currentPool = this;
+    currentWorker = index;
+    victimSeed = static_cast<uint32_t>(index * 2654435761u) | 1;
+    applyPlacement(index);
+
+    int idleRounds = 0;
+    while (true) {
+        if (index >= targetCount_.load(std::memory_order_relaxed) && retire(index)) {
+            return;
+        }
+
+        if (Task* task = findTask(index)) {
+            run(task);
+            idleRounds = 0;
+            continue;
+        }
+
+        if (stop_ && queued_.load(std::memory_order_acquire) == 0) {
+            return;
+        }
+
+        if (++idleRounds < SPIN_ROUNDS) {
+            std::this_thread::yield();
+            continue;
+        }
+
+        idleRounds = 0;
+        park();
+    }
+}
+
+ThreadPool::Task* ThreadPool::findTask(size_t index) {
+    Task* task = nullptr;
+
+    if (fairQueues_[static_cast<size_t>(TaskPriority::HIGH)].pop(task)) {
+        return task;
+    }
+
+    auto& normal = fairQueues_[static_cast<size_t>(TaskPriority::NORMAL)];
+    fairQueueFirst = !fairQueueFirst;
+    if (fairQueueFirst && normal.pop(task)) {
+        return task;
+    }
+    if ((task = findLocalTask(index))) {
+        return task;
+    }
+    if (!fairQueueFirst && normal.pop(task)) {
+        return task;
+    }
+
+    auto& low = fairQueues_[static_cast<size_t>(TaskPriority::LOW)];
+    if (!low.empty() && acquireBulkSlot()) {
+        if (low.pop(task)) {
+            return task;
+        }
+        bulkRunning_.fetch_sub(1, std::memory_order_seq_cst);
+    }
+    return nullptr;
+}
+
+ThreadPool::Task* ThreadPool::findLocalTask(size_t index) {
+    Worker* self = workers_[index].load(std::memory_order_relaxed);
+
+    if (Task* task = self->deque.pop()) {
+        return task;
+    }
+    if (Task* task = self->inbox.tryPop()) {
+        return task;
+    }
+
+    size_t count = workerCount_.load(std::memory_order_acquire);
+    if (count < 2) {
+        return nullptr;
+    }
+
+    // One pass over every other worker, starting at a random one
+    size_t start = nextRandom() % count;
+    for (size_t i = 0; i < count; ++i) {
+        size_t victimIndex = (start + i) % count;
+        if (victimIndex == index) {
+            continue;
+        }
+        Worker* victim = workers_[victimIndex].load(std::memory_order_acquire);
+        if (Task* task = victim->deque.steal()) {
+            return task;
+        }
+        if (Task* task = victim->inbox.tryPop()) {
+            return task;
+        }
+    }
+    return nullptr;
+}
+
+bool ThreadPool::acquireBulkSlot() {
+    size_t count = targetCount_.load(std::memory_order_relaxed);
+    size_t limit = count > 1 ? count - 1 : 1;
+
+    if (bulkRunning_.fetch_add(1, std::memory_order_seq_cst) < limit) {
+        return true;
+    }
+    bulkRunning_.fetch_sub(1, std::memory_order_seq_cst);
+    return false;
+}
+
+bool ThreadPool::hasRunnableWork() const {
+    size_t queued = queued_.load(std::memory_order_seq_cst);
+    if (queued == 0) {
+        return false;
+    }
 
-    if (numThreads > oldSize) {
-        workers_.reserve(numThreads);
+    // Waiting LOW tasks do not count while LOW already holds its share of workers
+    size_t count = targetCount_.load(std::memory_order_relaxed);
+    size_t limit = count > 1 ? count - 1 : 1;
+    if (bulkRunning_.load(std::memory_order_seq_cst) >= limit) {
+        return queued > fairQueues_[static_cast<size_t>(TaskPriority::LOW)].size();
+    }
+    return true;
+}
 
-        for (size_t i = oldSize; i < numThreads; ++i) {
-            workers_.emplace_back([this] {
-                while (true) {
-                    std::function<void()> task;
+void ThreadPool::run(Task* task) {
+    // The last task of a stopping pool lets parked workers exit
+    if (queued_.fetch_sub(1, std::memory_order_acq_rel) == 1 && stop_) {
+        std::lock_guard<std::mutex> lock(parkMutex_);
+        parkCondition_.notify_all();
+    }
 
-                    {
-                        std::unique_lock<std::mutex> lock(queueMutex_);
-                        condition_.wait(lock, [this] {
-                            return stop_ || !tasks_.empty();
-                        });
+    auto waited = std::chrono::steady_clock::now() - task->queuedAt;
+    waitedNanos_.fetch_add(std::chrono::duration_cast<std::chrono::nanoseconds>(waited).count(), std::memory_order_relaxed);
+    started_.fetch_add(1, std::memory_order_relaxed);
 
-                        if (stop_ && tasks_.empty()) {
-                            return;
-                        }
+    active_.fetch_add(1, std::memory_order_relaxed);
+    try {
+        task->function();
+    } catch (const std::exception& e) {
+        LOG_ERROR("Task posted to the thread pool failed: " + std::string(e.what()));
+    } catch (...) {
+        LOG_ERROR("Task posted to the thread pool failed");
+    }
+    active_.fetch_sub(1, std::memory_order_relaxed);
 
-                        task = std::move(tasks_.front());
-                        tasks_.pop();
-                    }
+    TaskPriority priority = task->priority;
+    deleteTask(task);
 
-                    activeThreads_++;
-                    task();
-                    activeThreads_--;
-                }
-            });
+    // A freed LOW slot may be what a waiting LOW task needs
+    if (priority == TaskPriority::LOW) {
+        bulkRunning_.fetch_sub(1, std::memory_order_seq_cst);
+        if (!fairQueues_[static_cast<size_t>(TaskPriority::LOW)].empty()) {
+            wakeOne();
         }
-    } else if (numThreads < oldSize) {
-        lock.unlock();
-        condition_.notify_all();
     }
 }
 
-} // namespace chad
\ No newline at end of file
+void ThreadPool::park() {
+    sleepers_.fetch_add(1, std::memory_order_seq_cst);
+    uint64_t epoch = epoch_.load(std::memory_order_seq_cst);
+
+    // Work that arrived before the epoch was read is counted by now. A
+    // stopping pool only parks workers that wait for LOW slots to free up.
+    if (!hasRunnableWork() && !(stop_ && queued_.load(std::memory_order_acquire) == 0)) {
+        std::unique_lock<std::mutex> lock(parkMutex_);
+        parkCondition_.wait(lock, [this, epoch] {
+            return epoch_.load(std::memory_order_relaxed) != epoch ||
+                   (stop_ && queued_.load(std::memory_order_relaxed) == 0);
+        });
+    }
+
+    sleepers_.fetch_sub(1, std::memory_order_relaxed);
+}
+
+} // namespace chad
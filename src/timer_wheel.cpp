@@ -0,0 +1,116 @@
+#include "../include/timer_wheel.hpp"
+
+#include <algorithm>
+
+namespace chad {
+
+TimerWheel::Entry::~Entry() {
+    if (wheel_) {
+        wheel_->cancel(*this);
+    }
+}
+
+TimerWheel::TimerWheel(std::chrono::milliseconds tick, size_t slots)
+    : tick_(tick), slots_(slots, nullptr) {}
+
+TimerWheel::~TimerWheel() {
+    stop();
+}
+
+void TimerWheel::start(boost::asio::io_context& ioContext) {
+    timer_ = std::make_unique<boost::asio::steady_timer>(ioContext);
+    timer_->expires_after(tick_);
+    armTick();
+}
+
+void TimerWheel::stop() {
+    timer_.reset();
+}
+
+uint64_t TimerWheel::schedule(Entry& entry, std::chrono::milliseconds delay) {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    if (entry.linked_) {
+        unlink(entry);
+    }
+
+    // Round up, plus one tick for the part of the current one already gone,
+    // so an entry never fires before its deadline
+    size_t ticks = static_cast<size_t>((std::max(delay, std::chrono::milliseconds(0)) + tick_ -
+                                        std::chrono::milliseconds(1)) / tick_) + 1;
+
+    size_t slot = (cursor_ + ticks) % slots_.size();
+    entry.slot_ = slot;
+    entry.rounds_ = (ticks - 1) / slots_.size();
+    entry.wheel_ = this;
+    entry.linked_ = true;
+    entry.prev_ = nullptr;
+    entry.next_ = slots_[slot];
+    if (entry.next_) {
+        entry.next_->prev_ = &entry;
+    }
+    slots_[slot] = &entry;
+
+    return ++entry.generation_;
+}
+
+void TimerWheel::cancel(Entry& entry) {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    if (entry.linked_) {
+        unlink(entry);
+    }
+}
+
+void TimerWheel::unlink(Entry& entry) {
+    if (entry.prev_) {
+        entry.prev_->next_ = entry.next_;
+    } else {
+        slots_[entry.slot_] = entry.next_;
+    }
+    if (entry.next_) {
+        entry.next_->prev_ = entry.prev_;
+    }
+
+    entry.prev_ = entry.next_ = nullptr;
+    entry.linked_ = false;
+}
+
+void TimerWheel::armTick() {
+    timer_->async_wait([this](const boost::system::error_code& error) {
+        if (!error) {
+            onTick();
+        }
+    });
+}
+
+void TimerWheel::onTick() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        cursor_ = (cursor_ + 1) % slots_.size();
+
+        Entry* entry = slots_[cursor_];
+        while (entry) {
+            Entry* next = entry->next_;
+            if (entry->rounds_ > 0) {
+                entry->rounds_--;
+            } else {
+                expired_.emplace_back(entry->callback_, entry->generation_);
+                unlink(*entry);
+            }
+            entry = next;
+        }
+    }
+
+    // Callbacks run unlocked so they may re-arm their entries
+    for (auto& [callback, generation] : expired_) {
+        callback(generation);
+    }
+    expired_.clear();
+
+    // Fixed cadence: a late tick does not push every later deadline back
+    timer_->expires_at(timer_->expiry() + tick_);
+    armTick();
+}
+
+} // namespace chad
@@ -0,0 +1,219 @@
+#include "../include/uring_file.hpp"
+#include "../include/logger.hpp"
+
+#ifdef CHAD_HAVE_IO_URING
+
+#include <algorithm>
+#include <cstring>
+#include <sys/uio.h>
+
+namespace chad {
+
+namespace {
+
+// Four 256 KiB buffers: one filling while up to three are written
+constexpr size_t BUFFER_COUNT = 4;
+constexpr size_t BUFFER_SIZE = 256 * 1024;
+
+constexpr unsigned QUEUE_DEPTH = BUFFER_COUNT * 2;
+
+} // namespace
+
+std::unique_ptr<UringFile> UringFile::create(int fd) {
+    std::unique_ptr<UringFile> file(new UringFile(fd));
+    if (!file->initialize()) {
+        return nullptr;
+    }
+    return file;
+}
+
+UringFile::UringFile(int fd) : fd_(fd) {}
+
+UringFile::~UringFile() {
+    if (!ringReady_) {
+        return;
+    }
+
+    // The kernel may still be reading from the registered buffers
+    while (inFlight_ > 0 && reap(true)) {
+    }
+    io_uring_queue_exit(&ring_);
+}
+
+bool UringFile::initialize() {
+    int result = io_uring_queue_init(QUEUE_DEPTH, &ring_, 0);
+    if (result < 0) {
+        LOG_DEBUG("io_uring unavailable, using write(): " + std::string(std::strerror(-result)));
+        return false;
+    }
+    ringReady_ = true;
+
+    memory_ = std::make_unique<char[]>(BUFFER_COUNT * BUFFER_SIZE);
+    buffers_.resize(BUFFER_COUNT);
+
+    std::vector<iovec> iovecs(BUFFER_COUNT);
+    for (size_t i = 0; i < BUFFER_COUNT; ++i) {
+        buffers_[i].data = memory_.get() + i * BUFFER_SIZE;
+        iovecs[i].iov_base = buffers_[i].data;
+        iovecs[i].iov_len = BUFFER_SIZE;
+    }
+
+    // Registered buffers are pinned once instead of mapped on every request
+    result = io_uring_register_buffers(&ring_, iovecs.data(), static_cast<unsigned>(iovecs.size()));
+    if (result < 0) {
+        LOG_DEBUG("io_uring buffer registration failed, using write(): " + std::string(std::strerror(-result)));
+        return false;
+    }
+    return true;
+}
+
+bool UringFile::write(const char* data, size_t size) {
+    while (size > 0 && !failed_) {
+        Buffer& buffer = buffers_[current_];
+
+        // Wait until the kernel is done with the buffer we are about to refill
+        while (buffer.busy) {
+            if (!reap(true)) {
+                return false;
+            }
+        }
+
+        if (buffer.length == 0) {
+            buffer.offset = offset_;
+        }
+
+        size_t n = std::min(size, BUFFER_SIZE - buffer.length);
+        std::memcpy(buffer.data + buffer.length, data, n);
+        buffer.length += n;
+        offset_ += n;
+        data += n;
+        size -= n;
+
+        if (buffer.length == BUFFER_SIZE) {
+            if (!queueWrite(buffer) || io_uring_submit(&ring_) < 0) {
+                failed_ = true;
+                break;
+            }
+            current_ = (current_ + 1) % BUFFER_COUNT;
+        }
+    }
+
+    // Collect completions that are already there without blocking
+    while (inFlight_ > 0 && !failed_ && reap(false)) {
+    }
+    return !failed_;
+}
+
+bool UringFile::finish() {
+    if (failed_) {
+        return false;
+    }
+
+    // fdatasync only covers writes that completed before it started
+    while (inFlight_ > 0) {
+        if (!reap(true)) {
+            return false;
+        }
+    }
+    if (failed_) {
+        return false;
+    }
+
+    Buffer& tail = buffers_[current_];
+    if (tail.length > 0) {
+        io_uring_sqe* tailWrite = queueWrite(tail);
+        if (!tailWrite) {
+            return false;
+        }
+        tailWrite->flags |= IOSQE_IO_LINK;
+    }
+
+    io_uring_sqe* sqe = io_uring_get_sqe(&ring_);
+    if (!sqe) {
+        return false;
+    }
+    io_uring_prep_fsync(sqe, fd_, IORING_FSYNC_DATASYNC);
+    io_uring_sqe_set_data(sqe, nullptr);
+    ++inFlight_;
+
+    // Tail write and sync go out in one submission; the sync is linked to the
+    // write so it only runs once the write succeeded
+    if (io_uring_submit(&ring_) < 0) {
+        --inFlight_;
+        failed_ = true;
+        return false;
+    }
+
+    while (inFlight_ > 0) {
+        if (!reap(true)) {
+            return false;
+        }
+    }
+    return !failed_;
+}
+
+io_uring_sqe* UringFile::queueWrite(Buffer& buffer) {
+    io_uring_sqe* sqe = io_uring_get_sqe(&ring_);
+    if (!sqe) {
+        return nullptr;
+    }
+
+    size_t index = static_cast<size_t>(&buffer - buffers_.data());
+    io_uring_prep_write_fixed(sqe, fd_, buffer.data + buffer.written,
+                              static_cast<unsigned>(buffer.length - buffer.written),
+                              buffer.offset + buffer.written, static_cast<int>(index));
+    io_uring_sqe_set_data(sqe, &buffer);
+
+    buffer.busy = true;
+    ++inFlight_;
+    return sqe;
+}
+
+bool UringFile::reap(bool wait) {
+    io_uring_cqe* cqe = nullptr;
+    int result = wait ? io_uring_wait_cqe(&ring_, &cqe) : io_uring_peek_cqe(&ring_, &cqe);
+    if (result < 0 || !cqe) {
+        if (wait) {
+            LOG_ERROR("io_uring wait failed: " + std::string(std::strerror(-result)));
+            failed_ = true;
+        }
+        return false;
+    }
+
+    auto* buffer = static_cast<Buffer*>(io_uring_cqe_get_data(cqe));
+    int res = cqe->res;
+    io_uring_cqe_seen(&ring_, cqe);
+    --inFlight_;
+
+    if (res < 0) {
+        LOG_ERROR("io_uring file " + std::string(buffer ? "write" : "sync") + " failed: " + std::strerror(-res));
+        failed_ = true;
+        if (buffer) {
+            buffer->busy = false;
+        }
+        return true;
+    }
+
+    if (!buffer) {
+        return true;
+    }
+
+    buffer->written += static_cast<size_t>(res);
+    if (buffer->written < buffer->length) {
+        // Short write: requeue the remainder
+        if (res == 0 || !queueWrite(*buffer) || io_uring_submit(&ring_) < 0) {
+            buffer->busy = false;
+            failed_ = true;
+        }
+        return true;
+    }
+
+    buffer->busy = false;
+    buffer->length = 0;
+    buffer->written = 0;
+    return true;
+}
+
+} // namespace chad
+
+#endif // CHAD_HAVE_IO_URING
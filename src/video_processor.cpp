@@ -1,6 +1,9 @@
 #include "../include/video_processor.hpp"
 #include "../include/logger.hpp"
 #include "../include/storage_manager.hpp"
+#ifdef CHAD_HAVE_LIBAV
+#include "../include/av_transcoder.hpp"
+#endif
 #include <filesystem>
 #include <chrono>
 #include <algorithm>
@@ -9,8 +12,16 @@
 #include <iomanip>
 #include <cstdio>
 #include <memory>
-#include <array>
+#include <cmath>
 #include <stdexcept>
+#include <regex>
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#include <fcntl.h>
+#include <spawn.h>
+#include <sys/wait.h>
+#include <unistd.h>
 #include <nlohmann/json.hpp>
 
 namespace fs = std::filesystem;
@@ -18,32 +29,225 @@ using json = nlohmann::json;
 
 namespace chad {
 
-std::string execCommand(const std::string& cmd) {
-    std::array<char, 128> buffer;
-    std::string result;
-    std::unique_ptr<FILE, decltype(&pclose)> pipe(popen(cmd.c_str(), "r"), pclose);
+namespace {
+
+// Cost model of a transcode: a second of 1080p video takes about this long
+// to encode to H.264 on one worker. The scheduler corrects it from the times
+// transcodes actually take, so only the ratios below need to be right.
+constexpr double HD_X264_SECONDS = 0.5;
+constexpr double HD_PIXELS = 1920.0 * 1080.0;
+
+// Client-supplied FFmpeg option values; anything else is refused
+const std::regex CODEC_PATTERN("[A-Za-z0-9_.-]+");
+const std::regex BITRATE_PATTERN("[0-9]+(\\.[0-9]+)?[kKMG]?");
+
+// Assumed for inputs whose duration ffprobe could not read
+constexpr double DEFAULT_DURATION = 10.0;
+
+// Read size for the output of FFmpeg and ffprobe
+constexpr size_t OUTPUT_BUFFER_SIZE = 64 * 1024;
+
+// Encoding effort of a target codec relative to libx264
+double codecCost(const std::string& codec) {
+    static const std::unordered_map<std::string, double> costs = {
+        {"copy", 0.05},
+        {"mpeg4", 0.5},
+        {"libx264", 1.0},
+        {"h264_nvenc", 0.2},
+        {"libvpx", 2.0},
+        {"libsvtav1", 3.0},
+        {"libx265", 4.0},
+        {"hevc_nvenc", 0.2},
+        {"libvpx-vp9", 5.0},
+        {"libaom-av1", 12.0}
+    };
+    auto it = costs.find(codec);
+    return it == costs.end() ? 1.0 : it->second;
+}
+
+#ifdef CHAD_HAVE_LIBAV
+// Bit rates as ffmpeg takes them: "800k", "2.5M" or plain bits per second
+int64_t parseBitRate(const std::string& text) {
+    size_t used = 0;
+    double value = std::stod(text, &used);
+    std::string suffix = text.substr(used);
+    if (suffix == "k" || suffix == "K") {
+        value *= 1e3;
+    } else if (suffix == "M") {
+        value *= 1e6;
+    } else if (suffix == "G") {
+        value *= 1e9;
+    } else if (!suffix.empty()) {
+        throw std::invalid_argument("Invalid bitrate: " + text);
+    }
+    if (value <= 0) {
+        throw std::invalid_argument("Invalid bitrate: " + text);
+    }
+    return static_cast<int64_t>(value);
+}
+
+// The out_time format of ffmpeg -progress, so events read the same with either engine
+std::string formatOutTime(double seconds) {
+    int64_t micros = static_cast<int64_t>(std::max(0.0, seconds) * 1e6);
+    std::ostringstream out;
+    out << std::setfill('0') << std::setw(2) << micros / 3600000000 << ':'
+        << std::setw(2) << micros / 60000000 % 60 << ':'
+        << std::setw(2) << micros / 1000000 % 60 << '.'
+        << std::setw(6) << micros % 1000000;
+    return out.str();
+}
+#endif
 
-    if (!pipe) {
-        throw std::runtime_error("popen() failed");
+} // namespace
+
+// Runs a program without a shell, handing each line it prints on stdout or
+// stderr to onLine as soon as it is printed. If onLine throws, the program is killed.
+void execCommand(const std::vector<std::string>& args, const std::function<void(const std::string&)>& onLine) {
+    std::vector<char*> argv;
+    for (const auto& arg : args) {
+        argv.push_back(const_cast<char*>(arg.c_str()));
+    }
+    argv.push_back(nullptr);
+
+    int fds[2];
+    if (::pipe2(fds, O_CLOEXEC) != 0) {
+        throw std::runtime_error("pipe() failed: " + std::string(std::strerror(errno)));
     }
 
-    while (fgets(buffer.data(), buffer.size(), pipe.get()) != nullptr) {
-        result += buffer.data();
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_addopen(&actions, STDIN_FILENO, "/dev/null", O_RDONLY, 0);
+    posix_spawn_file_actions_adddup2(&actions, fds[1], STDOUT_FILENO);
+    posix_spawn_file_actions_adddup2(&actions, fds[1], STDERR_FILENO);
+
+    pid_t pid;
+    int spawned = posix_spawnp(&pid, argv[0], &actions, nullptr, argv.data(), environ);
+    posix_spawn_file_actions_destroy(&actions);
+    ::close(fds[1]);
+
+    if (spawned != 0) {
+        ::close(fds[0]);
+        throw std::runtime_error("Failed to run " + args[0] + ": " + std::strerror(spawned));
     }
 
+    auto reap = [pid]() {
+        while (::waitpid(pid, nullptr, 0) < 0 && errno == EINTR) {
+        }
+    };
+
+    try {
+        // FFmpeg prints a block of progress lines at a time; read whatever is there in one go
+        std::vector<char> buffer(OUTPUT_BUFFER_SIZE);
+        std::string line;
+        while (true) {
+            ssize_t count = ::read(fds[0], buffer.data(), buffer.size());
+            if (count < 0 && errno == EINTR) {
+                continue;
+            }
+            if (count <= 0) {
+                break;
+            }
+
+            const char* begin = buffer.data();
+            const char* end = begin + count;
+            while (const char* newline = static_cast<const char*>(std::memchr(begin, '\n', end - begin))) {
+                line.append(begin, newline);
+                onLine(line);
+                line.clear();
+                begin = newline + 1;
+            }
+            line.append(begin, end);
+        }
+
+        if (!line.empty()) {
+            onLine(line);
+        }
+    } catch (...) {
+        ::kill(pid, SIGTERM);
+        ::close(fds[0]);
+        reap();
+        throw;
+    }
+
+    ::close(fds[0]);
+    reap();
+}
+
+std::string execCommand(const std::vector<std::string>& args) {
+    std::string result;
+    execCommand(args, [&result](const std::string& line) {
+        result.append(line).append("\n");
+    });
     return result;
 }
 
 VideoProcessor::VideoProcessor() : VideoProcessor(std::thread::hardware_concurrency()) {}
 
-VideoProcessor::VideoProcessor(size_t threadPoolSize) 
+VideoProcessor::VideoProcessor(size_t threadPoolSize) : VideoProcessor(threadPoolSize, Placement()) {}
+
+VideoProcessor::VideoProcessor(size_t threadPoolSize, const Placement& placement)
     : maxChunks_(0), processedChunks_(0), failedChunks_(0) {
-    threadPool_ = std::make_unique<ThreadPool>(threadPoolSize > 0 ? threadPoolSize : std::thread::hardware_concurrency());
-    LOG_INFO("Video processor created with thread pool size: " + std::to_string(threadPool_->getActiveThreadCount()));
+    if (threadPoolSize == 0) {
+        threadPoolSize = std::max(1u, std::thread::hardware_concurrency());
+    }
+
+    const auto& nodes = CpuTopology::getInstance().nodes();
+    if (!placement.numaLocal || nodes.size() < 2) {
+        addLane(threadPoolSize, ThreadPool::Placement{placement.cpuSets, -1});
+        LOG_INFO("Video processor created with thread pool size: " + std::to_string(lanes_.front().pool->getThreadCount()));
+        return;
+    }
+
+    for (size_t i = 0; i < nodes.size(); ++i) {
+        const auto& node = nodes[i];
+
+        ThreadPool::Placement nodePlacement{{}, node.id};
+        for (const auto& set : placement.cpuSets) {
+            if (std::includes(node.cpus.begin(), node.cpus.end(), set.begin(), set.end())) {
+                nodePlacement.cpuSets.push_back(set);
+            }
+        }
+        if (nodePlacement.cpuSets.empty()) {
+            nodePlacement.cpuSets.push_back(node.cpus);
+        }
+
+        // Spread the threads evenly, the remainder going to the first nodes
+        size_t threads = threadPoolSize / nodes.size() + (i < threadPoolSize % nodes.size() ? 1 : 0);
+        addLane(std::max<size_t>(threads, 1), std::move(nodePlacement));
+
+        LOG_INFO("Video processor pool for NUMA node " + std::to_string(node.id) + " created with " +
+                 std::to_string(lanes_.back().pool->getThreadCount()) + " threads on CPUs " + formatCpuList(node.cpus));
+    }
 }
 
 VideoProcessor::~VideoProcessor() {
     LOG_INFO("Video processor shutting down");
+
+    // Transcodes that have not reached a pool fail their chunks, which posts to the pools
+    for (auto& lane : lanes_) {
+        lane.scheduler->close();
+    }
+
+    // The pools drain and join here, while the chunk records their tasks update still exist
+    lanes_.clear();
+}
+
+bool VideoProcessor::setEngine(Engine engine) {
+#ifndef CHAD_HAVE_LIBAV
+    if (engine == Engine::LIBAV) {
+        LOG_WARNING("libav engine not built in (CHAD_ENABLE_LIBAV), keeping the ffmpeg binary");
+        return false;
+    }
+#endif
+    engine_ = engine;
+    return true;
+}
+
+void VideoProcessor::addLane(size_t threads, ThreadPool::Placement placement) {
+    Lane lane;
+    lane.pool = std::make_unique<ThreadPool>(threads, std::move(placement));
+    lane.scheduler = std::make_unique<CostScheduler>(*lane.pool);
+    lanes_.push_back(std::move(lane));
 }
 
 bool VideoProcessor::initialize(const std::string& storagePath, const std::string& tempPath) {
@@ -60,8 +264,13 @@ bool VideoProcessor::initialize(const std::string& storagePath, const std::strin
         storagePath_ = storagePath;
         tempPath_ = tempPath;
 
+        if (engine_ == Engine::LIBAV) {
+            LOG_INFO("Video processor initialized, transcoding in-process with libav");
+            return true;
+        }
+
         try {
-            std::string ffmpegVersion = execCommand("ffmpeg -version");
+            std::string ffmpegVersion = execCommand({"ffmpeg", "-version"});
             if (ffmpegVersion.empty()) {
                 LOG_WARNING("FFmpeg check returned empty result");
             } else {
@@ -81,90 +290,434 @@ bool VideoProcessor::initialize(const std::string& storagePath, const std::strin
 }
 
 std::future<ChunkInfo> VideoProcessor::processChunk(const std::string& inputPath, const std::string& optionsStr) {
-    return threadPool_->submit([this, inputPath, optionsStr]() -> ChunkInfo {
-        ChunkInfo info;
-        info.chunkId = generateChunkId();
-        info.filePath = inputPath;
-        info.status = ProcessingStatus::PROCESSING;
+    std::string chunkId = registerChunk(inputPath);
 
-        LOG_INFO("Processing chunk " + info.chunkId + " from " + inputPath);
+    std::promise<ChunkInfo> promise;
+    std::future<ChunkInfo> result = promise.get_future();
+    startPipeline(chunkId, inputPath, optionsStr, std::string())
+        .then([promise = std::move(promise)](ChunkInfo info) mutable {
+            promise.set_value(std::move(info));
+        });
+    return result;
+}
 
-        try {
-            json options;
-            if (!optionsStr.empty()) {
-                options = json::parse(optionsStr);
-            }
+std::string VideoProcessor::submitChunk(const std::string& inputPath, const std::string& optionsStr,
+                                        const std::string& tenant) {
+    std::string chunkId = registerChunk(inputPath);
 
-            info.size = fs::file_size(inputPath);
+    // The result is published through chunks_; nobody waits on the future
+    startPipeline(chunkId, inputPath, optionsStr, tenant);
+
+    return chunkId;
+}
 
-            if (!fs::exists(inputPath)) {
-                throw std::runtime_error("Input file does not exist");
+Future<ChunkInfo> VideoProcessor::startPipeline(const std::string& chunkId, const std::string& inputPath,
+                                                const std::string& optionsStr, const std::string& tenant) {
+    // Each stage is its own task, so no worker waits for another stage: probes
+    // are short and jump the queue, transcodes are bulk work that waits its
+    // turn in the scheduler and must not hold up anything else.
+    const Lane& lane = pickLane();
+    return schedule(*lane.pool, TaskClass{TaskPriority::HIGH, tenant}, [this, chunkId, inputPath]() {
+            return probeChunk(chunkId, inputPath);
+        })
+        .then([this, &lane, inputPath, optionsStr, tenant](ChunkInfo info) {
+            return queueTranscode(lane, std::move(info), inputPath, optionsStr, tenant);
+        })
+        .then([this](ChunkInfo info) {
+            return verifyChunk(std::move(info));
+        })
+        .recover([this, chunkId, inputPath](std::exception_ptr error) {
+            return failChunk(chunkId, inputPath, error);
+        })
+        .then([this, inputPath](ChunkInfo info) {
+            publishChunk(info);
+            if (info.status == ProcessingStatus::COMPLETED) {
+                removeUpload(inputPath);
             }
+            return info;
+        });
+}
+
+Future<ChunkInfo> VideoProcessor::queueTranscode(const Lane& lane, ChunkInfo info, const std::string& inputPath,
+                                                 const std::string& optionsStr, const std::string& tenant) {
+    double cost = estimateCost(info, optionsStr);
 
-            std::string outputFilename = info.chunkId + "_processed.mp4";
-            std::string outputPath = fs::path(storagePath_) / outputFilename;
+    Promise<ChunkInfo> promise(lane.pool.get());
+    Future<ChunkInfo> result = promise.getFuture();
+    lane.scheduler->submit(cost, TaskClass{TaskPriority::LOW, tenant},
+                           [this, info = std::move(info), inputPath, optionsStr, promise = std::move(promise)]() mutable {
+        try {
+            promise.setValue(transcodeChunk(std::move(info), inputPath, optionsStr));
+        } catch (...) {
+            promise.setException(std::current_exception());
+        }
+    });
+    return result;
+}
+
+double VideoProcessor::estimateCost(const ChunkInfo& info, const std::string& optionsStr) {
+    json options;
+    try {
+        if (!optionsStr.empty()) {
+            options = json::parse(optionsStr);
+        }
+    } catch (const json::exception&) {
+        // transcodeChunk() reports the bad options; the estimate does not matter then
+    }
+
+    // Encoding works on the output frames, so a resize sets the pixel count
+    double pixels = static_cast<double>(info.width) * info.height;
+    if (options.contains("resize")) {
+        const json& resize = options["resize"];
+        if (resize.contains("width") && resize.contains("height") &&
+            resize["width"].is_number() && resize["height"].is_number()) {
+            pixels = resize["width"].get<double>() * resize["height"].get<double>();
+        }
+    }
+    if (pixels <= 0) {
+        pixels = HD_PIXELS;
+    }
 
-            info = extractMetadata(inputPath);
-            info.chunkId = info.chunkId.empty() ? generateChunkId() : info.chunkId;
-            info.status = ProcessingStatus::PROCESSING;
+    double duration = info.duration > 0 ? info.duration : DEFAULT_DURATION;
 
-            std::string ffmpegCmd = "ffmpeg -y -i \"" + inputPath + "\"";
+    std::string codec = "libx264";
+    if (options.contains("codec") && options["codec"].is_string()) {
+        codec = options["codec"].get<std::string>();
+    }
 
-            if (options.contains("resize")) {
-                if (options["resize"].contains("width") && options["resize"].contains("height")) {
-                    int width = options["resize"]["width"];
-                    int height = options["resize"]["height"];
-                    ffmpegCmd += " -vf scale=" + std::to_string(width) + ":" + std::to_string(height);
-                }
-            }
+    return duration * (pixels / HD_PIXELS) * codecCost(codec) * HD_X264_SECONDS;
+}
+std::string VideoProcessor::registerChunk(const std::string& inputPath) {
+    auto info = std::make_shared<ChunkInfo>();
+    info->chunkId = generateChunkId();
+    info->filePath = inputPath;
+    info->size = 0;
+    info->status = ProcessingStatus::PENDING;
+
+    std::error_code ec;
+    uintmax_t size = fs::file_size(inputPath, ec);
+    if (!ec) {
+        info->size = size;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(chunksMutex_);
+        chunks_.push_back(info);
+        bumpVersion();
+    }
+
+    ChunkEvent event;
+    event.chunk = info;
+    emitEvent(event);
+
+    return info->chunkId;
+}
+
+ChunkInfo VideoProcessor::probeChunk(const std::string& chunkId, const std::string& inputPath) {
+    LOG_INFO("Processing chunk " + chunkId + " from " + inputPath);
+
+    if (!fs::exists(inputPath)) {
+        throw std::runtime_error("Input file does not exist");
+    }
+
+    ChunkInfo info = extractMetadata(inputPath);
+    info.chunkId = chunkId;
+    info.size = fs::file_size(inputPath);
+    info.status = ProcessingStatus::PROCESSING;
+    publishChunk(info);
+
+    return info;
+}
+
+ChunkInfo VideoProcessor::transcodeChunk(ChunkInfo info, const std::string& inputPath, const std::string& optionsStr) {
+    // Cancelled while it waited in the scheduler
+    checkCancelled(info.chunkId);
 
-            if (options.contains("bitrate")) {
-                std::string bitrate = options["bitrate"];
-                ffmpegCmd += " -b:v " + bitrate;
+    json options;
+    if (!optionsStr.empty()) {
+        options = json::parse(optionsStr);
+    }
+
+    std::string outputFilename = info.chunkId + "_processed.mp4";
+    std::string outputPath = fs::path(storagePath_) / outputFilename;
+
+    if (engine_ == Engine::LIBAV) {
+        runLibav(info, inputPath, outputPath, options);
+    } else {
+        runFfmpeg(info, inputPath, outputPath, options);
+    }
+
+    info.filePath = outputPath;
+    return info;
+}
+
+void VideoProcessor::runFfmpeg(const ChunkInfo& info, const std::string& inputPath, const std::string& outputPath,
+                               const json& options) {
+    std::vector<std::string> ffmpegArgs = {"ffmpeg", "-y", "-i", inputPath};
+
+    if (options.contains("resize")) {
+        if (options["resize"].contains("width") && options["resize"].contains("height")) {
+            int width = options["resize"]["width"];
+            int height = options["resize"]["height"];
+            ffmpegArgs.insert(ffmpegArgs.end(), {"-vf", "scale=" + std::to_string(width) + ":" + std::to_string(height)});
+        }
+    }
+
+    if (options.contains("bitrate")) {
+        std::string bitrate = options["bitrate"];
+        if (!std::regex_match(bitrate, BITRATE_PATTERN)) {
+            throw std::invalid_argument("Invalid bitrate: " + bitrate);
+        }
+        ffmpegArgs.insert(ffmpegArgs.end(), {"-b:v", bitrate});
+    }
+
+    if (options.contains("codec")) {
+        std::string codec = options["codec"];
+        if (!std::regex_match(codec, CODEC_PATTERN)) {
+            throw std::invalid_argument("Invalid codec: " + codec);
+        }
+        ffmpegArgs.insert(ffmpegArgs.end(), {"-c:v", codec});
+    }
+
+    // Machine-readable progress blocks on stdout, each ending in a progress= line
+    ffmpegArgs.insert(ffmpegArgs.end(), {"-progress", "pipe:1", "-nostats", outputPath});
+
+    // FFmpeg inherits this worker's CPU set and memory policy through posix_spawn(),
+    // and sizes its own thread count to that CPU set
+    std::string output;
+    ChunkEvent progress;
+    progress.type = ChunkEvent::Type::PROGRESS;
+    progress.chunk = std::make_shared<ChunkInfo>(info);
+
+    try {
+        execCommand(ffmpegArgs, [&](const std::string& line) {
+            size_t equals = line.find('=');
+            std::string key = equals == std::string::npos ? std::string() : line.substr(0, equals);
+
+            if (key == "progress") {
+                checkCancelled(info.chunkId);
+                emitEvent(progress);
+                return;
             }
 
-            if (options.contains("codec")) {
-                std::string codec = options["codec"];
-                ffmpegCmd += " -c:v " + codec;
+            try {
+                if (key == "frame") {
+                    progress.frame = std::stoll(line.substr(equals + 1));
+                } else if (key == "fps") {
+                    progress.fps = std::stod(line.substr(equals + 1));
+                } else if (key == "out_time") {
+                    progress.outTime = line.substr(equals + 1);
+                } else {
+                    output.append(line).append("\n");
+                }
+            } catch (const std::exception&) {
+                // Values such as "N/A" before the first frame
             }
+        });
+    } catch (...) {
+        std::error_code ec;
+        fs::remove(outputPath, ec);
+        throw;
+    }
+    LOG_DEBUG("FFmpeg output: " + output);
+}
 
-            ffmpegCmd += " \"" + outputPath + "\" 2>&1";
+void VideoProcessor::runLibav(const ChunkInfo& info, const std::string& inputPath, const std::string& outputPath,
+                              const json& options) {
+#ifdef CHAD_HAVE_LIBAV
+    AvTranscoder::Options settings;
+    if (options.contains("resize")) {
+        if (options["resize"].contains("width") && options["resize"].contains("height")) {
+            settings.width = options["resize"]["width"];
+            settings.height = options["resize"]["height"];
+        }
+    }
 
-            std::string output = execCommand(ffmpegCmd);
-            LOG_DEBUG("FFmpeg output: " + output);
+    if (options.contains("bitrate")) {
+        settings.bitRate = parseBitRate(options["bitrate"].get<std::string>());
+    }
 
-            if (!fs::exists(outputPath)) {
-                throw std::runtime_error("Processing failed, output file not created");
-            }
+    if (options.contains("codec")) {
+        settings.codec = options["codec"].get<std::string>();
+    }
 
-            info.filePath = outputPath;
-            info.size = fs::file_size(outputPath);
-            info.status = ProcessingStatus::COMPLETED;
+    ChunkEvent event;
+    event.type = ChunkEvent::Type::PROGRESS;
+    event.chunk = std::make_shared<ChunkInfo>(info);
 
-            {
-                std::lock_guard<std::mutex> lock(chunksMutex_);
-                chunks_.push_back(std::make_shared<ChunkInfo>(info));
-                processedChunks_++;
+    // Runs on this worker, which keeps the codec contexts for its next chunk
+    AvTranscoder::transcode(inputPath, outputPath, settings, [&](const AvTranscoder::Progress& progress) {
+        event.frame = progress.frame;
+        event.fps = progress.fps;
+        event.outTime = formatOutTime(progress.outTime);
+        emitEvent(event);
 
-                cleanupOldChunks();
-            }
+        std::lock_guard<std::mutex> lock(chunksMutex_);
+        return cancelled_.count(info.chunkId) == 0;
+    });
+#else
+    (void)info;
+    (void)inputPath;
+    (void)outputPath;
+    (void)options;
+    throw std::logic_error("libav engine not built in");
+#endif
+}
 
-            LOG_INFO("Finished processing chunk " + info.chunkId);
+void VideoProcessor::checkCancelled(const std::string& chunkId) const {
+    std::lock_guard<std::mutex> lock(chunksMutex_);
+    if (cancelled_.count(chunkId)) {
+        throw std::runtime_error("Transcode cancelled");
+    }
+}
 
-        } catch (const std::exception& e) {
-            LOG_ERROR("Error processing chunk: " + std::string(e.what()));
-            info.status = ProcessingStatus::FAILED;
-            info.errorMessage = e.what();
-
-            {
-                std::lock_guard<std::mutex> lock(chunksMutex_);
-                chunks_.push_back(std::make_shared<ChunkInfo>(info));
-                failedChunks_++;
+ChunkInfo VideoProcessor::verifyChunk(ChunkInfo info) {
+    if (!fs::exists(info.filePath)) {
+        throw std::runtime_error("Processing failed, output file not created");
+    }
+
+    info.size = fs::file_size(info.filePath);
+    info.status = ProcessingStatus::COMPLETED;
+    processedChunks_++;
+
+    LOG_INFO("Finished processing chunk " + info.chunkId);
+    return info;
+}
+
+ChunkInfo VideoProcessor::failChunk(const std::string& chunkId, const std::string& inputPath, std::exception_ptr error) {
+    ChunkInfo info;
+    info.chunkId = chunkId;
+    info.filePath = inputPath;
+    info.status = ProcessingStatus::FAILED;
+
+    std::error_code ec;
+    uintmax_t inputSize = fs::file_size(inputPath, ec);
+    info.size = ec ? 0 : inputSize;
+
+    try {
+        std::rethrow_exception(error);
+    } catch (const std::exception& e) {
+        info.errorMessage = e.what();
+    } catch (...) {
+        info.errorMessage = "Unknown error";
+    }
+
+    LOG_ERROR("Error processing chunk: " + info.errorMessage);
+    failedChunks_++;
+    return info;
+}
+
+void VideoProcessor::removeUpload(const std::string& inputPath) {
+    // Only uploads belong to the processor; callers' own files are left alone
+    std::error_code ec;
+    if (tempPath_.empty() || !fs::equivalent(fs::path(inputPath).parent_path(), tempPath_, ec)) {
+        return;
+    }
+
+    fs::remove(inputPath, ec);
+}
+
+void VideoProcessor::publishChunk(const ChunkInfo& info) {
+    auto record = std::make_shared<ChunkInfo>(info);
+    std::vector<std::pair<WaiterId, ChunkCallback>> waiters;
+
+    {
+        std::lock_guard<std::mutex> lock(chunksMutex_);
+
+        auto it = std::find_if(chunks_.begin(), chunks_.end(), [&info](const std::shared_ptr<ChunkInfo>& chunk) {
+            return chunk->chunkId == info.chunkId;
+        });
+        if (it == chunks_.end()) {
+            // Deleted while it was being processed
+            return;
+        }
+        *it = record;
+        bumpVersion();
+
+        if (info.status == ProcessingStatus::COMPLETED || info.status == ProcessingStatus::FAILED) {
+            cancelled_.erase(info.chunkId);
+            auto waiting = waiters_.find(info.chunkId);
+            if (waiting != waiters_.end()) {
+                waiters = std::move(waiting->second);
+                waiters_.erase(waiting);
             }
+            cleanupOldChunks();
         }
+    }
 
-        return info;
-    });
+    ChunkEvent event;
+    event.chunk = record;
+    emitEvent(event);
+
+    // Outside the lock: callbacks may call back into the processor
+    for (auto& waiter : waiters) {
+        waiter.second(record);
+    }
+}
+
+void VideoProcessor::emitEvent(const ChunkEvent& event) const {
+    if (eventListener_) {
+        eventListener_(event);
+    }
+}
+
+void VideoProcessor::setEventListener(ChunkEventListener listener) {
+    eventListener_ = std::move(listener);
+}
+
+VideoProcessor::WaiterId VideoProcessor::waitForChunk(const std::string& chunkId, ChunkCallback callback) {
+    std::shared_ptr<ChunkInfo> finished;
+
+    {
+        std::lock_guard<std::mutex> lock(chunksMutex_);
+
+        auto it = std::find_if(chunks_.begin(), chunks_.end(), [&chunkId](const std::shared_ptr<ChunkInfo>& chunk) {
+            return chunk->chunkId == chunkId;
+        });
+        if (it == chunks_.end()) {
+            return 0;
+        }
+
+        if ((*it)->status != ProcessingStatus::COMPLETED && (*it)->status != ProcessingStatus::FAILED) {
+            WaiterId waiterId = nextWaiterId_++;
+            waiters_[chunkId].emplace_back(waiterId, std::move(callback));
+            return waiterId;
+        }
+        finished = *it;
+    }
+
+    callback(finished);
+    return 0;
+}
+
+bool VideoProcessor::cancelWait(const std::string& chunkId, WaiterId waiterId) {
+    ChunkCallback dropped;
+
+    {
+        std::lock_guard<std::mutex> lock(chunksMutex_);
+
+        auto waiting = waiters_.find(chunkId);
+        if (waiting == waiters_.end()) {
+            return false;
+        }
+
+        auto& callbacks = waiting->second;
+        auto it = std::find_if(callbacks.begin(), callbacks.end(), [waiterId](const auto& waiter) {
+            return waiter.first == waiterId;
+        });
+        if (it == callbacks.end()) {
+            return false;
+        }
+
+        dropped = std::move(it->second);
+        callbacks.erase(it);
+        if (callbacks.empty()) {
+            waiters_.erase(waiting);
+        }
+    }
+
+    // Destroyed outside the lock: whatever it captured may call back into the processor
+    return true;
 }
 
 std::shared_ptr<ChunkInfo> VideoProcessor::getChunkInfo(const std::string& chunkId) const {
@@ -186,6 +739,37 @@ std::vector<std::shared_ptr<ChunkInfo>> VideoProcessor::listChunks() const {
     return chunks_;
 }
 
+size_t VideoProcessor::getUnfinishedCount() const {
+    std::lock_guard<std::mutex> lock(chunksMutex_);
+    return std::count_if(chunks_.begin(), chunks_.end(), [](const std::shared_ptr<ChunkInfo>& chunk) {
+        return chunk->status == ProcessingStatus::PENDING || chunk->status == ProcessingStatus::PROCESSING;
+    });
+}
+
+uint64_t VideoProcessor::getVersion() const {
+    return version_.load(std::memory_order_acquire);
+}
+
+void VideoProcessor::bumpVersion() {
+    version_.fetch_add(1, std::memory_order_release);
+}
+
+bool VideoProcessor::cancelChunk(const std::string& chunkId) {
+    std::lock_guard<std::mutex> lock(chunksMutex_);
+
+    auto it = std::find_if(chunks_.begin(), chunks_.end(), [&chunkId](const std::shared_ptr<ChunkInfo>& chunk) {
+        return chunk->chunkId == chunkId;
+    });
+    if (it == chunks_.end() ||
+        ((*it)->status != ProcessingStatus::PENDING && (*it)->status != ProcessingStatus::PROCESSING)) {
+        return false;
+    }
+
+    cancelled_.insert(chunkId);
+    LOG_INFO("Cancelling chunk " + chunkId);
+    return true;
+}
+
 bool VideoProcessor::deleteChunk(const std::string& chunkId) {
     std::lock_guard<std::mutex> lock(chunksMutex_);
 
@@ -194,6 +778,11 @@ bool VideoProcessor::deleteChunk(const std::string& chunkId) {
     });
 
     if (it != chunks_.end()) {
+        // Unfinished chunks still own their input file and have waiters
+        if ((*it)->status == ProcessingStatus::PENDING || (*it)->status == ProcessingStatus::PROCESSING) {
+            return false;
+        }
+
         try {
             if (fs::exists((*it)->filePath)) {
                 fs::remove((*it)->filePath);
@@ -204,6 +793,7 @@ bool VideoProcessor::deleteChunk(const std::string& chunkId) {
         }
 
         chunks_.erase(it);
+        bumpVersion();
         return true;
     }
 
@@ -211,6 +801,7 @@ bool VideoProcessor::deleteChunk(const std::string& chunkId) {
 }
 
 void VideoProcessor::setMaxChunks(size_t maxChunks) {
+    std::lock_guard<std::mutex> lock(chunksMutex_);
     maxChunks_ = maxChunks;
 
     if (maxChunks_ > 0) {
@@ -218,10 +809,74 @@ void VideoProcessor::setMaxChunks(size_t maxChunks) {
     }
 }
 
+void VideoProcessor::enableAutoscaling(const ThreadPool::AutoscaleSettings& settings) {
+    // The bounds are for all pools together; a pool without a maximum keeps to its node's CPUs
+    ThreadPool::AutoscaleSettings perPool = settings;
+    perPool.minThreads = std::max<size_t>(1, settings.minThreads / lanes_.size());
+    if (settings.maxThreads > 0) {
+        perPool.maxThreads = std::max(perPool.minThreads, settings.maxThreads / lanes_.size());
+    }
+
+    for (auto& lane : lanes_) {
+        lane.pool->enableAutoscaling(perPool);
+    }
+}
+
+void VideoProcessor::setScheduling(const Scheduling& scheduling) {
+    maxBacklog_ = scheduling.maxBacklog;
+    for (auto& lane : lanes_) {
+        lane.scheduler->setAgingRate(scheduling.agingRate);
+    }
+}
+
+std::chrono::seconds VideoProcessor::getAdmissionDelay() const {
+    if (maxBacklog_.count() <= 0) {
+        return std::chrono::seconds(0);
+    }
+
+    // The time until the lane a new chunk would go to is back within budget
+    double excess = pickLane().scheduler->backlogSeconds() - maxBacklog_.count();
+    if (excess <= 0) {
+        return std::chrono::seconds(0);
+    }
+    return std::chrono::seconds(static_cast<long long>(std::ceil(excess)));
+}
+
+const VideoProcessor::Lane& VideoProcessor::pickLane() const {
+    const Lane* best = nullptr;
+    double bestBacklog = 0;
+    double bestLoad = 0;
+
+    // Probes and verifies are not in the backlog; they only break ties
+    for (const auto& lane : lanes_) {
+        const ThreadPool& pool = *lane.pool;
+        double backlog = lane.scheduler->backlogSeconds();
+        double load = static_cast<double>(pool.getActiveThreadCount() + pool.getQueueSize()) / pool.getThreadCount();
+        if (!best || backlog < bestBacklog || (backlog == bestBacklog && load < bestLoad)) {
+            best = &lane;
+            bestBacklog = backlog;
+            bestLoad = load;
+        }
+    }
+    return *best;
+}
+
 double VideoProcessor::getLoadFactor() const {
-    size_t activeThreads = threadPool_->getActiveThreadCount();
-    size_t queueSize = threadPool_->getQueueSize();
-    size_t totalCapacity = threadPool_->getActiveThreadCount() * 2;
+    if (maxBacklog_.count() > 0) {
+        return std::min(1.0, pickLane().scheduler->backlogSeconds() / maxBacklog_.count());
+    }
+
+    size_t activeThreads = 0;
+    size_t queueSize = 0;
+    size_t totalCapacity = 0;
+    for (const auto& lane : lanes_) {
+        activeThreads += lane.pool->getActiveThreadCount();
+        queueSize += lane.pool->getQueueSize();
+        totalCapacity += lane.pool->getThreadCount() * 2;
+    }
+    if (totalCapacity == 0) {
+        return 0.0;
+    }
 
     double loadFactor = static_cast<double>(activeThreads + queueSize) / totalCapacity;
     return std::min(1.0, loadFactor);
@@ -231,12 +886,24 @@ ChunkInfo VideoProcessor::extractMetadata(const std::string& filePath) {
     ChunkInfo info;
     info.filePath = filePath;
 
-    try {
-        std::string ffprobeCmd = "ffprobe -v error -select_streams v:0 -show_entries "
-                              "stream=width,height,codec_name,duration -of json \"" + 
-                              filePath + "\" 2>&1";
+#ifdef CHAD_HAVE_LIBAV
+    if (engine_ == Engine::LIBAV) {
+        try {
+            AvTranscoder::MediaInfo media = AvTranscoder::probe(filePath);
+            info.width = media.width;
+            info.height = media.height;
+            info.duration = media.duration;
+            info.codec = media.codec;
+        } catch (const std::exception& e) {
+            LOG_ERROR("Error extracting metadata: " + std::string(e.what()));
+        }
+        return info;
+    }
+#endif
 
-        std::string output = execCommand(ffprobeCmd);
+    try {
+        std::string output = execCommand({"ffprobe", "-v", "error", "-select_streams", "v:0", "-show_entries",
+                                          "stream=width,height,codec_name,duration", "-of", "json", filePath});
 
         json metadata = json::parse(output);
 
@@ -267,9 +934,9 @@ ChunkInfo VideoProcessor::extractMetadata(const std::string& filePath) {
 }
 
 std::string VideoProcessor::generateChunkId() {
-    static std::random_device rd;
-    static std::mt19937 gen(rd());
-    static std::uniform_int_distribution<> dis(0, 15);
+    // Chunks are registered on every IO thread at once, so each has its own engine
+    thread_local std::mt19937 gen(std::random_device{}());
+    thread_local std::uniform_int_distribution<> dis(0, 15);
     static const char* hex = "0123456789abcdef";
 
     std::string uuid;
@@ -283,28 +950,33 @@ std::string VideoProcessor::generateChunkId() {
 }
 
 void VideoProcessor::cleanupOldChunks() {
-    if (maxChunks_ > 0 && chunks_.size() > maxChunks_) {
-        std::sort(chunks_.begin(), chunks_.end(), [](const std::shared_ptr<ChunkInfo>& a, const std::shared_ptr<ChunkInfo>& b) {
-            return a.get() < b.get();
-        });
+    if (maxChunks_ == 0 || chunks_.size() <= maxChunks_) {
+        return;
+    }
 
-        size_t toDelete = chunks_.size() - maxChunks_;
+    size_t toDelete = chunks_.size() - maxChunks_;
 
-        for (size_t i = 0; i < toDelete && !chunks_.empty(); ++i) {
-            auto& chunk = chunks_[0];
+    // chunks_ is in submission order; only finished chunks are evicted
+    for (auto it = chunks_.begin(); it != chunks_.end() && toDelete > 0;) {
+        const auto& chunk = *it;
+        if (chunk->status == ProcessingStatus::PENDING || chunk->status == ProcessingStatus::PROCESSING) {
+            ++it;
+            continue;
+        }
 
-            try {
-                if (fs::exists(chunk->filePath)) {
-                    fs::remove(chunk->filePath);
-                }
-                LOG_INFO("Auto-deleted old chunk: " + chunk->chunkId);
-            } catch (const std::exception& e) {
-                LOG_ERROR("Error during auto-cleanup: " + std::string(e.what()));
+        try {
+            if (fs::exists(chunk->filePath)) {
+                fs::remove(chunk->filePath);
             }
-
-            chunks_.erase(chunks_.begin());
+            LOG_INFO("Auto-deleted old chunk: " + chunk->chunkId);
+        } catch (const std::exception& e) {
+            LOG_ERROR("Error during auto-cleanup: " + std::string(e.what()));
         }
+
+        it = chunks_.erase(it);
+        bumpVersion();
+        toDelete--;
     }
 }
 
-} // namespace chad
\ No newline at end of file
+} // namespace chad
@@ -0,0 +1,103 @@
+#include "http_server.hpp"
+#include "test_client.hpp"
+
+#include <gtest/gtest.h>
+
+#include <memory>
+#include <set>
+#include <sstream>
+#include <string>
+#include <thread>
+
+using chad::HttpRequest;
+using chad::HttpResponse;
+using chad::HttpServer;
+using chad::test::TestClient;
+
+namespace {
+
+constexpr unsigned short PORT = 18412;
+
+// Answers with the IO thread that served the request
+class AcceptShardsTest : public ::testing::Test {
+protected:
+    void start(size_t shards) {
+        server_ = std::make_unique<HttpServer>(PORT, 2);
+        server_->setAcceptShards(shards);
+        server_->addRoute("GET", "/thread", [](const HttpRequest&, HttpResponse& res) {
+            std::ostringstream id;
+            id << std::this_thread::get_id();
+            res.setText("thread " + id.str() + "<end>");
+        });
+        ASSERT_TRUE(server_->start());
+    }
+
+    void TearDown() override {
+        if (server_) {
+            server_->stop();
+        }
+    }
+
+    // The id of the thread that served one request on client; empty on failure
+    static std::string servingThread(TestClient& client) {
+        if (!client.send("GET /thread HTTP/1.1\r\nHost: test\r\n\r\n") || client.readUntil("<end>").empty()) {
+            return std::string();
+        }
+        std::string received = client.take();
+        size_t start = received.find("thread ");
+        return start == std::string::npos ? std::string() : received.substr(start, received.find("<end>") - start);
+    }
+
+    std::unique_ptr<HttpServer> server_;
+};
+
+TEST_F(AcceptShardsTest, ConnectionsAreSpreadOverTheShards) {
+    start(3);
+
+    // The kernel hashes each connection to one of the listeners; with 30
+    // connections all landing on one of three is vanishingly unlikely
+    std::set<std::string> threads;
+    for (int i = 0; i < 30; ++i) {
+        TestClient client;
+        ASSERT_TRUE(client.connect(PORT));
+        std::string thread = servingThread(client);
+        ASSERT_FALSE(thread.empty());
+        threads.insert(thread);
+    }
+    EXPECT_GE(threads.size(), 2u);
+    EXPECT_LE(threads.size(), 3u);
+}
+
+TEST_F(AcceptShardsTest, ConnectionStaysOnItsShard) {
+    start(3);
+
+    for (int i = 0; i < 5; ++i) {
+        TestClient client;
+        ASSERT_TRUE(client.connect(PORT));
+        std::string first = servingThread(client);
+        ASSERT_FALSE(first.empty());
+        for (int request = 0; request < 3; ++request) {
+            EXPECT_EQ(servingThread(client), first);
+        }
+    }
+}
+
+TEST_F(AcceptShardsTest, UnshardedServerStillServes) {
+    start(0);
+
+    TestClient client;
+    ASSERT_TRUE(client.connect(PORT));
+    EXPECT_FALSE(servingThread(client).empty());
+}
+
+TEST_F(AcceptShardsTest, ShardedServerCanBeRestarted) {
+    start(2);
+    server_->stop();
+    ASSERT_TRUE(server_->start());
+
+    TestClient client;
+    ASSERT_TRUE(client.connect(PORT));
+    EXPECT_FALSE(servingThread(client).empty());
+}
+
+} // namespace
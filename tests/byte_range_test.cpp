@@ -0,0 +1,146 @@
+#include "http_server.hpp"
+
+#include <gtest/gtest.h>
+
+#include <cstdio>
+#include <fstream>
+#include <string>
+#include <unistd.h>
+
+using chad::HttpResponse;
+
+namespace {
+
+// Byte ranges are parsed by HttpResponse::setFile, so each test serves a
+// small temporary file and inspects the resulting response
+class ByteRangeTest : public ::testing::Test {
+protected:
+    static constexpr const char* CONTENT = "0123456789abcdefghij";
+
+    void SetUp() override {
+        char path[] = "/tmp/chad_range_XXXXXX";
+        int fd = ::mkstemp(path);
+        ASSERT_GE(fd, 0);
+        ::close(fd);
+        path_ = path;
+        std::ofstream(path_, std::ios::binary) << CONTENT;
+    }
+
+    void TearDown() override {
+        std::remove(path_.c_str());
+    }
+
+    HttpResponse serve(std::optional<std::string_view> range) {
+        HttpResponse response;
+        EXPECT_TRUE(response.setFile(path_, "video/mp4", range));
+        return response;
+    }
+
+    // The bytes the connection would send: each segment's prefix and file range, then the trailer
+    static std::string bodyOf(const HttpResponse& response) {
+        std::string body;
+        for (const auto& segment : response.file->segments) {
+            body += segment.prefix;
+            std::string data(segment.length, '\0');
+            EXPECT_EQ(::pread(response.file->fd, data.data(), data.size(), static_cast<off_t>(segment.offset)),
+                      static_cast<ssize_t>(data.size()));
+            body += data;
+        }
+        return body + response.file->trailer;
+    }
+
+    static std::string header(const HttpResponse& response, const char* name) {
+        auto it = response.headers.find(name);
+        return it == response.headers.end() ? std::string() : std::string(it->second);
+    }
+
+    std::string path_;
+};
+
+} // namespace
+
+TEST_F(ByteRangeTest, ServesWholeFileWithoutRange) {
+    HttpResponse response = serve(std::nullopt);
+    EXPECT_EQ(response.statusCode, 200);
+    EXPECT_EQ(header(response, "Accept-Ranges"), "bytes");
+    EXPECT_EQ(bodyOf(response), CONTENT);
+    EXPECT_EQ(response.file->size(), 20u);
+}
+
+TEST_F(ByteRangeTest, ServesSingleRanges) {
+    struct Case {
+        const char* range;
+        const char* contentRange;
+        const char* body;
+    };
+    const Case cases[] = {
+        {"bytes=0-4", "bytes 0-4/20", "01234"},
+        {"bytes=10-", "bytes 10-19/20", "abcdefghij"},
+        {"bytes=-3", "bytes 17-19/20", "hij"},
+        {"bytes=-100", "bytes 0-19/20", CONTENT},
+        {"bytes=15-100", "bytes 15-19/20", "fghij"},
+        {" bytes= 2-2 ", "bytes 2-2/20", "2"},
+        {"bytes=50-60, 1-1", "bytes 1-1/20", "1"},
+    };
+
+    for (const auto& c : cases) {
+        HttpResponse response = serve(std::string_view(c.range));
+        EXPECT_EQ(response.statusCode, 206) << c.range;
+        EXPECT_EQ(header(response, "Content-Range"), c.contentRange) << c.range;
+        EXPECT_EQ(header(response, "Content-Type"), "video/mp4") << c.range;
+        EXPECT_EQ(bodyOf(response), c.body) << c.range;
+    }
+}
+
+TEST_F(ByteRangeTest, ServesMultipleRangesAsMultipart) {
+    HttpResponse response = serve(std::string_view("bytes=0-1, -2"));
+    ASSERT_EQ(response.statusCode, 206);
+
+    const std::string contentType = header(response, "Content-Type");
+    const std::string prefix = "multipart/byteranges; boundary=";
+    ASSERT_EQ(contentType.substr(0, prefix.size()), prefix);
+    const std::string boundary = contentType.substr(prefix.size());
+    EXPECT_FALSE(boundary.empty());
+    EXPECT_TRUE(header(response, "Content-Range").empty());
+
+    const std::string expected =
+        "--" + boundary + "\r\n"
+        "Content-Type: video/mp4\r\n"
+        "Content-Range: bytes 0-1/20\r\n\r\n"
+        "01"
+        "\r\n--" + boundary + "\r\n"
+        "Content-Type: video/mp4\r\n"
+        "Content-Range: bytes 18-19/20\r\n\r\n"
+        "ij"
+        "\r\n--" + boundary + "--\r\n";
+    EXPECT_EQ(bodyOf(response), expected);
+    EXPECT_EQ(response.file->size(), expected.size());
+}
+
+TEST_F(ByteRangeTest, RejectsUnsatisfiableRanges) {
+    for (const char* range : {"bytes=20-", "bytes=25-30", "bytes=-0", "bytes=30-40, 50-"}) {
+        HttpResponse response = serve(std::string_view(range));
+        EXPECT_EQ(response.statusCode, 416) << range;
+        EXPECT_EQ(header(response, "Content-Range"), "bytes */20") << range;
+        EXPECT_FALSE(response.file) << range;
+    }
+}
+
+TEST_F(ByteRangeTest, IgnoresInvalidRangeHeaders) {
+    std::string tooMany = "bytes=0-0";
+    for (int i = 1; i <= 16; ++i) {
+        tooMany += "," + std::to_string(i) + "-" + std::to_string(i);
+    }
+
+    for (std::string range : {std::string("items=0-1"), std::string("bytes=5-2"), std::string("bytes=a-b"),
+                              std::string("bytes=3"), std::string("bytes="), std::string("bytes=,,"), tooMany}) {
+        HttpResponse response = serve(std::string_view(range));
+        EXPECT_EQ(response.statusCode, 200) << range;
+        EXPECT_EQ(bodyOf(response), CONTENT) << range;
+    }
+}
+
+TEST_F(ByteRangeTest, FailsForMissingFile) {
+    HttpResponse response;
+    EXPECT_FALSE(response.setFile(path_ + ".missing", "video/mp4"));
+}
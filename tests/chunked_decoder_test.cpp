@@ -0,0 +1,130 @@
+#include "http_parser.hpp"
+
+#include <gtest/gtest.h>
+
+#include <string>
+#include <vector>
+
+using chad::ChunkedDecoder;
+using Status = ChunkedDecoder::Status;
+
+namespace {
+
+const std::string BODY =
+    "5\r\nhello\r\n"
+    "7;name=value\r\n, world\r\n"
+    "A\r\n0123456789\r\n"
+    "0\r\n"
+    "X-Trailer: ignored\r\n"
+    "\r\n";
+
+const std::string PAYLOAD = "hello, world0123456789";
+
+// Feeds the body in pieces of at most step bytes, as separate reads would
+// deliver it, and collects the decoded payload
+Status decodeInPieces(const std::string& input, size_t step, std::string& payload, size_t& used) {
+    ChunkedDecoder decoder;
+    payload.clear();
+    used = 0;
+
+    while (used < input.size()) {
+        std::string piece = input.substr(used, step);
+        size_t consumed = 0;
+        size_t produced = 0;
+        Status status = decoder.decode(piece.data(), piece.size(), consumed, produced);
+        if (status == Status::BAD_REQUEST) {
+            return status;
+        }
+
+        payload.append(piece.data(), produced);
+        used += consumed;
+        if (status == Status::COMPLETE) {
+            return status;
+        }
+        EXPECT_EQ(consumed, piece.size());
+    }
+    return Status::INCOMPLETE;
+}
+
+} // namespace
+
+TEST(ChunkedDecoderTest, DecodesInPlace) {
+    std::string buffer = BODY;
+    ChunkedDecoder decoder;
+    size_t consumed = 0;
+    size_t payload = 0;
+
+    ASSERT_EQ(decoder.decode(buffer.data(), buffer.size(), consumed, payload), Status::COMPLETE);
+    EXPECT_EQ(consumed, BODY.size());
+    EXPECT_EQ(buffer.substr(0, payload), PAYLOAD);
+}
+
+TEST(ChunkedDecoderTest, DecodesAcrossEverySplit) {
+    for (size_t step = 1; step <= BODY.size(); ++step) {
+        std::string payload;
+        size_t used = 0;
+        ASSERT_EQ(decodeInPieces(BODY, step, payload, used), Status::COMPLETE) << step;
+        EXPECT_EQ(payload, PAYLOAD) << step;
+        EXPECT_EQ(used, BODY.size()) << step;
+    }
+}
+
+TEST(ChunkedDecoderTest, StopsAtEndOfBody) {
+    const std::string pipelined = "GET /next HTTP/1.1\r\n\r\n";
+    std::string buffer = BODY + pipelined;
+    ChunkedDecoder decoder;
+    size_t consumed = 0;
+    size_t payload = 0;
+
+    ASSERT_EQ(decoder.decode(buffer.data(), buffer.size(), consumed, payload), Status::COMPLETE);
+    EXPECT_EQ(consumed, BODY.size());
+    EXPECT_EQ(buffer.substr(consumed), pipelined);
+}
+
+TEST(ChunkedDecoderTest, WaitsForMoreInput) {
+    std::string buffer = "4\r\nwi";
+    ChunkedDecoder decoder;
+    size_t consumed = 0;
+    size_t payload = 0;
+
+    ASSERT_EQ(decoder.decode(buffer.data(), buffer.size(), consumed, payload), Status::INCOMPLETE);
+    EXPECT_EQ(consumed, buffer.size());
+    EXPECT_EQ(buffer.substr(0, payload), "wi");
+
+    buffer = "ki\r\n0\r\n\r\n";
+    ASSERT_EQ(decoder.decode(buffer.data(), buffer.size(), consumed, payload), Status::COMPLETE);
+    EXPECT_EQ(buffer.substr(0, payload), "ki");
+}
+
+TEST(ChunkedDecoderTest, DecodesAgainAfterReset) {
+    ChunkedDecoder decoder;
+    size_t consumed = 0;
+    size_t payload = 0;
+
+    std::string first = "1\r\na\r\n0\r\n\r\n";
+    ASSERT_EQ(decoder.decode(first.data(), first.size(), consumed, payload), Status::COMPLETE);
+
+    decoder.reset();
+    std::string second = "2\r\nbc\r\n0\r\n\r\n";
+    ASSERT_EQ(decoder.decode(second.data(), second.size(), consumed, payload), Status::COMPLETE);
+    EXPECT_EQ(second.substr(0, payload), "bc");
+}
+
+TEST(ChunkedDecoderTest, RejectsMalformedBodies) {
+    const std::vector<std::string> bad = {
+        "\r\n",                             // no size
+        "g\r\n",                            // not hex
+        "5x\r\nhello\r\n0\r\n\r\n",         // junk after the size
+        "5\rxhello\r\n0\r\n\r\n",           // CR without LF
+        "5\r\nhelloXX0\r\n\r\n",            // data longer than its size
+        "0\r\n\rx",                         // bad final CRLF
+        "10000000000000000\r\n",            // size overflows 64 bits
+    };
+
+    for (const auto& input : bad) {
+        std::string payload;
+        size_t used = 0;
+        EXPECT_EQ(decodeInPieces(input, input.size(), payload, used), Status::BAD_REQUEST) << input;
+        EXPECT_EQ(decodeInPieces(input, 1, payload, used), Status::BAD_REQUEST) << input;
+    }
+}
@@ -0,0 +1,238 @@
+#include "cost_scheduler.hpp"
+
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+using chad::CostScheduler;
+using chad::TaskClass;
+using chad::TaskPriority;
+using chad::ThreadPool;
+
+namespace {
+
+// One worker, so the scheduler runs one job and hands the pool one more;
+// everything submitted after that waits in the scheduler's own queue
+class CostSchedulerTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        pool_ = std::make_unique<ThreadPool>(1);
+        taskClass_.priority = TaskPriority::LOW;
+        taskClass_.tenant = "test";
+    }
+
+    // Closes the scheduler, then lets the pool run what it was handed and
+    // join while the scheduler those jobs report back to still exists
+    void TearDown() override {
+        if (scheduler_) {
+            scheduler_->close();
+        }
+        release();
+        pool_.reset();
+    }
+
+    void makeScheduler(double agingRate) {
+        scheduler_ = std::make_unique<CostScheduler>(*pool_, agingRate);
+    }
+
+    // Holds the worker until release(), so later jobs have to queue
+    void block(double cost) {
+        auto started = std::make_shared<std::promise<void>>();
+        std::future<void> running = started->get_future();
+        scheduler_->submit(cost, taskClass_, [started, gate = gate_.get_future().share()] {
+            started->set_value();
+            gate.wait();
+        });
+        running.wait();
+    }
+
+    void release() {
+        if (!released_) {
+            released_ = true;
+            gate_.set_value();
+        }
+    }
+
+    void submitRecorded(double cost, int id, const std::string& tenant = "test") {
+        TaskClass taskClass = taskClass_;
+        taskClass.tenant = tenant;
+        scheduler_->submit(cost, taskClass, [this, id] {
+            std::lock_guard<std::mutex> lock(mutex_);
+            order_.push_back(id);
+        });
+    }
+
+    // Waits until every job submitted so far has run
+    void drain() {
+        auto done = std::make_shared<std::promise<void>>();
+        std::future<void> finished = done->get_future();
+        scheduler_->submit(1e9, taskClass_, [done] { done->set_value(); });
+        ASSERT_EQ(finished.wait_for(std::chrono::seconds(10)), std::future_status::ready);
+    }
+
+    std::vector<int> order() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return order_;
+    }
+
+    std::unique_ptr<ThreadPool> pool_;
+    std::unique_ptr<CostScheduler> scheduler_;
+    TaskClass taskClass_;
+
+    std::promise<void> gate_;
+    bool released_ = false;
+
+    std::mutex mutex_;
+    std::vector<int> order_;
+};
+
+} // namespace
+
+TEST_F(CostSchedulerTest, RunsCheapestQueuedJobFirst) {
+    makeScheduler(0.0);
+    block(1);
+    submitRecorded(1, 0);   // handed to the pool right away, as its one spare job
+
+    submitRecorded(50, 1);
+    submitRecorded(5, 2);
+    submitRecorded(20, 3);
+    submitRecorded(5, 4);
+    release();
+    drain();
+
+    // Equal costs keep their submission order
+    EXPECT_EQ(order(), (std::vector<int>{0, 2, 4, 3, 1}));
+}
+
+TEST_F(CostSchedulerTest, AgingLetsLongWaitersGoFirst) {
+    // 1000 seconds of cost forgiven per second waited: 30ms outweighs
+    // the 9 seconds the long job costs more
+    makeScheduler(1000.0);
+    block(1);
+    submitRecorded(1, 0);
+
+    submitRecorded(10, 1);
+    std::this_thread::sleep_for(std::chrono::milliseconds(30));
+    submitRecorded(1, 2);
+    release();
+    drain();
+
+    EXPECT_EQ(order(), (std::vector<int>{0, 1, 2}));
+}
+
+TEST_F(CostSchedulerTest, WithoutAgingShortJobsOvertake) {
+    makeScheduler(0.0);
+    block(1);
+    submitRecorded(1, 0);
+
+    submitRecorded(10, 1);
+    std::this_thread::sleep_for(std::chrono::milliseconds(30));
+    submitRecorded(1, 2);
+    release();
+    drain();
+
+    EXPECT_EQ(order(), (std::vector<int>{0, 2, 1}));
+}
+
+TEST_F(CostSchedulerTest, TenantsTakeTurns) {
+    makeScheduler(0.0);
+    block(1);
+    submitRecorded(1, 0);
+
+    // One quantum (5 seconds) per turn: each tenant gets one job in
+    for (int i = 1; i <= 6; ++i) {
+        submitRecorded(5, 10 + i, "busy");
+    }
+    submitRecorded(5, 21, "quiet");
+    submitRecorded(5, 22, "quiet");
+    release();
+    drain();
+
+    EXPECT_EQ(order(), (std::vector<int>{0, 11, 21, 12, 22, 13, 14, 15, 16}));
+}
+
+TEST_F(CostSchedulerTest, TenantWeightScalesItsShare) {
+    makeScheduler(0.0);
+    scheduler_->setTenantWeight("heavy", 2);
+    block(1);
+    submitRecorded(1, 0);
+
+    for (int i = 1; i <= 6; ++i) {
+        submitRecorded(5, 10 + i, "heavy");
+    }
+    for (int i = 1; i <= 3; ++i) {
+        submitRecorded(5, 20 + i, "light");
+    }
+    release();
+    drain();
+
+    EXPECT_EQ(order(), (std::vector<int>{0, 11, 12, 21, 13, 14, 22, 15, 16, 23}));
+}
+
+TEST_F(CostSchedulerTest, JobsLongerThanAQuantumStillRun) {
+    makeScheduler(0.0);
+    block(1);
+    submitRecorded(1, 0);
+
+    // Affordable only after 200 turns; the short tenant gets its jobs in meanwhile
+    submitRecorded(1000, 1, "long");
+    submitRecorded(5, 2, "short");
+    submitRecorded(5, 3, "short");
+    release();
+    drain();
+
+    EXPECT_EQ(order(), (std::vector<int>{0, 2, 3, 1}));
+}
+
+TEST_F(CostSchedulerTest, FailingJobDoesNotStopTheQueue) {
+    makeScheduler(1.0);
+    block(1);
+    scheduler_->submit(1, taskClass_, [] { throw std::runtime_error("job failed"); });
+    submitRecorded(2, 1);
+    release();
+    drain();
+
+    EXPECT_EQ(order(), (std::vector<int>{1}));
+}
+
+TEST_F(CostSchedulerTest, EstimatesBacklogFromQueuedAndRunningCost) {
+    makeScheduler(1.0);
+    EXPECT_DOUBLE_EQ(scheduler_->backlogSeconds(), 0.0);
+
+    block(10);
+    submitRecorded(2, 0);
+    submitRecorded(4, 1);
+
+    // 10 running (less the little it has run so far) + 2 waiting in the pool + 4 queued
+    double backlog = scheduler_->backlogSeconds();
+    EXPECT_GT(backlog, 15.0);
+    EXPECT_LE(backlog, 16.0);
+}
+
+TEST_F(CostSchedulerTest, CloseDropsQueuedAndLaterJobs) {
+    makeScheduler(1.0);
+    block(1);
+    submitRecorded(1, 0);
+
+    auto witness = std::make_shared<int>(0);
+    scheduler_->submit(1, taskClass_, [witness] { (*witness)++; });
+    EXPECT_EQ(witness.use_count(), 2);
+
+    scheduler_->close();
+    EXPECT_EQ(witness.use_count(), 1);
+
+    scheduler_->submit(1, taskClass_, [witness] { (*witness)++; });
+    EXPECT_EQ(witness.use_count(), 1);
+
+    release();
+    pool_.reset();
+    EXPECT_EQ(order(), (std::vector<int>{0}));
+    EXPECT_EQ(*witness, 0);
+}
@@ -0,0 +1,88 @@
+#include "cpu_affinity.hpp"
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+using chad::CpuSet;
+using chad::CpuTopology;
+using chad::cpuSetsFor;
+using chad::formatCpuList;
+using chad::parseCpuList;
+
+namespace {
+
+TEST(CpuListTest, ParsesSinglesAndRanges) {
+    EXPECT_EQ(parseCpuList("0"), (CpuSet{0}));
+    EXPECT_EQ(parseCpuList("0-3,8,10-11"), (CpuSet{0, 1, 2, 3, 8, 10, 11}));
+    EXPECT_EQ(parseCpuList("5-5"), (CpuSet{5}));
+    EXPECT_TRUE(parseCpuList("").empty());
+}
+
+TEST(CpuListTest, SortsMergesAndIgnoresWhitespace) {
+    // sysfs files end in a newline; hand-written settings may have spaces
+    EXPECT_EQ(parseCpuList("0-3\n"), (CpuSet{0, 1, 2, 3}));
+    EXPECT_EQ(parseCpuList(" 8, 2 - 3 ,,2"), (CpuSet{2, 3, 8}));
+    EXPECT_EQ(parseCpuList("4-6,5-7"), (CpuSet{4, 5, 6, 7}));
+}
+
+TEST(CpuListTest, RejectsMalformedLists) {
+    for (const char* list : {"a", "1-", "-1", "3-1", "1-2-3", "1x", "0-99999", "1,b"}) {
+        EXPECT_THROW(parseCpuList(list), std::invalid_argument) << list;
+    }
+}
+
+TEST(CpuListTest, FormatsRuns) {
+    EXPECT_EQ(formatCpuList({}), "");
+    EXPECT_EQ(formatCpuList({3}), "3");
+    EXPECT_EQ(formatCpuList({0, 1, 2, 3, 8, 10, 11}), "0-3,8,10-11");
+
+    CpuSet cpus = {1, 2, 5, 7, 8, 9};
+    EXPECT_EQ(parseCpuList(formatCpuList(cpus)), cpus);
+}
+
+TEST(CpuSetsForTest, EmptyPlacementLeavesThreadsUnpinned) {
+    EXPECT_TRUE(cpuSetsFor("").empty());
+}
+
+TEST(CpuSetsForTest, CpuListGivesOneCpuPerThread) {
+    EXPECT_EQ(cpuSetsFor("2-3,6"), (std::vector<CpuSet>{{2}, {3}, {6}}));
+    EXPECT_THROW(cpuSetsFor("cpus"), std::invalid_argument);
+    EXPECT_THROW(cpuSetsFor(","), std::invalid_argument);
+}
+
+TEST(CpuSetsForTest, CoresAndNodesCoverOnlyUsableCpus) {
+    const CpuTopology& topology = CpuTopology::getInstance();
+    const CpuSet& cpus = topology.cpus();
+    ASSERT_FALSE(cpus.empty());
+    EXPECT_TRUE(std::is_sorted(cpus.begin(), cpus.end()));
+
+    auto usable = [&cpus](int cpu) { return std::binary_search(cpus.begin(), cpus.end(), cpu); };
+
+    std::vector<CpuSet> cores = cpuSetsFor("cores");
+    ASSERT_FALSE(cores.empty());
+    EXPECT_LE(cores.size(), cpus.size());
+    for (const CpuSet& set : cores) {
+        ASSERT_EQ(set.size(), 1u);
+        EXPECT_TRUE(usable(set[0]));
+    }
+
+    // Falls back to one set of every CPU when the host exposes no nodes
+    std::vector<CpuSet> nodes = cpuSetsFor("nodes");
+    ASSERT_FALSE(nodes.empty());
+    CpuSet covered;
+    for (const CpuSet& set : nodes) {
+        ASSERT_FALSE(set.empty());
+        for (int cpu : set) {
+            EXPECT_TRUE(usable(cpu));
+            covered.push_back(cpu);
+        }
+    }
+    std::sort(covered.begin(), covered.end());
+    EXPECT_EQ(covered, cpus);
+}
+
+} // namespace
@@ -0,0 +1,167 @@
+#include "event_broadcaster.hpp"
+#include "test_client.hpp"
+
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <memory>
+#include <string>
+#include <thread>
+
+using chad::EventBroadcaster;
+using chad::HttpRequest;
+using chad::HttpResponder;
+using chad::HttpResponse;
+using chad::HttpServer;
+using chad::test::TestClient;
+
+namespace {
+
+constexpr unsigned short PORT = 18411;
+
+// A server with an event stream whose subscribers may queue a normal
+// backlog (/events) or only a few bytes (/slow)
+class EventBroadcasterTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        server_ = std::make_unique<HttpServer>(PORT, 1);
+        addStreamRoute("/events", 1024 * 1024);
+        addStreamRoute("/slow", 16);
+        ASSERT_TRUE(server_->start());
+
+        events_ = std::make_shared<EventBroadcaster>(server_->getExecutor(), std::chrono::seconds(60));
+    }
+
+    void TearDown() override {
+        server_->stop();
+    }
+
+    void addStreamRoute(const std::string& path, size_t maxBacklog) {
+        server_->addAsyncRoute("GET", path, [this, maxBacklog](const HttpRequest&, HttpResponder responder) {
+            HttpResponse head;
+            head.headers["Content-Type"] = "text/event-stream";
+            auto stream = responder.stream(std::move(head), maxBacklog);
+            if (stream) {
+                events_->subscribe(stream);
+            }
+        });
+    }
+
+    void subscribe(TestClient& client, const std::string& path) {
+        ASSERT_TRUE(client.connect(PORT));
+        ASSERT_TRUE(client.send("GET " + path + " HTTP/1.1\r\nHost: test\r\n\r\n"));
+        ASSERT_NE(client.readUntil("\r\n\r\n").find("200 OK"), std::string::npos);
+    }
+
+    // Subscriptions and drops happen on the IO thread
+    bool waitForSubscribers(size_t count) {
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+        while (events_->subscriberCount() != count) {
+            if (std::chrono::steady_clock::now() > deadline) {
+                return false;
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        return true;
+    }
+
+    std::unique_ptr<HttpServer> server_;
+    std::shared_ptr<EventBroadcaster> events_;
+};
+
+TEST_F(EventBroadcasterTest, FansEventsOutToEverySubscriber) {
+    TestClient first, second, third;
+    subscribe(first, "/events");
+    subscribe(second, "/events");
+    subscribe(third, "/events");
+    ASSERT_TRUE(waitForSubscribers(3));
+
+    events_->publish("data: one\n\n");
+    events_->publish("data: two\n\n");
+
+    for (TestClient* client : {&first, &second, &third}) {
+        std::string received = client->readUntil("data: two\n\n");
+        ASSERT_FALSE(received.empty());
+        EXPECT_LT(received.find("data: one\n\n"), received.find("data: two\n\n"));
+    }
+}
+
+TEST_F(EventBroadcasterTest, OnlyEventsAfterSubscribingAreSent) {
+    TestClient early;
+    subscribe(early, "/events");
+    ASSERT_TRUE(waitForSubscribers(1));
+    events_->publish("data: before\n\n");
+    ASSERT_FALSE(early.readUntil("data: before\n\n").empty());
+
+    TestClient late;
+    subscribe(late, "/events");
+    ASSERT_TRUE(waitForSubscribers(2));
+    events_->publish("data: after\n\n");
+
+    std::string received = late.readUntil("data: after\n\n");
+    ASSERT_FALSE(received.empty());
+    EXPECT_EQ(received.find("data: before"), std::string::npos);
+}
+
+TEST_F(EventBroadcasterTest, SubscriberBeyondItsBacklogIsDropped) {
+    TestClient fast, slow;
+    subscribe(fast, "/events");
+    subscribe(slow, "/slow");
+    ASSERT_TRUE(waitForSubscribers(2));
+
+    // More than the slow stream may queue: its client is disconnected, the
+    // other subscriber still gets the event
+    std::string event = "data: " + std::string(64, 'x') + "\n\n";
+    events_->publish(event);
+
+    EXPECT_FALSE(fast.readUntil(event).empty());
+    EXPECT_TRUE(slow.waitForClose());
+    EXPECT_TRUE(waitForSubscribers(1));
+
+    events_->publish("data: next\n\n");
+    EXPECT_FALSE(fast.readUntil("data: next\n\n").empty());
+}
+
+TEST_F(EventBroadcasterTest, DisconnectedSubscriberIsDropped) {
+    TestClient staying, leaving;
+    subscribe(staying, "/events");
+    subscribe(leaving, "/events");
+    ASSERT_TRUE(waitForSubscribers(2));
+
+    leaving.close();
+
+    // The stream fails once its connection notices the hang-up; the next
+    // event published after that removes it
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+    while (events_->subscriberCount() != 1 && std::chrono::steady_clock::now() < deadline) {
+        events_->publish(": ping\n\n");
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    }
+    EXPECT_EQ(events_->subscriberCount(), 1u);
+
+    events_->publish("data: still here\n\n");
+    EXPECT_FALSE(staying.readUntil("data: still here\n\n").empty());
+}
+
+TEST_F(EventBroadcasterTest, ClosingEndsEveryStream) {
+    TestClient first, second;
+    subscribe(first, "/events");
+    subscribe(second, "/events");
+    ASSERT_TRUE(waitForSubscribers(2));
+
+    events_->close();
+    EXPECT_EQ(events_->subscriberCount(), 0u);
+
+    // Each stream ends with the last chunk of its chunked body
+    for (TestClient* client : {&first, &second}) {
+        EXPECT_FALSE(client->readUntil("\r\n0\r\n\r\n").empty());
+    }
+
+    // A subscriber arriving later is ended at once
+    TestClient late;
+    subscribe(late, "/events");
+    EXPECT_FALSE(late.readUntil("\r\n0\r\n\r\n").empty());
+    EXPECT_EQ(events_->subscriberCount(), 0u);
+}
+
+} // namespace
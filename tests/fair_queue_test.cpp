@@ -0,0 +1,118 @@
+#include "fair_queue.hpp"
+
+#include <gtest/gtest.h>
+
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+using chad::FairQueue;
+
+namespace {
+
+// Items are "<flow><index>", so the pop order reads as a schedule
+std::string drain(FairQueue<std::string>& queue) {
+    std::string order;
+    std::string item;
+    while (queue.pop(item)) {
+        order += item.substr(0, 1);
+    }
+    return order;
+}
+
+void pushMany(FairQueue<std::string>& queue, const std::string& flow, size_t count, uint64_t cost = 1) {
+    for (size_t i = 0; i < count; ++i) {
+        queue.push(flow, flow + std::to_string(i), cost);
+    }
+}
+
+} // namespace
+
+TEST(FairQueueTest, KeepsFifoOrderWithinAFlow) {
+    FairQueue<std::string> queue;
+    std::string item;
+    EXPECT_TRUE(queue.empty());
+    EXPECT_FALSE(queue.pop(item));
+
+    pushMany(queue, "A", 3);
+    EXPECT_EQ(queue.size(), 3u);
+
+    for (const char* expected : {"A0", "A1", "A2"}) {
+        ASSERT_TRUE(queue.pop(item));
+        EXPECT_EQ(item, expected);
+    }
+    EXPECT_TRUE(queue.empty());
+    EXPECT_FALSE(queue.pop(item));
+}
+
+TEST(FairQueueTest, AlternatesBetweenFlowsRegardlessOfBacklog) {
+    FairQueue<std::string> queue;
+    pushMany(queue, "A", 6);
+    pushMany(queue, "B", 2);
+    pushMany(queue, "C", 1);
+
+    EXPECT_EQ(drain(queue), "ABCABAAAA");
+}
+
+TEST(FairQueueTest, SharesInProportionToWeight) {
+    FairQueue<std::string> queue;
+    queue.setWeight("A", 3);
+    pushMany(queue, "A", 7);
+    pushMany(queue, "B", 3);
+
+    EXPECT_EQ(drain(queue), "AAABAAABAB");
+
+    // Back to the default weight
+    queue.setWeight("A", 1);
+    pushMany(queue, "A", 3);
+    pushMany(queue, "B", 3);
+    EXPECT_EQ(drain(queue), "ABABAB");
+}
+
+TEST(FairQueueTest, ChargesItemsByCost) {
+    // A's items cost three times B's, so B gets three items per A item
+    FairQueue<std::string> queue;
+    pushMany(queue, "A", 2, 3);
+    pushMany(queue, "B", 7, 1);
+
+    EXPECT_EQ(drain(queue), "BBABBBABB");
+}
+
+TEST(FairQueueTest, QuantumServesSeveralCheapItemsPerTurn) {
+    FairQueue<std::string> queue(4);
+    pushMany(queue, "A", 6, 2);
+    pushMany(queue, "B", 6, 2);
+
+    EXPECT_EQ(drain(queue), "AABBAABBAABB");
+}
+
+TEST(FairQueueTest, IdleFlowForfeitsItsCredit) {
+    FairQueue<std::string> queue(10);
+    std::string item;
+
+    // A leaves 9 units of credit unused when its queue runs dry
+    queue.push("A", "A0", 1);
+    ASSERT_TRUE(queue.pop(item));
+
+    // Had A kept them it would go first; it needs two turns instead
+    queue.push("A", "A1", 15);
+    queue.push("B", "B0", 1);
+    EXPECT_EQ(drain(queue), "BA");
+}
+
+TEST(FairQueueTest, NewFlowJoinsAtTheBackOfTheRing) {
+    FairQueue<std::string> queue;
+    pushMany(queue, "A", 3);
+    pushMany(queue, "B", 3);
+
+    std::string order;
+    std::string item;
+    ASSERT_TRUE(queue.pop(item));
+    order += item.substr(0, 1);
+
+    // C arrives during A's turn and waits for B's
+    pushMany(queue, "C", 3);
+    order += drain(queue);
+    EXPECT_EQ(order, "ABCABCABC");
+}
@@ -0,0 +1,173 @@
+#include "hot_restart.hpp"
+#include "http_server.hpp"
+#include "test_client.hpp"
+
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <cstdlib>
+#include <future>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+using chad::HotRestart;
+using chad::HttpRequest;
+using chad::HttpResponse;
+using chad::HttpServer;
+using chad::test::TestClient;
+
+namespace {
+
+constexpr unsigned short PORT = 18413;
+
+bool isListening(int fd) {
+    int listening = 0;
+    socklen_t size = sizeof(listening);
+    return ::getsockopt(fd, SOL_SOCKET, SO_ACCEPTCONN, &listening, &size) == 0 && listening;
+}
+
+unsigned short localPort(int fd) {
+    sockaddr_in address{};
+    socklen_t size = sizeof(address);
+    if (::getsockname(fd, reinterpret_cast<sockaddr*>(&address), &size) != 0) {
+        return 0;
+    }
+    return ntohs(address.sin_port);
+}
+
+// Answers /who with its name, so a client can tell the processes apart
+std::unique_ptr<HttpServer> makeServer(const std::string& name, size_t shards) {
+    auto server = std::make_unique<HttpServer>(PORT, 1);
+    server->setAcceptShards(shards);
+    server->addRoute("GET", "/who", [name](const HttpRequest&, HttpResponse& res) {
+        res.setText(name + "<end>");
+    });
+    return server;
+}
+
+std::string ask(TestClient& client) {
+    if (!client.connect(PORT) || !client.send("GET /who HTTP/1.1\r\nHost: test\r\nConnection: close\r\n\r\n")) {
+        return std::string();
+    }
+    std::string received = client.readUntil("<end>");
+    size_t end = received.find("<end>");
+    if (end == std::string::npos) {
+        return std::string();
+    }
+    size_t start = received.rfind('\n', end);
+    return received.substr(start + 1, end - start - 1);
+}
+
+TEST(HotRestartTest, ServerExposesOneListenerPerShard) {
+    auto server = makeServer("old", 2);
+    ASSERT_TRUE(server->start());
+
+    std::vector<int> fds = server->listenerFds();
+    ASSERT_EQ(fds.size(), 2u);
+    for (int fd : fds) {
+        EXPECT_TRUE(isListening(fd));
+        EXPECT_EQ(localPort(fd), PORT);
+    }
+    server->stop();
+}
+
+TEST(HotRestartTest, NotStartedByAHotRestart) {
+    HotRestart restart;
+    EXPECT_TRUE(restart.inheritListeners().empty());
+    restart.notifyReady();
+}
+
+// Run as the successor by HandsListenersToTheSuccessor; skipped otherwise
+TEST(HotRestartSuccessor, ServesInheritedListeners) {
+    if (!std::getenv("CHAD_HANDOFF_FD")) {
+        GTEST_SKIP() << "only runs as a successor";
+    }
+
+    HotRestart restart;
+    std::vector<int> fds = restart.inheritListeners();
+    ASSERT_EQ(fds.size(), 2u);
+    for (int fd : fds) {
+        ASSERT_TRUE(isListening(fd));
+        ASSERT_EQ(localPort(fd), PORT);
+    }
+
+    std::promise<void> quit;
+    auto server = makeServer("new", 2);
+    server->addRoute("GET", "/quit", [&quit](const HttpRequest&, HttpResponse& res) {
+        res.setText("bye");
+        quit.set_value();
+    });
+    server->adoptListeners(fds);
+    ASSERT_TRUE(server->start());
+    restart.notifyReady();
+
+    quit.get_future().wait_for(std::chrono::seconds(10));
+    server->stop();
+}
+
+TEST(HotRestartTest, HandsListenersToTheSuccessor) {
+    auto server = makeServer("old", 2);
+    ASSERT_TRUE(server->start());
+
+    TestClient before;
+    EXPECT_EQ(ask(before), "old");
+
+    HotRestart restart;
+    ASSERT_TRUE(restart.spawnSuccessor("/proc/self/exe",
+                                       {"hot_restart_test", "--gtest_filter=HotRestartSuccessor.*"},
+                                       server->listenerFds(), std::chrono::seconds(10)));
+
+    // Once this process stops accepting, the successor has every listener
+    server->stopAccepting();
+    for (int i = 0; i < 5; ++i) {
+        TestClient after;
+        EXPECT_EQ(ask(after), "new");
+    }
+    server->stop();
+
+    // The port is free again once the successor has quit
+    TestClient quit;
+    ASSERT_TRUE(quit.connect(PORT));
+    ASSERT_TRUE(quit.send("GET /quit HTTP/1.1\r\nHost: test\r\nConnection: close\r\n\r\n"));
+    EXPECT_TRUE(quit.waitForClose());
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+    while (quit.connect(PORT) && std::chrono::steady_clock::now() < deadline) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    EXPECT_FALSE(quit.connect(PORT));
+}
+
+TEST(HotRestartTest, SuccessorThatNeverReportsIsKilled) {
+    auto server = makeServer("old", 1);
+    ASSERT_TRUE(server->start());
+
+    HotRestart restart;
+    auto started = std::chrono::steady_clock::now();
+    EXPECT_FALSE(restart.spawnSuccessor("/bin/sleep", {"sleep", "10"}, server->listenerFds(),
+                                        std::chrono::milliseconds(200)));
+    EXPECT_LT(std::chrono::steady_clock::now() - started, std::chrono::seconds(5));
+
+    // The old process keeps serving
+    TestClient client;
+    EXPECT_EQ(ask(client), "old");
+    server->stop();
+}
+
+TEST(HotRestartTest, SuccessorThatExitsFailsAtOnce) {
+    auto server = makeServer("old", 1);
+    ASSERT_TRUE(server->start());
+
+    HotRestart restart;
+    auto started = std::chrono::steady_clock::now();
+    EXPECT_FALSE(restart.spawnSuccessor("/bin/true", {"true"}, server->listenerFds(), std::chrono::seconds(10)));
+    EXPECT_LT(std::chrono::steady_clock::now() - started, std::chrono::seconds(5));
+    server->stop();
+}
+
+} // namespace
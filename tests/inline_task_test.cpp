@@ -0,0 +1,146 @@
+#include "inline_task.hpp"
+
+#include <gtest/gtest.h>
+
+#include <array>
+#include <cstdlib>
+#include <memory>
+#include <new>
+
+using chad::InlineTask;
+
+namespace {
+
+size_t allocations = 0;
+
+// Counts live instances, so leaks and double destruction show up
+struct Tracked {
+    static inline int live = 0;
+
+    explicit Tracked(int* calls) : calls(calls) { live++; }
+    Tracked(Tracked&& other) noexcept : calls(other.calls) { live++; }
+    ~Tracked() { live--; }
+
+    void operator()() { (*calls)++; }
+
+    int* calls;
+};
+
+struct Large {
+    std::array<char, InlineTask::INLINE_SIZE + 1> padding{};
+    Tracked tracked;
+
+    void operator()() { tracked(); }
+};
+
+// Moving may throw, so it cannot live inside a noexcept-movable task
+struct ThrowingMove {
+    explicit ThrowingMove(int* calls) : tracked(calls) {}
+    ThrowingMove(ThrowingMove&& other) noexcept(false) : tracked(std::move(other.tracked)) {}
+
+    void operator()() { tracked(); }
+
+    Tracked tracked;
+};
+
+} // namespace
+
+void* operator new(size_t size) {
+    allocations++;
+    if (void* p = std::malloc(size ? size : 1)) {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept {
+    std::free(p);
+}
+
+void operator delete(void* p, size_t) noexcept {
+    std::free(p);
+}
+
+TEST(InlineTaskTest, EmptyTaskIsFalse) {
+    InlineTask task;
+    EXPECT_FALSE(task);
+}
+
+TEST(InlineTaskTest, StoresSmallCallablesWithoutAllocating) {
+    int calls = 0;
+    size_t before = allocations;
+    {
+        InlineTask task(Tracked{&calls});
+        EXPECT_TRUE(task);
+        task();
+        task();
+
+        InlineTask moved(std::move(task));
+        EXPECT_FALSE(task);
+        moved();
+        EXPECT_EQ(Tracked::live, 1);
+    }
+    EXPECT_EQ(allocations, before);
+    EXPECT_EQ(calls, 3);
+    EXPECT_EQ(Tracked::live, 0);
+}
+
+TEST(InlineTaskTest, MovesLargeCallablesToTheHeap) {
+    int calls = 0;
+    size_t before = allocations;
+    {
+        InlineTask task(Large{{}, Tracked{&calls}});
+        EXPECT_EQ(allocations, before + 1);
+
+        // Moving hands over the pointer without touching the target
+        InlineTask moved(std::move(task));
+        EXPECT_EQ(allocations, before + 1);
+        EXPECT_EQ(Tracked::live, 1);
+        moved();
+    }
+    EXPECT_EQ(calls, 1);
+    EXPECT_EQ(Tracked::live, 0);
+
+    {
+        InlineTask task(ThrowingMove{&calls});
+        EXPECT_EQ(allocations, before + 2);
+        task();
+    }
+    EXPECT_EQ(calls, 2);
+    EXPECT_EQ(Tracked::live, 0);
+}
+
+TEST(InlineTaskTest, HoldsMoveOnlyState) {
+    auto value = std::make_unique<int>(41);
+    int seen = 0;
+
+    InlineTask task([value = std::move(value), &seen]() mutable { seen = ++*value; });
+    InlineTask moved(std::move(task));
+    moved();
+    EXPECT_EQ(seen, 42);
+}
+
+TEST(InlineTaskTest, AssignmentDestroysPreviousTarget) {
+    int first = 0;
+    int second = 0;
+
+    InlineTask task(Tracked{&first});
+    InlineTask other(Large{{}, Tracked{&second}});
+    EXPECT_EQ(Tracked::live, 2);
+
+    task = std::move(other);
+    EXPECT_EQ(Tracked::live, 1);
+    EXPECT_FALSE(other);
+    task();
+    EXPECT_EQ(first, 0);
+    EXPECT_EQ(second, 1);
+
+    InlineTask& self = task;
+    task = std::move(self);
+    EXPECT_TRUE(task);
+    EXPECT_EQ(Tracked::live, 1);
+
+    task = InlineTask();
+    EXPECT_FALSE(task);
+    EXPECT_EQ(Tracked::live, 0);
+}
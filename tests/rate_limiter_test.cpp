@@ -0,0 +1,104 @@
+#include "rate_limiter.hpp"
+
+#include <gtest/gtest.h>
+
+using chad::RateLimiter;
+using Decision = RateLimiter::Decision;
+
+namespace {
+
+RateLimiter::Settings settings(size_t perMinute, size_t banThreshold = 0) {
+    RateLimiter::Settings s;
+    s.requestsPerMinute = perMinute;
+    s.banThreshold = banThreshold;
+    s.banTime = std::chrono::minutes(5);
+    return s;
+}
+
+uint64_t v4(const char* address) {
+    return RateLimiter::clientKey(boost::asio::ip::make_address(address));
+}
+
+} // namespace
+
+TEST(RateLimiterTest, AllowsBurstThenLimits) {
+    RateLimiter limiter(settings(10));
+    std::chrono::seconds retryAfter{0};
+
+    for (int i = 0; i < 10; ++i) {
+        EXPECT_EQ(limiter.acquire(1, retryAfter), Decision::ALLOW) << i;
+    }
+    EXPECT_EQ(limiter.acquire(1, retryAfter), Decision::LIMITED);
+
+    // One token refills every 6 seconds
+    EXPECT_GE(retryAfter.count(), 5);
+    EXPECT_LE(retryAfter.count(), 6);
+}
+
+TEST(RateLimiterTest, KeepsClientsApart) {
+    RateLimiter limiter(settings(2));
+    std::chrono::seconds retryAfter{0};
+
+    EXPECT_EQ(limiter.acquire(1, retryAfter), Decision::ALLOW);
+    EXPECT_EQ(limiter.acquire(1, retryAfter), Decision::ALLOW);
+    EXPECT_EQ(limiter.acquire(1, retryAfter), Decision::LIMITED);
+
+    EXPECT_EQ(limiter.acquire(2, retryAfter), Decision::ALLOW);
+    EXPECT_EQ(limiter.acquire(2, retryAfter), Decision::ALLOW);
+    EXPECT_EQ(limiter.acquire(2, retryAfter), Decision::LIMITED);
+}
+
+TEST(RateLimiterTest, BansRepeatOffenders) {
+    RateLimiter limiter(settings(1, 3));
+    std::chrono::seconds retryAfter{0};
+
+    EXPECT_EQ(limiter.acquire(7, retryAfter), Decision::ALLOW);
+    EXPECT_EQ(limiter.acquire(7, retryAfter), Decision::LIMITED);
+    EXPECT_EQ(limiter.acquire(7, retryAfter), Decision::LIMITED);
+    EXPECT_EQ(limiter.acquire(7, retryAfter), Decision::BANNED);
+    EXPECT_EQ(retryAfter, std::chrono::minutes(5));
+
+    // Stays banned, with the remaining time reported
+    EXPECT_EQ(limiter.acquire(7, retryAfter), Decision::BANNED);
+    EXPECT_GT(retryAfter.count(), 290);
+    EXPECT_LE(retryAfter.count(), 300);
+
+    EXPECT_EQ(limiter.acquire(8, retryAfter), Decision::ALLOW);
+}
+
+TEST(RateLimiterTest, NeverBansWithZeroThreshold) {
+    RateLimiter limiter(settings(1, 0));
+    std::chrono::seconds retryAfter{0};
+
+    EXPECT_EQ(limiter.acquire(3, retryAfter), Decision::ALLOW);
+    for (int i = 0; i < 200; ++i) {
+        ASSERT_EQ(limiter.acquire(3, retryAfter), Decision::LIMITED) << i;
+    }
+}
+
+TEST(RateLimiterTest, FailsOpenWhenTableIsFull) {
+    // The smallest table has 16 slots, all of them within one probe sequence
+    RateLimiter limiter(settings(1), 1);
+    std::chrono::seconds retryAfter{0};
+
+    for (uint64_t client = 1; client <= 16; ++client) {
+        EXPECT_EQ(limiter.acquire(client, retryAfter), Decision::ALLOW) << client;
+    }
+    EXPECT_EQ(limiter.acquire(1, retryAfter), Decision::LIMITED);
+
+    EXPECT_EQ(limiter.acquire(17, retryAfter), Decision::ALLOW);
+    EXPECT_EQ(limiter.acquire(17, retryAfter), Decision::ALLOW);
+}
+
+TEST(RateLimiterTest, KeysClientsByAddress) {
+    EXPECT_EQ(v4("192.0.2.1"), v4("::ffff:192.0.2.1"));
+    EXPECT_NE(v4("192.0.2.1"), v4("192.0.2.2"));
+
+    // IPv6 clients share a key per /64
+    EXPECT_EQ(v4("2001:db8:1:2::1"), v4("2001:db8:1:2:ffff::9"));
+    EXPECT_NE(v4("2001:db8:1:2::1"), v4("2001:db8:1:3::1"));
+
+    // 0 is reserved for empty slots
+    EXPECT_NE(v4("::"), 0u);
+    EXPECT_NE(v4("0.0.0.0"), v4("::"));
+}
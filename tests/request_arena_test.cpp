@@ -0,0 +1,111 @@
+#include "http_server.hpp"
+#include "test_client.hpp"
+
+#include <gtest/gtest.h>
+
+#include <cstddef>
+#include <memory>
+#include <memory_resource>
+#include <string>
+
+using chad::HttpHeader;
+using chad::HttpRequest;
+using chad::HttpResponse;
+using chad::HttpServer;
+using chad::test::TestClient;
+
+namespace {
+
+constexpr unsigned short PORT = 18414;
+
+// Counts what is allocated through it
+class CountingResource : public std::pmr::memory_resource {
+public:
+    size_t allocations = 0;
+
+private:
+    void* do_allocate(size_t bytes, size_t alignment) override {
+        ++allocations;
+        return std::pmr::new_delete_resource()->allocate(bytes, alignment);
+    }
+
+    void do_deallocate(void* p, size_t bytes, size_t alignment) override {
+        std::pmr::new_delete_resource()->deallocate(p, bytes, alignment);
+    }
+
+    bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override {
+        return this == &other;
+    }
+};
+
+TEST(RequestArenaTest, RequestTablesUseTheGivenResource) {
+    CountingResource resource;
+    HttpRequest request(&resource);
+
+    for (int i = 0; i < 20; ++i) {
+        request.headers.push_back(HttpHeader{"X-Header", "value"});
+    }
+    request.pathParams.push_back({"id", "42"});
+    EXPECT_GT(resource.allocations, 0u);
+    EXPECT_EQ(request.findHeader("x-header"), std::string_view("value"));
+}
+
+TEST(RequestArenaTest, ResponseTablesUseTheGivenResource) {
+    CountingResource resource;
+    HttpResponse response(&resource);
+
+    response.headers["X-Long-Header-Name-That-Defeats-SSO"] = "a value long enough to need its own allocation";
+    response.statusText = "A status text long enough to need its own allocation";
+    EXPECT_GE(resource.allocations, 3u);
+}
+
+TEST(RequestArenaTest, MovingBetweenEqualAllocatorsTakesTheStorage) {
+    CountingResource resource;
+    HttpRequest request(&resource);
+    request.headers.push_back(HttpHeader{"Host", "test"});
+
+    // What the connection relies on before rewinding its arena: the fresh
+    // request's tables take over storage instead of copying into the old one
+    size_t before = resource.allocations;
+    request = HttpRequest(&resource);
+    EXPECT_EQ(resource.allocations, before);
+    EXPECT_TRUE(request.headers.empty());
+}
+
+// Requests on one connection, each larger than the arena's inline buffer,
+// must not see anything the previous request left in the arena
+TEST(RequestArenaTest, ArenaIsRewoundBetweenRequests) {
+    HttpServer server(PORT, 1);
+    server.addRoute("GET", "/echo/{value}", [](const HttpRequest& req, HttpResponse& res) {
+        std::string body = std::string(*req.pathParam("value")) + ":" + std::to_string(req.headers.size());
+        for (const auto& header : req.headers) {
+            if (header.name == "X-Index") {
+                body += ":" + std::string(header.value);
+            }
+        }
+        res.headers["X-Echo"] = std::string(*req.pathParam("value"));
+        res.setText(body + "<end>");
+    });
+    ASSERT_TRUE(server.start());
+
+    TestClient client;
+    ASSERT_TRUE(client.connect(PORT));
+    for (int i = 0; i < 30; ++i) {
+        int headers = i % 2 ? 60 : 2;   // 61 headers is near the parser's limit of 64
+        std::string request = "GET /echo/" + std::to_string(i) + " HTTP/1.1\r\nHost: test\r\n";
+        for (int h = 1; h < headers; ++h) {
+            request += "X-Filler-" + std::to_string(h) + ": " + std::string(20, 'f') + "\r\n";
+        }
+        request += "X-Index: " + std::to_string(i) + "\r\n\r\n";
+        ASSERT_TRUE(client.send(request));
+
+        std::string expected = std::to_string(i) + ":" + std::to_string(headers + 1) + ":" + std::to_string(i) + "<end>";
+        ASSERT_FALSE(client.readUntil("<end>").empty()) << "request " << i;
+        std::string response = client.take();
+        EXPECT_NE(response.find("X-Echo: " + std::to_string(i) + "\r\n"), std::string::npos);
+        EXPECT_NE(response.find("\r\n\r\n" + expected), std::string::npos) << response;
+    }
+    server.stop();
+}
+
+} // namespace
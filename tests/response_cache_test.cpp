@@ -0,0 +1,111 @@
+#include "response_cache.hpp"
+
+#include <gtest/gtest.h>
+
+#include <string>
+
+using chad::HttpRequest;
+using chad::HttpResponse;
+using chad::ResponseCache;
+
+namespace {
+
+class ResponseCacheTest : public ::testing::Test {
+protected:
+    ResponseCacheTest() : cache_("application/json") {}
+
+    HttpResponse serve(uint64_t version, std::string_view ifNoneMatch = {}) {
+        HttpRequest request;
+        if (!ifNoneMatch.empty()) {
+            request.headers.push_back({"If-None-Match", ifNoneMatch});
+        }
+
+        HttpResponse response;
+        cache_.serve(request, response, version, [this, version] {
+            builds_++;
+            return "{\"version\":" + std::to_string(version) + "}";
+        });
+        return response;
+    }
+
+    static std::string etagOf(const HttpResponse& response) {
+        auto it = response.headers.find("ETag");
+        return it == response.headers.end() ? std::string() : std::string(it->second);
+    }
+
+    ResponseCache cache_;
+    int builds_ = 0;
+};
+
+} // namespace
+
+TEST_F(ResponseCacheTest, RebuildsOnlyWhenVersionChanges) {
+    HttpResponse first = serve(1);
+    HttpResponse second = serve(1);
+    EXPECT_EQ(builds_, 1);
+    EXPECT_EQ(first.bodyView(), "{\"version\":1}");
+    EXPECT_EQ(first.sharedBody, second.sharedBody);
+    EXPECT_EQ(etagOf(first), etagOf(second));
+    EXPECT_EQ(first.headers["Content-Type"], "application/json");
+    EXPECT_EQ(first.headers["Cache-Control"], "no-cache");
+
+    HttpResponse third = serve(2);
+    EXPECT_EQ(builds_, 2);
+    EXPECT_EQ(third.bodyView(), "{\"version\":2}");
+    EXPECT_NE(etagOf(third), etagOf(first));
+}
+
+TEST_F(ResponseCacheTest, EtagIsQuotedAndStableForSameBytes) {
+    std::string etag = etagOf(serve(1));
+    ASSERT_EQ(etag.size(), 18u);
+    EXPECT_EQ(etag.front(), '"');
+    EXPECT_EQ(etag.back(), '"');
+
+    // Same body under a new version: rebuilt, but the tag does not change
+    ResponseCache other("application/json");
+    HttpRequest request;
+    HttpResponse response;
+    other.serve(request, response, 99, [] { return std::string("{\"version\":1}"); });
+    EXPECT_EQ(etagOf(response), etag);
+}
+
+TEST_F(ResponseCacheTest, AnswersMatchingIfNoneMatchWith304) {
+    const std::string etag = etagOf(serve(1));
+
+    const std::string matching[] = {
+        etag,
+        "W/" + etag,
+        "*",
+        "\"other\", " + etag,
+        " \"other\" ,\t" + etag + " ",
+        "\"a\",,W/" + etag,
+    };
+    for (const auto& header : matching) {
+        HttpResponse response = serve(1, header);
+        EXPECT_EQ(response.statusCode, 304) << header;
+        EXPECT_TRUE(response.bodyView().empty()) << header;
+        EXPECT_EQ(etagOf(response), etag) << header;
+    }
+}
+
+TEST_F(ResponseCacheTest, ServesBodyWhenIfNoneMatchDiffers) {
+    const std::string etag = etagOf(serve(1));
+    const std::string unquoted = etag.substr(1, etag.size() - 2);
+
+    const std::string differing[] = {
+        "\"other\"",
+        unquoted,
+        "w/" + etag,
+        etag + "x",
+        "\"a\", \"b\"",
+    };
+    for (const auto& header : differing) {
+        HttpResponse response = serve(1, header);
+        EXPECT_EQ(response.statusCode, 200) << header;
+        EXPECT_EQ(response.bodyView(), "{\"version\":1}") << header;
+    }
+
+    // A tag from an older version no longer matches
+    HttpResponse response = serve(2, etag);
+    EXPECT_EQ(response.statusCode, 200);
+}
@@ -0,0 +1,144 @@
+#include "router.hpp"
+
+#include <gtest/gtest.h>
+
+#include <stdexcept>
+#include <string>
+
+using chad::PathParam;
+using chad::Router;
+
+namespace {
+
+class RouterTest : public ::testing::Test {
+protected:
+    size_t find(std::string_view method, std::string_view path) {
+        return router_.find(method, path, params_).route;
+    }
+
+    std::string param(std::string_view name) const {
+        for (const auto& p : params_) {
+            if (p.name == name) {
+                return std::string(p.value);
+            }
+        }
+        return "<missing>";
+    }
+
+    Router router_;
+    std::pmr::vector<PathParam> params_;
+};
+
+} // namespace
+
+TEST_F(RouterTest, MatchesStaticPathsAcrossSplitEdges) {
+    router_.insert("GET", "/api/videos", 0);
+    router_.insert("GET", "/api/status", 1);
+    router_.insert("GET", "/api/v", 2);
+    router_.insert("GET", "/", 3);
+
+    EXPECT_EQ(find("GET", "/api/videos"), 0u);
+    EXPECT_EQ(find("GET", "/api/status"), 1u);
+    EXPECT_EQ(find("GET", "/api/v"), 2u);
+    EXPECT_EQ(find("GET", "/"), 3u);
+    EXPECT_EQ(find("GET", "/api"), Router::NO_ROUTE);
+    EXPECT_EQ(find("GET", "/api/videosx"), Router::NO_ROUTE);
+    EXPECT_EQ(find("GET", "/api/vid"), Router::NO_ROUTE);
+    EXPECT_TRUE(params_.empty());
+}
+
+TEST_F(RouterTest, CapturesParameters) {
+    router_.insert("GET", "/api/videos/{id}/chunks/{chunk}", 0);
+
+    ASSERT_EQ(find("GET", "/api/videos/42/chunks/7"), 0u);
+    ASSERT_EQ(params_.size(), 2u);
+    EXPECT_EQ(param("id"), "42");
+    EXPECT_EQ(param("chunk"), "7");
+
+    // A parameter never matches an empty segment or spans a '/'
+    EXPECT_EQ(find("GET", "/api/videos//chunks/7"), Router::NO_ROUTE);
+    EXPECT_EQ(find("GET", "/api/videos/4/2/chunks/7"), Router::NO_ROUTE);
+    EXPECT_TRUE(params_.empty());
+}
+
+TEST_F(RouterTest, CapturesWildcardRest) {
+    router_.insert("GET", "/static/*path", 0);
+
+    ASSERT_EQ(find("GET", "/static/css/site.css"), 0u);
+    EXPECT_EQ(param("path"), "css/site.css");
+
+    ASSERT_EQ(find("GET", "/static/"), 0u);
+    EXPECT_EQ(param("path"), "");
+
+    EXPECT_EQ(find("GET", "/static"), Router::NO_ROUTE);
+}
+
+TEST_F(RouterTest, PrefersStaticThenParameterThenWildcard) {
+    router_.insert("GET", "/files/latest", 0);
+    router_.insert("GET", "/files/{id}", 1);
+    router_.insert("GET", "/files/*rest", 2);
+
+    EXPECT_EQ(find("GET", "/files/latest"), 0u);
+    EXPECT_EQ(find("GET", "/files/17"), 1u);
+    EXPECT_EQ(param("id"), "17");
+    EXPECT_EQ(find("GET", "/files/17/raw"), 2u);
+    EXPECT_EQ(param("rest"), "17/raw");
+}
+
+TEST_F(RouterTest, BacktracksOutOfDeadEnds) {
+    router_.insert("GET", "/users/new/profile", 0);
+    router_.insert("GET", "/users/{id}/settings", 1);
+    router_.insert("GET", "/*any", 2);
+
+    // The static "new" edge is tried first and fails on the next segment
+    ASSERT_EQ(find("GET", "/users/new/settings"), 1u);
+    ASSERT_EQ(params_.size(), 1u);
+    EXPECT_EQ(param("id"), "new");
+
+    // Both fail; the parameter captured on the way is dropped again
+    ASSERT_EQ(find("GET", "/users/new/other"), 2u);
+    ASSERT_EQ(params_.size(), 1u);
+    EXPECT_EQ(param("any"), "users/new/other");
+}
+
+TEST_F(RouterTest, DistinguishesMethods) {
+    router_.insert("GET", "/api/videos/{id}", 0);
+    router_.insert("DELETE", "/api/videos/{id}", 1);
+
+    EXPECT_EQ(find("GET", "/api/videos/1"), 0u);
+    EXPECT_EQ(find("DELETE", "/api/videos/1"), 1u);
+
+    Router::Match match = router_.find("POST", "/api/videos/1", params_);
+    EXPECT_EQ(match.route, Router::NO_ROUTE);
+    EXPECT_TRUE(match.pathMatched);
+
+    match = router_.find("BREW", "/api/videos/1", params_);
+    EXPECT_EQ(match.route, Router::NO_ROUTE);
+    EXPECT_TRUE(match.pathMatched);
+
+    match = router_.find("GET", "/api/other", params_);
+    EXPECT_FALSE(match.pathMatched);
+}
+
+TEST_F(RouterTest, KeepsFirstRouteForDuplicatePattern) {
+    EXPECT_EQ(router_.insert("GET", "/a/{x}", 5), 5u);
+    EXPECT_EQ(router_.insert("GET", "/a/{x}", 9), 5u);
+    EXPECT_EQ(router_.insert("PUT", "/a/{x}", 9), 9u);
+}
+
+TEST_F(RouterTest, RejectsMalformedPatterns) {
+    EXPECT_THROW(router_.insert("BREW", "/a", 0), std::invalid_argument);
+    EXPECT_THROW(router_.insert("GET", "", 0), std::invalid_argument);
+    EXPECT_THROW(router_.insert("GET", "a/b", 0), std::invalid_argument);
+    EXPECT_THROW(router_.insert("GET", "/a{id}", 0), std::invalid_argument);
+    EXPECT_THROW(router_.insert("GET", "/a/{}", 0), std::invalid_argument);
+    EXPECT_THROW(router_.insert("GET", "/a/{id", 0), std::invalid_argument);
+    EXPECT_THROW(router_.insert("GET", "/a/{id}x", 0), std::invalid_argument);
+    EXPECT_THROW(router_.insert("GET", "/a/*", 0), std::invalid_argument);
+    EXPECT_THROW(router_.insert("GET", "/a/*rest/more", 0), std::invalid_argument);
+
+    router_.insert("GET", "/b/{id}", 0);
+    EXPECT_THROW(router_.insert("GET", "/b/{name}/x", 1), std::invalid_argument);
+    router_.insert("GET", "/c/*path", 0);
+    EXPECT_THROW(router_.insert("POST", "/c/*rest", 1), std::invalid_argument);
+}
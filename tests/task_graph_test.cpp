@@ -0,0 +1,257 @@
+#include "task_graph.hpp"
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+using chad::Future;
+using chad::Promise;
+using chad::TaskGraph;
+using chad::ThreadPool;
+
+TEST(FutureTest, ThenChainsOnThePool) {
+    ThreadPool pool(2);
+
+    Future<std::string> result = chad::schedule(pool, [] { return 20; })
+        .then([](int x) { return x + 1; })
+        .then([](int x) { return x * 2; })
+        .then([](int x) { return std::to_string(x); });
+
+    EXPECT_EQ(result.get(), "42");
+}
+
+TEST(FutureTest, ThenUnwrapsReturnedFutures) {
+    ThreadPool pool(2);
+
+    Future<int> result = chad::schedule(pool, [] { return 5; })
+        .then([&pool](int x) { return chad::schedule(pool, [x] { return x * 3; }); });
+
+    EXPECT_EQ(result.get(), 15);
+}
+
+TEST(FutureTest, ExceptionSkipsToRecover) {
+    ThreadPool pool(2);
+    std::atomic<bool> skippedRan{false};
+
+    Future<int> result = chad::schedule(pool, []() -> int { throw std::runtime_error("boom"); })
+        .then([&skippedRan](int x) {
+            skippedRan = true;
+            return x;
+        })
+        .recover([](std::exception_ptr error) {
+            try {
+                std::rethrow_exception(error);
+            } catch (const std::runtime_error& e) {
+                return std::string(e.what()) == "boom" ? 7 : -1;
+            }
+        })
+        .then([](int x) { return x + 1; });
+
+    EXPECT_EQ(result.get(), 8);
+    EXPECT_FALSE(skippedRan);
+}
+
+TEST(FutureTest, RecoverPassesValuesThrough) {
+    ThreadPool pool(1);
+
+    Future<int> result = chad::schedule(pool, [] { return 3; }).recover([](std::exception_ptr) { return 0; });
+    EXPECT_EQ(result.get(), 3);
+
+    Future<void> failed = chad::schedule(pool, [] {}).then([] { throw std::logic_error("late"); });
+    EXPECT_THROW(failed.get(), std::logic_error);
+}
+
+TEST(FutureTest, RunsContinuationsInlineWithoutAPool) {
+    Promise<int> promise;
+    std::thread::id ranOn;
+    Future<int> result = promise.getFuture().then([&ranOn](int x) {
+        ranOn = std::this_thread::get_id();
+        return x + 1;
+    });
+
+    EXPECT_FALSE(result.isReady());
+    promise.setValue(1);
+    EXPECT_TRUE(result.isReady());
+    EXPECT_EQ(ranOn, std::this_thread::get_id());
+    EXPECT_EQ(result.get(), 2);
+}
+
+TEST(FutureTest, PromiseBreaksItsFutureWhenAbandoned) {
+    Future<int> future;
+    {
+        Promise<int> promise;
+        future = promise.getFuture();
+    }
+    EXPECT_THROW(future.get(), std::runtime_error);
+
+    Promise<void> settled;
+    settled.setValue();
+    EXPECT_THROW(settled.setValue(), std::logic_error);
+}
+
+TEST(FutureTest, WhenAllWaitsForEveryInput) {
+    ThreadPool pool(2);
+
+    std::vector<Future<int>> futures;
+    for (int i = 0; i < 20; ++i) {
+        futures.push_back(chad::schedule(pool, [i] { return i * i; }));
+    }
+
+    chad::whenAll(futures).get();
+    for (int i = 0; i < 20; ++i) {
+        ASSERT_TRUE(futures[i].isReady());
+        EXPECT_EQ(futures[i].get(), i * i);
+    }
+
+    EXPECT_TRUE(chad::whenAll(std::vector<Future<int>>{}).isReady());
+}
+
+TEST(FutureTest, WhenAllFailsWithAnInputsException) {
+    std::vector<Promise<int>> promises(3);
+    std::vector<Future<int>> futures;
+    for (auto& promise : promises) {
+        futures.push_back(promise.getFuture());
+    }
+
+    Future<void> all = chad::whenAll(futures);
+    promises[1].setException(std::make_exception_ptr(std::out_of_range("second")));
+    promises[0].setValue(0);
+    EXPECT_FALSE(all.isReady());
+
+    promises[2].setValue(2);
+    EXPECT_THROW(all.get(), std::out_of_range);
+    EXPECT_EQ(futures[2].get(), 2);
+}
+
+TEST(FutureTest, WhenAnyReportsTheFirstToComplete) {
+    std::vector<Promise<int>> promises(3);
+    std::vector<Future<int>> futures;
+    for (auto& promise : promises) {
+        futures.push_back(promise.getFuture());
+    }
+
+    Future<size_t> any = chad::whenAny(futures);
+    EXPECT_FALSE(any.isReady());
+
+    promises[2].setException(std::make_exception_ptr(std::runtime_error("third")));
+    promises[0].setValue(0);
+    EXPECT_EQ(any.get(), 2u);
+    EXPECT_THROW(futures[2].get(), std::runtime_error);
+
+    EXPECT_THROW(chad::whenAny(std::vector<Future<int>>{}), std::invalid_argument);
+}
+
+namespace {
+
+// Records the order nodes ran in
+class Trace {
+public:
+    chad::InlineTask node(int id) {
+        return [this, id] {
+            std::lock_guard<std::mutex> lock(mutex_);
+            order_.push_back(id);
+        };
+    }
+
+    size_t position(int id) const {
+        for (size_t i = 0; i < order_.size(); ++i) {
+            if (order_[i] == id) {
+                return i;
+            }
+        }
+        return SIZE_MAX;
+    }
+
+    size_t count() const {
+        return order_.size();
+    }
+
+private:
+    std::mutex mutex_;
+    std::vector<int> order_;
+};
+
+} // namespace
+
+TEST(TaskGraphTest, RunsNodesAfterTheirDependencies) {
+    ThreadPool pool(3);
+    Trace trace;
+    TaskGraph graph;
+
+    // 0 fans out to 1, 2 and 3; 4 joins 1 and 2, 5 follows 3, and 6 joins 4 and 5
+    auto n0 = graph.add(trace.node(0));
+    auto n1 = graph.add(trace.node(1), {n0});
+    auto n2 = graph.add(trace.node(2), {n0});
+    auto n3 = graph.add(trace.node(3), {n0});
+    auto n4 = graph.add(trace.node(4), {n1, n2});
+    auto n5 = graph.add(trace.node(5), {n3});
+    graph.add(trace.node(6), {n4, n5});
+
+    graph.run(pool).get();
+
+    ASSERT_EQ(trace.count(), 7u);
+    EXPECT_LT(trace.position(0), trace.position(1));
+    EXPECT_LT(trace.position(0), trace.position(2));
+    EXPECT_LT(trace.position(0), trace.position(3));
+    EXPECT_LT(trace.position(1), trace.position(4));
+    EXPECT_LT(trace.position(2), trace.position(4));
+    EXPECT_LT(trace.position(3), trace.position(5));
+    EXPECT_LT(trace.position(4), trace.position(6));
+    EXPECT_LT(trace.position(5), trace.position(6));
+}
+
+TEST(TaskGraphTest, SkipsDependentsOfAFailedNode) {
+    ThreadPool pool(2);
+    Trace trace;
+    TaskGraph graph;
+
+    auto root = graph.add(trace.node(0));
+    auto failing = graph.add([] { throw std::runtime_error("node failed"); }, {root});
+    auto after = graph.add(trace.node(2), {failing});
+    graph.add(trace.node(3), {after});
+
+    Future<void> result = graph.run(pool);
+    EXPECT_THROW(result.get(), std::runtime_error);
+    EXPECT_EQ(trace.count(), 1u);
+    EXPECT_EQ(trace.position(2), SIZE_MAX);
+    EXPECT_EQ(trace.position(3), SIZE_MAX);
+}
+
+TEST(TaskGraphTest, RunsWideGraphsWithTaskClasses) {
+    ThreadPool pool(2);
+    std::atomic<int> ran{0};
+    TaskGraph graph;
+
+    std::vector<TaskGraph::NodeId> layer;
+    for (int i = 0; i < 100; ++i) {
+        chad::TaskClass taskClass;
+        taskClass.priority = i % 2 ? chad::TaskPriority::LOW : chad::TaskPriority::HIGH;
+        taskClass.tenant = "tenant" + std::to_string(i % 3);
+        layer.push_back(graph.add(taskClass, [&ran] { ran++; }));
+    }
+    graph.add([&ran] { ran += 1000; }, layer);
+
+    graph.run(pool).get();
+    EXPECT_EQ(ran.load(), 1100);
+}
+
+TEST(TaskGraphTest, RejectsForwardDependencies) {
+    TaskGraph graph;
+    EXPECT_THROW(graph.add([] {}, {0}), std::invalid_argument);
+
+    auto first = graph.add([] {});
+    EXPECT_THROW(graph.add([] {}, {first + 1}), std::invalid_argument);
+}
+
+TEST(TaskGraphTest, EmptyGraphCompletesAtOnce) {
+    ThreadPool pool(1);
+    TaskGraph graph;
+    Future<void> result = graph.run(pool);
+    EXPECT_TRUE(result.isReady());
+    EXPECT_NO_THROW(result.get());
+}
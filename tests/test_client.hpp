@@ -0,0 +1,125 @@
+#pragma once
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <string>
+
+namespace chad {
+namespace test {
+
+/**
+ * @class TestClient
+ * @brief Blocking loopback client for tests that talk to a running HttpServer
+ *
+ * Every read takes a deadline, so a server that stops answering fails the
+ * test instead of hanging it.
+ */
+class TestClient {
+public:
+    TestClient() = default;
+
+    ~TestClient() {
+        close();
+    }
+
+    TestClient(const TestClient&) = delete;
+    TestClient& operator=(const TestClient&) = delete;
+
+    bool connect(unsigned short port) {
+        close();
+        fd_ = ::socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (fd_ < 0) {
+            return false;
+        }
+
+        sockaddr_in address{};
+        address.sin_family = AF_INET;
+        address.sin_port = htons(port);
+        address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        return ::connect(fd_, reinterpret_cast<sockaddr*>(&address), sizeof(address)) == 0;
+    }
+
+    bool send(const std::string& data) {
+        size_t sent = 0;
+        while (sent < data.size()) {
+            ssize_t n = ::send(fd_, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+            if (n <= 0) {
+                return false;
+            }
+            sent += static_cast<size_t>(n);
+        }
+        return true;
+    }
+
+    // Everything received so far, once it contains needle; empty on timeout
+    std::string readUntil(const std::string& needle,
+                          std::chrono::milliseconds timeout = std::chrono::milliseconds(5000)) {
+        auto deadline = std::chrono::steady_clock::now() + timeout;
+        while (received_.find(needle) == std::string::npos) {
+            if (!readSome(deadline)) {
+                return std::string();
+            }
+        }
+        return received_;
+    }
+
+    // True once the server has closed the connection
+    bool waitForClose(std::chrono::milliseconds timeout = std::chrono::milliseconds(5000)) {
+        auto deadline = std::chrono::steady_clock::now() + timeout;
+        while (readSome(deadline)) {
+        }
+        return closed_;
+    }
+
+    // Hands over what was received so far, so the next readUntil() starts afresh
+    std::string take() {
+        std::string received;
+        received.swap(received_);
+        return received;
+    }
+
+    void close() {
+        if (fd_ >= 0) {
+            ::close(fd_);
+            fd_ = -1;
+        }
+        received_.clear();
+        closed_ = false;
+    }
+
+private:
+    // Appends what arrives before the deadline; false on timeout or close
+    bool readSome(std::chrono::steady_clock::time_point deadline) {
+        if (fd_ < 0 || closed_) {
+            return false;
+        }
+
+        auto left = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now());
+        pollfd pfd{fd_, POLLIN, 0};
+        if (left.count() <= 0 || ::poll(&pfd, 1, static_cast<int>(left.count())) <= 0) {
+            return false;
+        }
+
+        char buffer[4096];
+        ssize_t n = ::recv(fd_, buffer, sizeof(buffer), 0);
+        if (n <= 0) {
+            closed_ = true;
+            return false;
+        }
+        received_.append(buffer, static_cast<size_t>(n));
+        return true;
+    }
+
+private:
+    int fd_ = -1;
+    std::string received_;
+    bool closed_ = false;
+};
+
+} // namespace test
+} // namespace chad
@@ -0,0 +1,193 @@
+#include "thread_pool.hpp"
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <future>
+#include <mutex>
+#include <set>
+#include <thread>
+#include <vector>
+
+using chad::ThreadPool;
+
+namespace {
+
+using namespace std::chrono_literals;
+
+// Polls until condition holds or timeout passes
+template<class Condition>
+bool eventually(Condition condition, std::chrono::milliseconds timeout = 5000ms) {
+    auto deadline = std::chrono::steady_clock::now() + timeout;
+    while (!condition()) {
+        if (std::chrono::steady_clock::now() > deadline) {
+            return false;
+        }
+        std::this_thread::sleep_for(1ms);
+    }
+    return true;
+}
+
+// Holds every task that waits on it until opened
+class Gate {
+public:
+    void wait() {
+        std::unique_lock<std::mutex> lock(mutex_);
+        ++waiting_;
+        changed_.notify_all();
+        changed_.wait(lock, [this] { return open_; });
+    }
+
+    bool waitForWaiting(size_t count) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        return changed_.wait_for(lock, 5s, [this, count] { return waiting_ >= count; });
+    }
+
+    void open() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        open_ = true;
+        changed_.notify_all();
+    }
+
+private:
+    std::mutex mutex_;
+    std::condition_variable changed_;
+    size_t waiting_ = 0;
+    bool open_ = false;
+};
+
+TEST(ThreadPoolResizeTest, ShrinkingKeepsQueuedTasks) {
+    ThreadPool pool(4);
+    Gate gate;
+
+    // Every worker busy, so the tasks below sit in the deques and inboxes of
+    // workers that are about to retire
+    std::vector<std::future<void>> blockers;
+    for (int i = 0; i < 4; ++i) {
+        blockers.push_back(pool.submit([&gate] { gate.wait(); }));
+    }
+    ASSERT_TRUE(gate.waitForWaiting(4));
+
+    std::atomic<int> ran{0};
+    std::vector<std::future<void>> tasks;
+    for (int i = 0; i < 100; ++i) {
+        tasks.push_back(pool.submit([&ran] { ran++; }));
+    }
+
+    pool.resize(1);
+    EXPECT_EQ(pool.getThreadCount(), 1u);
+    gate.open();
+
+    for (auto& task : tasks) {
+        ASSERT_EQ(task.wait_for(5s), std::future_status::ready);
+    }
+    EXPECT_EQ(ran.load(), 100);
+}
+
+TEST(ThreadPoolResizeTest, RetiredWorkersRunNothing) {
+    ThreadPool pool(4);
+    pool.resize(1);
+
+    // Retiring workers finish their current task first; give them a moment
+    std::this_thread::sleep_for(50ms);
+
+    std::set<std::thread::id> threads;
+    for (int i = 0; i < 50; ++i) {
+        threads.insert(pool.submit([] { return std::this_thread::get_id(); }).get());
+    }
+    EXPECT_EQ(threads.size(), 1u);
+}
+
+TEST(ThreadPoolResizeTest, GrowingAgainRestartsWorkers) {
+    ThreadPool pool(3);
+    pool.resize(1);
+    pool.resize(3);
+    EXPECT_EQ(pool.getThreadCount(), 3u);
+
+    // Three tasks that can only finish together need three workers
+    Gate gate;
+    std::vector<std::future<void>> tasks;
+    for (int i = 0; i < 3; ++i) {
+        tasks.push_back(pool.submit([&gate] { gate.wait(); }));
+    }
+    EXPECT_TRUE(gate.waitForWaiting(3));
+    gate.open();
+    for (auto& task : tasks) {
+        task.wait();
+    }
+}
+
+TEST(ThreadPoolResizeTest, SizeIsClamped) {
+    ThreadPool pool(2);
+    pool.resize(0);
+    EXPECT_EQ(pool.getThreadCount(), 1u);
+}
+
+ThreadPool::AutoscaleSettings fastSettings(size_t maxThreads) {
+    ThreadPool::AutoscaleSettings settings;
+    settings.minThreads = 1;
+    settings.maxThreads = maxThreads;
+    settings.interval = 10ms;
+    settings.maxQueueWait = 5ms;
+    settings.shrinkAfter = 1s;
+    settings.maxHostLoad = 101;   // never held back by whatever else the host runs
+    return settings;
+}
+
+TEST(ThreadPoolAutoscaleTest, GrowsUnderBacklogAndShrinksWhenIdle) {
+    ThreadPool pool(1);
+    pool.enableAutoscaling(fastSettings(4));
+
+    Gate gate;
+    std::vector<std::future<void>> tasks;
+    for (int i = 0; i < 16; ++i) {
+        tasks.push_back(pool.submit([&gate] { gate.wait(); }));
+    }
+
+    EXPECT_TRUE(eventually([&pool] { return pool.getThreadCount() == 4; }));
+    EXPECT_TRUE(gate.waitForWaiting(4));
+    gate.open();
+    for (auto& task : tasks) {
+        task.wait();
+    }
+
+    EXPECT_TRUE(eventually([&pool] { return pool.getThreadCount() == 1; }, 10000ms));
+}
+
+TEST(ThreadPoolAutoscaleTest, StaysWithinItsBounds) {
+    ThreadPool pool(1);
+    ThreadPool::AutoscaleSettings settings = fastSettings(2);
+    settings.minThreads = 2;
+    pool.enableAutoscaling(settings);
+
+    // Raised to the minimum even without load
+    EXPECT_TRUE(eventually([&pool] { return pool.getThreadCount() == 2; }));
+
+    Gate gate;
+    std::vector<std::future<void>> tasks;
+    for (int i = 0; i < 16; ++i) {
+        tasks.push_back(pool.submit([&gate] { gate.wait(); }));
+    }
+    std::this_thread::sleep_for(200ms);
+    EXPECT_EQ(pool.getThreadCount(), 2u);
+
+    gate.open();
+    for (auto& task : tasks) {
+        task.wait();
+    }
+}
+
+TEST(ThreadPoolAutoscaleTest, NoGrowthWithoutBacklog) {
+    ThreadPool pool(1);
+    pool.enableAutoscaling(fastSettings(4));
+
+    for (int i = 0; i < 20; ++i) {
+        pool.submit([] {}).get();
+        std::this_thread::sleep_for(5ms);
+    }
+    EXPECT_EQ(pool.getThreadCount(), 1u);
+}
+
+} // namespace
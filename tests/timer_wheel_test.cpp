@@ -0,0 +1,144 @@
+#include "timer_wheel.hpp"
+
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <vector>
+
+using chad::TimerWheel;
+using namespace std::chrono_literals;
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+class TimerWheelTest : public ::testing::Test {
+protected:
+    TimerWheelTest() : wheel_(5ms, 8) {}
+
+    void SetUp() override {
+        wheel_.start(ioContext_);
+        start_ = Clock::now();
+    }
+
+    void TearDown() override {
+        wheel_.stop();
+    }
+
+    // Runs the wheel until the predicate holds or the limit passes
+    template <typename Predicate>
+    bool runUntil(Predicate done, std::chrono::milliseconds limit = 2000ms) {
+        auto deadline = Clock::now() + limit;
+        while (!done() && Clock::now() < deadline) {
+            ioContext_.run_for(1ms);
+        }
+        return done();
+    }
+
+    std::chrono::milliseconds elapsed() const {
+        return std::chrono::duration_cast<std::chrono::milliseconds>(Clock::now() - start_);
+    }
+
+    boost::asio::io_context ioContext_;
+    TimerWheel wheel_;
+    Clock::time_point start_;
+};
+
+} // namespace
+
+TEST_F(TimerWheelTest, FiresNoEarlierThanDeadline) {
+    TimerWheel::Entry entry;
+    std::chrono::milliseconds firedAt{-1};
+    uint64_t firedGeneration = 0;
+    entry.setCallback([&](uint64_t generation) {
+        firedAt = elapsed();
+        firedGeneration = generation;
+    });
+
+    uint64_t generation = wheel_.schedule(entry, 22ms);
+    ASSERT_TRUE(runUntil([&] { return firedAt.count() >= 0; }));
+    EXPECT_GE(firedAt, 22ms);
+    EXPECT_EQ(firedGeneration, generation);
+}
+
+TEST_F(TimerWheelTest, FiresInDeadlineOrderBeyondOneRevolution) {
+    // 8 slots of 5ms: the 100ms entry goes round the wheel twice first
+    TimerWheel::Entry shortEntry;
+    TimerWheel::Entry longEntry;
+    std::vector<int> order;
+    std::chrono::milliseconds longFiredAt{0};
+    shortEntry.setCallback([&](uint64_t) { order.push_back(1); });
+    longEntry.setCallback([&](uint64_t) {
+        order.push_back(2);
+        longFiredAt = elapsed();
+    });
+
+    wheel_.schedule(longEntry, 100ms);
+    wheel_.schedule(shortEntry, 10ms);
+    ASSERT_TRUE(runUntil([&] { return order.size() == 2; }));
+    EXPECT_EQ(order, (std::vector<int>{1, 2}));
+    EXPECT_GE(longFiredAt, 100ms);
+}
+
+TEST_F(TimerWheelTest, CancelledEntryNeverFires) {
+    TimerWheel::Entry cancelled;
+    TimerWheel::Entry witness;
+    bool cancelledFired = false;
+    bool witnessFired = false;
+    cancelled.setCallback([&](uint64_t) { cancelledFired = true; });
+    witness.setCallback([&](uint64_t) { witnessFired = true; });
+
+    wheel_.schedule(cancelled, 10ms);
+    wheel_.schedule(witness, 30ms);
+    wheel_.cancel(cancelled);
+    wheel_.cancel(cancelled);
+
+    ASSERT_TRUE(runUntil([&] { return witnessFired; }));
+    EXPECT_FALSE(cancelledFired);
+}
+
+TEST_F(TimerWheelTest, DestroyedEntryIsUnlinked) {
+    TimerWheel::Entry witness;
+    bool witnessFired = false;
+    witness.setCallback([&](uint64_t) { witnessFired = true; });
+
+    bool destroyedFired = false;
+    {
+        // Shares the witness's slot, so a dangling link would be walked
+        TimerWheel::Entry destroyed;
+        destroyed.setCallback([&](uint64_t) { destroyedFired = true; });
+        wheel_.schedule(witness, 20ms);
+        wheel_.schedule(destroyed, 20ms);
+    }
+
+    ASSERT_TRUE(runUntil([&] { return witnessFired; }));
+    EXPECT_FALSE(destroyedFired);
+}
+
+TEST_F(TimerWheelTest, RescheduleReplacesDeadline) {
+    TimerWheel::Entry entry;
+    std::vector<uint64_t> fired;
+    entry.setCallback([&](uint64_t generation) { fired.push_back(generation); });
+
+    uint64_t first = wheel_.schedule(entry, 10ms);
+    uint64_t second = wheel_.schedule(entry, 40ms);
+    EXPECT_GT(second, first);
+
+    ASSERT_TRUE(runUntil([&] { return !fired.empty(); }));
+    EXPECT_GE(elapsed(), 40ms);
+    EXPECT_EQ(fired, (std::vector<uint64_t>{second}));
+}
+
+TEST_F(TimerWheelTest, CallbackMayRearmItsEntry) {
+    TimerWheel::Entry entry;
+    int count = 0;
+    entry.setCallback([&](uint64_t) {
+        if (++count < 3) {
+            wheel_.schedule(entry, 5ms);
+        }
+    });
+
+    wheel_.schedule(entry, 5ms);
+    ASSERT_TRUE(runUntil([&] { return count == 3; }));
+    EXPECT_GE(elapsed(), 15ms);
+}
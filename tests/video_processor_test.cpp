@@ -0,0 +1,191 @@
+#include "video_processor.hpp"
+
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <future>
+#include <memory>
+#include <string>
+
+#include <sys/stat.h>
+
+using chad::ChunkInfo;
+using chad::ProcessingStatus;
+using chad::VideoProcessor;
+
+namespace fs = std::filesystem;
+
+namespace {
+
+// Stand-ins for the FFmpeg tools, found first on PATH. The ffmpeg one holds
+// every transcode until the test creates the "release" file, so the test
+// decides when chunks finish.
+const char* FAKE_FFPROBE = R"(#!/bin/sh
+echo '{"streams":[{"width":1280,"height":720,"codec_name":"h264","duration":"2.0"}]}'
+)";
+
+const char* FAKE_FFMPEG = R"(#!/bin/sh
+[ "$1" = "-version" ] && { echo "ffmpeg version test"; exit 0; }
+dir=$(dirname "$0")
+while [ ! -e "$dir/release" ]; do sleep 0.01; done
+input=""; previous=""
+for arg in "$@"; do [ "$previous" = "-i" ] && input="$arg"; previous="$arg"; done
+echo "progress=end"
+cp "$input" "$arg"
+)";
+
+class VideoProcessorTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        char pattern[] = "/tmp/chad_video_test_XXXXXX";
+        ASSERT_NE(mkdtemp(pattern), nullptr);
+        dir_ = pattern;
+
+        bin_ = dir_ / "bin";
+        fs::create_directories(bin_);
+        writeFile(bin_ / "ffprobe", FAKE_FFPROBE, 0755);
+        writeFile(bin_ / "ffmpeg", FAKE_FFMPEG, 0755);
+        writeFile(dir_ / "input.mp4", "not really a video", 0644);
+
+        const char* path = std::getenv("PATH");
+        savedPath_ = path ? path : "";
+        setenv("PATH", (bin_.string() + ":" + savedPath_).c_str(), 1);
+
+        processor_ = std::make_unique<VideoProcessor>(2);
+        ASSERT_TRUE(processor_->initialize((dir_ / "storage").string(), (dir_ / "temp").string()));
+    }
+
+    void TearDown() override {
+        release();
+        processor_.reset();
+        setenv("PATH", savedPath_.c_str(), 1);
+        fs::remove_all(dir_);
+    }
+
+    static void writeFile(const fs::path& path, const std::string& content, mode_t mode) {
+        std::ofstream(path) << content;
+        chmod(path.c_str(), mode);
+    }
+
+    // Lets every held transcode finish
+    void release() {
+        std::ofstream(bin_ / "release");
+    }
+
+    std::string submit() {
+        return processor_->submitChunk((dir_ / "input.mp4").string(), "{}");
+    }
+
+    fs::path dir_;
+    fs::path bin_;
+    std::string savedPath_;
+    std::unique_ptr<VideoProcessor> processor_;
+};
+
+TEST_F(VideoProcessorTest, WaiterIsCalledWhenTheChunkCompletes) {
+    std::string chunkId = submit();
+
+    std::promise<std::shared_ptr<ChunkInfo>> finished;
+    auto result = finished.get_future();
+    EXPECT_NE(processor_->waitForChunk(chunkId, [&finished](std::shared_ptr<ChunkInfo> info) {
+        finished.set_value(std::move(info));
+    }), 0u);
+    EXPECT_EQ(result.wait_for(std::chrono::milliseconds(50)), std::future_status::timeout);
+
+    release();
+    ASSERT_EQ(result.wait_for(std::chrono::seconds(10)), std::future_status::ready);
+    auto info = result.get();
+    EXPECT_EQ(info->chunkId, chunkId);
+    EXPECT_EQ(info->status, ProcessingStatus::COMPLETED);
+    EXPECT_EQ(processor_->getChunkInfo(chunkId)->status, ProcessingStatus::COMPLETED);
+}
+
+TEST_F(VideoProcessorTest, FinishedChunkIsReportedAtOnce) {
+    release();
+    std::string chunkId = submit();
+
+    std::promise<void> done;
+    processor_->waitForChunk(chunkId, [&done](std::shared_ptr<ChunkInfo>) { done.set_value(); });
+    ASSERT_EQ(done.get_future().wait_for(std::chrono::seconds(10)), std::future_status::ready);
+
+    bool called = false;
+    EXPECT_EQ(processor_->waitForChunk(chunkId, [&called](std::shared_ptr<ChunkInfo> info) {
+        called = info->status == ProcessingStatus::COMPLETED;
+    }), 0u);
+    EXPECT_TRUE(called);
+}
+
+TEST_F(VideoProcessorTest, UnknownChunkIsNotWaitedFor) {
+    bool called = false;
+    EXPECT_EQ(processor_->waitForChunk("no-such-chunk", [&called](std::shared_ptr<ChunkInfo>) { called = true; }), 0u);
+    EXPECT_FALSE(called);
+}
+
+TEST_F(VideoProcessorTest, WaiterIsCalledWhenTheChunkFails) {
+    std::string chunkId = processor_->submitChunk((dir_ / "missing.mp4").string(), "{}");
+
+    // Called at once or from the pool, depending on whether the probe failed already
+    std::promise<ProcessingStatus> finished;
+    processor_->waitForChunk(chunkId, [&finished](std::shared_ptr<ChunkInfo> info) {
+        finished.set_value(info->status);
+    });
+    auto result = finished.get_future();
+    ASSERT_EQ(result.wait_for(std::chrono::seconds(10)), std::future_status::ready);
+    EXPECT_EQ(result.get(), ProcessingStatus::FAILED);
+}
+
+TEST_F(VideoProcessorTest, CancelledWaiterIsReleasedAndNotCalled) {
+    std::string chunkId = submit();
+
+    // The token stands in for the HttpResponder a long-poll's callback holds
+    auto token = std::make_shared<int>(0);
+    bool called = false;
+    VideoProcessor::WaiterId waiter = processor_->waitForChunk(chunkId, [token, &called](std::shared_ptr<ChunkInfo>) {
+        called = true;
+    });
+    ASSERT_NE(waiter, 0u);
+    EXPECT_EQ(token.use_count(), 2);
+
+    EXPECT_TRUE(processor_->cancelWait(chunkId, waiter));
+    EXPECT_EQ(token.use_count(), 1);
+    EXPECT_FALSE(processor_->cancelWait(chunkId, waiter));
+
+    std::promise<void> done;
+    processor_->waitForChunk(chunkId, [&done](std::shared_ptr<ChunkInfo>) { done.set_value(); });
+    release();
+    ASSERT_EQ(done.get_future().wait_for(std::chrono::seconds(10)), std::future_status::ready);
+    EXPECT_FALSE(called);
+}
+
+TEST_F(VideoProcessorTest, CancelOnlyDropsItsOwnWaiter) {
+    std::string chunkId = submit();
+
+    std::promise<void> kept;
+    VideoProcessor::WaiterId first = processor_->waitForChunk(chunkId, [](std::shared_ptr<ChunkInfo>) {});
+    VideoProcessor::WaiterId second = processor_->waitForChunk(chunkId, [&kept](std::shared_ptr<ChunkInfo>) {
+        kept.set_value();
+    });
+    EXPECT_NE(first, second);
+    EXPECT_FALSE(processor_->cancelWait("no-such-chunk", first));
+    EXPECT_TRUE(processor_->cancelWait(chunkId, first));
+
+    release();
+    EXPECT_EQ(kept.get_future().wait_for(std::chrono::seconds(10)), std::future_status::ready);
+}
+
+TEST_F(VideoProcessorTest, WaiterCannotBeCancelledOnceCalled) {
+    std::string chunkId = submit();
+
+    std::promise<void> done;
+    VideoProcessor::WaiterId waiter = processor_->waitForChunk(chunkId, [&done](std::shared_ptr<ChunkInfo>) {
+        done.set_value();
+    });
+    release();
+    ASSERT_EQ(done.get_future().wait_for(std::chrono::seconds(10)), std::future_status::ready);
+    EXPECT_FALSE(processor_->cancelWait(chunkId, waiter));
+}
+
+} // namespace
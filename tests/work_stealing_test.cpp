@@ -0,0 +1,179 @@
+#include "thread_pool.hpp"
+#include "work_stealing_deque.hpp"
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+using chad::ThreadPool;
+using chad::WorkStealingDeque;
+
+namespace {
+
+std::vector<int> makeItems(size_t count) {
+    std::vector<int> items(count);
+    for (size_t i = 0; i < count; ++i) {
+        items[i] = static_cast<int>(i);
+    }
+    return items;
+}
+
+} // namespace
+
+TEST(WorkStealingDequeTest, OwnerPopsNewestAndThievesStealOldest) {
+    std::vector<int> items = makeItems(4);
+    WorkStealingDeque<int*> deque;
+
+    EXPECT_EQ(deque.pop(), nullptr);
+    EXPECT_EQ(deque.steal(), nullptr);
+
+    for (int& item : items) {
+        deque.push(&item);
+    }
+    EXPECT_EQ(deque.size(), 4u);
+
+    EXPECT_EQ(deque.pop(), &items[3]);
+    EXPECT_EQ(deque.steal(), &items[0]);
+    EXPECT_EQ(deque.steal(), &items[1]);
+    EXPECT_EQ(deque.pop(), &items[2]);
+    EXPECT_EQ(deque.pop(), nullptr);
+    EXPECT_EQ(deque.steal(), nullptr);
+    EXPECT_EQ(deque.size(), 0u);
+}
+
+TEST(WorkStealingDequeTest, GrowsPastItsCapacity) {
+    std::vector<int> items = makeItems(1000);
+    WorkStealingDeque<int*> deque(2);
+
+    // Leave the top off index 0 so that growing has to copy a wrapped range
+    deque.push(&items[0]);
+    EXPECT_EQ(deque.steal(), &items[0]);
+
+    for (size_t i = 1; i < items.size(); ++i) {
+        deque.push(&items[i]);
+    }
+    EXPECT_EQ(deque.size(), items.size() - 1);
+
+    for (size_t i = 1; i < 500; ++i) {
+        ASSERT_EQ(deque.steal(), &items[i]);
+    }
+    for (size_t i = items.size() - 1; i >= 500; --i) {
+        ASSERT_EQ(deque.pop(), &items[i]);
+    }
+    EXPECT_EQ(deque.pop(), nullptr);
+}
+
+TEST(WorkStealingDequeTest, EveryItemIsTakenExactlyOnceUnderContention) {
+    constexpr size_t ITEMS = 200000;
+    constexpr size_t THIEVES = 3;
+
+    std::vector<int> items = makeItems(ITEMS);
+    std::vector<std::atomic<int>> taken(ITEMS);
+    WorkStealingDeque<int*> deque(4);
+    std::atomic<bool> done{false};
+
+    auto take = [&](int* item) {
+        taken[static_cast<size_t>(*item)].fetch_add(1, std::memory_order_relaxed);
+    };
+
+    std::vector<std::thread> thieves;
+    for (size_t t = 0; t < THIEVES; ++t) {
+        thieves.emplace_back([&] {
+            while (!done.load(std::memory_order_acquire)) {
+                if (int* item = deque.steal()) {
+                    take(item);
+                } else {
+                    std::this_thread::yield();
+                }
+            }
+        });
+    }
+
+    // The owner pushes in bursts and pops some back, racing the thieves for the last item
+    for (size_t i = 0; i < ITEMS; ++i) {
+        deque.push(&items[i]);
+        if (i % 3 == 0) {
+            if (int* item = deque.pop()) {
+                take(item);
+            }
+        }
+    }
+    while (int* item = deque.pop()) {
+        take(item);
+    }
+
+    done.store(true, std::memory_order_release);
+    for (auto& thief : thieves) {
+        thief.join();
+    }
+
+    for (size_t i = 0; i < ITEMS; ++i) {
+        ASSERT_EQ(taken[i].load(), 1) << i;
+    }
+}
+
+TEST(ThreadPoolInboxTest, RunsTasksPostedFromManyThreadsOnce) {
+    constexpr size_t PRODUCERS = 4;
+    constexpr size_t TASKS_EACH = 20000;
+
+    std::vector<std::atomic<int>> runs(PRODUCERS * TASKS_EACH);
+    {
+        // Posts from outside the pool go through the workers' inboxes
+        ThreadPool pool(3);
+
+        std::vector<std::thread> producers;
+        for (size_t p = 0; p < PRODUCERS; ++p) {
+            producers.emplace_back([&, p] {
+                for (size_t i = 0; i < TASKS_EACH; ++i) {
+                    size_t index = p * TASKS_EACH + i;
+                    pool.post([&runs, index] { runs[index].fetch_add(1, std::memory_order_relaxed); });
+                }
+            });
+        }
+        for (auto& producer : producers) {
+            producer.join();
+        }
+    }
+
+    for (size_t i = 0; i < runs.size(); ++i) {
+        ASSERT_EQ(runs[i].load(), 1) << i;
+    }
+}
+
+TEST(ThreadPoolInboxTest, RunsTasksSubmittedFromWorkers) {
+    std::atomic<int> leaves{0};
+    {
+        ThreadPool pool(2);
+
+        // Each outer task fans out onto its worker's own deque, from which idle workers steal
+        std::vector<std::future<void>> outer;
+        for (int i = 0; i < 50; ++i) {
+            outer.push_back(pool.submit([&pool, &leaves] {
+                for (int j = 0; j < 100; ++j) {
+                    pool.post([&leaves] { leaves.fetch_add(1, std::memory_order_relaxed); });
+                }
+            }));
+        }
+        for (auto& future : outer) {
+            future.get();
+        }
+    }
+    EXPECT_EQ(leaves.load(), 5000);
+}
+
+TEST(ThreadPoolInboxTest, SubmitReturnsResultsAndExceptions) {
+    ThreadPool pool(2);
+
+    std::vector<std::future<int>> results;
+    for (int i = 0; i < 100; ++i) {
+        results.push_back(pool.submit([](int x) { return x * x; }, i));
+    }
+    for (int i = 0; i < 100; ++i) {
+        EXPECT_EQ(results[i].get(), i * i);
+    }
+
+    auto failed = pool.submit([]() -> int { throw std::runtime_error("boom"); });
+    EXPECT_THROW(failed.get(), std::runtime_error);
+}